@@ -114,21 +114,21 @@ Flow::Flow(u_char *packet, int totallength) {
         int src_addr, des_addr;
         src_addr = ntohl(*((int *)(ip_header + 12)));
         des_addr = ntohl(*((int *)(ip_header + 16)));
-        this->field_value["sip"] = new IP(src_addr, 32);
-        this->field_value["dip"] = new IP(des_addr, 32);
-        this->field_value["tag"] = new int(0);
-        this->field_value["iplen"] = new int(totallength);
+        this->field_value["sip"] = arena_new<IP>(src_addr, 32);
+        this->field_value["dip"] = arena_new<IP>(des_addr, 32);
+        this->field_value["tag"] = arena_new<int>(0);
+        this->field_value["iplen"] = arena_new<int>(totallength);
         uint8_t protocol = (*(uint8_t *)(ip_header + 9));
-        this->field_value["UDP"] = new int((protocol == IPPROTO_UDP) ? 1 : 0);
+        this->field_value["UDP"] = arena_new<int>((protocol == IPPROTO_UDP) ? 1 : 0);
 
         /*TCP layer*/
         TCPHdr *tcph = (TCPHdr *)(ip_header + ip_header_length);
-        this->field_value["sport"] = new int(ntohs(tcph->th_sport));
-        this->field_value["dport"] = new int(ntohs(tcph->th_dport));
+        this->field_value["sport"] = arena_new<int>(ntohs(tcph->th_sport));
+        this->field_value["dport"] = arena_new<int>(ntohs(tcph->th_dport));
         /*URG ACK PSH RST SYN FIN*/
-        this->field_value["flag_fin"] = new int(tcph->th_flags        & 0x1);
-        this->field_value["flag_syn"] = new int((tcph->th_flags >> 1) & 0x1);
-        this->field_value["flag_ack"] = new int((tcph->th_flags >> 4) & 0x1);
+        this->field_value["flag_fin"] = arena_new<int>(tcph->th_flags        & 0x1);
+        this->field_value["flag_syn"] = arena_new<int>((tcph->th_flags >> 1) & 0x1);
+        this->field_value["flag_ack"] = arena_new<int>((tcph->th_flags >> 4) & 0x1);
 }
 void
 Flow::clean() {
@@ -154,19 +154,19 @@ State<unordered_map<IP, unordered_map<IP, int>>> bq(*(new unordered_map<IP, unor
 
 int
 process(Flow &f) {
-        if ((*(int *)f["dport"]) == *(new int(53))) {
-                bq[f][(*(IP *)f["sip"])][(*(IP *)f["dip"])] = *(new int(1));
+        if ((*(int *)f["dport"]) == *arena_new<int>(53)) {
+                bq[f][(*(IP *)f["sip"])][(*(IP *)f["dip"])] = *arena_new<int>(1);
         }
-        if (((*(int *)f["dport"]) != *(new int(53)) && (*(int *)f["sport"]) == *(new int(53))) &&
-            (bq[f][(*(IP *)f["dip"])][(*(IP *)f["sip"])] != *(new int(1)))) {
-                (*(IP *)f["dip"]) = *(new IP("0.0.0.0/0"));
+        if (((*(int *)f["dport"]) != *arena_new<int>(53) && (*(int *)f["sport"]) == *arena_new<int>(53)) &&
+            (bq[f][(*(IP *)f["dip"])][(*(IP *)f["sip"])] != *arena_new<int>(1))) {
+                (*(IP *)f["dip"]) = *arena_new<IP>("0.0.0.0/0");
         }
-        if ((*(int *)f["dport"]) != *(new int(53)) && (*(int *)f["sport"]) != *(new int(53))) {
+        if ((*(int *)f["dport"]) != *arena_new<int>(53) && (*(int *)f["sport"]) != *arena_new<int>(53)) {
         }
-        if (((*(int *)f["dport"]) != *(new int(53))) &&
-            (bq[f][(*(IP *)f["dip"])][(*(IP *)f["sip"])] == *(new int(1)))) {
+        if (((*(int *)f["dport"]) != *arena_new<int>(53)) &&
+            (bq[f][(*(IP *)f["dip"])][(*(IP *)f["sip"])] == *arena_new<int>(1))) {
         }
-        if (*(IP *)f["dip"] == *(new IP("0.0.0.0/0"))) {
+        if (*(IP *)f["dip"] == *arena_new<IP>("0.0.0.0/0")) {
                 return -1;
         }
         f.clean();
@@ -302,6 +302,15 @@ packet_handler(struct rte_mbuf *buf, struct onvm_pkt_meta *meta,
         return 0;
 }
 
+/*
+ * Flow headers live in flow_arena, release the ones of the last burst.
+ */
+static int
+callback_handler(__attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx) {
+        arena_reset();
+        return 0;
+}
+
 int
 main(int argc, char *argv[]) {
         struct onvm_nf_local_ctx *nf_local_ctx;
@@ -315,6 +324,7 @@ main(int argc, char *argv[]) {
 
         nf_function_table = onvm_nflib_init_nf_function_table();
         nf_function_table->pkt_handler = &packet_handler;
+        nf_function_table->user_actions = &callback_handler;
 
         if ((arg_offset = onvm_nflib_init(argc, argv, NF_TAG, nf_local_ctx, nf_function_table)) < 0) {
                 onvm_nflib_stop(nf_local_ctx);
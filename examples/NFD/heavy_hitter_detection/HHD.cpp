@@ -62,11 +62,14 @@ extern "C" {
 #endif
 
 #include <rte_common.h>
+#include <rte_cycles.h>
 #include <rte_ip.h>
 #include <rte_mbuf.h>
+#include <rte_random.h>
 
 #include "onvm_nflib.h"
 #include "onvm_pkt_helper.h"
+#include "onvm_sketch.h"
 
 #ifdef __cplusplus
 }
@@ -81,11 +84,8 @@ extern "C" {
 #include <cstring>
 #include <iomanip>
 #include <iostream>
-#include <unordered_map>
-#include <unordered_set>
 #include <vector>
-#include "basic_classes.h"
-#include "decode.h"
+#include "nfd_fast.h"
 
 using namespace std;
 
@@ -97,93 +97,77 @@ static uint32_t print_delay = 1000000;
 static uint32_t destination;
 
 /*******************************NFD features********************************/
-Flow::Flow(u_char *packet, int totallength) {
-        /*Decoding*/
-        this->pkt = packet;
-        struct ether_header *eth_header;
-        eth_header = (struct ether_header *)packet;
-
-        /* Pointers to start point of various headers */
-        u_char *ip_header;
-        /* Header lengths in bytes */
-        int ethernet_header_length = 14; /* Doesn't change */
-        int ip_header_length;
-        ip_header = packet + ethernet_header_length;
-        ip_header_length = ((*ip_header) & 0x0F);
-        ip_header_length = ip_header_length * 4;
-        int src_addr, des_addr;
-        src_addr = ntohl(*((int *)(ip_header + 12)));
-        des_addr = ntohl(*((int *)(ip_header + 16)));
-        this->field_value["sip"] = new IP(src_addr, 32);
-        this->field_value["dip"] = new IP(des_addr, 32);
-        this->field_value["tag"] = new int(0);
-        this->field_value["iplen"] = new int(totallength);
-        uint8_t protocol = (*(uint8_t *)(ip_header + 9));
-        this->field_value["UDP"] = new int((protocol == IPPROTO_UDP) ? 1 : 0);
-
-        /*TCP layer*/
-        TCPHdr *tcph = (TCPHdr *)(ip_header + ip_header_length);
-        this->field_value["sport"] = new int(ntohs(tcph->th_sport));
-        this->field_value["dport"] = new int(ntohs(tcph->th_dport));
-        /*URG ACK PSH RST SYN FIN*/
-        this->field_value["flag_fin"] = new int(tcph->th_flags        & 0x1);
-        this->field_value["flag_syn"] = new int((tcph->th_flags >> 1) & 0x1);
-        this->field_value["flag_ack"] = new int((tcph->th_flags >> 4) & 0x1);
-}
-void
-Flow::clean() {
-}
+/*
+ * HHDmodel.txt compiled against nfd_fast.h. hh_counter is a Count-Min sketch
+ * keyed by f[sip] instead of an exact map, so memory stays bounded when the
+ * sources are spoofed. A source is a heavy hitter (hh[f[sip]]==1) once its
+ * estimate went past the threshold.
+ */
+#define HHD_SKETCH_ROWS 4
+#define HHD_SKETCH_WIDTH 16384
+#define HHD_TOP_SOURCES 32
+#define HHD_TOP_PRINT 10
 
-int
-process(Flow &f);
-Flow f_glb;
 long int _counter = 0;
-unordered_map<string, int> F_Type::MAP = unordered_map<string, int>();
-unordered_map<string, int> F_Type::MAP2 = unordered_map<string, int>();
-
-int _t1 = 100;
-int _t2 = 1;
-int _t3 = 1;
-int _t4 = 1;
-int _t5 = 1;
-int _t6 = 1;
-int _t7 = 1;
-int _t8 = 1;
-int _t9 = 1;
-int _t10 = 1;
+static const int threshold = 100;
+static struct onvm_sketch *hh_counter;
+static struct onvm_topk *top_sources;
+
+/* Sketch epoch length in seconds, 0 counts forever like the exact map did */
+static uint32_t epoch_seconds = 0;
+static uint64_t last_rotation;
 
 struct timeval begin_time;
 struct timeval end_time;
 
-State<unordered_map<IP, int>> hh(*(new unordered_map<IP, int>()));
-State<unordered_map<IP, int>> hh_counter(*(new unordered_map<IP, int>()));
-State<int> threshold(_t1);
-
-void
+int
 _init_() {
-        (new F_Type())->init();
+        hh_counter = onvm_sketch_create(NULL, ONVM_SKETCH_CM, HHD_SKETCH_ROWS, HHD_SKETCH_WIDTH, 0, rte_rand());
+        top_sources = onvm_topk_create(HHD_TOP_SOURCES);
+        last_rotation = rte_get_tsc_cycles();
+        return (hh_counter == NULL || top_sources == NULL) ? -1 : 0;
 }
 
 int
-process(Flow &f) {
-        if (((*(int *)f["flag_syn"]) == _t2) &&
-            (hh[f][(*(IP *)f["sip"])] != _t3 && hh_counter[f][(*(IP *)f["sip"])] != threshold[f])) {
-                hh_counter[f][(*(IP *)f["sip"])] = hh_counter[f][(*(IP *)f["sip"])] + _t4;
-        } else if (((*(int *)f["flag_syn"]) == _t5) &&
-                   (hh[f][(*(IP *)f["sip"])] != _t6 && hh_counter[f][(*(IP *)f["sip"])] == threshold[f])) {
-                hh[f][(*(IP *)f["sip"])] = _t7;
-        } else if (((*(int *)f["flag_syn"]) == _t8) && (hh[f][(*(IP *)f["sip"])] == _t9)) {
+process(struct nfd_flow &f) {
+        uint32_t sip;
+        int64_t count;
+
+        if (f.f[NFD_F_FLAG_SYN] != 1)
+                return 0;
+
+        sip = f.f[NFD_F_SIP];
+        count = onvm_sketch_update(hh_counter, &sip, sizeof(sip), 1);
+        onvm_topk_update(top_sources, sip, 1);
+        /* The first threshold + 1 SYNs pass, the last one marks the source */
+        if (count > threshold + 1)
                 return -1;
-        } else if ((*(int *)f["flag_syn"]) != _t10) {
-        }
-        f.clean();
         return 0;
 }
 
+static void
+print_top_sources() {
+        struct onvm_topk_entry top[HHD_TOP_PRINT];
+        struct in_addr addr;
+        uint32_t i, n;
+
+        n = onvm_topk_list(top_sources, top, HHD_TOP_PRINT);
+        printf("Top SYN sources (epoch %" PRIu64 ")\n", hh_counter->epoch);
+        printf("-----\n");
+        for (i = 0; i < n; i++) {
+                addr.s_addr = htonl((uint32_t)top[i].key);
+                printf("%-16s %" PRIu64 " (+/- %" PRIu64 ")\n", inet_ntoa(addr), top[i].count, top[i].error);
+        }
+        printf("\n");
+}
+
 int
 HHD(u_char *pkt, int totallength) {
-        f_glb = Flow(pkt, totallength);
-        return process(f_glb);
+        struct nfd_flow f;
+
+        if (nfd_flow_decode(&f, pkt, totallength) < 0)
+                return 0;
+        return process(f);
 }
 
 void
@@ -196,6 +180,7 @@ stop() {
         printf("%ld packets are processed\n", _counter);
         printf("NF runs for %f seconds\n", total);
         printf("**************************************************\n\n");
+        print_top_sources();
 }
 
 /**********************************************************************/
@@ -205,7 +190,8 @@ stop() {
  */
 static void
 usage(const char *progname) {
-        printf("Usage: %s [EAL args] -- [NF_LIB args] -- -d <destination> -p <print_delay>\n\n", progname);
+        printf("Usage: %s [EAL args] -- [NF_LIB args] -- -d <destination> -p <print_delay> [-e <epoch_seconds>]\n\n",
+               progname);
 }
 
 /*
@@ -215,7 +201,7 @@ static int
 parse_app_args(int argc, char *argv[], const char *progname) {
         int c, dst_flag = 0;
 
-        while ((c = getopt(argc, argv, "d:p:")) != -1) {
+        while ((c = getopt(argc, argv, "d:p:e:")) != -1) {
                 switch (c) {
                         case 'd':
                                 destination = strtoul(optarg, NULL, 10);
@@ -224,11 +210,14 @@ parse_app_args(int argc, char *argv[], const char *progname) {
                         case 'p':
                                 print_delay = strtoul(optarg, NULL, 10);
                                 break;
+                        case 'e':
+                                epoch_seconds = strtoul(optarg, NULL, 10);
+                                break;
                         case '?':
                                 usage(progname);
                                 if (optopt == 'd')
                                         RTE_LOG(INFO, APP, "Option -%c requires an argument.\n", optopt);
-                                else if (optopt == 'p')
+                                else if (optopt == 'p' || optopt == 'e')
                                         RTE_LOG(INFO, APP, "Option -%c requires an argument.\n", optopt);
                                 else if (isprint(optopt))
                                         RTE_LOG(INFO, APP, "Unknown option `-%c'.\n", optopt);
@@ -280,6 +269,26 @@ do_stats_display(struct rte_mbuf *pkt) {
         } else {
                 printf("No IP4 header found\n");
         }
+        printf("\n");
+        print_top_sources();
+}
+
+/*
+ * Start a new sketch epoch every epoch_seconds.
+ */
+static int
+callback_handler(__attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx) {
+        uint64_t now;
+
+        if (epoch_seconds == 0)
+                return 0;
+        now = rte_get_tsc_cycles();
+        if (now - last_rotation >= epoch_seconds * rte_get_timer_hz()) {
+                onvm_sketch_rotate(hh_counter);
+                onvm_topk_reset(top_sources);
+                last_rotation = now;
+        }
+        return 0;
 }
 
 static int
@@ -322,6 +331,7 @@ main(int argc, char *argv[]) {
 
         nf_function_table = onvm_nflib_init_nf_function_table();
         nf_function_table->pkt_handler = &packet_handler;
+        nf_function_table->user_actions = &callback_handler;
 
         if ((arg_offset = onvm_nflib_init(argc, argv, NF_TAG, nf_local_ctx, nf_function_table)) < 0) {
                 onvm_nflib_stop(nf_local_ctx);
@@ -337,7 +347,10 @@ main(int argc, char *argv[]) {
         argv += arg_offset;
 
         // NFD begin
-        _init_();
+        if (_init_() < 0) {
+                onvm_nflib_stop(nf_local_ctx);
+                rte_exit(EXIT_FAILURE, "Failed to allocate NFD state table\n");
+        }
         // NFD end
 
         if (parse_app_args(argc, argv, progname) < 0) {
@@ -17,10 +17,12 @@
 #include <stdint.h>
 #include <iostream>
 #include <map>
+#include <new>
 #include <set>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include <pcap.h>
@@ -31,6 +33,7 @@ typedef unordered_set<IP> ipset;
 enum header { Iplen = 0, Sport = 1, Dport = 2, Tcp = 3, Udp = 4, Sip = 10, Dip = 11, Tag = 20 };
 
 #define ERROR_HANDLE(x) std::cout << "Error Information: " << x << endl;
+#define ARENA_BLOCK_SIZE (64 * 1024)
 std::vector<std::string>
 split(const std::string& text, char sep);
 
@@ -67,6 +70,53 @@ create_map(unordered_map<A, B>& ns, int count, ...) {
         return ns;
 }
 
+/*
+ * Bump allocator for per-packet Flow headers and temporaries.
+ * Objects are never freed one by one, reset() rewinds every block at once
+ * and keeps them for reuse, so only trivially destructible types such as
+ * IP and int should be placed here.
+ */
+class Arena {
+       public:
+        explicit Arena(size_t size = ARENA_BLOCK_SIZE);
+        ~Arena();
+        void*
+        alloc(size_t size, size_t align);
+        void
+        reset() {
+                this->cur = 0;
+                this->used = 0;
+        }
+        template <typename T, typename... Args>
+        T*
+        make(Args&&... args) {
+                return new (alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+       private:
+        vector<char*> blocks;
+        size_t block_size;
+        size_t cur;
+        size_t used;
+        Arena(const Arena&);
+        Arena&
+        operator=(const Arena&);
+};
+
+/* Arena shared by all Flow objects, NFs reset it after every packet burst */
+extern Arena flow_arena;
+
+template <typename T, typename... Args>
+T*
+arena_new(Args&&... args) {
+        return flow_arena.make<T>(std::forward<Args>(args)...);
+}
+
+static inline void
+arena_reset() {
+        flow_arena.reset();
+}
+
 class F_Type {
        public:
         static unordered_map<string, int> MAP;
@@ -112,7 +162,8 @@ class F_Type {
 
 class Flow {
         u_char* pkt;
-        void* q = new string("error");
+        static string error_value;
+        void* q = &error_value;
         unordered_map<string, void*> field_value;
         friend struct FlowCmp;
 
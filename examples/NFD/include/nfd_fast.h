@@ -0,0 +1,246 @@
+/**********************************************************************************
+                               NFD project
+   A C++ based NF developing framework designed by Wenfei's group
+   from IIIS, Tsinghua University, China.
+******************************************************************************/
+
+/************************************************************************************
+* Filename:   nfd_fast.h
+* Copyright:
+* Disclaimer: This code is presented "as is" without any guarantees.
+* Details:    Compiled fast path for NFD NFs. A model is lowered into a fixed-layout
+              nfd_flow (header fields indexed by enum nfd_field) and one flat
+              open-addressing nfd_table per state key, so processing a packet does
+              no heap allocation and no string lookups.
+*************************************************************************************/
+
+#ifndef _NFD_FAST_H_
+#define _NFD_FAST_H_
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "decode.h"
+
+#define NFD_ETHER_TYPE_IPV4 0x0800
+#define NFD_TABLE_MIN_SIZE 1024
+
+/* Header fields a model may refer to as f[...], see Flow::Flow for the old names */
+enum nfd_field {
+        NFD_F_SIP = 0,
+        NFD_F_DIP,
+        NFD_F_SPORT,
+        NFD_F_DPORT,
+        NFD_F_PROTO,
+        NFD_F_UDP,
+        NFD_F_FLAG_FIN,
+        NFD_F_FLAG_SYN,
+        NFD_F_FLAG_ACK,
+        NFD_F_IPLEN,
+        NFD_F_TAG,
+        NFD_F_MAX
+};
+
+struct nfd_flow {
+        uint32_t f[NFD_F_MAX];
+};
+
+/*
+ * Decode the fields of an ethernet frame into flow. Addresses and ports are
+ * kept in host order like the IP and int objects of the string keyed Flow.
+ * Returns -1 if the frame is not IPv4, in which case only iplen is set.
+ */
+static inline int
+nfd_flow_decode(struct nfd_flow *flow, const u_char *pkt, uint32_t totallength) {
+        const EtherHdr *eth_hdr = (const EtherHdr *)pkt;
+        const IPHdr *ip_hdr;
+        const TCPHdr *tcp_hdr;
+        uint32_t ip_hdr_len;
+
+        memset(flow, 0, sizeof(*flow));
+        flow->f[NFD_F_IPLEN] = totallength;
+
+        if (totallength < sizeof(EtherHdr) + sizeof(IPHdr) || eth_hdr->ether_type != htons(NFD_ETHER_TYPE_IPV4))
+                return -1;
+
+        ip_hdr = (const IPHdr *)(pkt + sizeof(EtherHdr));
+        ip_hdr_len = ip_hdr->ip_hlen * 4;
+        flow->f[NFD_F_SIP] = ntohl(ip_hdr->ip_src.s_addr);
+        flow->f[NFD_F_DIP] = ntohl(ip_hdr->ip_dst.s_addr);
+        flow->f[NFD_F_PROTO] = ip_hdr->ip_proto;
+        flow->f[NFD_F_UDP] = (ip_hdr->ip_proto == IPPROTO_UDP);
+
+        if (ip_hdr->ip_proto != IPPROTO_TCP && ip_hdr->ip_proto != IPPROTO_UDP)
+                return 0;
+        if (totallength < sizeof(EtherHdr) + ip_hdr_len + 2 * sizeof(u_short))
+                return 0;
+
+        /* Ports sit at the same offset for TCP and UDP */
+        tcp_hdr = (const TCPHdr *)((const u_char *)ip_hdr + ip_hdr_len);
+        flow->f[NFD_F_SPORT] = ntohs(tcp_hdr->th_sport);
+        flow->f[NFD_F_DPORT] = ntohs(tcp_hdr->th_dport);
+
+        if (ip_hdr->ip_proto != IPPROTO_TCP || totallength < sizeof(EtherHdr) + ip_hdr_len + sizeof(TCPHdr))
+                return 0;
+
+        flow->f[NFD_F_FLAG_FIN] = !!(tcp_hdr->th_flags & TH_FIN);
+        flow->f[NFD_F_FLAG_SYN] = !!(tcp_hdr->th_flags & TH_SYN);
+        flow->f[NFD_F_FLAG_ACK] = !!(tcp_hdr->th_flags & TH_ACK);
+
+        return 0;
+}
+
+/*
+ * Flat open-addressing hash table used for compiled model state.
+ * Keys are KW 32 bit words, values are copied by assignment so V should be
+ * a plain struct. Slots carry a non zero signature so empty slots are found
+ * without comparing keys, and probing is linear. The table doubles when it
+ * is 3/4 full, which is the only time it allocates after construction.
+ */
+template <typename V, unsigned KW>
+class nfd_table {
+       public:
+        struct key {
+                uint32_t w[KW];
+        };
+
+        nfd_table(uint32_t size, const V &init) : init_value(init), overflow(init), count(0) {
+                capacity = NFD_TABLE_MIN_SIZE;
+                while (capacity < size)
+                        capacity <<= 1;
+                slots = (struct slot *)calloc(capacity, sizeof(struct slot));
+        }
+
+        ~nfd_table() {
+                free(slots);
+        }
+
+        /* False if the initial allocation failed */
+        bool
+        ok() const {
+                return slots != NULL;
+        }
+
+        uint32_t
+        size() const {
+                return count;
+        }
+
+        /* Returns the value for k or NULL, never inserts */
+        V *
+        find(const struct key &k) {
+                uint64_t h = hash(k);
+                uint32_t sig = signature(h);
+                uint32_t mask = capacity - 1;
+                uint32_t i;
+
+                for (i = h & mask; slots[i].sig != 0; i = (i + 1) & mask) {
+                        if (slots[i].sig == sig && memcmp(&slots[i].k, &k, sizeof(k)) == 0)
+                                return &slots[i].v;
+                }
+                return NULL;
+        }
+
+        /* Returns the value for k, inserting the initial value if k is new */
+        V &operator[](const struct key &k) {
+                uint64_t h = hash(k);
+                uint32_t sig = signature(h);
+                uint32_t mask = capacity - 1;
+                uint32_t i;
+
+                for (i = h & mask; slots[i].sig != 0; i = (i + 1) & mask) {
+                        if (slots[i].sig == sig && memcmp(&slots[i].k, &k, sizeof(k)) == 0)
+                                return slots[i].v;
+                }
+
+                if ((count + 1) * 4 > capacity * 3 && grow())
+                        return (*this)[k];
+                /* Could not grow, keep the last slot free so probing terminates */
+                if (count + 1 >= capacity) {
+                        overflow = init_value;
+                        return overflow;
+                }
+
+                slots[i].sig = sig;
+                slots[i].k = k;
+                slots[i].v = init_value;
+                count++;
+                return slots[i].v;
+        }
+
+        /* Calls fn(key, value) for every entry */
+        template <typename F>
+        void
+        iterate(F fn) {
+                uint32_t i;
+
+                for (i = 0; i < capacity; i++) {
+                        if (slots[i].sig != 0)
+                                fn(slots[i].k, slots[i].v);
+                }
+        }
+
+       private:
+        struct slot {
+                uint32_t sig;
+                struct key k;
+                V v;
+        };
+
+        struct slot *slots;
+        V init_value;
+        V overflow;
+        uint32_t capacity;
+        uint32_t count;
+
+        nfd_table(const nfd_table &);
+        nfd_table &operator=(const nfd_table &);
+
+        static inline uint64_t
+        hash(const struct key &k) {
+                uint64_t h = 0x9e3779b97f4a7c15ULL;
+                unsigned i;
+
+                for (i = 0; i < KW; i++) {
+                        h ^= k.w[i];
+                        h *= 0xff51afd7ed558ccdULL;
+                        h ^= h >> 32;
+                }
+                return h;
+        }
+
+        static inline uint32_t
+        signature(uint64_t h) {
+                return (uint32_t)(h >> 32) | 1;
+        }
+
+        bool
+        grow() {
+                struct slot *old = slots;
+                uint32_t old_capacity = capacity;
+                uint32_t mask, i, j;
+
+                slots = (struct slot *)calloc((size_t)capacity << 1, sizeof(struct slot));
+                if (slots == NULL) {
+                        slots = old;
+                        return false;
+                }
+                capacity <<= 1;
+                mask = capacity - 1;
+                for (i = 0; i < old_capacity; i++) {
+                        if (old[i].sig == 0)
+                                continue;
+                        for (j = hash(old[i].k) & mask; slots[j].sig != 0; j = (j + 1) & mask)
+                                ;
+                        slots[j] = old[i];
+                }
+                free(old);
+                return true;
+        }
+};
+
+#endif  // _NFD_FAST_H_
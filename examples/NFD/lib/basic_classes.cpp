@@ -24,6 +24,39 @@
 
 using namespace std;
 
+Arena flow_arena;
+string Flow::error_value("error");
+
+Arena::Arena(size_t size) : block_size(size), cur(0), used(0) {
+}
+
+Arena::~Arena() {
+        for (auto it = this->blocks.begin(); it != this->blocks.end(); it++)
+                free(*it);
+}
+
+void*
+Arena::alloc(size_t size, size_t align) {
+        while (true) {
+                if (this->cur < this->blocks.size()) {
+                        size_t off = (this->used + align - 1) & ~(align - 1);
+                        if (off + size <= this->block_size) {
+                                this->used = off + size;
+                                return this->blocks[this->cur] + off;
+                        }
+                        this->cur++;
+                        this->used = 0;
+                        continue;
+                }
+                if (size > this->block_size)
+                        throw std::bad_alloc();
+                char* block = (char*)malloc(this->block_size);
+                if (block == NULL)
+                        throw std::bad_alloc();
+                this->blocks.push_back(block);
+        }
+}
+
 // constructor 1
 IP::IP(const string& raw_ip) {
         std::vector<string> vec = split(raw_ip, '/');
@@ -97,9 +130,9 @@ IP::operator!=(const IP& other) {
 
 Flow::Flow(int* tag) {
         this->headers[Tag] = tag;
-        this->headers[Sip] = new IP(0, 0);
-        this->headers[Dip] = new IP(0, 0);
-        this->headers[Iplen] = new int(0);
+        this->headers[Sip] = arena_new<IP>(0, 0);
+        this->headers[Dip] = arena_new<IP>(0, 0);
+        this->headers[Iplen] = arena_new<int>(0);
 }
 
 void*& Flow::operator[](const string& field) {
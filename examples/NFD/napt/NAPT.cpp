@@ -108,15 +108,15 @@ Flow::Flow(u_char *packet, int totallength) {
                 ethernet_header_length = 14;
         IPHdr *ip_hdr = (IPHdr *)(packet + ethernet_header_length);
         int src_addr = ntohl(ip_hdr->ip_src.s_addr);
-        this->headers[Sip] = new IP(src_addr, 32);
+        this->headers[Sip] = arena_new<IP>(src_addr, 32);
         int des_addr = ntohl(ip_hdr->ip_dst.s_addr);
-        this->headers[Dip] = new IP(des_addr, 32);
+        this->headers[Dip] = arena_new<IP>(des_addr, 32);
 
         int ip_header_length = ((*(packet + ethernet_header_length)) & 0x0F);
         ip_header_length = ip_header_length * 4;
         TCPHdr *tcph = (TCPHdr *)(packet + ethernet_header_length + ip_header_length);
-        this->headers[Sport] = new int(ntohs(tcph->th_sport));
-        this->headers[Dport] = new int(ntohs(tcph->th_dport));
+        this->headers[Sport] = arena_new<int>(ntohs(tcph->th_sport));
+        this->headers[Dport] = arena_new<int>(ntohs(tcph->th_dport));
 }
 void
 Flow::clean() {
@@ -315,6 +315,15 @@ packet_handler(struct rte_mbuf *buf, struct onvm_pkt_meta *meta,
         return 0;
 }
 
+/*
+ * Flow headers live in flow_arena, release the ones of the last burst.
+ */
+static int
+callback_handler(__attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx) {
+        arena_reset();
+        return 0;
+}
+
 int
 main(int argc, char *argv[]) {
         struct onvm_nf_local_ctx *nf_local_ctx;
@@ -328,6 +337,7 @@ main(int argc, char *argv[]) {
 
         nf_function_table = onvm_nflib_init_nf_function_table();
         nf_function_table->pkt_handler = &packet_handler;
+        nf_function_table->user_actions = &callback_handler;
 
         if ((arg_offset = onvm_nflib_init(argc, argv, NF_TAG, nf_local_ctx, nf_function_table)) < 0) {
                 onvm_nflib_stop(nf_local_ctx);
@@ -110,9 +110,9 @@ Flow::Flow(u_char *packet, int totallength) {
 
         IPHdr *ip_hdr = (IPHdr *)(packet + ethernet_header_length);
         int src_addr = ntohl(ip_hdr->ip_src.s_addr);
-        this->headers[Sip] = new IP(src_addr, 32);
+        this->headers[Sip] = arena_new<IP>(src_addr, 32);
         short protocol = (short)(ip_hdr->ip_proto);
-        this->headers[Tcp] = new int((protocol == IPPROTO_TCP) ? 1 : 0);
+        this->headers[Tcp] = arena_new<int>((protocol == IPPROTO_TCP) ? 1 : 0);
 }
 void
 Flow::clean() {
@@ -275,6 +275,15 @@ packet_handler(struct rte_mbuf *buf, struct onvm_pkt_meta *meta,
         return 0;
 }
 
+/*
+ * Flow headers live in flow_arena, release the ones of the last burst.
+ */
+static int
+callback_handler(__attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx) {
+        arena_reset();
+        return 0;
+}
+
 int
 main(int argc, char *argv[]) {
         struct onvm_nf_local_ctx *nf_local_ctx;
@@ -288,6 +297,7 @@ main(int argc, char *argv[]) {
 
         nf_function_table = onvm_nflib_init_nf_function_table();
         nf_function_table->pkt_handler = &packet_handler;
+        nf_function_table->user_actions = &callback_handler;
 
         if ((arg_offset = onvm_nflib_init(argc, argv, NF_TAG, nf_local_ctx, nf_function_table)) < 0) {
                 onvm_nflib_stop(nf_local_ctx);
@@ -62,11 +62,14 @@ extern "C" {
 #endif
 
 #include <rte_common.h>
+#include <rte_cycles.h>
 #include <rte_ip.h>
 #include <rte_mbuf.h>
+#include <rte_random.h>
 
 #include "onvm_nflib.h"
 #include "onvm_pkt_helper.h"
+#include "onvm_sketch.h"
 
 #ifdef __cplusplus
 }
@@ -81,11 +84,8 @@ extern "C" {
 #include <cstring>
 #include <iomanip>
 #include <iostream>
-#include <unordered_map>
-#include <unordered_set>
 #include <vector>
-#include "basic_classes.h"
-#include "decode.h"
+#include "nfd_fast.h"
 
 using namespace std;
 
@@ -97,99 +97,56 @@ static uint32_t print_delay = 1000000;
 static uint32_t destination;
 
 /*******************************NFD features********************************/
-Flow::Flow(u_char *packet, int totallength) {
-        /*Decoding*/
-        this->pkt = packet;
-        struct ether_header *eth_header;
-        eth_header = (struct ether_header *)packet;
-
-        /* Pointers to start point of various headers */
-        u_char *ip_header;
-        /* Header lengths in bytes */
-        int ethernet_header_length = 14; /* Doesn't change */
-        int ip_header_length;
-        ip_header = packet + ethernet_header_length;
-        ip_header_length = ((*ip_header) & 0x0F);
-        ip_header_length = ip_header_length * 4;
-        int src_addr, des_addr;
-        src_addr = ntohl(*((int *)(ip_header + 12)));
-        des_addr = ntohl(*((int *)(ip_header + 16)));
-        this->field_value["sip"] = new IP(src_addr, 32);
-        this->field_value["dip"] = new IP(des_addr, 32);
-        this->field_value["tag"] = new int(0);
-        this->field_value["iplen"] = new int(totallength);
-        uint8_t protocol = (*(uint8_t *)(ip_header + 9));
-        this->field_value["UDP"] = new int((protocol == IPPROTO_UDP) ? 1 : 0);
-
-        /*TCP layer*/
-        TCPHdr *tcph = (TCPHdr *)(ip_header + ip_header_length);
-        this->field_value["sport"] = new int(ntohs(tcph->th_sport));
-        this->field_value["dport"] = new int(ntohs(tcph->th_dport));
-        /*URG ACK PSH RST SYN FIN*/
-        this->field_value["flag_fin"] = new int(tcph->th_flags        & 0x1);
-        this->field_value["flag_syn"] = new int((tcph->th_flags >> 1) & 0x1);
-        this->field_value["flag_ack"] = new int((tcph->th_flags >> 4) & 0x1);
-}
-void
-Flow::clean() {
-}
+/*
+ * SSDmodel.txt compiled against nfd_fast.h. Instead of an exact per source
+ * map, the destinations a source opens connections to are counted by a
+ * HyperLogLog sketch keyed by f[sip], so memory stays bounded when the
+ * sources are spoofed. A source is a super spreader (tlist[f[sip]]==1) once
+ * it has reached more than threshold distinct destinations.
+ */
+#define SSD_SKETCH_ROWS 2
+#define SSD_SKETCH_WIDTH 2048
+#define SSD_HLL_BITS 8
 
-int
-process(Flow &f);
-Flow f_glb;
 long int _counter = 0;
-unordered_map<string, int> F_Type::MAP = unordered_map<string, int>();
-unordered_map<string, int> F_Type::MAP2 = unordered_map<string, int>();
+static const int threshold = 100;
+static struct onvm_sketch *list_sketch;
+
+/* Sketch epoch length in seconds, 0 counts forever */
+static uint32_t epoch_seconds = 0;
+static uint64_t last_rotation;
 
 struct timeval begin_time;
 struct timeval end_time;
 
-void
+int
 _init_() {
-        (new F_Type())->init();
+        list_sketch = onvm_sketch_create(NULL, ONVM_SKETCH_HLL, SSD_SKETCH_ROWS, SSD_SKETCH_WIDTH, SSD_HLL_BITS, rte_rand());
+        last_rotation = rte_get_tsc_cycles();
+        return list_sketch == NULL ? -1 : 0;
 }
-int _t1 = 100;
-int _t2 = 1;
-int _t3 = 1;
-int _t4 = 1;
-int _t5 = 1;
-int _t6 = 1;
-int _t7 = 1;
-int _t8 = 1;
-int _t9 = 1;
-int _t10 = 1;
-int _t11 = 1;
-State<unordered_map<IP, int>> list(*(new unordered_map<IP, int>()));
-State<unordered_map<IP, int>> tlist(*(new unordered_map<IP, int>()));
-State<int> threshold(_t1);
 
 int
-process(Flow &f) {
-        if (((*(int *)f["flag_syn"]) == 1) && 
-             tlist[f][(*(IP *)f["sip"])] == 1){
+process(struct nfd_flow &f) {
+        uint32_t sip, dip;
+
+        if (f.f[NFD_F_FLAG_SYN] != 1)
+                return 0;
+
+        sip = f.f[NFD_F_SIP];
+        dip = f.f[NFD_F_DIP];
+        if (onvm_sketch_hll_add(list_sketch, &sip, sizeof(sip), &dip, sizeof(dip)) > threshold)
                 return -1;
-        } else if (((*(int *)f["flag_syn"]) == _t2) &&
-            (tlist[f][(*(IP *)f["sip"])] != _t3 && list[f][(*(IP *)f["sip"])] != threshold[f])) {
-                list[f][(*(IP *)f["sip"])] = list[f][(*(IP *)f["sip"])] + _t4;
-        } else if (((*(int *)f["flag_syn"]) == _t5) &&
-                   (tlist[f][(*(IP *)f["sip"])] != _t6 && list[f][(*(IP *)f["sip"])] == threshold[f])) {
-                tlist[f][(*(IP *)f["sip"])] = _t7;
-        } else if ((*(int *)f["flag_fin"]) == _t8 && 
-                  tlist[f][(*(IP *)f["sip"])] == 1){
-                list[f][(*(IP *)f["sip"])] = list[f][(*(IP *)f["sip"])] - 1;
-                tlist[f][(*(IP *)f["sip"])] = 0;
-        } else if ((*(int *)f["flag_fin"]) == _t8) {
-                list[f][(*(IP *)f["sip"])] = list[f][(*(IP *)f["sip"])] - _t9;
-        } else if ((*(int *)f["flag_syn"]) != _t10 && (*(int *)f["flag_fin"]) == _t11) {
-        }
-        f.clean();
         return 0;
 }
 
 int
 SSD(u_char *pkt, int totallength) {
-        f_glb = Flow(pkt, totallength);
-        return process(f_glb);
+        struct nfd_flow f;
+
+        if (nfd_flow_decode(&f, pkt, totallength) < 0)
+                return 0;
+        return process(f);
 }
 
 void
@@ -211,7 +168,8 @@ stop() {
  */
 static void
 usage(const char *progname) {
-        printf("Usage: %s [EAL args] -- [NF_LIB args] -- -d <destination> -p <print_delay>\n\n", progname);
+        printf("Usage: %s [EAL args] -- [NF_LIB args] -- -d <destination> -p <print_delay> [-e <epoch_seconds>]\n\n",
+               progname);
 }
 
 /*
@@ -221,7 +179,7 @@ static int
 parse_app_args(int argc, char *argv[], const char *progname) {
         int c, dst_flag = 0;
 
-        while ((c = getopt(argc, argv, "d:p:")) != -1) {
+        while ((c = getopt(argc, argv, "d:p:e:")) != -1) {
                 switch (c) {
                         case 'd':
                                 destination = strtoul(optarg, NULL, 10);
@@ -230,11 +188,14 @@ parse_app_args(int argc, char *argv[], const char *progname) {
                         case 'p':
                                 print_delay = strtoul(optarg, NULL, 10);
                                 break;
+                        case 'e':
+                                epoch_seconds = strtoul(optarg, NULL, 10);
+                                break;
                         case '?':
                                 usage(progname);
                                 if (optopt == 'd')
                                         RTE_LOG(INFO, APP, "Option -%c requires an argument.\n", optopt);
-                                else if (optopt == 'p')
+                                else if (optopt == 'p' || optopt == 'e')
                                         RTE_LOG(INFO, APP, "Option -%c requires an argument.\n", optopt);
                                 else if (isprint(optopt))
                                         RTE_LOG(INFO, APP, "Unknown option `-%c'.\n", optopt);
@@ -288,6 +249,23 @@ do_stats_display(struct rte_mbuf *pkt) {
         }
 }
 
+/*
+ * Start a new sketch epoch every epoch_seconds.
+ */
+static int
+callback_handler(__attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx) {
+        uint64_t now;
+
+        if (epoch_seconds == 0)
+                return 0;
+        now = rte_get_tsc_cycles();
+        if (now - last_rotation >= epoch_seconds * rte_get_timer_hz()) {
+                onvm_sketch_rotate(list_sketch);
+                last_rotation = now;
+        }
+        return 0;
+}
+
 static int
 packet_handler(struct rte_mbuf *buf, struct onvm_pkt_meta *meta,
                __attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx) {
@@ -330,6 +308,7 @@ main(int argc, char *argv[]) {
 
         nf_function_table = onvm_nflib_init_nf_function_table();
         nf_function_table->pkt_handler = &packet_handler;
+        nf_function_table->user_actions = &callback_handler;
 
         if ((arg_offset = onvm_nflib_init(argc, argv, NF_TAG, nf_local_ctx, nf_function_table)) < 0) {
                 onvm_nflib_stop(nf_local_ctx);
@@ -345,7 +324,10 @@ main(int argc, char *argv[]) {
         argv += arg_offset;
 
         // NFD begin
-        _init_();
+        if (_init_() < 0) {
+                onvm_nflib_stop(nf_local_ctx);
+                rte_exit(EXIT_FAILURE, "Failed to allocate NFD state table\n");
+        }
         // NFD end
 
         if (parse_app_args(argc, argv, progname) < 0) {
@@ -81,11 +81,8 @@ extern "C" {
 #include <cstring>
 #include <iomanip>
 #include <iostream>
-#include <unordered_map>
-#include <unordered_set>
 #include <vector>
-#include "basic_classes.h"
-#include "decode.h"
+#include "nfd_fast.h"
 
 using namespace std;
 
@@ -97,92 +94,61 @@ static uint32_t print_delay = 1000000;
 static uint32_t destination;
 
 /*******************************NFD features********************************/
-Flow::Flow(u_char *packet, int totallength) {
-        /*Decoding*/
-        this->pkt = packet;
-        struct ether_header *eth_header;
-        eth_header = (struct ether_header *)packet;
-
-        /* Pointers to start point of various headers */
-        u_char *ip_header;
-        /* Header lengths in bytes */
-        int ethernet_header_length = 14; /* Doesn't change */
-        int ip_header_length;
-        ip_header = packet + ethernet_header_length;
-        ip_header_length = ((*ip_header) & 0x0F);
-        ip_header_length = ip_header_length * 4;
-        int src_addr, des_addr;
-        src_addr = ntohl(*((int *)(ip_header + 12)));
-        des_addr = ntohl(*((int *)(ip_header + 16)));
-        this->field_value["sip"] = new IP(src_addr, 32);
-        this->field_value["dip"] = new IP(des_addr, 32);
-        this->field_value["tag"] = new int(0);
-        this->field_value["iplen"] = new int(totallength);
-        uint8_t protocol = (*(uint8_t *)(ip_header + 9));
-        this->field_value["UDP"] = new int((protocol == IPPROTO_UDP) ? 1 : 0);
-
-        /*TCP layer*/
-        TCPHdr *tcph = (TCPHdr *)(ip_header + ip_header_length);
-        this->field_value["sport"] = new int(ntohs(tcph->th_sport));
-        this->field_value["dport"] = new int(ntohs(tcph->th_dport));
-        /*URG ACK PSH RST SYN FIN*/
-        this->field_value["flag_fin"] = new int(tcph->th_flags        & 0x1);
-        this->field_value["flag_syn"] = new int((tcph->th_flags >> 1) & 0x1);
-        this->field_value["flag_ack"] = new int((tcph->th_flags >> 4) & 0x1);
-}
-void
-Flow::clean() {
-}
+/*
+ * UDPFloodMitagationModel.txt compiled against nfd_fast.h. udpcounter and
+ * udpflood are both keyed by f[sip], so they share a single table entry.
+ */
+struct udpfm_state {
+        int udpcounter;
+        int udpflood;
+};
+
+typedef nfd_table<struct udpfm_state, 1> udpfm_table;
 
-int
-process(Flow &f);
-Flow f_glb;
 long int _counter = 0;
 long int _drop = 0;
-unordered_map<string, int> F_Type::MAP = unordered_map<string, int>();
-unordered_map<string, int> F_Type::MAP2 = unordered_map<string, int>();
+static const int threshold = 100;
+static udpfm_table *state_table;
 
 struct timeval begin_time;
 struct timeval end_time;
 
-void
+int
 _init_() {
-        (new F_Type())->init();
+        struct udpfm_state init = {0, 0};
+
+        state_table = new udpfm_table(NFD_TABLE_MIN_SIZE, init);
+        return state_table->ok() ? 0 : -1;
 }
-int _t1 = 100;
-int _t2 = 1;
-int _t3 = 1;
-int _t4 = 1;
-int _t5 = 1;
-int _t6 = 1;
-int _t7 = 1;
-int _t8 = 1;
-State<unordered_map<IP, int>> udpcounter(*(new unordered_map<IP, int>()));
-State<unordered_map<IP, int>> udpflood(*(new unordered_map<IP, int>()));
-State<int> threshold(_t1);
 
 int
-process(Flow &f) {
-        if (((*(int *)f["UDP"]) == 1) &&
-            udpflood[f][(*(IP *)f["sip"])] == 1){
+process(struct nfd_flow &f) {
+        struct udpfm_state *st;
+        udpfm_table::key k;
+
+        if (f.f[NFD_F_UDP] != 1)
+                return 0;
+
+        k.w[0] = f.f[NFD_F_SIP];
+        st = &(*state_table)[k];
+        if (st->udpflood == 1) {
                 return -1;
-        } else if (((*(int *)f["UDP"]) == _t2) &&
-            (udpflood[f][(*(IP *)f["sip"])] != _t3 && udpcounter[f][(*(IP *)f["sip"])] != threshold[f])) {
-                udpcounter[f][(*(IP *)f["sip"])] = udpcounter[f][(*(IP *)f["sip"])] + _t4;
-        } else if (((*(int *)f["UDP"]) == _t5) &&
-                   (udpflood[f][(*(IP *)f["sip"])] != _t6 && udpcounter[f][(*(IP *)f["sip"])] == threshold[f])) {
-                udpflood[f][(*(IP *)f["sip"])] = _t7;
+        } else if (st->udpcounter != threshold) {
+                st->udpcounter = st->udpcounter + 1;
+        } else {
+                st->udpflood = 1;
                 return -1;
-        } else if ((*(int *)f["UDP"]) != _t8) {
         }
-
-        f.clean();
         return 0;
 }
+
 int
 UDPFM(u_char *pkt, int totallength) {
-        f_glb = Flow(pkt, totallength);
-        return process(f_glb);
+        struct nfd_flow f;
+
+        if (nfd_flow_decode(&f, pkt, totallength) < 0)
+                return 0;
+        return process(f);
 }
 
 void
@@ -336,7 +302,10 @@ main(int argc, char *argv[]) {
         argv += arg_offset;
 
         // NFD begin
-        _init_();
+        if (_init_() < 0) {
+                onvm_nflib_stop(nf_local_ctx);
+                rte_exit(EXIT_FAILURE, "Failed to allocate NFD state table\n");
+        }
         // NFD end
 
         if (parse_app_args(argc, argv, progname) < 0) {
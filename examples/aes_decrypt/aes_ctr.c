@@ -0,0 +1,265 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *            2016-2019 Hewlett Packard Enterprise Development LP
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * aes_ctr.c - AES-256 CTR engine with AES-NI and table based paths
+ ********************************************************************/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rte_branch_prediction.h>
+#include <rte_byteorder.h>
+#include <rte_common.h>
+#include <rte_cpuflags.h>
+#include <wmmintrin.h>
+
+#include "aes_ctr.h"
+
+/*
+ * Counter block as two host order halves, byte 0 of the block is the top byte of hi
+ */
+struct aes_ctr_counter {
+        uint64_t hi;
+        uint64_t lo;
+};
+
+static inline void
+aes_ctr_counter_load(struct aes_ctr_counter *ctr, const uint8_t iv[AES_BLOCK_SIZE]) {
+        uint64_t half;
+
+        memcpy(&half, iv, sizeof(half));
+        ctr->hi = rte_be_to_cpu_64(half);
+        memcpy(&half, iv + sizeof(half), sizeof(half));
+        ctr->lo = rte_be_to_cpu_64(half);
+}
+
+static inline void
+aes_ctr_counter_inc(struct aes_ctr_counter *ctr) {
+        if (++ctr->lo == 0)
+                ctr->hi++;
+}
+
+/***************************AES-NI implementation****************************/
+
+#define AES_NI_TARGET __attribute__((target("aes,sse2")))
+
+static inline AES_NI_TARGET __m128i
+aes_ni_key_256_assist_1(__m128i t1, __m128i t2) {
+        __m128i t4;
+
+        t2 = _mm_shuffle_epi32(t2, 0xff);
+        t4 = _mm_slli_si128(t1, 0x4);
+        t1 = _mm_xor_si128(t1, t4);
+        t4 = _mm_slli_si128(t4, 0x4);
+        t1 = _mm_xor_si128(t1, t4);
+        t4 = _mm_slli_si128(t4, 0x4);
+        t1 = _mm_xor_si128(t1, t4);
+        return _mm_xor_si128(t1, t2);
+}
+
+static inline AES_NI_TARGET __m128i
+aes_ni_key_256_assist_2(__m128i t1, __m128i t3) {
+        __m128i t2, t4;
+
+        t4 = _mm_aeskeygenassist_si128(t1, 0x0);
+        t2 = _mm_shuffle_epi32(t4, 0xaa);
+        t4 = _mm_slli_si128(t3, 0x4);
+        t3 = _mm_xor_si128(t3, t4);
+        t4 = _mm_slli_si128(t4, 0x4);
+        t3 = _mm_xor_si128(t3, t4);
+        t4 = _mm_slli_si128(t4, 0x4);
+        t3 = _mm_xor_si128(t3, t4);
+        return _mm_xor_si128(t3, t2);
+}
+
+/* aeskeygenassist needs the round constant as an immediate */
+#define AES_NI_EXPAND_ROUND(rk, i, rcon)                                              \
+        do {                                                                          \
+                t1 = aes_ni_key_256_assist_1(t1, _mm_aeskeygenassist_si128(t3, rcon)); \
+                _mm_store_si128((__m128i *)rk[i], t1);                                \
+                t3 = aes_ni_key_256_assist_2(t1, t3);                                 \
+                _mm_store_si128((__m128i *)rk[i + 1], t3);                            \
+        } while (0)
+
+static AES_NI_TARGET void
+aes_ni_key_expand_256(const uint8_t key[AES_CTR_KEY_SIZE], uint8_t rk[AES_CTR_ROUNDS + 1][AES_BLOCK_SIZE]) {
+        __m128i t1, t3;
+
+        t1 = _mm_loadu_si128((const __m128i *)key);
+        t3 = _mm_loadu_si128((const __m128i *)(key + 16));
+        _mm_store_si128((__m128i *)rk[0], t1);
+        _mm_store_si128((__m128i *)rk[1], t3);
+
+        AES_NI_EXPAND_ROUND(rk, 2, 0x01);
+        AES_NI_EXPAND_ROUND(rk, 4, 0x02);
+        AES_NI_EXPAND_ROUND(rk, 6, 0x04);
+        AES_NI_EXPAND_ROUND(rk, 8, 0x08);
+        AES_NI_EXPAND_ROUND(rk, 10, 0x10);
+        AES_NI_EXPAND_ROUND(rk, 12, 0x20);
+        t1 = aes_ni_key_256_assist_1(t1, _mm_aeskeygenassist_si128(t3, 0x40));
+        _mm_store_si128((__m128i *)rk[14], t1);
+}
+
+/*
+ * Encrypt up to AES_CTR_LANES counter blocks side by side, each with its own key, and xor them into the data
+ */
+static inline AES_NI_TARGET void
+aes_ni_ctr_lanes(__m128i blk[], const struct aes_ctr_ctx *ctx[], uint8_t *dst[], uint32_t len[], unsigned lanes) {
+        uint8_t keystream[AES_BLOCK_SIZE];
+        unsigned l, r, i;
+
+        for (l = 0; l < lanes; l++)
+                blk[l] = _mm_xor_si128(blk[l], _mm_load_si128((const __m128i *)ctx[l]->round_keys[0]));
+        for (r = 1; r < AES_CTR_ROUNDS; r++)
+                for (l = 0; l < lanes; l++)
+                        blk[l] = _mm_aesenc_si128(blk[l], _mm_load_si128((const __m128i *)ctx[l]->round_keys[r]));
+        for (l = 0; l < lanes; l++)
+                blk[l] = _mm_aesenclast_si128(blk[l],
+                                              _mm_load_si128((const __m128i *)ctx[l]->round_keys[AES_CTR_ROUNDS]));
+
+        for (l = 0; l < lanes; l++) {
+                if (likely(len[l] == AES_BLOCK_SIZE)) {
+                        _mm_storeu_si128((__m128i *)dst[l],
+                                         _mm_xor_si128(_mm_loadu_si128((const __m128i *)dst[l]), blk[l]));
+                } else {
+                        _mm_storeu_si128((__m128i *)keystream, blk[l]);
+                        for (i = 0; i < len[l]; i++)
+                                dst[l][i] ^= keystream[i];
+                }
+        }
+}
+
+static AES_NI_TARGET void
+aes_ni_ctr_burst(struct aes_ctr_job *jobs, uint16_t count) {
+        __m128i blk[AES_CTR_LANES];
+        const struct aes_ctr_ctx *ctx[AES_CTR_LANES];
+        uint8_t *dst[AES_CTR_LANES];
+        uint32_t len[AES_CTR_LANES];
+        struct aes_ctr_counter ctr;
+        uint32_t off;
+        unsigned lanes;
+        uint16_t j;
+
+        /* Lanes are filled block by block across jobs, so short packets still keep all of them busy */
+        lanes = 0;
+        for (j = 0; j < count; j++) {
+                aes_ctr_counter_load(&ctr, jobs[j].iv);
+                for (off = 0; off < jobs[j].len; off += AES_BLOCK_SIZE) {
+                        blk[lanes] = _mm_set_epi64x(rte_cpu_to_be_64(ctr.lo), rte_cpu_to_be_64(ctr.hi));
+                        ctx[lanes] = jobs[j].ctx;
+                        dst[lanes] = jobs[j].data + off;
+                        len[lanes] = RTE_MIN((uint32_t)AES_BLOCK_SIZE, jobs[j].len - off);
+                        aes_ctr_counter_inc(&ctr);
+                        if (++lanes == AES_CTR_LANES) {
+                                aes_ni_ctr_lanes(blk, ctx, dst, len, lanes);
+                                lanes = 0;
+                        }
+                }
+        }
+        if (lanes > 0)
+                aes_ni_ctr_lanes(blk, ctx, dst, len, lanes);
+}
+
+/*********************************Interfaces**********************************/
+
+void
+aes_ctr_ctx_init(struct aes_ctr_ctx *ctx, const uint8_t key[AES_CTR_KEY_SIZE], int force_table) {
+        memset(ctx, 0, sizeof(*ctx));
+        aes_key_setup(key, ctx->key_schedule, 256);
+
+        ctx->use_aesni = !force_table && rte_cpu_get_flag_enabled(RTE_CPUFLAG_AES) > 0;
+        if (ctx->use_aesni)
+                aes_ni_key_expand_256(key, ctx->round_keys);
+}
+
+int
+aes_ctr_load_keys(const char *path, struct aes_ctr_ctx *ctxs, int max_keys, int force_table) {
+        char line[128];
+        uint8_t key[AES_CTR_KEY_SIZE];
+        char byte[3];
+        int num_keys, i;
+        FILE *file;
+
+        file = fopen(path, "r");
+        if (file == NULL)
+                return -1;
+
+        num_keys = 0;
+        byte[2] = '\0';
+        while (fgets(line, sizeof(line), file) != NULL) {
+                line[strcspn(line, "\r\n")] = '\0';
+                if (line[0] == '\0' || line[0] == '#')
+                        continue;
+                if (num_keys == max_keys || strlen(line) != 2 * AES_CTR_KEY_SIZE) {
+                        fclose(file);
+                        return -1;
+                }
+                for (i = 0; i < AES_CTR_KEY_SIZE; i++) {
+                        if (!isxdigit(line[2 * i]) || !isxdigit(line[2 * i + 1])) {
+                                fclose(file);
+                                return -1;
+                        }
+                        byte[0] = line[2 * i];
+                        byte[1] = line[2 * i + 1];
+                        key[i] = (uint8_t)strtoul(byte, NULL, 16);
+                }
+                aes_ctr_ctx_init(&ctxs[num_keys++], key, force_table);
+        }
+
+        fclose(file);
+        return num_keys;
+}
+
+void
+aes_ctr_burst(struct aes_ctr_job *jobs, uint16_t count) {
+        uint16_t j, first;
+
+        /* Runs of jobs with AES-NI keys go through the pipelined path, the rest through the tables */
+        for (j = 0; j < count;) {
+                if (jobs[j].ctx->use_aesni) {
+                        first = j;
+                        while (j < count && jobs[j].ctx->use_aesni)
+                                j++;
+                        aes_ni_ctr_burst(&jobs[first], j - first);
+                } else {
+                        aes_encrypt_ctr(jobs[j].data, jobs[j].len, jobs[j].data, jobs[j].ctx->key_schedule, 256,
+                                        jobs[j].iv);
+                        j++;
+                }
+        }
+}
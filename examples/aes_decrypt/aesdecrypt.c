@@ -50,13 +50,14 @@
 #include <sys/queue.h>
 #include <unistd.h>
 
+#include <rte_byteorder.h>
 #include <rte_common.h>
 #include <rte_ether.h>
 #include <rte_ip.h>
 #include <rte_mbuf.h>
 #include <rte_udp.h>
 
-#include "aes.h"
+#include "aes_ctr.h"
 #include "onvm_nflib.h"
 #include "onvm_pkt_helper.h"
 
@@ -67,11 +68,13 @@ static uint32_t print_delay = 1000000;
 
 static uint32_t destination;
 
-/* AES encryption parameters */
+/* AES decryption parameters, key[0] is used when no key file is given */
 BYTE key[1][32] = {{0x60, 0x3d, 0xeb, 0x10, 0x15, 0xca, 0x71, 0xbe, 0x2b, 0x73, 0xae, 0xf0, 0x85, 0x7d, 0x77, 0x81,
                     0x1f, 0x35, 0x2c, 0x07, 0x3b, 0x61, 0x08, 0xd7, 0x2d, 0x98, 0x10, 0xa3, 0x09, 0x14, 0xdf, 0xf4}};
-BYTE iv[1][16] = {{0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f}};
-WORD key_schedule[60];  // word Schedule
+static struct aes_ctr_ctx key_ctxs[AES_CTR_MAX_KEYS];
+static int num_keys = 1;
+static const char *key_file = NULL;
+static int force_table = 0;
 
 /*
  * Print a usage message
@@ -79,11 +82,13 @@ WORD key_schedule[60];  // word Schedule
 static void
 usage(const char *progname) {
         printf("Usage:\n");
-        printf("%s [EAL args] -- [NF_LIB args] -- -d <destination> -p <print_delay>\n", progname);
+        printf("%s [EAL args] -- [NF_LIB args] -- -d <destination> -p <print_delay> -k <key_file> -t\n", progname);
         printf("%s -F <CONFIG_FILE.json> [EAL args] -- [NF_LIB args] -- [NF args]\n\n", progname);
         printf("Flags:\n");
         printf(" - `-d <dst>`: destination service ID to foward to\n");
         printf(" - `-p <print_delay>`: number of packets between each print, e.g. `-p 1` prints every packets.\n");
+        printf(" - `-k <key_file>`: file with one hex encoded 256 bit key per line, must match the encrypting NF\n");
+        printf(" - `-t`: use the table based AES even if the CPU supports AES-NI\n");
 }
 
 /*
@@ -93,7 +98,7 @@ static int
 parse_app_args(int argc, char *argv[], const char *progname) {
         int c, dst_flag = 0;
 
-        while ((c = getopt(argc, argv, "d:p:")) != -1) {
+        while ((c = getopt(argc, argv, "d:p:k:t")) != -1) {
                 switch (c) {
                         case 'd':
                                 destination = strtoul(optarg, NULL, 10);
@@ -102,12 +107,20 @@ parse_app_args(int argc, char *argv[], const char *progname) {
                         case 'p':
                                 print_delay = strtoul(optarg, NULL, 10);
                                 break;
+                        case 'k':
+                                key_file = optarg;
+                                break;
+                        case 't':
+                                force_table = 1;
+                                break;
                         case '?':
                                 usage(progname);
                                 if (optopt == 'd')
                                         RTE_LOG(INFO, APP, "Option -%c requires an argument.\n", optopt);
                                 else if (optopt == 'p')
                                         RTE_LOG(INFO, APP, "Option -%c requires an argument.\n", optopt);
+                                else if (optopt == 'k')
+                                        RTE_LOG(INFO, APP, "Option -%c requires an argument.\n", optopt);
                                 else if (isprint(optopt))
                                         RTE_LOG(INFO, APP, "Unknown option `-%c'.\n", optopt);
                                 else
@@ -169,59 +182,110 @@ do_stats_display(struct rte_mbuf *pkt) {
         }
 }
 
+/*
+ * Fill in the decryption job of a UDP packet and strip its trailer, the payload stays in place for the
+ * job. Returns 1 if there is a payload to decrypt.
+ */
 static int
-packet_handler(struct rte_mbuf *pkt, struct onvm_pkt_meta *meta,
-               __attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx) {
+decrypt_prepare(struct rte_mbuf *pkt, struct onvm_pkt_meta *meta, struct aes_ctr_job *job, int print) {
+        struct rte_ipv4_hdr *ip;
         struct rte_udp_hdr *udp;
-        static uint32_t counter = 0;
+        struct aes_ctr_trailer *trailer;
+        uint8_t *pkt_data;
+        uint8_t *eth;
+        uint16_t plen;
+        uint16_t hlen;
+        uint16_t total_length;
+
+        meta->action = ONVM_NF_ACTION_TONF;
+        meta->destination = destination;
 
         /* Check if we have a valid UDP packet */
         udp = onvm_pkt_udp_hdr(pkt);
-        if (udp != NULL) {
-                uint8_t *pkt_data;
-                uint8_t *eth;
-                uint16_t plen;
-                uint16_t hlen;
-
-                /* Get at the payload */
-                pkt_data = ((uint8_t *)udp) + sizeof(struct rte_udp_hdr);
-                /* Calculate length */
-                eth = rte_pktmbuf_mtod(pkt, uint8_t *);
-                hlen = pkt_data - eth;
-                plen = pkt->pkt_len - hlen;
-
-                /* Encrypt. */
-                /* IV should change with every packet, but we don't have any
-                 * way to send it to the other side. */
-                aes_decrypt_ctr(pkt_data, plen, pkt_data, key_schedule, 256, iv[0]);
-                if (counter == 0) {
-                        printf("Decrypted %d bytes at offset %d (%ld)\n", plen, hlen,
-                               sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr));
-                }
+        ip = onvm_pkt_ipv4_hdr(pkt);
+        if (udp == NULL || ip == NULL)
+                return 0;
+
+        /* Get at the payload */
+        pkt_data = ((uint8_t *)udp) + sizeof(struct rte_udp_hdr);
+        /* Calculate length, the payload ends with the trailer added by the encrypting NF */
+        eth = rte_pktmbuf_mtod(pkt, uint8_t *);
+        hlen = pkt_data - eth;
+        plen = RTE_MIN((uint32_t)(rte_be_to_cpu_16(udp->dgram_len) - sizeof(struct rte_udp_hdr)),
+                       pkt->pkt_len - hlen);
+        if (plen < sizeof(struct aes_ctr_trailer)) {
+                meta->action = ONVM_NF_ACTION_DROP;
+                return 0;
         }
+        plen -= sizeof(struct aes_ctr_trailer);
+        trailer = (struct aes_ctr_trailer *)(pkt_data + plen);
+        if (trailer->key_id >= num_keys) {
+                meta->action = ONVM_NF_ACTION_DROP;
+                return 0;
+        }
+
+        job->data = pkt_data;
+        job->len = plen;
+        job->iv = trailer->iv;
+        job->ctx = &key_ctxs[trailer->key_id];
 
-        if (++counter == print_delay) {
-                do_stats_display(pkt);
-                counter = 0;
+        if (print) {
+                printf("Decrypting %d bytes at offset %d (%ld) with key %d\n", plen, hlen,
+                       sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr),
+                       trailer->key_id);
         }
 
-        meta->action = ONVM_NF_ACTION_TONF;
-        meta->destination = destination;
-        return 0;
+        /* Strip the trailer and any ethernet padding, trimming leaves the trailer's IV where the job reads it */
+        rte_pktmbuf_trim(pkt, pkt->pkt_len - hlen - plen);
+        udp->dgram_len = rte_cpu_to_be_16(plen + sizeof(struct rte_udp_hdr));
+        udp->dgram_cksum = 0;
+        total_length = rte_cpu_to_be_16((uint8_t *)udp - (uint8_t *)ip + plen + sizeof(struct rte_udp_hdr));
+        ip->hdr_checksum = onvm_pkt_cksum_update16(ip->hdr_checksum, ip->total_length, total_length);
+        ip->total_length = total_length;
+        return 1;
+}
+
+/*
+ * Decrypt the payloads of the whole burst together, so the AES-NI path interleaves the blocks of many packets
+ */
+static uint16_t
+packet_bulk_handler(struct rte_mbuf **pkts, uint16_t nb_pkts,
+                    __attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx) {
+        struct aes_ctr_job jobs[PACKET_READ_SIZE];
+        static uint32_t counter = 0;
+        uint16_t done, n, num_jobs, i;
+
+        for (done = 0; done < nb_pkts; done += n) {
+                n = RTE_MIN(nb_pkts - done, PACKET_READ_SIZE);
+                num_jobs = 0;
+                for (i = done; i < done + n; i++) {
+                        onvm_pkt_prefetch_ahead(pkts, i, nb_pkts);
+                        num_jobs += decrypt_prepare(pkts[i], onvm_get_pkt_meta(pkts[i]), &jobs[num_jobs],
+                                                    counter + 1 == print_delay);
+                        if (++counter == print_delay) {
+                                do_stats_display(pkts[i]);
+                                counter = 0;
+                        }
+                }
+                aes_ctr_burst(jobs, num_jobs);
+        }
+
+        return nb_pkts;
 }
 
 int
 main(int argc, char *argv[]) {
-        int arg_offset;
         struct onvm_nf_local_ctx *nf_local_ctx;
         struct onvm_nf_function_table *nf_function_table;
+        int arg_offset;
+
         const char *progname = argv[0];
 
         nf_local_ctx = onvm_nflib_init_nf_local_ctx();
         onvm_nflib_start_signal_handler(nf_local_ctx, NULL);
 
         nf_function_table = onvm_nflib_init_nf_function_table();
-        nf_function_table->pkt_handler = &packet_handler;
+        nf_function_table->pkt_bulk_handler = &packet_bulk_handler;
 
         if ((arg_offset = onvm_nflib_init(argc, argv, NF_TAG, nf_local_ctx, nf_function_table)) < 0) {
                 onvm_nflib_stop(nf_local_ctx);
@@ -241,8 +305,18 @@ main(int argc, char *argv[]) {
                 rte_exit(EXIT_FAILURE, "Invalid command-line arguments\n");
         }
 
-        /* Initialise encryption engine. Key should be configurable. */
-        aes_key_setup(key[0], key_schedule, 256);
+        /* Initialise decryption engine, one context per key */
+        if (key_file != NULL) {
+                num_keys = aes_ctr_load_keys(key_file, key_ctxs, AES_CTR_MAX_KEYS, force_table);
+                if (num_keys <= 0) {
+                        onvm_nflib_stop(nf_local_ctx);
+                        rte_exit(EXIT_FAILURE, "Cannot load keys from %s\n", key_file);
+                }
+        } else {
+                aes_ctr_ctx_init(&key_ctxs[0], key[0], force_table);
+        }
+        RTE_LOG(INFO, APP, "Using %d key(s) with %s\n", num_keys,
+                key_ctxs[0].use_aesni ? "AES-NI" : "table based AES");
 
         onvm_nflib_run(nf_local_ctx);
 
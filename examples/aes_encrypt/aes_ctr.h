@@ -0,0 +1,94 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *            2016-2019 Hewlett Packard Enterprise Development LP
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * aes_ctr.h - AES-256 CTR engine with AES-NI and table based paths
+ ********************************************************************/
+
+#ifndef _AES_CTR_H_
+#define _AES_CTR_H_
+
+#include <stdint.h>
+
+#include "aes.h"
+
+#define AES_CTR_KEY_SIZE 32
+#define AES_CTR_ROUNDS 14
+#define AES_CTR_MAX_KEYS 256
+/* Number of blocks encrypted side by side, enough to hide the AESENC latency */
+#define AES_CTR_LANES 8
+
+/*
+ * Expanded key, both for AES-NI and for the table based fallback
+ */
+struct aes_ctr_ctx {
+        uint8_t round_keys[AES_CTR_ROUNDS + 1][AES_BLOCK_SIZE] __attribute__((aligned(16)));
+        WORD key_schedule[60];
+        uint8_t use_aesni;
+};
+
+/*
+ * One buffer to run through CTR mode, the counter block is incremented as a 128 bit big endian number
+ */
+struct aes_ctr_job {
+        uint8_t *data;
+        uint32_t len;
+        const uint8_t *iv;
+        const struct aes_ctr_ctx *ctx;
+};
+
+/*
+ * Appended to every encrypted payload so the receiver knows the key and counter block used
+ */
+struct aes_ctr_trailer {
+        uint8_t iv[AES_BLOCK_SIZE];
+        uint8_t key_id;
+} __attribute__((packed));
+
+/* Expand a 256 bit key, uses AES-NI if the CPU has it unless disabled with force_table */
+void
+aes_ctr_ctx_init(struct aes_ctr_ctx *ctx, const uint8_t key[AES_CTR_KEY_SIZE], int force_table);
+
+/* Load one hex encoded 256 bit key per line, returns the number of keys or -1 on error */
+int
+aes_ctr_load_keys(const char *path, struct aes_ctr_ctx *ctxs, int max_keys, int force_table);
+
+/* Encrypt or decrypt every job in place, blocks of different jobs are interleaved */
+void
+aes_ctr_burst(struct aes_ctr_job *jobs, uint16_t count);
+
+#endif  // _AES_CTR_H_
@@ -34,9 +34,9 @@
  *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  *
- * fair_queue.c - Simulates fair queueing by categorizing packets based
- *      on IPv4 header values into separate queues and dequeue
- *      packets in a round robin fashion.
+ * fair_queue.c - Fair queueing by categorizing packets based on IPv4
+ *      header values into separate queues and dequeuing packets
+ *      with weighted deficit round robin.
  ********************************************************************/
 
 #include <errno.h>
@@ -55,8 +55,10 @@
 #include <rte_ip.h>
 #include <rte_malloc.h>
 #include <rte_mbuf.h>
+#include <rte_pause.h>
 
 #include "cJSON.h"
+#include "onvm_config_common.h"
 #include "onvm_nflib.h"
 #include "onvm_pkt_helper.h"
 
@@ -79,6 +81,7 @@
 
 static uint32_t destination;
 static uint8_t print_stats_flag;
+static char *profile_file = NULL;
 
 /* For advanced rings scaling */
 rte_atomic16_t signal_exit_flag;
@@ -102,17 +105,93 @@ do_fq_stats_display(void *arg);
 static void
 usage(const char *progname) {
         printf("Usage:\n");
-        printf("%s [EAL args] -- [NF_LIB args] -- -d <destination> -p <print_delay> -D <tb_depth> -R <tb_rate>\n",
+        printf("%s [EAL args] -- [NF_LIB args] -- -d <destination> -n <num_queues> -c <profile_file> -p\n",
                progname);
         printf("%s -F <CONFIG_FILE.json> [EAL args] -- [NF_LIB args] -- [NF args]\n\n", progname);
         printf("Flags:\n");
         printf(" - `-d <dst>`: Destination service ID to forward to\n");
         printf(" - `-n <num_queues>`: Number of queues to simulate round robin fair queueing\n");
+        printf(" - `-c <profile_file>`: JSON file with queue weights and rate limits, see README\n");
         printf(
             " - `-p`: Print per queue stats on the terminal (Not recommended for use with large value of "
             "num_queues)\n");
 }
 
+/*
+ * Read the scheduling profiles and the profile of every queue from a JSON file:
+ * { "queue_size": 1024,
+ *   "profiles": [ { "weight": 1, "rate_mbps": 0, "burst_kb": 0 }, ... ],
+ *   "queues": [ 0, 1, ... ] }
+ * Queues that are not listed use profile 0.
+ */
+static int
+load_profiles(char *filename, struct fairqueue_profile *profiles, uint8_t *queue_profile, uint16_t num_queues,
+              unsigned *queue_size) {
+        cJSON *config, *profiles_json, *queues_json, *item, *value;
+        int num_profiles, i;
+
+        config = onvm_config_parse_file(filename);
+        if (config == NULL) {
+                RTE_LOG(INFO, APP, "Could not parse profile file %s\n", filename);
+                return -1;
+        }
+
+        value = cJSON_GetObjectItem(config, "queue_size");
+        if (value != NULL) {
+                if (!cJSON_IsNumber(value) || !rte_is_power_of_2(value->valueint)) {
+                        RTE_LOG(INFO, APP, "queue_size must be a power of 2\n");
+                        cJSON_Delete(config);
+                        return -1;
+                }
+                *queue_size = value->valueint;
+        }
+
+        num_profiles = 0;
+        profiles_json = cJSON_GetObjectItem(config, "profiles");
+        cJSON_ArrayForEach(item, profiles_json) {
+                if (num_profiles == FQ_MAX_PROFILES) {
+                        RTE_LOG(INFO, APP, "At most %d profiles are supported\n", FQ_MAX_PROFILES);
+                        cJSON_Delete(config);
+                        return -1;
+                }
+                value = cJSON_GetObjectItem(item, "weight");
+                if (value == NULL || !cJSON_IsNumber(value) || value->valueint < 1) {
+                        RTE_LOG(INFO, APP, "Profile %d needs a weight of at least 1\n", num_profiles);
+                        cJSON_Delete(config);
+                        return -1;
+                }
+                profiles[num_profiles].weight = value->valueint;
+                value = cJSON_GetObjectItem(item, "rate_mbps");
+                profiles[num_profiles].rate = value != NULL ? (uint64_t)(value->valuedouble * 1000 * 1000 / 8) : 0;
+                value = cJSON_GetObjectItem(item, "burst_kb");
+                profiles[num_profiles].burst = value != NULL ? (uint64_t)(value->valuedouble * 1024) : 0;
+                if (profiles[num_profiles].rate != 0 && profiles[num_profiles].burst < RTE_ETHER_MAX_LEN)
+                        profiles[num_profiles].burst = RTE_ETHER_MAX_LEN;
+                num_profiles++;
+        }
+        if (num_profiles == 0) {
+                RTE_LOG(INFO, APP, "Profile file %s has no profiles\n", filename);
+                cJSON_Delete(config);
+                return -1;
+        }
+
+        i = 0;
+        queues_json = cJSON_GetObjectItem(config, "queues");
+        cJSON_ArrayForEach(item, queues_json) {
+                if (i == num_queues)
+                        break;
+                if (!cJSON_IsNumber(item) || item->valueint < 0 || item->valueint >= num_profiles) {
+                        RTE_LOG(INFO, APP, "Queue %d has an invalid profile\n", i + 1);
+                        cJSON_Delete(config);
+                        return -1;
+                }
+                queue_profile[i++] = item->valueint;
+        }
+
+        cJSON_Delete(config);
+        return 0;
+}
+
 /*
  * Parse the application arguments.
  */
@@ -120,10 +199,14 @@ static int
 parse_app_args(int argc, char *argv[], const char *progname, struct onvm_nf *nf) {
         int c, dst_flag = 0, num_queues_flag = 0;
         struct fairqueue_t *fairqueue;
+        /* Without a profile file every queue gets the same weight and no rate limit */
+        struct fairqueue_profile profiles[FQ_MAX_PROFILES] = {{.weight = 1, .rate = 0, .burst = 0}};
+        static uint8_t queue_profile[FQ_MAX_QUEUES];
+        unsigned queue_size = FQ_DEFAULT_QUEUE_SIZE;
         print_stats_flag = 0;    /* No per queue output by default */
         uint16_t num_queues = 2; /* Default number of queueus */
 
-        while ((c = getopt(argc, argv, "d:n:p")) != -1) {
+        while ((c = getopt(argc, argv, "d:n:c:p")) != -1) {
                 switch (c) {
                         case 'd':
                                 destination = strtoul(optarg, NULL, 10);
@@ -133,6 +216,9 @@ parse_app_args(int argc, char *argv[], const char *progname, struct onvm_nf *nf)
                                 num_queues = strtoul(optarg, NULL, 10);
                                 num_queues_flag = 1;
                                 break;
+                        case 'c':
+                                profile_file = optarg;
+                                break;
                         case 'p':
                                 print_stats_flag = 1;
                                 break;
@@ -142,6 +228,8 @@ parse_app_args(int argc, char *argv[], const char *progname, struct onvm_nf *nf)
                                         RTE_LOG(INFO, APP, "Option -%c requires an argument.\n", optopt);
                                 else if (optopt == 'n')
                                         RTE_LOG(INFO, APP, "Option -%c requires an argument.\n", optopt);
+                                else if (optopt == 'c')
+                                        RTE_LOG(INFO, APP, "Option -%c requires an argument.\n", optopt);
                                 else if (isprint(optopt))
                                         RTE_LOG(INFO, APP, "Unknown option `-%c'.\n", optopt);
                                 else
@@ -162,8 +250,18 @@ parse_app_args(int argc, char *argv[], const char *progname, struct onvm_nf *nf)
                 RTE_LOG(INFO, APP, "Default number of queues (2) used. Specify a number using flag -n.\n");
         }
 
+        if (num_queues == 0 || num_queues > FQ_MAX_QUEUES) {
+                RTE_LOG(INFO, APP, "Number of queues must be between 1 and %d.\n", FQ_MAX_QUEUES);
+                return -1;
+        }
+
+        if (profile_file != NULL &&
+            load_profiles(profile_file, profiles, queue_profile, num_queues, &queue_size) < 0) {
+                return -1;
+        }
+
         /* Setup fair queue */
-        setup_fairqueue(&fairqueue, num_queues);
+        setup_fairqueue(&fairqueue, num_queues, nf->instance_id, queue_size, profiles, queue_profile);
         nf->data = (void *)fairqueue;
 
         return optind;
@@ -222,15 +320,14 @@ sig_handler(int sig) {
 
 static int
 tx_loop(struct onvm_nf_local_ctx *nf_local_ctx) {
-        void *pktsTX[PKT_READ_SIZE];
-        int tx_batch_size;
+        struct rte_mbuf *pktsTX[PKT_READ_SIZE];
+        uint16_t i, nb_pkts;
         struct onvm_pkt_meta *meta;
         struct rte_ring *tx_ring;
         struct rte_ring *msg_q;
         struct onvm_nf *nf;
         struct onvm_nf_msg *msg;
         struct rte_mempool *nf_msg_pool;
-        struct rte_mbuf *pkt;
         struct fairqueue_t *fair_queue;
 
         nf = nf_local_ctx->nf;
@@ -246,7 +343,6 @@ tx_loop(struct onvm_nf_local_ctx *nf_local_ctx) {
         if (onvm_threading_core_affinitize(nf->thread_info.core) < 0)
                 rte_exit(EXIT_FAILURE, "Failed to affinitize to core %d\n", nf->thread_info.core);
 
-        tx_batch_size = 0;
         while (!rte_atomic16_read(&signal_exit_flag)) {
                 /* Check for a stop message from the manager */
                 if (unlikely(rte_ring_count(msg_q) > 0)) {
@@ -260,33 +356,34 @@ tx_loop(struct onvm_nf_local_ctx *nf_local_ctx) {
                         rte_mempool_put(nf_msg_pool, (void *)msg);
                 }
 
-                /* Dequeue packet from the fair queue system */
-                pkt = NULL;
-                fairqueue_dequeue(fair_queue, &pkt);
-
-                if (pkt == NULL) {
+                /* Dequeue a burst of packets from the fair queue system */
+                nb_pkts = fairqueue_dequeue_burst(fair_queue, pktsTX, PKT_READ_SIZE);
+                if (nb_pkts == 0) {
+                        /* Nothing queued or every queue is rate limited, don't hammer the bitmap */
+                        rte_pause();
                         continue;
                 }
 
-                meta = onvm_get_pkt_meta((struct rte_mbuf *)pkt);
-                meta->action = ONVM_NF_ACTION_TONF;
-                meta->destination = destination;
-                pktsTX[tx_batch_size++] = pkt;
-                if (tx_batch_size == PKT_READ_SIZE) {
-                        rte_ring_enqueue_bulk(tx_ring, pktsTX, tx_batch_size, NULL);
-                        tx_batch_size = 0;
+                for (i = 0; i < nb_pkts; i++) {
+                        meta = onvm_get_pkt_meta(pktsTX[i]);
+                        meta->action = ONVM_NF_ACTION_TONF;
+                        meta->destination = destination;
                 }
+
+                /* A full tx ring backs up into the queues, which keeps the scheduling fair */
+                while (rte_ring_enqueue_bulk(tx_ring, (void **)pktsTX, nb_pkts, NULL) == 0 &&
+                       !rte_atomic16_read(&signal_exit_flag))
+                        rte_pause();
         }
         return 0;
 }
 
 static int
 rx_loop(struct onvm_nf_local_ctx *nf_local_ctx) {
-        void *pkts[PKT_READ_SIZE];
-        void *pktsDrop[PKT_READ_SIZE];
+        struct rte_mbuf *pkts[PKT_READ_SIZE];
+        struct rte_mbuf *pktsDrop[PKT_READ_SIZE];
         struct onvm_pkt_meta *meta;
-        uint16_t i, nb_pkts;
-        int tx_batch_size;
+        uint16_t i, nb_pkts, nb_drops, nb_sent;
         struct rte_ring *rx_ring;
         struct rte_ring *tx_ring;
         struct rte_ring *msg_q;
@@ -309,7 +406,6 @@ rx_loop(struct onvm_nf_local_ctx *nf_local_ctx) {
         if (onvm_threading_core_affinitize(nf->thread_info.core) < 0)
                 rte_exit(EXIT_FAILURE, "Failed to affinitize to core %d\n", nf->thread_info.core);
 
-        tx_batch_size = 0;
         while (!rte_atomic16_read(&signal_exit_flag)) {
                 /* Check for a stop message from the manager */
                 if (unlikely(rte_ring_count(msg_q) > 0)) {
@@ -323,19 +419,25 @@ rx_loop(struct onvm_nf_local_ctx *nf_local_ctx) {
                         rte_mempool_put(nf_msg_pool, (void *)msg);
                 }
 
-                nb_pkts = rte_ring_dequeue_burst(rx_ring, pkts, PKT_READ_SIZE, NULL);
+                nb_pkts = rte_ring_dequeue_burst(rx_ring, (void **)pkts, PKT_READ_SIZE, NULL);
+                if (nb_pkts == 0) {
+                        continue;
+                }
 
-                for (i = 0; i < nb_pkts; i++) {
-                        if (fairqueue_enqueue(fair_queue, pkts[i]) == -1) {
-                                meta = onvm_get_pkt_meta((struct rte_mbuf *)pkts[i]);
-                                meta->action = ONVM_NF_ACTION_DROP;
-                                meta->destination = destination;
-                                pktsDrop[tx_batch_size++] = pkts[i];
-                                if (tx_batch_size == 32) {
-                                        rte_ring_enqueue_bulk(tx_ring, pktsDrop, tx_batch_size, NULL);
-                                        tx_batch_size = 0;
-                                }
-                        }
+                nb_drops = fairqueue_enqueue_burst(fair_queue, pkts, nb_pkts, pktsDrop);
+                if (nb_drops == 0) {
+                        continue;
+                }
+
+                /* Hand dropped packets back to the manager so they are counted, free what does not fit */
+                for (i = 0; i < nb_drops; i++) {
+                        meta = onvm_get_pkt_meta(pktsDrop[i]);
+                        meta->action = ONVM_NF_ACTION_DROP;
+                        meta->destination = destination;
+                }
+                nb_sent = rte_ring_enqueue_burst(tx_ring, (void **)pktsDrop, nb_drops, NULL);
+                for (i = nb_sent; i < nb_drops; i++) {
+                        rte_pktmbuf_free(pktsDrop[i]);
                 }
         }
         return 0;
@@ -35,99 +35,130 @@
  *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  *
  * fair_queue_helper.h - functions and structures required to maintain
- *      multiple queue and simulate fair queueing
+ *      multiple queues and schedule them with deficit round robin
  ********************************************************************/
 
 #include <onvm_flow_table.h>
 #include <rte_cycles.h>
+#include <rte_ether.h>
 #include <rte_hash_crc.h>
 #include <rte_malloc.h>
 #include <rte_mbuf.h>
 #include <rte_ring.h>
-#include <rte_spinlock.h>
 
-#define QUEUE_SIZE (NF_QUEUE_RINGSIZE)
+#define FQ_MAX_QUEUES 1024
+#define FQ_BITMAP_WORDS (FQ_MAX_QUEUES / 64)
+#define FQ_MAX_PROFILES 16
+#define FQ_DEFAULT_QUEUE_SIZE 1024
+/* Packets taken off a queue ring at once by the tx thread */
+#define FQ_STAGE_SIZE 32
+/* Bytes added to a queue's deficit every round per unit of weight */
+#define FQ_QUANTUM RTE_ETHER_MAX_LEN
+
+#define FQ_RING_NAME "FQ_%u_%u"
+
+/* Scheduling parameters shared by a group of queues, in the spirit of rte_sched subport/pipe profiles */
+struct fairqueue_profile {
+        uint32_t weight;  // share of the link relative to the other queues
+        uint64_t rate;    // bytes per second, 0 for no limit
+        uint64_t burst;   // bytes the queue may send back to back when under its rate
+};
 
 /* Structure of each queue */
 struct fairqueue_queue {
-        uint32_t head;                                          // head of the queue
-        uint32_t tail;                                          // tail of the queue
-        struct rte_mbuf **pkts;                                 // array of packet pointers
-        rte_spinlock_t lock;                                    // lock to access the queue
-        uint64_t rx, rx_last, tx, tx_last;                      // maintaining stats
-        uint64_t rx_drop, tx_drop, rx_drop_last, tx_drop_last;  // maintaining stats
+        struct rte_ring *ring;  // SPSC ring from the rx thread to the tx thread
+
+        /* Only touched by the tx thread */
+        struct rte_mbuf *stage[FQ_STAGE_SIZE];  // packets taken off the ring that were not sent yet
+        uint16_t stage_pos;
+        uint16_t stage_count;
+        uint32_t quantum;   // bytes added to the deficit every round
+        uint32_t deficit;   // bytes the queue can still send this round
+        uint64_t rate;      // token bucket rate in bytes per second, 0 if unlimited
+        uint64_t burst;     // token bucket size in bytes
+        uint64_t tokens;    // bytes the queue can send before it is rate limited
+        uint64_t tb_time;   // tsc of the last token bucket refill
+        uint64_t tb_frac;   // bytes * tsc hz earned since the last refill that don't make a whole byte yet
+        uint64_t tx, tx_last, tx_drop, tx_drop_last;  // maintaining stats
+
+        /* Only touched by the rx thread, on its own cache line */
+        uint64_t rx __rte_cache_aligned;
+        uint64_t rx_last, rx_drop, rx_drop_last;  // maintaining stats
 };
 
 /* Fair queue structure */
 struct fairqueue_t {
         struct fairqueue_queue **fq;  // pointer to each queue
         uint16_t num_queues;          // number of queues
+
+        /* DRR position of the tx thread */
+        uint16_t cur_qid;
+        uint8_t in_service;
+
+        /* Bit per queue that may hold packets, set by the rx thread and cleared by the tx thread */
+        uint64_t active[FQ_BITMAP_WORDS] __rte_cache_aligned;
 };
 
 /*
  * Allocate memory to the fairqueue_t structure and initialize the variables.
+ * queue_profile[i] is the index in profiles of the parameters for queue i.
  */
 static int
-setup_fairqueue(struct fairqueue_t **fairqueue, uint16_t num_queues) {
+setup_fairqueue(struct fairqueue_t **fairqueue, uint16_t num_queues, uint16_t instance_id, unsigned queue_size,
+                const struct fairqueue_profile *profiles, const uint8_t *queue_profile) {
+        const struct fairqueue_profile *profile;
+        char ring_name[RTE_RING_NAMESIZE];
         uint16_t i;
 
-        *fairqueue = (struct fairqueue_t *)rte_malloc(NULL, sizeof(struct fairqueue_t), 0);
+        if (num_queues == 0 || num_queues > FQ_MAX_QUEUES) {
+                rte_exit(EXIT_FAILURE, "Number of queues must be between 1 and %d.\n", FQ_MAX_QUEUES);
+        }
+
+        *fairqueue = (struct fairqueue_t *)rte_zmalloc(NULL, sizeof(struct fairqueue_t), RTE_CACHE_LINE_SIZE);
         if ((*fairqueue) == NULL) {
                 rte_exit(EXIT_FAILURE, "Unable to allocate memory for fair queue structure.\n");
         }
 
         (*fairqueue)->fq =
-            (struct fairqueue_queue **)rte_malloc(NULL, sizeof(struct fairqueue_queue *) * num_queues, 0);
+            (struct fairqueue_queue **)rte_zmalloc(NULL, sizeof(struct fairqueue_queue *) * num_queues, 0);
         if ((*fairqueue)->fq == NULL) {
-                rte_free(*fairqueue);
                 rte_exit(EXIT_FAILURE, "Unable to allocate memory for fair queue pointers.\n");
         }
 
         (*fairqueue)->num_queues = num_queues;
 
         for (i = 0; i < num_queues; i++) {
-                (*fairqueue)->fq[i] = (struct fairqueue_queue *)rte_malloc(NULL, sizeof(struct fairqueue_queue), 0);
-                if ((*fairqueue)->fq[i] == NULL) {
-                        for (uint16_t j = 0; j < i; j++) {
-                                rte_free((*fairqueue)->fq[j]);
-                        }
-                        rte_free((*fairqueue)->fq);
-                        rte_free(*fairqueue);
+                struct fairqueue_queue *fq;
+
+                fq = (struct fairqueue_queue *)rte_zmalloc(NULL, sizeof(struct fairqueue_queue), RTE_CACHE_LINE_SIZE);
+                if (fq == NULL) {
                         rte_exit(EXIT_FAILURE, "Unable to allocate memory for queue %d.\n", i + 1);
                 }
-                struct fairqueue_queue *fq = (*fairqueue)->fq[i];
+                (*fairqueue)->fq[i] = fq;
 
-                fq->pkts = (struct rte_mbuf **)rte_malloc(NULL, sizeof(struct rte_mbuf *) * QUEUE_SIZE, 0);
-                if (fq->pkts == NULL) {
-                        for (uint16_t j = 0; j < i; j++) {
-                                rte_free((*fairqueue)->fq[j]);
-                        }
-                        rte_free((*fairqueue)->fq[i]);
-                        rte_free((*fairqueue)->fq);
-                        rte_free(*fairqueue);
+                snprintf(ring_name, sizeof(ring_name), FQ_RING_NAME, instance_id, i);
+                fq->ring = rte_ring_create(ring_name, queue_size, rte_socket_id(), RING_F_SP_ENQ | RING_F_SC_DEQ);
+                if (fq->ring == NULL) {
                         rte_exit(EXIT_FAILURE, "Unable to create queue %d.\n", i + 1);
                 }
-                fq->head = 0;
-                fq->tail = 0;
-                rte_spinlock_init(&fq->lock);
-
-                fq->rx = 0;
-                fq->rx_last = 0;
-                fq->tx = 0;
-                fq->tx_last = 0;
-                fq->rx_drop = 0;
-                fq->rx_drop_last = 0;
-                fq->tx_drop = 0;
-                fq->tx_drop_last = 0;
+
+                profile = &profiles[queue_profile[i]];
+                fq->quantum = profile->weight * FQ_QUANTUM;
+                fq->rate = profile->rate;
+                fq->burst = profile->burst;
+                fq->tokens = profile->burst;
+                fq->tb_time = rte_get_tsc_cycles();
         }
         return 0;
 }
 
 /*
- * Free memory allocated to the fairqueue_t struct.
+ * Free memory allocated to the fairqueue_t struct, packets still queued are freed.
  */
 static int
 destroy_fairqueue(struct fairqueue_t **fairqueue) {
+        struct fairqueue_queue *fq;
+        struct rte_mbuf *pkt;
         uint16_t i;
 
         if ((*fairqueue) == NULL) {
@@ -135,8 +166,13 @@ destroy_fairqueue(struct fairqueue_t **fairqueue) {
         }
 
         for (i = 0; i < (*fairqueue)->num_queues; i++) {
-                rte_free((*fairqueue)->fq[i]->pkts);
-                rte_free((*fairqueue)->fq[i]);
+                fq = (*fairqueue)->fq[i];
+                while (fq->stage_pos < fq->stage_count)
+                        rte_pktmbuf_free(fq->stage[fq->stage_pos++]);
+                while (rte_ring_sc_dequeue(fq->ring, (void **)&pkt) == 0)
+                        rte_pktmbuf_free(pkt);
+                rte_ring_free(fq->ring);
+                rte_free(fq);
         }
         rte_free((*fairqueue)->fq);
         rte_free(*fairqueue);
@@ -148,7 +184,7 @@ destroy_fairqueue(struct fairqueue_t **fairqueue) {
  * Classify the incoming pkts based on the 5-tuple from the pkt header
  * (src IP, dst IP, src port, dst port, protocol)
  * into the queues of the fairqueue_t struct.
- * Internally called by `fairqueue_enqueue`.
+ * Internally called by `fairqueue_enqueue_burst`.
  */
 static int
 get_enqueue_qid(struct fairqueue_t *fairqueue, struct rte_mbuf *pkt) {
@@ -159,7 +195,6 @@ get_enqueue_qid(struct fairqueue_t *fairqueue, struct rte_mbuf *pkt) {
         /* Obtain the 5-tuple values */
         ret = onvm_ft_fill_key(&key, pkt);
         if (ret < 0) {
-                printf("Received a non-IP4 packet!\n");
                 return -1;
         }
 
@@ -175,87 +210,173 @@ get_enqueue_qid(struct fairqueue_t *fairqueue, struct rte_mbuf *pkt) {
 }
 
 /*
- * Enqueue pkt to one of the queues of the fairqueue_t struct.
+ * Enqueue a burst of pkts to the queues of the fairqueue_t struct. Only called from the rx thread.
+ * Packets that could not be queued are stored in drops, returns how many there are.
  */
-static int
-fairqueue_enqueue(struct fairqueue_t *fairqueue, struct rte_mbuf *pkt) {
-        int qid;
+static uint16_t
+fairqueue_enqueue_burst(struct fairqueue_t *fairqueue, struct rte_mbuf **pkts, uint16_t count,
+                        struct rte_mbuf **drops) {
+        uint64_t touched[FQ_BITMAP_WORDS] = {0};
         struct fairqueue_queue *fq;
+        uint16_t i, nb_drops;
+        int qid;
 
-        qid = get_enqueue_qid(fairqueue, pkt);
-        if (qid == -1) {
-                return -1;
-        }
-        fq = fairqueue->fq[qid];
+        nb_drops = 0;
+        for (i = 0; i < count; i++) {
+                qid = get_enqueue_qid(fairqueue, pkts[i]);
+                if (qid == -1) {
+                        drops[nb_drops++] = pkts[i];
+                        continue;
+                }
+                fq = fairqueue->fq[qid];
 
-        rte_spinlock_lock(&fq->lock);
-        if (fq->head == fq->tail && fq->pkts[fq->head] != NULL) {
-                fq->rx_drop += 1;
-                return -1;
+                if (rte_ring_sp_enqueue(fq->ring, pkts[i]) != 0) {
+                        fq->rx_drop += 1;
+                        drops[nb_drops++] = pkts[i];
+                        continue;
+                }
+                fq->rx += 1;
+                touched[qid / 64] |= 1ULL << (qid % 64);
         }
-        fq->pkts[fq->tail] = pkt;
-        fq->tail = (fq->tail + 1) % QUEUE_SIZE;
-        rte_spinlock_unlock(&fq->lock);
 
-        fq->rx += 1;
+        /* Publish once per burst, the atomic also orders the ring enqueues before the bitmap update */
+        for (i = 0; i < FQ_BITMAP_WORDS; i++) {
+                if (touched[i] != 0)
+                        __atomic_fetch_or(&fairqueue->active[i], touched[i], __ATOMIC_SEQ_CST);
+        }
 
-        return 0;
+        return nb_drops;
 }
 
 /*
- * Iterates through each queue atmost once and stops on finding a non-empty queue.
- * Return the queue_id if queue isn't empty.
- * Return -1 otherwise.
- * Internally called by `fairqueue_dequeue`.
+ * Find the first queue at or after qid, wrapping around, that has its active bit set.
+ * Return -1 if no queue is active.
  */
-static int
-get_dequeue_qid(struct fairqueue_t *fairqueue) {
-        static uint16_t qid = 0;
-        uint16_t start_qid;
-        struct fairqueue_queue *fq;
-
-        start_qid = qid;
-        do {
-                fq = fairqueue->fq[qid];
-
-                if (fq->pkts[fq->head] == NULL) {
-                        qid = (qid + 1) % fairqueue->num_queues;
-                        continue;
-                }
-
-                uint16_t temp_qid = qid;
-                qid = (qid + 1) % fairqueue->num_queues;
-                return temp_qid;
-        } while (qid != start_qid);
+static inline int
+get_next_active_qid(struct fairqueue_t *fairqueue, uint16_t qid) {
+        uint16_t num_words, word, i;
+        uint64_t bits;
+
+        num_words = (fairqueue->num_queues + 63) / 64;
+        word = qid / 64;
+        bits = __atomic_load_n(&fairqueue->active[word], __ATOMIC_ACQUIRE) & (~0ULL << (qid % 64));
+        for (i = 0; i <= num_words; i++) {
+                if (bits != 0)
+                        return word * 64 + __builtin_ctzll(bits);
+                word = (word + 1) % num_words;
+                bits = __atomic_load_n(&fairqueue->active[word], __ATOMIC_ACQUIRE);
+        }
 
         return -1;
 }
 
 /*
- * Dequeue pkt from the fairqueue_t queues in a round robin fashion.
+ * Clear the active bit of an empty queue. The rx thread may have queued a packet after the queue
+ * was seen empty, so check again once the bit is cleared.
  */
-static int
-fairqueue_dequeue(struct fairqueue_t *fairqueue, struct rte_mbuf **pkt) {
-        int qid;
-        struct fairqueue_queue *fq;
+static inline void
+clear_active_qid(struct fairqueue_t *fairqueue, uint16_t qid) {
+        uint64_t bit = 1ULL << (qid % 64);
 
-        qid = get_dequeue_qid(fairqueue);
+        __atomic_fetch_and(&fairqueue->active[qid / 64], ~bit, __ATOMIC_SEQ_CST);
+        if (!rte_ring_empty(fairqueue->fq[qid]->ring))
+                __atomic_fetch_or(&fairqueue->active[qid / 64], bit, __ATOMIC_SEQ_CST);
+}
 
-        if (qid == -1) {
-                *pkt = NULL;
-                return -1;
+/*
+ * Return the packet at the head of a queue without removing it, or NULL if the queue is empty.
+ */
+static inline struct rte_mbuf *
+fairqueue_peek(struct fairqueue_queue *fq) {
+        if (fq->stage_pos == fq->stage_count) {
+                fq->stage_pos = 0;
+                fq->stage_count = rte_ring_sc_dequeue_burst(fq->ring, (void **)fq->stage, FQ_STAGE_SIZE, NULL);
+                if (fq->stage_count == 0)
+                        return NULL;
+        }
+        return fq->stage[fq->stage_pos];
+}
+
+/*
+ * Refill the token bucket of a rate limited queue and check if it may send len bytes.
+ */
+static inline int
+fairqueue_conform(struct fairqueue_queue *fq, uint32_t len) {
+        uint64_t now, elapsed, credit, hz;
+
+        if (fq->rate == 0)
+                return 1;
+
+        if (fq->tokens < len) {
+                hz = rte_get_tsc_hz();
+                now = rte_get_tsc_cycles();
+                /* The bucket is full after a second at most, which also keeps the product from overflowing */
+                elapsed = RTE_MIN(now - fq->tb_time, hz);
+                fq->tb_time = now;
+                /* Short polls earn less than a byte, the remainder carries over so no cycle goes uncredited */
+                credit = elapsed * fq->rate + fq->tb_frac;
+                fq->tokens += credit / hz;
+                fq->tb_frac = credit % hz;
+                if (fq->tokens >= fq->burst) {
+                        fq->tokens = fq->burst;
+                        fq->tb_frac = 0;
+                }
+                if (fq->tokens < len)
+                        return 0;
         }
+        fq->tokens -= len;
+        return 1;
+}
+
+/*
+ * Dequeue up to max pkts from the fairqueue_t queues with deficit round robin over the packet
+ * bytes, so queues with a higher weight get a proportionally larger share. Only called from
+ * the tx thread. Returns the number of pkts dequeued.
+ */
+static uint16_t
+fairqueue_dequeue_burst(struct fairqueue_t *fairqueue, struct rte_mbuf **pkts, uint16_t max) {
+        struct fairqueue_queue *fq;
+        struct rte_mbuf *pkt;
+        uint16_t nb_pkts, idle;
+        int qid;
 
-        fq = fairqueue->fq[qid];
+        nb_pkts = 0;
+        idle = 0;
+        /* Give up after visiting every queue once without sending, e.g. when all are rate limited */
+        while (nb_pkts < max && idle <= fairqueue->num_queues) {
+                if (!fairqueue->in_service) {
+                        qid = get_next_active_qid(fairqueue, fairqueue->cur_qid);
+                        if (qid == -1)
+                                break;
+                        fairqueue->cur_qid = qid;
+                        fairqueue->in_service = 1;
+                        fairqueue->fq[qid]->deficit += fairqueue->fq[qid]->quantum;
+                        idle++;
+                }
 
-        /* Dequeue pkt */
-        rte_spinlock_lock(&fq->lock);
-        *pkt = fq->pkts[fq->head];
-        fq->pkts[fq->head] = NULL;
-        fq->head = (fq->head + 1) % QUEUE_SIZE;
-        rte_spinlock_unlock(&fq->lock);
+                fq = fairqueue->fq[fairqueue->cur_qid];
+                pkt = fairqueue_peek(fq);
+                if (pkt == NULL) {
+                        /* An empty queue does not keep its deficit for the next round */
+                        fq->deficit = 0;
+                        clear_active_qid(fairqueue, fairqueue->cur_qid);
+                } else if (pkt->pkt_len <= fq->deficit) {
+                        if (fairqueue_conform(fq, pkt->pkt_len)) {
+                                fq->deficit -= pkt->pkt_len;
+                                fq->stage_pos++;
+                                fq->tx += 1;
+                                pkts[nb_pkts++] = pkt;
+                                idle = 0;
+                                continue;
+                        }
+                        /* Rate limited, the deficit must not keep growing until tokens arrive */
+                        fq->deficit = 0;
+                }
 
-        fq->tx += 1;
+                /* Move on to the next queue */
+                fairqueue->cur_qid = (fairqueue->cur_qid + 1) % fairqueue->num_queues;
+                fairqueue->in_service = 0;
+        }
 
-        return 0;
+        return nb_pkts;
 }
@@ -46,19 +46,24 @@
 #include <inttypes.h>
 #include <limits.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/queue.h>
+#include <sys/stat.h>
 #include <stdlib.h>
 #include <getopt.h>
 #include <string.h>
 #include "cJSON.h"
 
 #include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_errno.h>
 #include <rte_mbuf.h>
 #include <rte_ip.h>
 #include <rte_malloc.h>
 
-#include <rte_lpm.h>
+#include <rte_acl.h>
 
 #include "onvm_nflib.h"
 #include "onvm_pkt_helper.h"
@@ -66,18 +71,28 @@
 
 #define NF_TAG "firewall"
 
-#define MAX_RULES 256
-#define NUM_TBLS 8
+/* Most packets classified in one call */
+#define FW_BURST_SIZE 32
+/* Seconds between checks of the rules file for changes */
+#define FW_RELOAD_INTERVAL 1
+
+#define FW_ACTION_ACCEPT 0
+#define FW_ACTION_DROP 1
 
 static uint16_t destination;
 static int debug = 0;
 char *rule_file = NULL;
+static int socket_id;
+
+/* Rule set the packet handler classifies with, only ever touched by the NF thread */
+static struct fw_ruleset *active_rules;
+/* Handoff with the reload thread: a new rule set to switch to, and the old one to free */
+static struct fw_ruleset *volatile pending_rules = NULL;
+static struct fw_ruleset *volatile retired_rules = NULL;
+static volatile int reload_running = 1;
+static pthread_t reload_thread;
 
-/* Structs that contain information to setup LPM and its rules */
-struct lpm_request *firewall_req;
 static struct firewall_pkt_stats stats;
-struct rte_lpm *lpm_tbl;
-struct onvm_fw_rule **rules;
 
 /* Number of packets between each print */
 static uint32_t print_delay = 10000000;
@@ -85,19 +100,97 @@ static uint32_t print_delay = 10000000;
 /* Shared data structure containing host port info */
 extern struct port_info *ports;
 
-/* Struct for the firewall LPM rules */
+/* Struct for a firewall rule, a missing field in the rules file matches anything */
 struct onvm_fw_rule {
         uint32_t src_ip;
-        uint8_t depth;
+        uint8_t src_depth;
+        uint32_t dst_ip;
+        uint8_t dst_depth;
+        uint16_t src_port_lo;
+        uint16_t src_port_hi;
+        uint16_t dst_port_lo;
+        uint16_t dst_port_hi;
+        uint8_t proto;
+        uint8_t proto_mask;
+        int32_t priority;
         uint8_t action;
+        uint16_t destination;
 };
 
+/* Compiled classifier and the rules it was built from, the ACL userdata is the rule index plus one */
+struct fw_ruleset {
+        struct rte_acl_ctx *acx;
+        struct onvm_fw_rule *rules;
+        int num_rules;
+};
+
+/* Classifier input, values are kept in network byte order as on the wire */
+struct fw_acl_key {
+        uint8_t proto;
+        uint8_t pad[3];
+        uint32_t src_addr;
+        uint32_t dst_addr;
+        uint16_t src_port;
+        uint16_t dst_port;
+};
+
+enum {
+        FW_FIELD_PROTO,
+        FW_FIELD_SRC,
+        FW_FIELD_DST,
+        FW_FIELD_SRC_PORT,
+        FW_FIELD_DST_PORT,
+        FW_NUM_FIELDS
+};
+
+/* rte_acl reads its input 4 bytes at a time, both ports share one input */
+static struct rte_acl_field_def fw_acl_defs[FW_NUM_FIELDS] = {
+        {
+                .type = RTE_ACL_FIELD_TYPE_BITMASK,
+                .size = sizeof(uint8_t),
+                .field_index = FW_FIELD_PROTO,
+                .input_index = 0,
+                .offset = offsetof(struct fw_acl_key, proto),
+        },
+        {
+                .type = RTE_ACL_FIELD_TYPE_MASK,
+                .size = sizeof(uint32_t),
+                .field_index = FW_FIELD_SRC,
+                .input_index = 1,
+                .offset = offsetof(struct fw_acl_key, src_addr),
+        },
+        {
+                .type = RTE_ACL_FIELD_TYPE_MASK,
+                .size = sizeof(uint32_t),
+                .field_index = FW_FIELD_DST,
+                .input_index = 2,
+                .offset = offsetof(struct fw_acl_key, dst_addr),
+        },
+        {
+                .type = RTE_ACL_FIELD_TYPE_RANGE,
+                .size = sizeof(uint16_t),
+                .field_index = FW_FIELD_SRC_PORT,
+                .input_index = 3,
+                .offset = offsetof(struct fw_acl_key, src_port),
+        },
+        {
+                .type = RTE_ACL_FIELD_TYPE_RANGE,
+                .size = sizeof(uint16_t),
+                .field_index = FW_FIELD_DST_PORT,
+                .input_index = 3,
+                .offset = offsetof(struct fw_acl_key, dst_port),
+        },
+};
+
+RTE_ACL_RULE_DEF(fw_acl_rule, FW_NUM_FIELDS);
+
 /* Struct for printing stats */
 struct firewall_pkt_stats {
         uint64_t pkt_drop;
         uint64_t pkt_accept;
         uint64_t pkt_not_ipv4;
         uint64_t pkt_total;
+        uint64_t reloads;
 };
 
 /*
@@ -111,7 +204,8 @@ usage(const char *progname) {
         printf(" - `-p PRINT_DELAY`: Number of packets between each print, e.g. `-p 1` prints every packets.\n");
         printf(" - `-b`: Debug mode: Print each incoming packets source/destination"
                " IP address as well as its drop/forward status\n");
-        printf(" - `-f`: Path to a JSON file containing firewall rules; See README for example usage\n");
+        printf(" - `-f`: Path to a JSON file containing firewall rules, reloaded when it changes; "
+               "See README for example usage\n");
 }
 
 /*
@@ -186,6 +280,7 @@ do_stats_display(void) {
 
         /* Clear screen and move to top left */
         printf("%s%s", clr, topLeft);
+        printf("Rules: %d (reloaded %lu times)\n", active_rules->num_rules, stats.reloads);
         printf("Packets Dropped: %lu\n", stats.pkt_drop);
         printf("Packets not IPv4: %lu\n", stats.pkt_not_ipv4);
         printf("Packets Accepted: %lu\n", stats.pkt_accept);
@@ -194,169 +289,459 @@ do_stats_display(void) {
         printf("\n\n");
 }
 
-static int
-packet_handler(struct rte_mbuf *pkt, struct onvm_pkt_meta *meta,
-               __attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx) {
-        struct rte_ipv4_hdr *ipv4_hdr;
-        static uint32_t counter = 0;
-        int ret;
-        uint32_t rule = 0;
-        uint32_t track_ip = 0;
-        char ip_string[16];
-
-        if (++counter == print_delay) {
-                do_stats_display();
-                counter = 0;
+/*
+ * Build the classifier input from the IPv4 5 tuple, protocols without ports match with ports 0
+ */
+static inline void
+fw_fill_key(struct fw_acl_key *key, struct rte_ipv4_hdr *ipv4_hdr) {
+        uint16_t *l4_ports;
+
+        key->proto = ipv4_hdr->next_proto_id;
+        key->src_addr = ipv4_hdr->src_addr;
+        key->dst_addr = ipv4_hdr->dst_addr;
+        if (ipv4_hdr->next_proto_id == IP_PROTOCOL_TCP || ipv4_hdr->next_proto_id == IP_PROTOCOL_UDP) {
+                l4_ports = (uint16_t *)((uint8_t *)ipv4_hdr +
+                                        (ipv4_hdr->version_ihl & RTE_IPV4_HDR_IHL_MASK) * RTE_IPV4_IHL_MULTIPLIER);
+                key->src_port = l4_ports[0];
+                key->dst_port = l4_ports[1];
+        } else {
+                key->src_port = 0;
+                key->dst_port = 0;
         }
+}
 
-        stats.pkt_total++;
-
-        if (!onvm_pkt_is_ipv4(pkt)) {
-                if (debug) RTE_LOG(INFO, APP, "Packet received not ipv4\n");
-                stats.pkt_not_ipv4++;
-                meta->action = ONVM_NF_ACTION_DROP;
-                return 0;
+/*
+ * Classify up to FW_BURST_SIZE IPv4 packets with a single lookup. results[i] is the index of the
+ * highest priority matching rule plus one, or 0 when no rule matches.
+ */
+static void
+fw_classify_burst(struct rte_mbuf *pkts[], uint16_t count, uint32_t results[]) {
+        struct fw_acl_key keys[FW_BURST_SIZE];
+        const uint8_t *data[FW_BURST_SIZE];
+        uint16_t i;
+
+        for (i = 0; i < count; i++) {
+                fw_fill_key(&keys[i], onvm_pkt_ipv4_hdr(pkts[i]));
+                data[i] = (const uint8_t *)&keys[i];
         }
+        rte_acl_classify(active_rules->acx, data, results, count, 1);
+}
 
-        ipv4_hdr = onvm_pkt_ipv4_hdr(pkt);
-        ret = rte_lpm_lookup(lpm_tbl, rte_be_to_cpu_32(ipv4_hdr->src_addr), &rule);
+/*
+ * Set the action of an IPv4 packet from the result of its classification
+ */
+static void
+fw_apply_result(struct rte_mbuf *pkt, struct onvm_pkt_meta *meta, uint32_t result) {
+        struct rte_ipv4_hdr *ipv4_hdr;
+        struct onvm_fw_rule *rule;
+        char ip_string[16];
 
-        if (debug) onvm_pkt_parse_char_ip(ip_string, rte_be_to_cpu_32(ipv4_hdr->src_addr));
+        if (debug) {
+                ipv4_hdr = onvm_pkt_ipv4_hdr(pkt);
+                onvm_pkt_parse_char_ip(ip_string, rte_be_to_cpu_32(ipv4_hdr->src_addr));
+        }
 
-        if (ret < 0) {
+        if (result == 0) {
                 meta->action = ONVM_NF_ACTION_DROP;
                 stats.pkt_drop++;
-                if (debug) RTE_LOG(INFO, APP, "Packet from source IP %s has been dropped\n", ip_string);
-                return 0;
+                if (debug) RTE_LOG(INFO, APP, "Packet from source IP %s matched no rule, dropped\n", ip_string);
+                return;
         }
 
-        switch (rule) {
-                case 0:
+        rule = &active_rules->rules[result - 1];
+        switch (rule->action) {
+                case FW_ACTION_ACCEPT:
                         meta->action = ONVM_NF_ACTION_TONF;
-                        meta->destination = destination;
+                        meta->destination = rule->destination;
                         stats.pkt_accept++;
-                        if (debug) RTE_LOG(INFO, APP, "Packet from source IP %s has been accepted\n", ip_string);
+                        if (debug)
+                                RTE_LOG(INFO, APP, "Packet from source IP %s has been accepted by rule %u\n",
+                                        ip_string, result - 1);
                         break;
                 default:
                         meta->action = ONVM_NF_ACTION_DROP;
                         stats.pkt_drop++;
-                        if (debug) RTE_LOG(INFO, APP, "Packet from source IP %s has been dropped\n", ip_string);
+                        if (debug)
+                                RTE_LOG(INFO, APP, "Packet from source IP %s has been dropped by rule %u\n",
+                                        ip_string, result - 1);
                         break;
         }
+}
 
-        return 0;
+/*
+ * Classify the whole burst with one ACL lookup, packets that aren't IPv4 are dropped before it
+ */
+static uint16_t
+packet_bulk_handler(struct rte_mbuf **pkts, uint16_t nb_pkts,
+                    __attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx) {
+        struct rte_mbuf *ipv4_pkts[FW_BURST_SIZE];
+        uint32_t results[FW_BURST_SIZE];
+        static uint32_t counter = 0;
+        uint16_t done, n, count, i;
+
+        for (done = 0; done < nb_pkts; done += n) {
+                n = RTE_MIN(nb_pkts - done, FW_BURST_SIZE);
+                count = 0;
+                for (i = done; i < done + n; i++) {
+                        onvm_pkt_prefetch_ahead(pkts, i, nb_pkts);
+                        if (++counter == print_delay) {
+                                do_stats_display();
+                                counter = 0;
+                        }
+
+                        stats.pkt_total++;
+
+                        if (!onvm_pkt_is_ipv4(pkts[i])) {
+                                if (debug) RTE_LOG(INFO, APP, "Packet received not ipv4\n");
+                                stats.pkt_not_ipv4++;
+                                onvm_get_pkt_meta(pkts[i])->action = ONVM_NF_ACTION_DROP;
+                                continue;
+                        }
+                        ipv4_pkts[count++] = pkts[i];
+                }
+
+                if (count == 0)
+                        continue;
+                fw_classify_burst(ipv4_pkts, count, results);
+                for (i = 0; i < count; i++)
+                        fw_apply_result(ipv4_pkts[i], onvm_get_pkt_meta(ipv4_pkts[i]), results[i]);
+        }
+
+        return nb_pkts;
 }
 
+/*
+ * Switch to a rule set built by the reload thread, this runs between bursts so no packet
+ * is classified against a rule set that is being freed
+ */
 static int
-lpm_setup(struct onvm_fw_rule **rules, int num_rules) {
-        int i, status, ret;
-        uint32_t ip;
-        char name[64];
-        char ip_string[16];
+callback_handler(__attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx) {
+        struct fw_ruleset *next = pending_rules;
+
+        if (unlikely(next != NULL)) {
+                retired_rules = active_rules;
+                active_rules = next;
+                rte_smp_wmb();
+                pending_rules = NULL;
+                stats.reloads++;
+                RTE_LOG(INFO, APP, "Switched to %d firewall rules\n", next->num_rules);
+        }
+
+        return 0;
+}
 
-        firewall_req = (struct lpm_request *) rte_malloc(NULL, sizeof(struct lpm_request), 0);
+static void
+fw_ruleset_free(struct fw_ruleset *set) {
+        if (set == NULL)
+                return;
+        if (set->acx)
+                rte_acl_free(set->acx);
+        free(set->rules);
+        free(set);
+}
 
-        if (!firewall_req) return 0;
+/*
+ * Compile the rules into a new ACL context
+ */
+static int
+fw_ruleset_build(struct fw_ruleset *set) {
+        struct rte_acl_param param;
+        struct rte_acl_config cfg;
+        struct fw_acl_rule *acl_rules;
+        struct onvm_fw_rule *rule;
+        char name[RTE_ACL_NAMESIZE];
+        int i, ret;
+
+        snprintf(name, sizeof(name), "fw%d-%" PRIu64, getpid(), rte_get_tsc_cycles());
+        memset(&param, 0, sizeof(param));
+        param.name = name;
+        param.socket_id = socket_id;
+        param.rule_size = RTE_ACL_RULE_SZ(FW_NUM_FIELDS);
+        param.max_rule_num = set->num_rules;
+
+        set->acx = rte_acl_create(&param);
+        if (set->acx == NULL) {
+                RTE_LOG(ERR, APP, "Cannot create ACL context for firewall\n");
+                return -1;
+        }
 
-        snprintf(name, sizeof(name), "fw%d-%"PRIu64, rte_lcore_id(), rte_get_tsc_cycles());
-        firewall_req->max_num_rules = 1024;
-        firewall_req->num_tbl8s = 24;
-        firewall_req->socket_id = rte_socket_id();
-        snprintf(firewall_req->name, sizeof(name), "%s", name);
-        status = onvm_nflib_request_lpm(firewall_req);
+        acl_rules = calloc(set->num_rules, sizeof(struct fw_acl_rule));
+        if (acl_rules == NULL)
+                return -1;
 
-        if (status < 0) {
-                rte_exit(EXIT_FAILURE, "Cannot get lpm region for firewall\n");
+        for (i = 0; i < set->num_rules; i++) {
+                rule = &set->rules[i];
+                acl_rules[i].data.category_mask = 1;
+                acl_rules[i].data.priority = rule->priority;
+                acl_rules[i].data.userdata = i + 1;
+                acl_rules[i].field[FW_FIELD_PROTO].value.u8 = rule->proto;
+                acl_rules[i].field[FW_FIELD_PROTO].mask_range.u8 = rule->proto_mask;
+                acl_rules[i].field[FW_FIELD_SRC].value.u32 = rule->src_ip;
+                acl_rules[i].field[FW_FIELD_SRC].mask_range.u32 = rule->src_depth;
+                acl_rules[i].field[FW_FIELD_DST].value.u32 = rule->dst_ip;
+                acl_rules[i].field[FW_FIELD_DST].mask_range.u32 = rule->dst_depth;
+                acl_rules[i].field[FW_FIELD_SRC_PORT].value.u16 = rule->src_port_lo;
+                acl_rules[i].field[FW_FIELD_SRC_PORT].mask_range.u16 = rule->src_port_hi;
+                acl_rules[i].field[FW_FIELD_DST_PORT].value.u16 = rule->dst_port_lo;
+                acl_rules[i].field[FW_FIELD_DST_PORT].mask_range.u16 = rule->dst_port_hi;
         }
 
-        lpm_tbl = rte_lpm_find_existing(name);
+        ret = rte_acl_add_rules(set->acx, (struct rte_acl_rule *)acl_rules, set->num_rules);
+        free(acl_rules);
+        if (ret < 0) {
+                RTE_LOG(ERR, APP, "Cannot add firewall rules to the ACL context: %s\n", rte_strerror(-ret));
+                return -1;
+        }
 
-        if (lpm_tbl == NULL) {
-                printf("No existing LPM_TBL\n");
+        memset(&cfg, 0, sizeof(cfg));
+        cfg.num_categories = 1;
+        cfg.num_fields = FW_NUM_FIELDS;
+        memcpy(cfg.defs, fw_acl_defs, sizeof(fw_acl_defs));
+        ret = rte_acl_build(set->acx, &cfg);
+        if (ret < 0) {
+                RTE_LOG(ERR, APP, "Cannot build the firewall ACL: %s\n", rte_strerror(-ret));
+                return -1;
         }
 
-        for (i = 0; i < num_rules; ++i) {
-                ip = rules[i]->src_ip;
-                onvm_pkt_parse_char_ip(ip_string, ip);
-                printf("RULE %d: { ip: %s, depth: %d, action: %d }\n", i, ip_string, rules[i]->depth, rules[i]->action);
-                ret = rte_lpm_add(lpm_tbl, rules[i]->src_ip, rules[i]->depth, rules[i]->action);
-                if (ret < 0) {
-                        printf("ERROR ADDING RULE %d\n", ret);
-                        return 1;
-                }
+        return 0;
+}
+
+/*
+ * Read an IP prefix, falling back to the wildcard 0/0 when the rule does not have one
+ */
+static int
+parse_rule_prefix(cJSON *rule_json, const char *ip_name, const char *depth_name, uint32_t *ip, uint8_t *depth) {
+        cJSON *ip_json = cJSON_GetObjectItem(rule_json, ip_name);
+        cJSON *depth_json = cJSON_GetObjectItem(rule_json, depth_name);
+
+        *ip = 0;
+        *depth = 0;
+        if (ip_json == NULL)
+                return 0;
+        if (!cJSON_IsString(ip_json) || onvm_pkt_parse_ip(ip_json->valuestring, ip) < 0)
+                return -1;
+        *depth = 32;
+        if (depth_json != NULL) {
+                if (!cJSON_IsNumber(depth_json) || depth_json->valueint < 0 || depth_json->valueint > 32)
+                        return -1;
+                *depth = depth_json->valueint;
         }
-        rte_free(firewall_req);
+        return 0;
+}
+
+/*
+ * Read a port given either as a single number or as an inclusive [low, high] pair
+ */
+static int
+parse_rule_ports(cJSON *rule_json, const char *name, uint16_t *lo, uint16_t *hi) {
+        cJSON *port_json = cJSON_GetObjectItem(rule_json, name);
+        cJSON *lo_json, *hi_json;
 
+        *lo = 0;
+        *hi = UINT16_MAX;
+        if (port_json == NULL)
+                return 0;
+        if (cJSON_IsNumber(port_json)) {
+                lo_json = hi_json = port_json;
+        } else if (cJSON_IsArray(port_json) && cJSON_GetArraySize(port_json) == 2) {
+                lo_json = cJSON_GetArrayItem(port_json, 0);
+                hi_json = cJSON_GetArrayItem(port_json, 1);
+                if (!cJSON_IsNumber(lo_json) || !cJSON_IsNumber(hi_json))
+                        return -1;
+        } else {
+                return -1;
+        }
+        if (lo_json->valueint < 0 || hi_json->valueint > UINT16_MAX || lo_json->valueint > hi_json->valueint)
+                return -1;
+        *lo = lo_json->valueint;
+        *hi = hi_json->valueint;
         return 0;
 }
 
-static void
-lpm_teardown(struct onvm_fw_rule **rules, int num_rules) {
-        int i;
+static int
+parse_rule(cJSON *rule_json, struct onvm_fw_rule *rule, int default_priority) {
+        cJSON *proto = cJSON_GetObjectItem(rule_json, "proto");
+        cJSON *priority = cJSON_GetObjectItem(rule_json, "priority");
+        cJSON *action = cJSON_GetObjectItem(rule_json, "action");
+        cJSON *dst = cJSON_GetObjectItem(rule_json, "destination");
+        const char *src_ip_name = "src_ip";
+        const char *src_depth_name = "src_depth";
+
+        /* "ip" and "depth" are the source prefix of the original LPM rules */
+        if (cJSON_GetObjectItem(rule_json, "src_ip") == NULL) {
+                src_ip_name = "ip";
+                src_depth_name = "depth";
+        }
+        if (parse_rule_prefix(rule_json, src_ip_name, src_depth_name, &rule->src_ip, &rule->src_depth) < 0 ||
+            parse_rule_prefix(rule_json, "dst_ip", "dst_depth", &rule->dst_ip, &rule->dst_depth) < 0) {
+                RTE_LOG(ERR, APP, "Rule %s: IP not found/invalid\n", rule_json->string);
+                return -1;
+        }
 
-        if (rules) {
-                for (i = 0; i < num_rules; ++i) {
-                        if (rules[i]) free(rules[i]);
+        if (parse_rule_ports(rule_json, "src_port", &rule->src_port_lo, &rule->src_port_hi) < 0 ||
+            parse_rule_ports(rule_json, "dst_port", &rule->dst_port_lo, &rule->dst_port_hi) < 0) {
+                RTE_LOG(ERR, APP, "Rule %s: Port not found/invalid\n", rule_json->string);
+                return -1;
+        }
+
+        rule->proto = 0;
+        rule->proto_mask = 0;
+        if (proto != NULL) {
+                if (!cJSON_IsNumber(proto) || proto->valueint < 0 || proto->valueint > UINT8_MAX) {
+                        RTE_LOG(ERR, APP, "Rule %s: Proto invalid\n", rule_json->string);
+                        return -1;
                 }
-                free(rules);
+                rule->proto = proto->valueint;
+                rule->proto_mask = UINT8_MAX;
         }
 
-        if (lpm_tbl) {
-                rte_lpm_free(lpm_tbl);
+        rule->priority = default_priority;
+        if (priority != NULL) {
+                if (!cJSON_IsNumber(priority) || priority->valueint < RTE_ACL_MIN_PRIORITY ||
+                    priority->valueint > RTE_ACL_MAX_PRIORITY) {
+                        RTE_LOG(ERR, APP, "Rule %s: Priority invalid\n", rule_json->string);
+                        return -1;
+                }
+                rule->priority = priority->valueint;
         }
 
-        if (rule_file) {
-                free(rule_file);
+        if (action == NULL || !cJSON_IsNumber(action)) {
+                RTE_LOG(ERR, APP, "Rule %s: Action not found/invalid\n", rule_json->string);
+                return -1;
+        }
+        rule->action = action->valueint == FW_ACTION_ACCEPT ? FW_ACTION_ACCEPT : FW_ACTION_DROP;
+
+        rule->destination = destination;
+        if (dst != NULL) {
+                if (!cJSON_IsNumber(dst) || dst->valueint < 0 || dst->valueint > UINT16_MAX) {
+                        RTE_LOG(ERR, APP, "Rule %s: Destination invalid\n", rule_json->string);
+                        return -1;
+                }
+                rule->destination = dst->valueint;
         }
-}
 
-struct onvm_fw_rule
-**setup_rules(int *total_rules, char *rules_file) {
-        int ip[4];
-        int num_rules, ret;
-        int i = 0;
+        return 0;
+}
 
-        cJSON *rules_json = onvm_config_parse_file(rules_file);
-        cJSON *rules_ip = NULL;
-        cJSON *depth = NULL;
-        cJSON *action = NULL;
+/*
+ * Parse the rules file and compile it, returns NULL if either fails so a bad edit of the
+ * file never replaces working rules
+ */
+static struct fw_ruleset *
+fw_ruleset_load(char *rules_file) {
+        struct fw_ruleset *set;
+        cJSON *rules_json;
+        cJSON *rule_json;
+        int i;
 
+        rules_json = onvm_config_parse_file(rules_file);
         if (rules_json == NULL) {
-                rte_exit(EXIT_FAILURE, "%s file could not be parsed/not found. Assure rules file"
-                                       " the directory to the rules file is being specified.\n", rules_file);
+                RTE_LOG(ERR, APP, "%s file could not be parsed/not found. Assure rules file"
+                                  " the directory to the rules file is being specified.\n", rules_file);
+                return NULL;
         }
 
-        num_rules = onvm_config_get_item_count(rules_json);
-        *total_rules = num_rules;
-        rules = (struct onvm_fw_rule **) malloc(num_rules * sizeof(struct onvm_fw_rule *));
-        rules_json = rules_json->child;
-
-        while (rules_json != NULL) {
-                rules_ip = cJSON_GetObjectItem(rules_json, "ip");
-                depth = cJSON_GetObjectItem(rules_json, "depth");
-                action = cJSON_GetObjectItem(rules_json, "action");
-
-                if (rules_ip == NULL) rte_exit(EXIT_FAILURE, "IP not found/invalid\n");
-                if (depth == NULL) rte_exit(EXIT_FAILURE, "Depth not found/invalid\n");
-                if (action == NULL) rte_exit(EXIT_FAILURE, "Action not found/invalid\n");
+        set = calloc(1, sizeof(struct fw_ruleset));
+        if (set == NULL) {
+                cJSON_Delete(rules_json);
+                return NULL;
+        }
+        set->num_rules = onvm_config_get_item_count(rules_json);
+        if (set->num_rules == 0) {
+                RTE_LOG(ERR, APP, "%s has no rules\n", rules_file);
+                cJSON_Delete(rules_json);
+                fw_ruleset_free(set);
+                return NULL;
+        }
+        set->rules = calloc(set->num_rules, sizeof(struct onvm_fw_rule));
+        if (set->rules == NULL) {
+                cJSON_Delete(rules_json);
+                fw_ruleset_free(set);
+                return NULL;
+        }
 
-                rules[i] = (struct onvm_fw_rule *) malloc(sizeof(struct onvm_fw_rule));
-                onvm_pkt_parse_ip(rules_ip->valuestring, &rules[i]->src_ip);
-                rules[i]->depth = depth->valueint;
-                rules[i]->action = action->valueint;
-                rules_json = rules_json->next;
+        /* Without explicit priorities the first matching rule in the file wins */
+        i = 0;
+        cJSON_ArrayForEach(rule_json, rules_json) {
+                if (parse_rule(rule_json, &set->rules[i], set->num_rules - i) < 0) {
+                        cJSON_Delete(rules_json);
+                        fw_ruleset_free(set);
+                        return NULL;
+                }
                 i++;
         }
         cJSON_Delete(rules_json);
 
-        return rules;
+        if (fw_ruleset_build(set) < 0) {
+                fw_ruleset_free(set);
+                return NULL;
+        }
+
+        if (debug) {
+                char src_string[16], dst_string[16];
+
+                for (i = 0; i < set->num_rules; i++) {
+                        onvm_pkt_parse_char_ip(src_string, set->rules[i].src_ip);
+                        onvm_pkt_parse_char_ip(dst_string, set->rules[i].dst_ip);
+                        printf("RULE %d: { src: %s/%d, dst: %s/%d, sport: %d-%d, dport: %d-%d, proto: %d, "
+                               "priority: %d, action: %d }\n",
+                               i, src_string, set->rules[i].src_depth, dst_string, set->rules[i].dst_depth,
+                               set->rules[i].src_port_lo, set->rules[i].src_port_hi, set->rules[i].dst_port_lo,
+                               set->rules[i].dst_port_hi, set->rules[i].proto_mask ? set->rules[i].proto : -1,
+                               set->rules[i].priority, set->rules[i].action);
+                }
+        }
+
+        return set;
+}
+
+/*
+ * Watch the rules file and compile a new rule set whenever it changes, the NF thread switches
+ * to it in callback_handler. Compiling large rule sets takes a while, so it is kept off the NF thread.
+ */
+static void *
+fw_reload_thread_main(__attribute__((unused)) void *arg) {
+        struct fw_ruleset *set;
+        struct timespec last_mtime;
+        struct stat st;
+
+        if (stat(rule_file, &st) == 0)
+                last_mtime = st.st_mtim;
+        else
+                memset(&last_mtime, 0, sizeof(last_mtime));
+
+        while (reload_running) {
+                sleep(FW_RELOAD_INTERVAL);
+
+                if (retired_rules != NULL) {
+                        fw_ruleset_free(retired_rules);
+                        retired_rules = NULL;
+                }
+                /* The NF thread has not switched to the last rule set yet */
+                if (pending_rules != NULL)
+                        continue;
+
+                if (stat(rule_file, &st) < 0 ||
+                    (st.st_mtim.tv_sec == last_mtime.tv_sec && st.st_mtim.tv_nsec == last_mtime.tv_nsec))
+                        continue;
+                last_mtime = st.st_mtim;
+
+                set = fw_ruleset_load(rule_file);
+                if (set == NULL) {
+                        RTE_LOG(WARNING, APP, "Keeping the current firewall rules\n");
+                        continue;
+                }
+                rte_smp_wmb();
+                pending_rules = set;
+        }
+
+        return NULL;
 }
 
 int main(int argc, char *argv[]) {
         struct onvm_nf_local_ctx *nf_local_ctx;
         struct onvm_nf_function_table *nf_function_table;
-        struct onvm_fw_rule **rules;
-        int arg_offset, num_rules;
+        int arg_offset;
 
         const char *progname = argv[0];
         stats.pkt_drop = 0;
@@ -366,7 +751,8 @@ int main(int argc, char *argv[]) {
         onvm_nflib_start_signal_handler(nf_local_ctx, NULL);
 
         nf_function_table = onvm_nflib_init_nf_function_table();
-        nf_function_table->pkt_handler = &packet_handler;
+        nf_function_table->pkt_bulk_handler = &packet_bulk_handler;
+        nf_function_table->user_actions = &callback_handler;
 
         if ((arg_offset = onvm_nflib_init(argc, argv, NF_TAG, nf_local_ctx, nf_function_table)) < 0) {
                 onvm_nflib_stop(nf_local_ctx);
@@ -386,11 +772,28 @@ int main(int argc, char *argv[]) {
                 rte_exit(EXIT_FAILURE, "Invalid command-line arguments\n");
         }
 
-        rules = setup_rules(&num_rules, rule_file);
-        lpm_setup(rules, num_rules);
+        socket_id = rte_socket_id();
+        active_rules = fw_ruleset_load(rule_file);
+        if (active_rules == NULL) {
+                onvm_nflib_stop(nf_local_ctx);
+                rte_exit(EXIT_FAILURE, "Cannot load firewall rules from %s\n", rule_file);
+        }
+        RTE_LOG(INFO, APP, "Loaded %d firewall rules\n", active_rules->num_rules);
+
+        if (pthread_create(&reload_thread, NULL, fw_reload_thread_main, NULL) != 0) {
+                onvm_nflib_stop(nf_local_ctx);
+                rte_exit(EXIT_FAILURE, "Cannot start the rules reload thread\n");
+        }
+
         onvm_nflib_run(nf_local_ctx);
 
-        lpm_teardown(rules, num_rules);
+        reload_running = 0;
+        pthread_join(reload_thread, NULL);
+        fw_ruleset_free(active_rules);
+        fw_ruleset_free(pending_rules);
+        fw_ruleset_free(retired_rules);
+        free(rule_file);
+
         onvm_nflib_stop(nf_local_ctx);
         printf("If we reach here, program is ending\n");
         return 0;
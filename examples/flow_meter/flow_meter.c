@@ -0,0 +1,492 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2020 National Institute of Technology Karnataka, Surathkal
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * flow_meter.c - meters packets per flow or per subnet with srTCM/trTCM
+ *      buckets, drops red packets and forwards the rest to a DST NF.
+ ********************************************************************/
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <unistd.h>
+
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_ip.h>
+#include <rte_mbuf.h>
+#include <rte_meter.h>
+
+#include "cJSON.h"
+#include "onvm_config_common.h"
+#include "onvm_meter.h"
+#include "onvm_nflib.h"
+#include "onvm_pkt_helper.h"
+
+#define NF_TAG "flow_meter"
+
+#define PKT_READ_SIZE ((uint16_t)32)
+
+#define DEFAULT_MAX_BUCKETS 65536
+/* Most buckets listed by the per bucket stats */
+#define STATS_MAX_BUCKETS 32
+
+static uint32_t destination;
+static char *config_file = NULL;
+static uint8_t print_stats_flag = 0;
+
+static struct onvm_meter *meter;
+static uint8_t drop_red = 1;
+static uint8_t mark_flag = 0;
+static int8_t color_dscp[RTE_COLORS] = {ONVM_METER_DSCP_KEEP, ONVM_METER_DSCP_KEEP, ONVM_METER_DSCP_KEEP};
+static char *profile_names[ONVM_METER_MAX_PROFILES];
+static uint64_t color_pkts[RTE_COLORS];
+
+static const char *color_names[RTE_COLORS] = {"green", "yellow", "red"};
+
+/* For advanced rings scaling */
+rte_atomic16_t signal_exit_flag;
+
+void
+sig_handler(int sig);
+
+/*
+ * Print a usage message
+ */
+static void
+usage(const char *progname) {
+        printf("Usage:\n");
+        printf("%s [EAL args] -- [NF_LIB args] -- -d <destination> -f <config_file> [-p]\n", progname);
+        printf("%s -F <CONFIG_FILE.json> [EAL args] -- [NF_LIB args] -- [NF args]\n\n", progname);
+        printf("Flags:\n");
+        printf(" - `-d <dst>`: destination service ID to foward to\n");
+        printf(" - `-f <config_file>`: JSON file with the meter profiles and buckets, see README\n");
+        printf(" - `-p`: print per bucket conformance stats every second\n");
+}
+
+/*
+ * Parse the application arguments.
+ */
+static int
+parse_app_args(int argc, char *argv[], const char *progname) {
+        int c, dst_flag = 0;
+
+        while ((c = getopt(argc, argv, "d:f:p")) != -1) {
+                switch (c) {
+                        case 'd':
+                                destination = strtoul(optarg, NULL, 10);
+                                dst_flag = 1;
+                                break;
+                        case 'f':
+                                config_file = optarg;
+                                break;
+                        case 'p':
+                                print_stats_flag = 1;
+                                break;
+                        case '?':
+                                usage(progname);
+                                if (optopt == 'd')
+                                        RTE_LOG(INFO, APP, "Option -%c requires an argument.\n", optopt);
+                                else if (optopt == 'f')
+                                        RTE_LOG(INFO, APP, "Option -%c requires an argument.\n", optopt);
+                                else if (isprint(optopt))
+                                        RTE_LOG(INFO, APP, "Unknown option `-%c'.\n", optopt);
+                                else
+                                        RTE_LOG(INFO, APP, "Unknown option character `\\x%x'.\n", optopt);
+                                return -1;
+                        default:
+                                usage(progname);
+                                return -1;
+                }
+        }
+
+        if (!dst_flag) {
+                RTE_LOG(INFO, APP, "Flow Meter NF requires destination flag -d.\n");
+                return -1;
+        }
+
+        if (config_file == NULL) {
+                RTE_LOG(INFO, APP, "Flow Meter NF requires a config file with -f.\n");
+                return -1;
+        }
+
+        return optind;
+}
+
+static uint64_t
+get_config_u64(cJSON *item, const char *name) {
+        cJSON *value = cJSON_GetObjectItem(item, name);
+
+        return value != NULL && cJSON_IsNumber(value) ? (uint64_t)value->valuedouble : 0;
+}
+
+static int
+find_profile(const char *name) {
+        int i;
+
+        for (i = 0; i < ONVM_METER_MAX_PROFILES && profile_names[i] != NULL; i++) {
+                if (strcmp(profile_names[i], name) == 0)
+                        return i;
+        }
+        return -1;
+}
+
+/*
+ * Add the profiles of the config file to the meter, keeping their names for the buckets
+ */
+static int
+load_profiles(cJSON *profiles) {
+        struct onvm_meter_params params;
+        cJSON *profile, *type;
+        int id;
+
+        cJSON_ArrayForEach(profile, profiles) {
+                type = cJSON_GetObjectItem(profile, "type");
+                memset(&params, 0, sizeof(params));
+                if (type != NULL && cJSON_IsString(type) && strcmp(type->valuestring, "trtcm") == 0) {
+                        params.type = ONVM_METER_TRTCM;
+                        params.trtcm.cir = get_config_u64(profile, "cir");
+                        params.trtcm.pir = get_config_u64(profile, "pir");
+                        params.trtcm.cbs = get_config_u64(profile, "cbs");
+                        params.trtcm.pbs = get_config_u64(profile, "pbs");
+                } else if (type == NULL || (cJSON_IsString(type) && strcmp(type->valuestring, "srtcm") == 0)) {
+                        params.type = ONVM_METER_SRTCM;
+                        params.srtcm.cir = get_config_u64(profile, "cir");
+                        params.srtcm.cbs = get_config_u64(profile, "cbs");
+                        params.srtcm.ebs = get_config_u64(profile, "ebs");
+                } else {
+                        RTE_LOG(INFO, APP, "Profile %s: type must be srtcm or trtcm\n", profile->string);
+                        return -1;
+                }
+
+                id = onvm_meter_add_profile(meter, &params);
+                if (id < 0) {
+                        RTE_LOG(INFO, APP, "Profile %s is invalid: %s\n", profile->string, strerror(-id));
+                        return -1;
+                }
+                profile_names[id] = strdup(profile->string);
+        }
+
+        return 0;
+}
+
+/*
+ * Create the meter from the config file:
+ * { "key": "flow" | "src_subnet" | "dst_subnet", "depth": 24, "max_buckets": 65536,
+ *   "profiles": { "name": { "type": "srtcm", "cir": ..., "cbs": ..., "ebs": ... }, ... },
+ *   "default_profile": "name",
+ *   "buckets": [ { "subnet": "10.0.1.0", "profile": "name" }, ... ],
+ *   "dscp": { "green": 10, "yellow": 12, "red": 14 },
+ *   "drop_red": true }
+ */
+static int
+load_config(char *filename) {
+        enum onvm_meter_key_type key_type;
+        struct onvm_ft_ipv4_5tuple key;
+        cJSON *config, *item, *bucket, *subnet, *profile;
+        int max_buckets, depth, id, i;
+        uint32_t ip;
+
+        config = onvm_config_parse_file(filename);
+        if (config == NULL) {
+                RTE_LOG(INFO, APP, "Could not parse config file %s\n", filename);
+                return -1;
+        }
+
+        key_type = ONVM_METER_KEY_FLOW;
+        item = cJSON_GetObjectItem(config, "key");
+        if (item != NULL && cJSON_IsString(item)) {
+                if (strcmp(item->valuestring, "src_subnet") == 0)
+                        key_type = ONVM_METER_KEY_SRC_SUBNET;
+                else if (strcmp(item->valuestring, "dst_subnet") == 0)
+                        key_type = ONVM_METER_KEY_DST_SUBNET;
+                else if (strcmp(item->valuestring, "flow") != 0) {
+                        RTE_LOG(INFO, APP, "key must be flow, src_subnet or dst_subnet\n");
+                        goto fail;
+                }
+        }
+        item = cJSON_GetObjectItem(config, "depth");
+        depth = item != NULL && cJSON_IsNumber(item) ? item->valueint : 32;
+        item = cJSON_GetObjectItem(config, "max_buckets");
+        max_buckets = item != NULL && cJSON_IsNumber(item) ? item->valueint : DEFAULT_MAX_BUCKETS;
+
+        meter = onvm_meter_create(max_buckets, key_type, depth);
+        if (meter == NULL) {
+                RTE_LOG(INFO, APP, "Could not create a meter with %d buckets\n", max_buckets);
+                goto fail;
+        }
+
+        if (load_profiles(cJSON_GetObjectItem(config, "profiles")) < 0)
+                goto fail;
+
+        item = cJSON_GetObjectItem(config, "default_profile");
+        if (item != NULL) {
+                id = cJSON_IsString(item) ? find_profile(item->valuestring) : -1;
+                if (id < 0) {
+                        RTE_LOG(INFO, APP, "default_profile is not a known profile\n");
+                        goto fail;
+                }
+                onvm_meter_set_default_profile(meter, id);
+        }
+
+        cJSON_ArrayForEach(bucket, cJSON_GetObjectItem(config, "buckets")) {
+                subnet = cJSON_GetObjectItem(bucket, "subnet");
+                profile = cJSON_GetObjectItem(bucket, "profile");
+                if (key_type == ONVM_METER_KEY_FLOW || subnet == NULL || !cJSON_IsString(subnet) ||
+                    onvm_pkt_parse_ip(subnet->valuestring, &ip) < 0) {
+                        RTE_LOG(INFO, APP, "Buckets need a subnet and a subnet key\n");
+                        goto fail;
+                }
+                id = profile != NULL && cJSON_IsString(profile) ? find_profile(profile->valuestring) : -1;
+                if (id < 0) {
+                        RTE_LOG(INFO, APP, "Bucket %s does not have a known profile\n", subnet->valuestring);
+                        goto fail;
+                }
+                onvm_meter_subnet_key(meter, ip, &key);
+                if (onvm_meter_add_bucket(meter, &key, id) < 0) {
+                        RTE_LOG(INFO, APP, "Could not add bucket %s\n", subnet->valuestring);
+                        goto fail;
+                }
+        }
+
+        item = cJSON_GetObjectItem(config, "dscp");
+        for (i = 0; item != NULL && i < RTE_COLORS; i++) {
+                cJSON *dscp = cJSON_GetObjectItem(item, color_names[i]);
+                if (dscp != NULL && cJSON_IsNumber(dscp) && dscp->valueint >= 0 && dscp->valueint < 64) {
+                        color_dscp[i] = dscp->valueint;
+                        mark_flag = 1;
+                }
+        }
+
+        item = cJSON_GetObjectItem(config, "drop_red");
+        if (item != NULL)
+                drop_red = cJSON_IsTrue(item);
+
+        cJSON_Delete(config);
+        return 0;
+
+fail:
+        cJSON_Delete(config);
+        return -1;
+}
+
+/*
+ * This function displays stats. It uses ANSI terminal codes to clear
+ * screen when called. It is called from a single non-master
+ * thread in the server process, when the process is run with more
+ * than one lcore enabled.
+ */
+static void
+do_stats_display(void) {
+        const char clr[] = {27, '[', '2', 'J', '\0'};
+        const char topLeft[] = {27, '[', '1', ';', '1', 'H', '\0'};
+        const struct onvm_ft_ipv4_5tuple *key;
+        struct onvm_meter_bucket *bucket;
+        char ip_string[16];
+        uint32_t next = 0;
+        int shown = 0;
+
+        /* Clear screen and move to top left */
+        printf("%s%s", clr, topLeft);
+
+        printf("METER\n");
+        printf("-----\n");
+        printf("Green     : %" PRIu64 "\n", color_pkts[RTE_COLOR_GREEN]);
+        printf("Yellow    : %" PRIu64 "\n", color_pkts[RTE_COLOR_YELLOW]);
+        printf("Red       : %" PRIu64 "\n", color_pkts[RTE_COLOR_RED]);
+        printf("Unmetered : %" PRIu64 "\n", meter->unmetered);
+        printf("\n");
+
+        printf("%-42s %-10s %12s %12s %12s\n", "BUCKET", "PROFILE", "GREEN", "YELLOW", "RED");
+        while (shown < STATS_MAX_BUCKETS && onvm_meter_iterate(meter, &key, &bucket, &next) >= 0) {
+                if (meter->key_type == ONVM_METER_KEY_SRC_SUBNET) {
+                        onvm_pkt_parse_char_ip(ip_string, rte_be_to_cpu_32(key->src_addr));
+                        printf("%-42s ", ip_string);
+                } else if (meter->key_type == ONVM_METER_KEY_DST_SUBNET) {
+                        onvm_pkt_parse_char_ip(ip_string, rte_be_to_cpu_32(key->dst_addr));
+                        printf("%-42s ", ip_string);
+                } else {
+                        char src_string[16], dst_string[16];
+                        onvm_pkt_parse_char_ip(src_string, rte_be_to_cpu_32(key->src_addr));
+                        onvm_pkt_parse_char_ip(dst_string, rte_be_to_cpu_32(key->dst_addr));
+                        printf("%15s:%-5u %15s:%-5u ", src_string, rte_be_to_cpu_16(key->src_port), dst_string,
+                               rte_be_to_cpu_16(key->dst_port));
+                }
+                printf("%-10s %12" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n", profile_names[bucket->profile_id],
+                       bucket->pkts[RTE_COLOR_GREEN], bucket->pkts[RTE_COLOR_YELLOW], bucket->pkts[RTE_COLOR_RED]);
+                shown++;
+        }
+        printf("\n");
+}
+
+void
+sig_handler(int sig) {
+        if (sig != SIGINT && sig != SIGTERM)
+                return;
+
+        /* Will stop the processing for all spawned threads in advanced rings mode */
+        rte_atomic16_set(&signal_exit_flag, 1);
+}
+
+static int
+thread_main_loop(struct onvm_nf_local_ctx *nf_local_ctx) {
+        struct rte_mbuf *pkts[PKT_READ_SIZE];
+        enum rte_color colors[PKT_READ_SIZE];
+        struct onvm_pkt_meta *meta;
+        uint16_t i, nb_pkts;
+        struct rte_ring *rx_ring;
+        struct rte_ring *msg_q;
+        struct onvm_nf *nf;
+        struct onvm_nf_msg *msg;
+        struct rte_mempool *nf_msg_pool;
+        uint64_t last_print;
+
+        nf = nf_local_ctx->nf;
+
+        onvm_nflib_nf_ready(nf);
+
+        /* Get rings from nflib */
+        rx_ring = nf->rx_q;
+        msg_q = nf->msg_q;
+        nf_msg_pool = rte_mempool_lookup(_NF_MSG_POOL_NAME);
+
+        printf("Process %d handling packets using advanced rings\n", nf->instance_id);
+        if (onvm_threading_core_affinitize(nf->thread_info.core) < 0)
+                rte_exit(EXIT_FAILURE, "Failed to affinitize to core %d\n", nf->thread_info.core);
+
+        last_print = rte_get_tsc_cycles();
+        while (!rte_atomic16_read(&signal_exit_flag)) {
+                /* Check for a stop message from the manager */
+                if (unlikely(rte_ring_count(msg_q) > 0)) {
+                        msg = NULL;
+                        rte_ring_dequeue(msg_q, (void **)(&msg));
+                        if (msg->msg_type == MSG_STOP) {
+                                rte_atomic16_set(&signal_exit_flag, 1);
+                        } else {
+                                printf("Received message %d, ignoring", msg->msg_type);
+                        }
+                        rte_mempool_put(nf_msg_pool, (void *)msg);
+                }
+
+                nb_pkts = rte_ring_dequeue_burst(rx_ring, (void **)pkts, PKT_READ_SIZE, NULL);
+
+                /* Meter the whole burst at once, then act on the colors */
+                onvm_meter_color_burst(meter, pkts, nb_pkts, colors);
+                if (mark_flag)
+                        onvm_meter_mark_burst(pkts, colors, nb_pkts, color_dscp);
+
+                for (i = 0; i < nb_pkts; i++) {
+                        meta = onvm_get_pkt_meta(pkts[i]);
+                        color_pkts[colors[i]]++;
+                        if (colors[i] == RTE_COLOR_RED && drop_red) {
+                                meta->action = ONVM_NF_ACTION_DROP;
+                        } else {
+                                meta->action = ONVM_NF_ACTION_TONF;
+                                meta->destination = destination;
+                        }
+                }
+
+                onvm_pkt_process_tx_batch(nf->nf_tx_mgr, pkts, nb_pkts, nf);
+                if (nb_pkts < PACKET_READ_SIZE) {
+                        onvm_pkt_flush_all_nfs(nf->nf_tx_mgr, nf);
+                }
+
+                if (print_stats_flag && rte_get_tsc_cycles() - last_print > rte_get_tsc_hz()) {
+                        do_stats_display();
+                        last_print = rte_get_tsc_cycles();
+                }
+        }
+        return 0;
+}
+
+int
+main(int argc, char *argv[]) {
+        struct onvm_nf_local_ctx *nf_local_ctx;
+        struct onvm_nf_function_table *nf_function_table;
+        int arg_offset;
+        int i;
+
+        const char *progname = argv[0];
+
+        nf_local_ctx = onvm_nflib_init_nf_local_ctx();
+        /* If we're using advanced rings also pass a custom cleanup function,
+         * this can be used to handle NF specific (non onvm) cleanup logic */
+        rte_atomic16_init(&signal_exit_flag);
+        rte_atomic16_set(&signal_exit_flag, 0);
+        onvm_nflib_start_signal_handler(nf_local_ctx, sig_handler);
+        /* No need to define a function table as adv rings won't run onvm_nflib_run */
+        nf_function_table = NULL;
+
+        if ((arg_offset = onvm_nflib_init(argc, argv, NF_TAG, nf_local_ctx, nf_function_table)) < 0) {
+                onvm_nflib_stop(nf_local_ctx);
+                if (arg_offset == ONVM_SIGNAL_TERMINATION) {
+                        printf("Exiting due to user termination\n");
+                        return 0;
+                } else {
+                        rte_exit(EXIT_FAILURE, "Failed ONVM init\n");
+                }
+        }
+
+        argc -= arg_offset;
+        argv += arg_offset;
+
+        if (parse_app_args(argc, argv, progname) < 0) {
+                onvm_nflib_stop(nf_local_ctx);
+                rte_exit(EXIT_FAILURE, "Invalid command-line arguments\n");
+        }
+
+        if (load_config(config_file) < 0) {
+                onvm_meter_free(meter);
+                onvm_nflib_stop(nf_local_ctx);
+                rte_exit(EXIT_FAILURE, "Invalid meter config\n");
+        }
+
+        thread_main_loop(nf_local_ctx);
+
+        onvm_meter_free(meter);
+        for (i = 0; i < ONVM_METER_MAX_PROFILES; i++) {
+                free(profile_names[i]);
+        }
+        onvm_nflib_stop(nf_local_ctx);
+
+        printf("If we reach here, program is ending\n");
+        return 0;
+}
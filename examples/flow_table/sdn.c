@@ -65,6 +65,7 @@
 #include "onvm_flow_table.h"
 #include "onvm_nflib.h"
 #include "onvm_sc_common.h"
+#include "onvm_sc_mgr.h"
 #include "sdn.h"
 #include "sdn_pkt_list.h"
 #include "setupconn.h"
@@ -223,17 +224,23 @@ datapath_handle_read(struct datapath *dp) {
                                 ret = onvm_flow_dir_get_key(fk, &flow_entry);
                                 if (ret == -ENOENT) {
                                         ret = onvm_flow_dir_add_key(fk, &flow_entry);
+                                } else if (ret >= 0 && onvm_sc_update(flow_entry->sc, sc) == 0) {
+                                        /* Packets of the flow in flight follow the new actions at their next hop */
+                                        rte_free(fk);
+                                        fk = NULL;
                                 } else if (ret >= 0) {
                                         rte_free(flow_entry->key);
-                                        rte_free(flow_entry->sc);
+                                        onvm_sc_free(flow_entry->sc);
                                 } else {
                                         rte_exit(EXIT_FAILURE, "onvm_flow_dir_get parameters are invalid");
                                 }
-                                memset(flow_entry, 0, sizeof(struct onvm_flow_entry));
-                                flow_entry->key = fk;
-                                flow_entry->sc = sc;
-                                flow_entry->idle_timeout = OFP_FLOW_PERMANENT;
-                                flow_entry->hard_timeout = OFP_FLOW_PERMANENT;
+                                if (fk != NULL) {
+                                        memset(flow_entry, 0, sizeof(struct onvm_flow_entry));
+                                        flow_entry->key = fk;
+                                        flow_entry->sc = sc;
+                                        flow_entry->idle_timeout = OFP_FLOW_PERMANENT;
+                                        flow_entry->hard_timeout = OFP_FLOW_PERMANENT;
+                                }
                                 sdn_list = (struct sdn_pkt_list *)onvm_ft_get_data(pkt_buf_ft, buffer_id);
                                 sdn_pkt_list_flush(nf, sdn_list);
                                 break;
@@ -463,10 +470,7 @@ flow_action_extract(struct ofp_action_header *oah, size_t actions_len) {
         uint8_t *p = (uint8_t *)oah;
         struct onvm_service_chain *chain;
 
-        chain = rte_calloc("service chain", 1, sizeof(struct onvm_service_chain), 0);
-        if (chain == NULL) {
-                rte_exit(EXIT_FAILURE, "Cannot allocate memory for service chain\n");
-        }
+        chain = onvm_sc_create();
 
         if (actions_len == 0) {
                 onvm_sc_append_entry(chain, ONVM_NF_ACTION_DROP, 0);
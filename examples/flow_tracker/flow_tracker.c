@@ -66,6 +66,7 @@
 /*Struct that holds all NF state information */
 struct state_info {
         struct onvm_ft *ft;
+        struct onvm_ft *ft_ipv6;
         uint16_t destination;
         uint16_t print_delay;
         uint16_t num_stored;
@@ -153,27 +154,25 @@ update_status(uint64_t elapsed_cycles, struct flow_stats *data) {
 }
 
 /*
- * Clears expired entries from the flow table
+ * Clears expired entries from one of the flow tables
  */
 static int
-clear_entries(struct state_info *state_info) {
-        if (unlikely(state_info == NULL)) {
-                return -1;
-        }
-
-        printf("Clearing expired entries\n");
+clear_table_entries(struct state_info *state_info, struct onvm_ft *ft, int ipv6) {
         struct flow_stats *data = NULL;
-        struct onvm_ft_ipv4_5tuple *key = NULL;
+        void *key = NULL;
         uint32_t next = 0;
         int ret = 0;
 
-        while (onvm_ft_iterate(state_info->ft, (const void **)&key, (void **)&data, &next) > -1) {
+        while (onvm_ft_iterate(ft, (const void **)&key, (void **)&data, &next) > -1) {
                 if (update_status(state_info->elapsed_cycles, data) < 0) {
                         return -1;
                 }
 
                 if (!data->is_active) {
-                        ret = onvm_ft_remove_key(state_info->ft, key);
+                        if (ipv6)
+                                ret = onvm_ft_remove_key_ipv6(ft, key);
+                        else
+                                ret = onvm_ft_remove_key(ft, key);
                         state_info->num_stored--;
                         if (ret < 0) {
                                 printf("Key should have been removed, but was not\n");
@@ -186,20 +185,31 @@ clear_entries(struct state_info *state_info) {
 }
 
 /*
- * Prints out information about flows stored in table
+ * Clears expired entries from the flow tables
+ */
+static int
+clear_entries(struct state_info *state_info) {
+        if (unlikely(state_info == NULL)) {
+                return -1;
+        }
+
+        printf("Clearing expired entries\n");
+        if (clear_table_entries(state_info, state_info->ft, 0) < 0)
+                return -1;
+        return clear_table_entries(state_info, state_info->ft_ipv6, 1);
+}
+
+/*
+ * Prints out information about flows stored in one of the tables
  */
 static void
-do_stats_display(struct state_info *state_info) {
+display_table(struct state_info *state_info, struct onvm_ft *ft, int ipv6) {
         struct flow_stats *data = NULL;
-        struct onvm_ft_ipv4_5tuple *key = NULL;
+        void *key = NULL;
         uint32_t next = 0;
         int32_t index;
 
-        printf("------------------------------\n");
-        printf("     Flow Table Contents\n");
-        printf("------------------------------\n");
-        printf("Current capacity: %d / %d\n\n", state_info->num_stored, TBL_SIZE);
-        while ((index = onvm_ft_iterate(state_info->ft, (const void **)&key, (void **)&data, &next)) > -1) {
+        while ((index = onvm_ft_iterate(ft, (const void **)&key, (void **)&data, &next)) > -1) {
                 update_status(state_info->elapsed_cycles, data);
                 printf("%d. Status: ", index);
                 if (data->is_active) {
@@ -209,18 +219,35 @@ do_stats_display(struct state_info *state_info) {
                 }
 
                 printf("Key information:\n");
-                _onvm_ft_print_key(key);
+                if (ipv6)
+                        _onvm_ft_print_key_ipv6(key);
+                else
+                        _onvm_ft_print_key(key);
                 printf("Packet count: %d\n\n", data->pkt_count);
         }
 }
 
+/*
+ * Prints out information about flows stored in the tables
+ */
+static void
+do_stats_display(struct state_info *state_info) {
+        printf("------------------------------\n");
+        printf("     Flow Table Contents\n");
+        printf("------------------------------\n");
+        printf("Current capacity: %d / %d\n\n", state_info->num_stored, TBL_SIZE);
+        display_table(state_info, state_info->ft, 0);
+        display_table(state_info, state_info->ft_ipv6, 1);
+}
+
 /*
  * Adds an entry to the flow table. It first checks if the table is full, and
  * if so, it calls clear_entries() to free up space.
  */
 static int
-table_add_entry(struct onvm_ft_ipv4_5tuple *key, struct state_info *state_info) {
+table_add_entry(void *key, int ipv6, struct state_info *state_info) {
         struct flow_stats *data = NULL;
+        int tbl_index;
 
         if (unlikely(key == NULL || state_info == NULL)) {
                 return -1;
@@ -233,7 +260,10 @@ table_add_entry(struct onvm_ft_ipv4_5tuple *key, struct state_info *state_info)
                 }
         }
 
-        int tbl_index = onvm_ft_add_key(state_info->ft, key, (char **)&data);
+        if (ipv6)
+                tbl_index = onvm_ft_add_key_ipv6(state_info->ft_ipv6, key, (char **)&data);
+        else
+                tbl_index = onvm_ft_add_key(state_info->ft, key, (char **)&data);
         if (tbl_index < 0) {
                 return -1;
         }
@@ -254,19 +284,26 @@ static int
 table_lookup_entry(struct rte_mbuf *pkt, struct state_info *state_info) {
         struct flow_stats *data = NULL;
         struct onvm_ft_ipv4_5tuple key;
+        struct onvm_ft_ipv6_5tuple key_ipv6;
+        int tbl_index;
 
         if (unlikely(pkt == NULL || state_info == NULL)) {
                 return -1;
         }
 
-        int ret = onvm_ft_fill_key_symmetric(&key, pkt);
-        if (ret < 0)
+        if (onvm_ft_fill_key_symmetric(&key, pkt) == 0) {
+                tbl_index = onvm_ft_lookup_key(state_info->ft, &key, (char **)&data);
+                if (tbl_index == -ENOENT)
+                        return table_add_entry(&key, 0, state_info);
+        } else if (onvm_ft_fill_key_ipv6_symmetric(&key_ipv6, pkt) == 0) {
+                tbl_index = onvm_ft_lookup_key_ipv6(state_info->ft_ipv6, &key_ipv6, (char **)&data);
+                if (tbl_index == -ENOENT)
+                        return table_add_entry(&key_ipv6, 1, state_info);
+        } else {
                 return -1;
+        }
 
-        int tbl_index = onvm_ft_lookup_key(state_info->ft, &key, (char **)&data);
-        if (tbl_index == -ENOENT) {
-                return table_add_entry(&key, state_info);
-        } else if (tbl_index < 0) {
+        if (tbl_index < 0) {
                 printf("Some other error occurred with the packet hashing\n");
                 return -1;
         } else {
@@ -291,7 +328,7 @@ callback_handler(__attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx)
 static int
 packet_handler(struct rte_mbuf *pkt, struct onvm_pkt_meta *meta,
                __attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx) {
-        if (!onvm_pkt_is_ipv4(pkt)) {
+        if (!onvm_pkt_is_ipv4(pkt) && !onvm_pkt_is_ipv6(pkt)) {
                 meta->destination = state_info->destination;
                 meta->action = ONVM_NF_ACTION_TONF;
                 return 0;
@@ -349,7 +386,8 @@ main(int argc, char *argv[]) {
         }
 
         state_info->ft = onvm_ft_create(TBL_SIZE, sizeof(struct flow_stats));
-        if (state_info->ft == NULL) {
+        state_info->ft_ipv6 = onvm_ft_create_ipv6(TBL_SIZE, sizeof(struct flow_stats));
+        if (state_info->ft == NULL || state_info->ft_ipv6 == NULL) {
                 onvm_nflib_stop(nf_local_ctx);
                 rte_exit(EXIT_FAILURE, "Unable to create flow table");
         }
@@ -361,6 +399,7 @@ main(int argc, char *argv[]) {
 
         onvm_nflib_stop(nf_local_ctx);
         onvm_ft_free(state_info->ft);
+        onvm_ft_free(state_info->ft_ipv6);
         rte_free(state_info);
         printf("If we reach here, program is ending!\n");
         return 0;
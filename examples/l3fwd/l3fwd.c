@@ -192,8 +192,7 @@ packet_handler(struct rte_mbuf *pkt, struct onvm_pkt_meta *meta,
 
 #ifdef DO_RFC_1812_CHECKS
                 /* Update time to live and header checksum */
-                --(ipv4_hdr->time_to_live);
-                ++(ipv4_hdr->hdr_checksum);
+                onvm_pkt_set_ttl(pkt, ipv4_hdr->time_to_live - 1);
 #endif
                 /* dst addr */
                 *(uint64_t *)&eth_hdr->d_addr = stats->dest_eth_addr[dst_port];
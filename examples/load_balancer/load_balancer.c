@@ -491,6 +491,8 @@ packet_handler(struct rte_mbuf *pkt, struct onvm_pkt_meta *meta,
         struct rte_ipv4_hdr *ip;
         struct rte_ether_hdr *ehdr;
         struct flow_info *flow_info;
+        uint32_t *hashed_addr;
+        uint32_t lb_addr;
         int i, ret;
 
         ehdr = onvm_pkt_ether_hdr(pkt);
@@ -508,14 +510,14 @@ packet_handler(struct rte_mbuf *pkt, struct onvm_pkt_meta *meta,
          * connections from client -> lbr and lbr <- server
          * will have the same hash
          */
-        if (pkt->port == lb->client_port) {
-                ip->dst_addr = 0;
-        } else {
-                ip->src_addr = 0;
-        }
+        hashed_addr = pkt->port == lb->client_port ? &ip->dst_addr : &ip->src_addr;
+        lb_addr = *hashed_addr;
+        *hashed_addr = 0;
 
         /* Get the packet flow entry */
         ret = table_lookup_entry(pkt, &flow_info);
+        /* Restore the address, the rewrite below patches the checksums from it */
+        *hashed_addr = lb_addr;
         if (ret == -1) {
                 meta->action = ONVM_NF_ACTION_DROP;
                 meta->destination = 0;
@@ -538,7 +540,7 @@ packet_handler(struct rte_mbuf *pkt, struct onvm_pkt_meta *meta,
                         ehdr->d_addr.addr_bytes[i] = flow_info->s_addr_bytes[i];
                 }
 
-                ip->src_addr = lb->ip_lb_client;
+                onvm_pkt_set_ipv4_src(pkt, lb->ip_lb_client);
                 meta->destination = lb->client_port;
         } else {
                 if (onvm_get_macaddr(lb->server_port, &ehdr->s_addr) == -1) {
@@ -548,13 +550,10 @@ packet_handler(struct rte_mbuf *pkt, struct onvm_pkt_meta *meta,
                         ehdr->d_addr.addr_bytes[i] = lb->server[flow_info->dest].d_addr_bytes[i];
                 }
 
-                ip->dst_addr = rte_cpu_to_be_32(lb->server[flow_info->dest].d_ip);
+                onvm_pkt_set_ipv4_dst(pkt, rte_cpu_to_be_32(lb->server[flow_info->dest].d_ip));
                 meta->destination = lb->server_port;
         }
 
-        /* Changing the pkt ip header so we want to recalculate pkt checksums */
-        onvm_pkt_set_checksums(pkt);
-
         meta->action = ONVM_NF_ACTION_OUT;
 
         if (++counter == print_delay) {
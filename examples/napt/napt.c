@@ -0,0 +1,728 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * napt.c - network address and port translation for an inside subnet
+ *      behind a single public address. Instances of the NF share the
+ *      public port range in blocks and pick ports whose inbound RSS hash
+ *      lands on themselves, so a service can scale out.
+ ********************************************************************/
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <unistd.h>
+
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_ip.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_memzone.h>
+#include <rte_pause.h>
+
+#include "onvm_flow_table.h"
+#include "onvm_nflib.h"
+#include "onvm_pkt_helper.h"
+#include "onvm_sc_common.h"
+
+#define NF_TAG "napt"
+#define NO_FLAGS 0
+
+#define DEFAULT_MAX_MAPPINGS (1 << 20)
+#define DEFAULT_TIMEOUT 60
+#define DEFAULT_PORT_LO 1024
+#define DEFAULT_PORT_HI 65535
+
+/* Public ports are handed out to instances in blocks of this many */
+#define NAPT_BLOCK_PORTS 64
+#define NAPT_MAX_BLOCKS (65536 / NAPT_BLOCK_PORTS)
+#define NAPT_BLOCK_FREE 0
+/* New blocks one allocation may claim when the owned ones have no port that hashes here */
+#define NAPT_CLAIM_TRIES 4
+/* Flow table entries checked for expiry each time the callback runs */
+#define NAPT_EXPIRE_BATCH 128
+#define NAPT_POOL_MZ_NAME "napt_pool_%u"
+
+/* Port blocks of a service, shared by its instances through a memzone */
+struct napt_port_pool {
+        volatile uint32_t ready;
+        uint32_t public_ip;
+        uint16_t port_lo;
+        uint16_t port_hi;
+        uint16_t num_blocks;
+        uint16_t owner[NAPT_MAX_BLOCKS];  // instance id or NAPT_BLOCK_FREE
+};
+
+/*
+ * A mapping has one flow table entry for the inside flow and one for the
+ * translated flow, both under their symmetric key so either direction finds it
+ */
+struct napt_entry {
+        struct onvm_ft_ipv4_5tuple peer;  // key of the other entry of the mapping
+        uint64_t last_pkt_cycles;
+        uint32_t addr;                    // rewritten address, network byte order
+        uint16_t port;                    // rewritten port, network byte order
+        uint16_t public_port;             // host byte order
+        uint8_t outbound;                 // entry of the inside flow
+};
+
+struct napt_stats {
+        uint64_t outbound;
+        uint64_t inbound;
+        uint64_t new_mappings;
+        uint64_t expired;
+        uint64_t drop_unsupported;
+        uint64_t drop_no_mapping;
+        uint64_t drop_no_port;
+        uint64_t drop_table_full;
+};
+
+/*Struct that holds all NF state information */
+struct state_info {
+        struct onvm_nf *nf;
+        struct onvm_ft *ft;
+        struct napt_port_pool *pool;
+        uint16_t destination;
+        uint16_t print_delay;
+        uint32_t inside_net;   // network byte order
+        uint32_t inside_mask;  // network byte order
+        uint32_t public_ip;    // network byte order
+        uint16_t port_lo;
+        uint16_t port_hi;
+        uint32_t max_mappings;
+        uint32_t num_mappings;
+        uint64_t timeout_cycles;
+        uint64_t cur_cycles;
+        uint64_t last_print_cycles;
+        uint32_t expire_next;
+        uint32_t *port_rss;    // RSS hash contribution of each public port
+        uint16_t num_owned;
+        uint16_t owned[NAPT_MAX_BLOCKS];
+        uint16_t claim_next;
+        uint64_t used[NAPT_MAX_BLOCKS];
+        struct napt_stats stats;
+};
+
+static struct state_info *state_info;
+
+/*
+ * Prints application arguments
+ */
+static void
+usage(const char *progname) {
+        printf("Usage:\n");
+        printf("%s [EAL args] -- [NF_LIB args] -- -d <destination> -s <inside_subnet> -a <public_ip> [-r <lo-hi>] "
+               "[-t <timeout>] [-m <max_mappings>] [-p <print_delay>]\n", progname);
+        printf("%s -F <CONFIG_FILE.json> [EAL args] -- [NF_LIB args] -- [NF args]\n\n", progname);
+        printf("Flags:\n");
+        printf(" - `-d <destination_id>`: Service ID to send translated packets to\n");
+        printf(" - `-s <inside_subnet>`: Inside subnet as a.b.c.d/len, its flows are translated\n");
+        printf(" - `-a <public_ip>`: Public address of the translated flows\n");
+        printf(" - `-r <lo-hi>`: Public port range (default %d-%d)\n", DEFAULT_PORT_LO, DEFAULT_PORT_HI);
+        printf(" - `-t <timeout>`: Seconds a mapping is kept without traffic (default %d)\n", DEFAULT_TIMEOUT);
+        printf(" - `-m <max_mappings>`: Most mappings of this instance (default %d)\n", DEFAULT_MAX_MAPPINGS);
+        printf(" - `-p <print_delay>`: Number of seconds between each print, 0 to disable (default 0)\n");
+}
+
+static int
+parse_subnet(char *str) {
+        uint32_t ip;
+        char *slash;
+        int len;
+
+        slash = strchr(str, '/');
+        if (slash == NULL)
+                return -1;
+        *slash = '\0';
+        len = atoi(slash + 1);
+        if (len < 0 || len > 32 || onvm_pkt_parse_ip(str, &ip) < 0)
+                return -1;
+
+        state_info->inside_mask = len == 0 ? 0 : rte_cpu_to_be_32(~0U << (32 - len));
+        state_info->inside_net = rte_cpu_to_be_32(ip) & state_info->inside_mask;
+        return 0;
+}
+
+/*
+ * Loops through inputted arguments and assigns values as necessary
+ */
+static int
+parse_app_args(int argc, char *argv[], const char *progname) {
+        int c, dst_flag = 0, subnet_flag = 0, public_flag = 0;
+        unsigned int lo, hi;
+        uint32_t ip;
+
+        while ((c = getopt(argc, argv, "d:s:a:r:t:m:p:")) != -1) {
+                switch (c) {
+                        case 'd':
+                                state_info->destination = strtoul(optarg, NULL, 10);
+                                dst_flag = 1;
+                                RTE_LOG(INFO, APP, "Sending packets to service ID %d\n", state_info->destination);
+                                break;
+                        case 's':
+                                if (parse_subnet(optarg) < 0) {
+                                        RTE_LOG(INFO, APP, "Invalid inside subnet %s\n", optarg);
+                                        return -1;
+                                }
+                                subnet_flag = 1;
+                                break;
+                        case 'a':
+                                if (onvm_pkt_parse_ip(optarg, &ip) < 0) {
+                                        RTE_LOG(INFO, APP, "Invalid public address %s\n", optarg);
+                                        return -1;
+                                }
+                                state_info->public_ip = rte_cpu_to_be_32(ip);
+                                public_flag = 1;
+                                break;
+                        case 'r':
+                                if (sscanf(optarg, "%u-%u", &lo, &hi) != 2 || lo == 0 || lo > hi || hi > 65535) {
+                                        RTE_LOG(INFO, APP, "Invalid port range %s\n", optarg);
+                                        return -1;
+                                }
+                                state_info->port_lo = lo;
+                                state_info->port_hi = hi;
+                                break;
+                        case 't':
+                                state_info->timeout_cycles = strtoul(optarg, NULL, 10) * rte_get_timer_hz();
+                                break;
+                        case 'm':
+                                state_info->max_mappings = strtoul(optarg, NULL, 10);
+                                break;
+                        case 'p':
+                                state_info->print_delay = strtoul(optarg, NULL, 10);
+                                break;
+                        case '?':
+                                usage(progname);
+                                if (strchr("dsartmp", optopt) != NULL)
+                                        RTE_LOG(INFO, APP, "Option -%c requires an argument\n", optopt);
+                                else
+                                        RTE_LOG(INFO, APP, "Unknown option character\n");
+                                return -1;
+                        default:
+                                usage(progname);
+                                return -1;
+                }
+        }
+
+        if (!dst_flag || !subnet_flag || !public_flag) {
+                RTE_LOG(INFO, APP, "NAPT NF requires a destination with -d, an inside subnet with -s and a public "
+                                   "address with -a\n");
+                return -1;
+        }
+        if (state_info->max_mappings == 0) {
+                RTE_LOG(INFO, APP, "NAPT NF needs room for at least one mapping\n");
+                return -1;
+        }
+
+        return optind;
+}
+
+/*
+ * Rewrite the source (outbound) or destination (inbound) address and port,
+ * the helpers patch the IP and L4 checksums instead of recomputing them
+ */
+static void
+napt_rewrite(struct rte_mbuf *pkt, const struct napt_entry *entry) {
+        if (entry->outbound) {
+                onvm_pkt_set_ipv4_src(pkt, entry->addr);
+                onvm_pkt_set_src_port(pkt, entry->port);
+        } else {
+                onvm_pkt_set_ipv4_dst(pkt, entry->addr);
+                onvm_pkt_set_dst_port(pkt, entry->port);
+        }
+}
+
+/*********************************Port blocks**********************************/
+
+/*
+ * Attach to the port pool of the service, the first instance creates it
+ */
+static int
+napt_pool_init(void) {
+        const struct rte_memzone *mz;
+        struct napt_port_pool *pool;
+        char name[RTE_MEMZONE_NAMESIZE];
+        uint16_t b;
+
+        snprintf(name, sizeof(name), NAPT_POOL_MZ_NAME, state_info->nf->service_id);
+        mz = rte_memzone_lookup(name);
+        if (mz == NULL) {
+                mz = rte_memzone_reserve(name, sizeof(struct napt_port_pool), rte_socket_id(), NO_FLAGS);
+                if (mz != NULL) {
+                        pool = mz->addr;
+                        memset(pool, 0, sizeof(struct napt_port_pool));
+                        pool->public_ip = state_info->public_ip;
+                        pool->port_lo = state_info->port_lo;
+                        pool->port_hi = state_info->port_hi;
+                        pool->num_blocks = (state_info->port_hi - state_info->port_lo) / NAPT_BLOCK_PORTS + 1;
+                        __atomic_store_n(&pool->ready, 1, __ATOMIC_RELEASE);
+                } else {
+                        /* Another instance got there first */
+                        mz = rte_memzone_lookup(name);
+                }
+        }
+        if (mz == NULL)
+                return -ENOMEM;
+
+        pool = mz->addr;
+        while (!__atomic_load_n(&pool->ready, __ATOMIC_ACQUIRE))
+                rte_pause();
+        if (pool->public_ip != state_info->public_ip || pool->port_lo != state_info->port_lo ||
+            pool->port_hi != state_info->port_hi)
+                return -EINVAL;
+
+        /* A restarted instance reuses its id, blocks it had before are no longer in use */
+        for (b = 0; b < pool->num_blocks; b++) {
+                if (pool->owner[b] == state_info->nf->instance_id)
+                        __atomic_store_n(&pool->owner[b], NAPT_BLOCK_FREE, __ATOMIC_RELEASE);
+        }
+
+        state_info->pool = pool;
+        state_info->claim_next = (uint32_t)state_info->nf->instance_id * pool->num_blocks / MAX_NFS;
+        return 0;
+}
+
+/* Ports of the range that fall in a block, the last one may be partial */
+static inline uint64_t
+napt_block_mask(uint16_t block) {
+        uint32_t first = state_info->port_lo + block * NAPT_BLOCK_PORTS;
+        uint32_t count = RTE_MIN((uint32_t)state_info->port_hi - first + 1, (uint32_t)NAPT_BLOCK_PORTS);
+
+        return count == NAPT_BLOCK_PORTS ? ~0ULL : (1ULL << count) - 1;
+}
+
+static int
+napt_block_claim(void) {
+        struct napt_port_pool *pool = state_info->pool;
+        uint16_t expected, b, i;
+
+        for (i = 0; i < pool->num_blocks; i++) {
+                b = (state_info->claim_next + i) % pool->num_blocks;
+                expected = NAPT_BLOCK_FREE;
+                if (pool->owner[b] != NAPT_BLOCK_FREE ||
+                    !__atomic_compare_exchange_n(&pool->owner[b], &expected, state_info->nf->instance_id, 0,
+                                                 __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+                        continue;
+                state_info->claim_next = (b + 1) % pool->num_blocks;
+                state_info->owned[state_info->num_owned++] = b;
+                state_info->used[b] = 0;
+                return b;
+        }
+
+        return -ENOSPC;
+}
+
+static void
+napt_block_release(uint16_t block) {
+        uint16_t i;
+
+        for (i = 0; i < state_info->num_owned; i++) {
+                if (state_info->owned[i] == block) {
+                        state_info->owned[i] = state_info->owned[--state_info->num_owned];
+                        break;
+                }
+        }
+        __atomic_store_n(&state_info->pool->owner[block], NAPT_BLOCK_FREE, __ATOMIC_RELEASE);
+}
+
+/*
+ * Position of this instance among the instances of its service, the manager
+ * spreads packets over them by RSS hash modulo their count
+ */
+static void
+napt_instance_slot(uint16_t *slot, uint16_t *count) {
+        uint16_t service_id = state_info->nf->service_id;
+        uint16_t i;
+
+        *slot = 0;
+        *count = nf_per_service_count[service_id];
+        for (i = 0; i < *count; i++) {
+                if (services[service_id][i] == state_info->nf->instance_id) {
+                        *slot = i;
+                        return;
+                }
+        }
+        *count = 1;
+}
+
+/* Take a free port of the block whose inbound flow hashes to this instance */
+static int
+napt_block_take(uint16_t block, uint32_t rss_base, uint16_t slot, uint16_t count) {
+        uint64_t free_ports = ~state_info->used[block] & napt_block_mask(block);
+        uint32_t offset;
+        int bit;
+
+        while (free_ports != 0) {
+                bit = __builtin_ctzll(free_ports);
+                free_ports &= free_ports - 1;
+                offset = block * NAPT_BLOCK_PORTS + bit;
+                if (count > 1 && (rss_base ^ state_info->port_rss[offset]) % count != slot)
+                        continue;
+                state_info->used[block] |= 1ULL << bit;
+                return state_info->port_lo + offset;
+        }
+        return -ENOSPC;
+}
+
+/*
+ * Pick a public port for a flow from remote_addr:remote_port. The RSS hash
+ * with the symmetric key is linear, so the hash of the inbound flow is the
+ * hash with port 0 xor the precomputed contribution of the port.
+ */
+static int
+napt_port_alloc(uint32_t remote_addr, uint16_t remote_port, uint8_t proto) {
+        struct onvm_ft_ipv4_5tuple key;
+        uint16_t slot, count, i;
+        uint32_t rss_base;
+        int block, port;
+
+        memset(&key, 0, sizeof(key));
+        key.src_addr = remote_addr;
+        key.dst_addr = state_info->public_ip;
+        key.src_port = remote_port;
+        key.proto = proto;
+        rss_base = onvm_softrss(&key);
+        napt_instance_slot(&slot, &count);
+
+        for (i = 0; i < state_info->num_owned; i++) {
+                port = napt_block_take(state_info->owned[i], rss_base, slot, count);
+                if (port >= 0)
+                        return port;
+        }
+        for (i = 0; i < NAPT_CLAIM_TRIES && (block = napt_block_claim()) >= 0; i++) {
+                port = napt_block_take(block, rss_base, slot, count);
+                if (port >= 0)
+                        return port;
+        }
+        return -ENOSPC;
+}
+
+static void
+napt_port_free(uint16_t port) {
+        uint32_t offset = port - state_info->port_lo;
+        uint16_t block = offset / NAPT_BLOCK_PORTS;
+
+        state_info->used[block] &= ~(1ULL << (offset % NAPT_BLOCK_PORTS));
+        /* Hand empty blocks back to the other instances, but keep one around */
+        if (state_info->used[block] == 0 && state_info->num_owned > 1)
+                napt_block_release(block);
+}
+
+static int
+napt_port_rss_init(void) {
+        struct onvm_ft_ipv4_5tuple key;
+        uint32_t i, count;
+
+        count = state_info->port_hi - state_info->port_lo + 1;
+        state_info->port_rss = rte_malloc("napt_port_rss", count * sizeof(uint32_t), 0);
+        if (state_info->port_rss == NULL)
+                return -ENOMEM;
+
+        memset(&key, 0, sizeof(key));
+        for (i = 0; i < count; i++) {
+                key.dst_port = rte_cpu_to_be_16(state_info->port_lo + i);
+                state_info->port_rss[i] = onvm_softrss(&key);
+        }
+        return 0;
+}
+
+/*********************************Mappings**********************************/
+
+static struct napt_entry *
+napt_mapping_add(struct onvm_ft_ipv4_5tuple *inside_key, struct rte_ipv4_hdr *ipv4_hdr, uint16_t src_port,
+                 uint16_t dst_port) {
+        struct onvm_ft_ipv4_5tuple public_key;
+        struct napt_entry *inside_entry, *public_entry;
+        int port;
+
+        if (state_info->num_mappings >= state_info->max_mappings) {
+                state_info->stats.drop_table_full++;
+                return NULL;
+        }
+
+        port = napt_port_alloc(ipv4_hdr->dst_addr, dst_port, ipv4_hdr->next_proto_id);
+        if (port < 0) {
+                state_info->stats.drop_no_port++;
+                return NULL;
+        }
+
+        memset(&public_key, 0, sizeof(public_key));
+        public_key.src_addr = state_info->public_ip;
+        public_key.dst_addr = ipv4_hdr->dst_addr;
+        public_key.src_port = rte_cpu_to_be_16(port);
+        public_key.dst_port = dst_port;
+        public_key.proto = ipv4_hdr->next_proto_id;
+        onvm_ft_key_symmetric(&public_key);
+
+        if (onvm_ft_add_key(state_info->ft, inside_key, (char **)&inside_entry) < 0) {
+                napt_port_free(port);
+                state_info->stats.drop_table_full++;
+                return NULL;
+        }
+        if (onvm_ft_add_key(state_info->ft, &public_key, (char **)&public_entry) < 0) {
+                onvm_ft_remove_key(state_info->ft, inside_key);
+                napt_port_free(port);
+                state_info->stats.drop_table_full++;
+                return NULL;
+        }
+
+        inside_entry->peer = public_key;
+        inside_entry->last_pkt_cycles = state_info->cur_cycles;
+        inside_entry->addr = state_info->public_ip;
+        inside_entry->port = rte_cpu_to_be_16(port);
+        inside_entry->public_port = port;
+        inside_entry->outbound = 1;
+
+        public_entry->peer = *inside_key;
+        public_entry->last_pkt_cycles = state_info->cur_cycles;
+        public_entry->addr = ipv4_hdr->src_addr;
+        public_entry->port = src_port;
+        public_entry->public_port = port;
+        public_entry->outbound = 0;
+
+        state_info->num_mappings++;
+        state_info->stats.new_mappings++;
+        return inside_entry;
+}
+
+/*
+ * Check a batch of entries for expiry, picking up where the last call left off.
+ * A mapping is expired from its inside entry once neither direction has seen traffic.
+ */
+static void
+napt_expire(void) {
+        struct onvm_ft_ipv4_5tuple inside_key, public_key;
+        const struct onvm_ft_ipv4_5tuple *key;
+        struct napt_entry *entry, *peer;
+        uint64_t last;
+        uint16_t port;
+        int i;
+
+        for (i = 0; i < NAPT_EXPIRE_BATCH; i++) {
+                if (onvm_ft_iterate(state_info->ft, (const void **)&key, (void **)&entry,
+                                    &state_info->expire_next) < 0) {
+                        state_info->expire_next = 0;
+                        return;
+                }
+                if (!entry->outbound)
+                        continue;
+
+                public_key = entry->peer;
+                last = entry->last_pkt_cycles;
+                if (onvm_ft_lookup_key(state_info->ft, &public_key, (char **)&peer) >= 0)
+                        last = RTE_MAX(last, peer->last_pkt_cycles);
+                if (state_info->cur_cycles - last < state_info->timeout_cycles)
+                        continue;
+
+                inside_key = *key;
+                port = entry->public_port;
+                onvm_ft_remove_key(state_info->ft, &public_key);
+                onvm_ft_remove_key(state_info->ft, &inside_key);
+                napt_port_free(port);
+                state_info->num_mappings--;
+                state_info->stats.expired++;
+        }
+}
+
+/*
+ * Prints out translation counters
+ */
+static void
+do_stats_display(void) {
+        struct napt_stats *stats = &state_info->stats;
+        const char clr[] = {27, '[', '2', 'J', '\0'};
+        const char topLeft[] = {27, '[', '1', ';', '1', 'H', '\0'};
+
+        /* Clear screen and move to top left */
+        printf("%s%s", clr, topLeft);
+
+        printf("NAPT\n");
+        printf("-----\n");
+        printf("Mappings       : %u / %u\n", state_info->num_mappings, state_info->max_mappings);
+        printf("Port blocks    : %u\n", state_info->num_owned);
+        printf("Outbound       : %" PRIu64 "\n", stats->outbound);
+        printf("Inbound        : %" PRIu64 "\n", stats->inbound);
+        printf("New mappings   : %" PRIu64 "\n", stats->new_mappings);
+        printf("Expired        : %" PRIu64 "\n", stats->expired);
+        printf("Drops\n");
+        printf("  unsupported  : %" PRIu64 "\n", stats->drop_unsupported);
+        printf("  no mapping   : %" PRIu64 "\n", stats->drop_no_mapping);
+        printf("  no port      : %" PRIu64 "\n", stats->drop_no_port);
+        printf("  table full   : %" PRIu64 "\n", stats->drop_table_full);
+        printf("\n\n");
+}
+
+static int
+callback_handler(__attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx) {
+        state_info->cur_cycles = rte_get_tsc_cycles();
+
+        napt_expire();
+
+        if (state_info->print_delay != 0 &&
+            state_info->cur_cycles - state_info->last_print_cycles > state_info->print_delay * rte_get_timer_hz()) {
+                state_info->last_print_cycles = state_info->cur_cycles;
+                do_stats_display();
+        }
+
+        return 0;
+}
+
+static int
+packet_handler(struct rte_mbuf *pkt, struct onvm_pkt_meta *meta,
+               __attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx) {
+        struct onvm_ft_ipv4_5tuple key;
+        struct rte_ipv4_hdr *ipv4_hdr;
+        struct napt_entry *entry;
+        uint16_t src_port, dst_port;
+        uint8_t inside;
+
+        meta->action = ONVM_NF_ACTION_DROP;
+
+        if (onvm_ft_fill_key(&key, pkt) < 0 ||
+            (key.proto != IP_PROTOCOL_TCP && key.proto != IP_PROTOCOL_UDP)) {
+                state_info->stats.drop_unsupported++;
+                return 0;
+        }
+        ipv4_hdr = onvm_pkt_ipv4_hdr(pkt);
+        src_port = key.src_port;
+        dst_port = key.dst_port;
+        onvm_ft_key_symmetric(&key);
+
+        inside = (ipv4_hdr->src_addr & state_info->inside_mask) == state_info->inside_net;
+        if (onvm_ft_lookup_key(state_info->ft, &key, (char **)&entry) < 0 || entry->outbound != inside) {
+                /* Only flows from the inside open a mapping */
+                if (!inside) {
+                        state_info->stats.drop_no_mapping++;
+                        return 0;
+                }
+                entry = napt_mapping_add(&key, ipv4_hdr, src_port, dst_port);
+                if (entry == NULL)
+                        return 0;
+        }
+
+        entry->last_pkt_cycles = state_info->cur_cycles;
+        napt_rewrite(pkt, entry);
+        if (inside)
+                state_info->stats.outbound++;
+        else
+                state_info->stats.inbound++;
+
+        meta->destination = state_info->destination;
+        meta->action = ONVM_NF_ACTION_TONF;
+
+        return 0;
+}
+
+int
+main(int argc, char *argv[]) {
+        int arg_offset;
+        struct onvm_nf_local_ctx *nf_local_ctx;
+        struct onvm_nf_function_table *nf_function_table;
+        const char *progname = argv[0];
+
+        nf_local_ctx = onvm_nflib_init_nf_local_ctx();
+        onvm_nflib_start_signal_handler(nf_local_ctx, NULL);
+
+        nf_function_table = onvm_nflib_init_nf_function_table();
+        nf_function_table->pkt_handler = &packet_handler;
+        nf_function_table->user_actions = &callback_handler;
+
+        if ((arg_offset = onvm_nflib_init(argc, argv, NF_TAG, nf_local_ctx, nf_function_table)) < 0) {
+                onvm_nflib_stop(nf_local_ctx);
+                if (arg_offset == ONVM_SIGNAL_TERMINATION) {
+                        printf("Exiting due to user termination\n");
+                        return 0;
+                } else {
+                        rte_exit(EXIT_FAILURE, "Failed ONVM init\n");
+                }
+        }
+
+        argc -= arg_offset;
+        argv += arg_offset;
+
+        state_info = rte_calloc("state", 1, sizeof(struct state_info), 0);
+        if (state_info == NULL) {
+                onvm_nflib_stop(nf_local_ctx);
+                rte_exit(EXIT_FAILURE, "Unable to initialize NF state");
+        }
+
+        state_info->nf = nf_local_ctx->nf;
+        state_info->port_lo = DEFAULT_PORT_LO;
+        state_info->port_hi = DEFAULT_PORT_HI;
+        state_info->timeout_cycles = DEFAULT_TIMEOUT * rte_get_timer_hz();
+        state_info->max_mappings = DEFAULT_MAX_MAPPINGS;
+
+        if (parse_app_args(argc, argv, progname) < 0) {
+                onvm_nflib_stop(nf_local_ctx);
+                rte_exit(EXIT_FAILURE, "Invalid command-line arguments\n");
+        }
+
+        /* Each mapping takes an entry for the inside and one for the public flow */
+        state_info->ft = onvm_ft_create(state_info->max_mappings * 2, sizeof(struct napt_entry));
+        if (state_info->ft == NULL) {
+                onvm_nflib_stop(nf_local_ctx);
+                rte_exit(EXIT_FAILURE, "Unable to create flow table\n");
+        }
+
+        if (napt_pool_init() < 0) {
+                onvm_nflib_stop(nf_local_ctx);
+                rte_exit(EXIT_FAILURE, "Unable to attach to the port pool, all instances need the same -a and -r\n");
+        }
+
+        if (napt_port_rss_init() < 0) {
+                onvm_nflib_stop(nf_local_ctx);
+                rte_exit(EXIT_FAILURE, "Unable to allocate the port hash table\n");
+        }
+
+        state_info->cur_cycles = rte_get_tsc_cycles();
+        state_info->last_print_cycles = state_info->cur_cycles;
+
+        onvm_nflib_run(nf_local_ctx);
+
+        onvm_nflib_stop(nf_local_ctx);
+        onvm_ft_free(state_info->ft);
+        rte_free(state_info->port_rss);
+        rte_free(state_info);
+        printf("If we reach here, program is ending!\n");
+        return 0;
+}
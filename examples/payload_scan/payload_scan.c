@@ -55,10 +55,13 @@
 #include <rte_ip.h>
 
 #include "onvm_nflib.h"
+#include "onvm_pattern.h"
 #include "onvm_pkt_helper.h"
 
 #define NF_TAG "payload_scan"
 
+#define MAX_PATTERNS 65536
+
 /* Number of packets between prints */
 static uint32_t print_delay = 10000000;
 
@@ -71,6 +74,12 @@ static uint8_t forward_on_match = 0;
 /* String to search within packet payload*/
 static char *search_term = NULL;
 
+/* File with one pattern per line to search within packet payload */
+static char *pattern_file = NULL;
+
+/* All search terms compiled together */
+static struct onvm_pattern_set *patterns;
+
 struct onvm_pkt_stats {
         uint64_t pkt_drop;
         uint64_t pkt_accept;
@@ -91,6 +100,8 @@ usage(const char *progname) {
         printf(" - `-p <print_delay>`: number of packets between each print, e.g. `-p 1` prints every packets.\n");
         printf(" - `-i <inverse mode>`: payload match to search term results in a packet drop, mismatch results in a forward\n");
         printf(" - `-s <input string>`: String to match against packet payload\n");
+        printf(" - `-f <pattern file>`: File with one pattern per line to match against packet payload, "
+               "`|..|` encloses hex bytes\n");
 }
 
 /*
@@ -100,18 +111,22 @@ static int
 parse_app_args(int argc, char *argv[], const char *progname) {
         int c, dst_flag = 0, input_flag = 0;
 
-        while ((c = getopt(argc, argv, "d:s:p:i")) != -1) {
+        while ((c = getopt(argc, argv, "d:s:f:p:i")) != -1) {
                 switch (c) {
                         case 'd':
                                 destination = strtoul(optarg, NULL, 10);
                                 dst_flag = 1;
                                 break;
                         case 's':
-                                search_term = malloc(sizeof(char) * (strlen(optarg)));
-                                strcpy(search_term, optarg);
+                                search_term = strdup(optarg);
                                 RTE_LOG(INFO, APP, "Search term = %s\n", search_term);
                                 input_flag = 1;
                                 break;
+                        case 'f':
+                                pattern_file = strdup(optarg);
+                                RTE_LOG(INFO, APP, "Pattern file = %s\n", pattern_file);
+                                input_flag = 1;
+                                break;
                         case 'p':
                                 print_delay = strtoul(optarg, NULL, 10);
                                 RTE_LOG(INFO, APP, "Print delay = %d\n", print_delay);
@@ -142,12 +157,48 @@ parse_app_args(int argc, char *argv[], const char *progname) {
                 return -1;
         }
         if (!input_flag) {
-                RTE_LOG(INFO, APP, "Payload NF requires a search term string with the -s flag.\n");
+                RTE_LOG(INFO, APP, "Payload NF requires a search term string with the -s flag or a pattern file with -f.\n");
                 return -1;
         }
         return optind;
 }
 
+/*
+ * Compile the search term and the patterns from the pattern file into one set.
+ */
+static int
+init_patterns(void) {
+        int ret;
+
+        patterns = onvm_pattern_set_create(MAX_PATTERNS, rte_socket_id());
+        if (patterns == NULL)
+                return -1;
+
+        if (search_term != NULL) {
+                ret = onvm_pattern_set_add(patterns, (const uint8_t *)search_term, strlen(search_term), 0);
+                if (ret < 0)
+                        return ret;
+        }
+
+        if (pattern_file != NULL) {
+                ret = onvm_pattern_set_load(patterns, pattern_file);
+                if (ret < 0) {
+                        RTE_LOG(INFO, APP, "Cannot load patterns from %s\n", pattern_file);
+                        return ret;
+                }
+        }
+
+        ret = onvm_pattern_set_compile(patterns);
+        if (ret == -E2BIG)
+                RTE_LOG(INFO, APP, "Patterns could need more than %u DFA states\n", patterns->max_states);
+        if (ret < 0)
+                return ret;
+
+        RTE_LOG(INFO, APP, "Compiled %u patterns into %u states (prefilter %s)\n", patterns->num_patterns,
+                patterns->num_states, patterns->use_prefilter ? "on" : "off");
+        return 0;
+}
+
 /*
  * This function displays stats. It uses ANSI terminal codes to clear
  * screen when called. It is called from a single non-master
@@ -162,7 +213,11 @@ do_stats_display(struct onvm_nf *nf) {
 
         /* Clear screen and move to top left */
         printf("%s%s", clr, topLeft);
-        printf("Search term: %s\n", search_term);
+        if (search_term != NULL)
+                printf("Search term: %s\n", search_term);
+        if (pattern_file != NULL)
+                printf("Pattern file: %s\n", pattern_file);
+        printf("Patterns: %u\n", patterns->num_patterns);
         printf("Packets accepted: %lu\n", stats->pkt_accept);
         printf("Packets dropped: %lu\n", stats->pkt_drop);
         printf("Packets not IPv4: %lu\n", stats->pkt_not_ipv4);
@@ -177,6 +232,9 @@ static int packet_handler(struct rte_mbuf *pkt, struct onvm_pkt_meta *meta, stru
         char search_match;
         static uint32_t counter = 0;
         uint8_t *pkt_data;
+        struct rte_ipv4_hdr *ipv4;
+        struct rte_tcp_hdr *tcp;
+        uint32_t offset, hdr_len, payload_len;
         struct onvm_pkt_stats *stats = (struct onvm_pkt_stats *) nf_local_ctx->nf->data;
 
         if (++counter == print_delay) {
@@ -202,15 +260,24 @@ static int packet_handler(struct rte_mbuf *pkt, struct onvm_pkt_meta *meta, stru
                 return 0;
         }
 
+        /* Payloads are binary, take their length from the headers instead of stopping at a NUL byte */
+        ipv4 = onvm_pkt_ipv4_hdr(pkt);
+        hdr_len = (ipv4->version_ihl & RTE_IPV4_HDR_IHL_MASK) * RTE_IPV4_IHL_MULTIPLIER;
+        offset = sizeof(struct rte_ether_hdr) + hdr_len;
         if (udp_pkt) {
-                pkt_data = rte_pktmbuf_mtod_offset(pkt, uint8_t * , sizeof(struct rte_ether_hdr) +
-                                                   sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr));
+                hdr_len += sizeof(struct rte_udp_hdr);
         } else {
-                pkt_data = rte_pktmbuf_mtod_offset(pkt, uint8_t * , sizeof(struct rte_ether_hdr) +
-                                                   sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_tcp_hdr));
+                tcp = rte_pktmbuf_mtod_offset(pkt, struct rte_tcp_hdr *, offset);
+                hdr_len += (tcp->data_off >> 4) * 4;
         }
+        offset = sizeof(struct rte_ether_hdr) + hdr_len;
+        payload_len = 0;
+        if (rte_be_to_cpu_16(ipv4->total_length) > hdr_len && rte_pktmbuf_data_len(pkt) > offset)
+                payload_len = RTE_MIN((uint32_t)rte_be_to_cpu_16(ipv4->total_length) - hdr_len,
+                                      (uint32_t)rte_pktmbuf_data_len(pkt) - offset);
+        pkt_data = rte_pktmbuf_mtod_offset(pkt, uint8_t *, offset);
 
-        search_match = strstr((const char *) pkt_data, search_term) != NULL;
+        search_match = onvm_pattern_scan(patterns, pkt_data, payload_len, NULL, NULL) != 0;
 
         if ((search_match && !forward_on_match) || (!search_match && forward_on_match)) {
                 meta->action = ONVM_NF_ACTION_TONF;
@@ -259,9 +326,15 @@ int main(int argc, char *argv[]) {
                 rte_exit(EXIT_FAILURE, "Invalid command-line arguments\n");
         }
 
+        if (init_patterns() < 0) {
+                onvm_nflib_stop(nf_local_ctx);
+                rte_exit(EXIT_FAILURE, "Cannot compile the search patterns\n");
+        }
+
         onvm_nflib_run(nf_local_ctx);
 
         onvm_nflib_stop(nf_local_ctx);
+        onvm_pattern_set_free(patterns);
         printf("If we reach here, program is ending\n");
         return 0;
 }
@@ -0,0 +1,1044 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * traffic_gen.c - replay pcap/pcapng files or generate UDP flows at a
+ *      rate paced by the TSC, with field ranges to spread the traffic
+ *      over many flows.
+ ********************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <rte_byteorder.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_errno.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+#include <rte_prefetch.h>
+#include <rte_random.h>
+#include <rte_udp.h>
+
+#include "onvm_nflib.h"
+#include "onvm_pkt_helper.h"
+
+#define NF_TAG "traffic_gen"
+
+#define DEFAULT_RATE 1000000
+#define DEFAULT_PKT_SIZE 64
+#define DEFAULT_SRC_IP RTE_IPV4(10, 0, 0, 1)
+#define DEFAULT_DST_IP RTE_IPV4(10, 0, 0, 2)
+#define DEFAULT_SRC_PORT 1234
+#define DEFAULT_DST_PORT 5678
+
+#define GEN_MAX_BURST 32
+/* A burst gets a packet per this many packets per second, so bursts stay about 10us apart at low rates */
+#define GEN_BURST_RATE_STEP 100000
+/* Fractional bits of the cycles per packet, so a rate that doesn't divide the TSC frequency keeps its average */
+#define GEN_PACE_FP_SHIFT 20
+/* Being this far behind schedule skips ahead instead of catching up with a storm of bursts */
+#define GEN_PACE_MAX_LAG_US 1000
+/* Bursts sent by one callback when it is behind schedule */
+#define GEN_PACE_MAX_BURSTS 8
+#define GEN_RAMP_STEP_US 1000
+#define NS_PER_S 1000000000ULL
+
+/* pcap and pcapng, see https://www.tcpdump.org/manpages/pcap-savefile.5.txt and draft-ietf-opsawg-pcapng */
+#define PCAP_MAGIC_US 0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define PCAP_FILE_HDR_LEN 24
+#define PCAP_REC_HDR_LEN 16
+#define PCAPNG_SHB 0x0A0D0D0A
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_IDB 1
+#define PCAPNG_SPB 3
+#define PCAPNG_EPB 6
+#define PCAPNG_BLOCK_MIN_LEN 12
+#define PCAPNG_OPT_END 0
+#define PCAPNG_OPT_TSRESOL 9
+#define PCAPNG_DEFAULT_TSRESOL 6
+#define PCAPNG_MAX_IFACES 64
+#define LINKTYPE_ETHERNET 1
+
+/* A packet to send, the data stays in the mapped file or the synthetic packet buffer */
+struct gen_template {
+        const uint8_t *data;
+        uint64_t gap_cycles;  // after the previous template at capture timing
+        uint16_t len;
+};
+
+/* Values a header field is set to, count 0 leaves the field as it is */
+struct gen_range {
+        uint32_t lo;
+        uint64_t count;
+};
+
+struct gen_stats {
+        uint64_t tx;
+        uint64_t tx_bytes;
+        uint64_t rx;
+        uint64_t loops;
+        uint64_t alloc_fail;
+        uint64_t late;       // times the generator fell too far behind and skipped ahead
+        uint64_t skipped;    // packets of the file that can't be replayed
+};
+
+struct pcapng_iface {
+        uint8_t ethernet;
+        uint8_t tsresol;
+};
+
+/*Struct that holds all NF state information */
+struct state_info {
+        struct onvm_nf *nf;
+        struct rte_mempool *pool;
+        uint16_t destination;
+        uint8_t action_out;
+        uint16_t print_delay;
+        const char *filename;
+        void *map;
+        size_t map_len;
+        uint8_t *synthetic;
+        uint16_t pkt_size;
+        struct rte_ether_addr dst_mac;
+        uint8_t set_dst_mac;
+        struct gen_range src_ip;
+        struct gen_range dst_ip;
+        struct gen_range src_port;
+        struct gen_range dst_port;
+        uint8_t randomize;
+        uint8_t set_checksums;
+        uint32_t split_index;
+        uint32_t split_count;
+        uint64_t num_seen;
+        struct gen_template *templates;
+        uint32_t num_templates;
+        uint32_t max_templates;
+        uint16_t max_len;  // longest packet an mbuf of the pool holds
+        uint64_t max_pkts;
+        uint64_t max_loops;
+        uint32_t next_tpl;
+        uint8_t capture_timing;
+        double speed;
+        uint64_t rate;             // target packets per second
+        uint64_t cur_rate;
+        uint64_t ramp_rate;        // rate the ramp starts from
+        uint64_t ramp_cycles;
+        uint64_t ramp_step_cycles;
+        uint64_t last_ramp_cycles;
+        uint64_t cycles_per_pkt_fp;
+        uint64_t pace_frac;
+        uint64_t next_tsc;
+        uint64_t max_lag_cycles;
+        uint16_t max_burst;
+        uint16_t burst;
+        uint64_t start_cycles;
+        uint64_t last_print_cycles;
+        uint64_t last_print_tx;
+        uint64_t last_print_tx_bytes;
+        struct gen_stats stats;
+};
+
+static struct state_info *state_info;
+
+/*
+ * Prints application arguments
+ */
+static void
+usage(const char *progname) {
+        printf("Usage:\n");
+        printf("%s [EAL args] -- [NF_LIB args] -- -d <destination> [-o] [-f <pcap_file>] [-t <rate>] "
+               "[-x <speed>] [-r <start_rate>:<seconds>] [-s <packet_size>] [-m <dst_mac>] [-S <src_ips>] "
+               "[-D <dst_ips>] [-P <src_ports>] [-Q <dst_ports>] [-b <burst>] [-n <count>] [-l <loops>] "
+               "[-k <index>/<count>] [-c] [-p <print_delay>]\n", progname);
+        printf("%s -F <CONFIG_FILE.json> [EAL args] -- [NF_LIB args] -- [NF args]\n\n", progname);
+        printf("Flags:\n");
+        printf(" - `-d <dst>`: Service ID to send the packets to, or port with `-o`\n");
+        printf(" - `-o`: Send the packets out of port `-d`\n");
+        printf(" - `-f <pcap_file>`: pcap or pcapng file of ethernet packets to replay, a UDP flow is generated "
+               "without it\n");
+        printf(" - `-t <rate>`: Packets per second (default %d), 0 replays the file at its capture timing\n",
+               DEFAULT_RATE);
+        printf(" - `-x <speed>`: Speed up the capture timing by this factor (default 1)\n");
+        printf(" - `-r <start_rate>:<seconds>`: Ramp the rate from start_rate to `-t` over that many seconds\n");
+        printf(" - `-s <packet_size>`: Size of the generated packets without a file (default %d)\n",
+               DEFAULT_PKT_SIZE);
+        printf(" - `-m <dst_mac>`: Destination MAC address, set in replayed packets too\n");
+        printf(" - `-S <src_ips>`, `-D <dst_ips>`: Source and destination address of each packet, picked at "
+               "random from a.b.c.d, a.b.c.d-e.f.g.h or a.b.c.d/len\n");
+        printf(" - `-P <src_ports>`, `-Q <dst_ports>`: TCP/UDP source and destination port of each packet, picked "
+               "at random from port or lo-hi\n");
+        printf(" - `-b <burst>`: Most packets sent at once (default %d)\n", GEN_MAX_BURST);
+        printf(" - `-n <count>`: Stop after sending count packets\n");
+        printf(" - `-l <loops>`: Stop after sending the file this many times\n");
+        printf(" - `-k <index>/<count>`: Only replay every count-th packet of the file starting at index, to split "
+               "a file over instances\n");
+        printf(" - `-c`: Recompute the IP and TCP/UDP checksums of each packet, offloaded to port `-d` when it can "
+               "with `-o`\n");
+        printf(" - `-p <print_delay>`: Number of seconds between each print, 0 to disable (default 1)\n");
+}
+
+static int
+parse_ip_range(char *str, struct gen_range *range) {
+        uint32_t lo, hi, mask;
+        char *sep;
+        int len;
+
+        if ((sep = strchr(str, '/')) != NULL) {
+                *sep = '\0';
+                len = atoi(sep + 1);
+                if (len < 0 || len > 32 || onvm_pkt_parse_ip(str, &lo) < 0)
+                        return -1;
+                mask = len == 0 ? 0 : ~0U << (32 - len);
+                lo &= mask;
+                hi = lo | ~mask;
+        } else if ((sep = strchr(str, '-')) != NULL) {
+                *sep = '\0';
+                if (onvm_pkt_parse_ip(str, &lo) < 0 || onvm_pkt_parse_ip(sep + 1, &hi) < 0 || lo > hi)
+                        return -1;
+        } else {
+                if (onvm_pkt_parse_ip(str, &lo) < 0)
+                        return -1;
+                hi = lo;
+        }
+
+        range->lo = lo;
+        range->count = (uint64_t)hi - lo + 1;
+        return 0;
+}
+
+static int
+parse_port_range(const char *str, struct gen_range *range) {
+        unsigned int lo, hi;
+        int count;
+
+        count = sscanf(str, "%u-%u", &lo, &hi);
+        if (count == 1)
+                hi = lo;
+        if (count < 1 || lo > hi || hi > UINT16_MAX)
+                return -1;
+
+        range->lo = lo;
+        range->count = hi - lo + 1;
+        return 0;
+}
+
+/*
+ * Loops through inputted arguments and assigns values as necessary
+ */
+static int
+parse_app_args(int argc, char *argv[], const char *progname) {
+        int c, dst_flag = 0;
+        unsigned int start, index, count;
+        double seconds;
+
+        while ((c = getopt(argc, argv, "d:of:t:x:r:s:m:S:D:P:Q:b:n:l:k:cp:")) != -1) {
+                switch (c) {
+                        case 'd':
+                                state_info->destination = strtoul(optarg, NULL, 10);
+                                dst_flag = 1;
+                                break;
+                        case 'o':
+                                state_info->action_out = 1;
+                                break;
+                        case 'f':
+                                state_info->filename = optarg;
+                                break;
+                        case 't':
+                                state_info->rate = strtoull(optarg, NULL, 10);
+                                break;
+                        case 'x':
+                                state_info->speed = strtod(optarg, NULL);
+                                if (state_info->speed <= 0) {
+                                        RTE_LOG(INFO, APP, "Invalid speed %s\n", optarg);
+                                        return -1;
+                                }
+                                break;
+                        case 'r':
+                                if (sscanf(optarg, "%u:%lf", &start, &seconds) != 2 || seconds <= 0) {
+                                        RTE_LOG(INFO, APP, "Invalid ramp %s\n", optarg);
+                                        return -1;
+                                }
+                                state_info->ramp_rate = start;
+                                state_info->ramp_cycles = seconds * rte_get_tsc_hz();
+                                break;
+                        case 's':
+                                state_info->pkt_size = strtoul(optarg, NULL, 10);
+                                break;
+                        case 'm':
+                                if (onvm_pkt_parse_mac(optarg, state_info->dst_mac.addr_bytes) < 0) {
+                                        RTE_LOG(INFO, APP, "Invalid MAC address %s\n", optarg);
+                                        return -1;
+                                }
+                                state_info->set_dst_mac = 1;
+                                break;
+                        case 'S':
+                        case 'D':
+                                if (parse_ip_range(optarg, c == 'S' ? &state_info->src_ip : &state_info->dst_ip) <
+                                    0) {
+                                        RTE_LOG(INFO, APP, "Invalid address range %s\n", optarg);
+                                        return -1;
+                                }
+                                break;
+                        case 'P':
+                        case 'Q':
+                                if (parse_port_range(optarg,
+                                                     c == 'P' ? &state_info->src_port : &state_info->dst_port) < 0) {
+                                        RTE_LOG(INFO, APP, "Invalid port range %s\n", optarg);
+                                        return -1;
+                                }
+                                break;
+                        case 'b':
+                                state_info->max_burst = strtoul(optarg, NULL, 10);
+                                if (state_info->max_burst == 0 || state_info->max_burst > GEN_MAX_BURST) {
+                                        RTE_LOG(INFO, APP, "Burst has to be between 1 and %d\n", GEN_MAX_BURST);
+                                        return -1;
+                                }
+                                break;
+                        case 'n':
+                                state_info->max_pkts = strtoull(optarg, NULL, 10);
+                                break;
+                        case 'l':
+                                state_info->max_loops = strtoull(optarg, NULL, 10);
+                                break;
+                        case 'k':
+                                if (sscanf(optarg, "%u/%u", &index, &count) != 2 || count == 0 || index >= count) {
+                                        RTE_LOG(INFO, APP, "Invalid split %s\n", optarg);
+                                        return -1;
+                                }
+                                state_info->split_index = index;
+                                state_info->split_count = count;
+                                break;
+                        case 'c':
+                                state_info->set_checksums = 1;
+                                break;
+                        case 'p':
+                                state_info->print_delay = strtoul(optarg, NULL, 10);
+                                break;
+                        case '?':
+                                usage(progname);
+                                if (strchr("dftxrsmSDPQbnlkp", optopt) != NULL)
+                                        RTE_LOG(INFO, APP, "Option -%c requires an argument\n", optopt);
+                                else
+                                        RTE_LOG(INFO, APP, "Unknown option character\n");
+                                return -1;
+                        default:
+                                usage(progname);
+                                return -1;
+                }
+        }
+
+        if (!dst_flag) {
+                RTE_LOG(INFO, APP, "Traffic generator NF requires a destination with -d\n");
+                return -1;
+        }
+        if (state_info->rate == 0 && state_info->filename == NULL) {
+                RTE_LOG(INFO, APP, "Capture timing (-t 0) needs a file to replay with -f\n");
+                return -1;
+        }
+        if (state_info->split_count > 1 && state_info->filename == NULL) {
+                RTE_LOG(INFO, APP, "A split (-k) needs a file to split with -f\n");
+                return -1;
+        }
+        if (state_info->rate == 0 && state_info->ramp_cycles != 0) {
+                RTE_LOG(INFO, APP, "A ramp (-r) needs a rate with -t\n");
+                return -1;
+        }
+        if (state_info->filename == NULL &&
+            (state_info->pkt_size < RTE_ETHER_HDR_LEN + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr) ||
+             state_info->pkt_size > state_info->max_len)) {
+                RTE_LOG(INFO, APP, "Generated packets need a size between %zu and %u\n",
+                        RTE_ETHER_HDR_LEN + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr),
+                        state_info->max_len);
+                return -1;
+        }
+
+        return optind;
+}
+
+/*********************************Templates**********************************/
+
+static inline uint16_t
+gen_read16(const uint8_t *p, int swap) {
+        uint16_t v;
+
+        memcpy(&v, p, sizeof(v));
+        return swap ? rte_bswap16(v) : v;
+}
+
+static inline uint32_t
+gen_read32(const uint8_t *p, int swap) {
+        uint32_t v;
+
+        memcpy(&v, p, sizeof(v));
+        return swap ? rte_bswap32(v) : v;
+}
+
+/*
+ * Keep a packet of the file as template, the timestamp is turned into the gap
+ * to the previous template once the whole file is read
+ */
+static int
+gen_add_template(const uint8_t *data, uint32_t len, uint64_t ts_ns) {
+        struct gen_template *templates;
+        struct gen_template *tpl;
+        uint32_t max;
+
+        if (state_info->num_seen++ % state_info->split_count != state_info->split_index)
+                return 0;
+        if (len < RTE_ETHER_HDR_LEN || len > state_info->max_len) {
+                state_info->stats.skipped++;
+                return 0;
+        }
+
+        if (state_info->num_templates == state_info->max_templates) {
+                if (state_info->max_templates == UINT32_MAX)
+                        return -ENOSPC;
+                max = state_info->max_templates == 0 ? 1024 : state_info->max_templates * 2;
+                if (max < state_info->max_templates)
+                        max = UINT32_MAX;
+                templates = realloc(state_info->templates, (size_t)max * sizeof(struct gen_template));
+                if (templates == NULL)
+                        return -ENOMEM;
+                state_info->templates = templates;
+                state_info->max_templates = max;
+        }
+
+        tpl = &state_info->templates[state_info->num_templates++];
+        tpl->data = data;
+        tpl->len = len;
+        tpl->gap_cycles = ts_ns;
+        return 0;
+}
+
+static int
+gen_load_pcap(const uint8_t *buf, size_t size) {
+        uint32_t magic, linktype, incl_len;
+        uint64_t frac_ns, ts_ns;
+        size_t off;
+        int swap, ret;
+
+        if (size < PCAP_FILE_HDR_LEN)
+                return -EINVAL;
+
+        magic = gen_read32(buf, 0);
+        swap = magic == rte_bswap32(PCAP_MAGIC_US) || magic == rte_bswap32(PCAP_MAGIC_NS);
+        frac_ns = magic == PCAP_MAGIC_NS || magic == rte_bswap32(PCAP_MAGIC_NS) ? 1 : 1000;
+        /* The upper bits of the link type may carry FCS information */
+        linktype = gen_read32(buf + 20, swap);
+        if ((linktype & 0xffff) != LINKTYPE_ETHERNET)
+                return -EPROTONOSUPPORT;
+
+        for (off = PCAP_FILE_HDR_LEN; off + PCAP_REC_HDR_LEN <= size; off += PCAP_REC_HDR_LEN + incl_len) {
+                incl_len = gen_read32(buf + off + 8, swap);
+                /* A capture cut short ends with a partial record */
+                if (incl_len > size - off - PCAP_REC_HDR_LEN)
+                        break;
+                ts_ns = gen_read32(buf + off, swap) * NS_PER_S + gen_read32(buf + off + 4, swap) * frac_ns;
+                ret = gen_add_template(buf + off + PCAP_REC_HDR_LEN, incl_len, ts_ns);
+                if (ret < 0)
+                        return ret;
+        }
+
+        return 0;
+}
+
+/*
+ * Interface description block options, only the timestamp resolution matters here
+ */
+static uint8_t
+gen_pcapng_tsresol(const uint8_t *opts, uint32_t len, int swap) {
+        uint16_t code, opt_len;
+        uint32_t off;
+
+        for (off = 0; off + 4 <= len; off += 4 + RTE_ALIGN_CEIL(opt_len, 4)) {
+                code = gen_read16(opts + off, swap);
+                opt_len = gen_read16(opts + off + 2, swap);
+                if (code == PCAPNG_OPT_END || opt_len > len - off - 4)
+                        break;
+                if (code == PCAPNG_OPT_TSRESOL && opt_len == 1)
+                        return opts[off + 4];
+        }
+
+        return PCAPNG_DEFAULT_TSRESOL;
+}
+
+/*
+ * The resolution is 10^-n seconds, or 2^-n with the top bit set
+ */
+static uint64_t
+gen_pcapng_ts_ns(uint64_t ts, uint8_t tsresol) {
+        uint8_t exp = tsresol & 0x7f;
+        uint64_t scale = 1;
+        uint8_t i;
+
+        if (tsresol & 0x80) {
+                /* Keeps the fraction times NS_PER_S within 64 bits */
+                if (exp > 34) {
+                        ts >>= exp - 34;
+                        exp = 34;
+                }
+                return (ts >> exp) * NS_PER_S + (((ts & ((1ULL << exp) - 1)) * NS_PER_S) >> exp);
+        }
+
+        if (exp > 19)
+                return 0;
+        for (i = 0; i < (exp <= 9 ? 9 - exp : exp - 9); i++)
+                scale *= 10;
+        return exp <= 9 ? ts * scale : ts / scale;
+}
+
+static int
+gen_load_pcapng(const uint8_t *buf, size_t size) {
+        struct pcapng_iface ifaces[PCAPNG_MAX_IFACES];
+        uint32_t type, len, body_len, iface, cap_len, num_ifaces = 0;
+        uint64_t ts, ts_ns = 0;
+        const uint8_t *body;
+        size_t off;
+        int swap = 0, ret;
+
+        for (off = 0; off + PCAPNG_BLOCK_MIN_LEN <= size; off += len) {
+                /* The section header type reads the same in either byte order */
+                type = gen_read32(buf + off, swap);
+                if (type == PCAPNG_SHB) {
+                        if (gen_read32(buf + off + 8, 0) == PCAPNG_BYTE_ORDER_MAGIC)
+                                swap = 0;
+                        else if (gen_read32(buf + off + 8, 0) == rte_bswap32(PCAPNG_BYTE_ORDER_MAGIC))
+                                swap = 1;
+                        else
+                                return -EINVAL;
+                        /* Interfaces are numbered per section */
+                        num_ifaces = 0;
+                }
+
+                len = gen_read32(buf + off + 4, swap);
+                if (len < PCAPNG_BLOCK_MIN_LEN || len % 4 != 0 || len > size - off)
+                        break;
+                body = buf + off + 8;
+                body_len = len - PCAPNG_BLOCK_MIN_LEN;
+
+                if (type == PCAPNG_IDB && body_len >= 8) {
+                        if (num_ifaces < PCAPNG_MAX_IFACES) {
+                                ifaces[num_ifaces].ethernet = gen_read16(body, swap) == LINKTYPE_ETHERNET;
+                                ifaces[num_ifaces].tsresol = gen_pcapng_tsresol(body + 8, body_len - 8, swap);
+                        }
+                        num_ifaces++;
+                } else if (type == PCAPNG_EPB && body_len >= 20) {
+                        iface = gen_read32(body, swap);
+                        cap_len = gen_read32(body + 12, swap);
+                        if (iface >= RTE_MIN(num_ifaces, (uint32_t)PCAPNG_MAX_IFACES) || !ifaces[iface].ethernet ||
+                            cap_len > body_len - 20) {
+                                state_info->stats.skipped++;
+                                continue;
+                        }
+                        ts = (uint64_t)gen_read32(body + 4, swap) << 32 | gen_read32(body + 8, swap);
+                        ts_ns = gen_pcapng_ts_ns(ts, ifaces[iface].tsresol);
+                        ret = gen_add_template(body + 20, cap_len, ts_ns);
+                        if (ret < 0)
+                                return ret;
+                } else if (type == PCAPNG_SPB && body_len >= 4) {
+                        /* Simple packets come from the first interface, have no timestamp and are padded */
+                        if (num_ifaces == 0 || !ifaces[0].ethernet) {
+                                state_info->stats.skipped++;
+                                continue;
+                        }
+                        cap_len = RTE_MIN(gen_read32(body, swap), body_len - 4);
+                        ret = gen_add_template(body + 4, cap_len, ts_ns);
+                        if (ret < 0)
+                                return ret;
+                }
+        }
+
+        return 0;
+}
+
+/*
+ * Map the file and keep its packets as templates. The mapping is populated
+ * up front so the replay doesn't fault pages in while it is paced.
+ */
+static int
+gen_load_file(void) {
+        const uint8_t *buf;
+        struct stat st;
+        int fd, ret;
+
+        fd = open(state_info->filename, O_RDONLY);
+        if (fd < 0)
+                return -errno;
+        if (fstat(fd, &st) < 0 || st.st_size < PCAPNG_BLOCK_MIN_LEN) {
+                close(fd);
+                return -EINVAL;
+        }
+        state_info->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        ret = -errno;
+        close(fd);
+        if (state_info->map == MAP_FAILED) {
+                state_info->map = NULL;
+                return ret;
+        }
+        state_info->map_len = st.st_size;
+
+        buf = state_info->map;
+        if (gen_read32(buf, 0) == PCAPNG_SHB)
+                ret = gen_load_pcapng(buf, state_info->map_len);
+        else if (gen_read32(buf, 0) == PCAP_MAGIC_US || gen_read32(buf, 0) == PCAP_MAGIC_NS ||
+                 gen_read32(buf, 1) == PCAP_MAGIC_US || gen_read32(buf, 1) == PCAP_MAGIC_NS)
+                ret = gen_load_pcap(buf, state_info->map_len);
+        else
+                ret = -EINVAL;
+        if (ret < 0)
+                return ret;
+
+        return state_info->num_templates == 0 ? -ENOENT : 0;
+}
+
+/*
+ * Without a file a single UDP packet from the low end of the ranges is the template
+ */
+static int
+gen_build_packet(void) {
+        struct rte_ether_hdr *eth_hdr;
+        struct rte_ipv4_hdr *ipv4_hdr;
+        struct rte_udp_hdr *udp_hdr;
+        uint16_t len = state_info->pkt_size;
+
+        state_info->synthetic = calloc(1, len);
+        if (state_info->synthetic == NULL)
+                return -ENOMEM;
+
+        eth_hdr = (struct rte_ether_hdr *)state_info->synthetic;
+        if (onvm_get_macaddr(0, &eth_hdr->s_addr) == -1) {
+                RTE_LOG(INFO, APP, "Using fake MAC address\n");
+                onvm_get_fake_macaddr(&eth_hdr->s_addr);
+        }
+        rte_ether_addr_copy(&state_info->dst_mac, &eth_hdr->d_addr);
+        eth_hdr->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4);
+
+        ipv4_hdr = (struct rte_ipv4_hdr *)(eth_hdr + 1);
+        onvm_pkt_fill_ipv4(ipv4_hdr, state_info->src_ip.count ? state_info->src_ip.lo : DEFAULT_SRC_IP,
+                           state_info->dst_ip.count ? state_info->dst_ip.lo : DEFAULT_DST_IP, IPPROTO_UDP);
+        ipv4_hdr->total_length = rte_cpu_to_be_16(len - RTE_ETHER_HDR_LEN);
+
+        udp_hdr = (struct rte_udp_hdr *)(ipv4_hdr + 1);
+        onvm_pkt_fill_udp(udp_hdr, state_info->src_port.count ? state_info->src_port.lo : DEFAULT_SRC_PORT,
+                          state_info->dst_port.count ? state_info->dst_port.lo : DEFAULT_DST_PORT,
+                          len - RTE_ETHER_HDR_LEN - sizeof(struct rte_ipv4_hdr) - sizeof(struct rte_udp_hdr));
+
+        /* Full checksums, so the ranges can patch them incrementally */
+        ipv4_hdr->hdr_checksum = rte_ipv4_cksum(ipv4_hdr);
+        udp_hdr->dgram_cksum = rte_ipv4_udptcp_cksum(ipv4_hdr, udp_hdr);
+
+        /* Single values are already in the packet */
+        if (state_info->src_ip.count == 1)
+                state_info->src_ip.count = 0;
+        if (state_info->dst_ip.count == 1)
+                state_info->dst_ip.count = 0;
+        if (state_info->src_port.count == 1)
+                state_info->src_port.count = 0;
+        if (state_info->dst_port.count == 1)
+                state_info->dst_port.count = 0;
+        state_info->set_dst_mac = 0;
+
+        return gen_add_template(state_info->synthetic, len, 0);
+}
+
+/*
+ * Turn the timestamps of the templates into gaps in TSC cycles, a loop of the
+ * file starts right after its last packet
+ */
+static void
+gen_set_gaps(void) {
+        double cycles_per_ns = (double)rte_get_tsc_hz() / NS_PER_S / state_info->speed;
+        struct gen_template *templates = state_info->templates;
+        uint32_t i;
+
+        for (i = state_info->num_templates - 1; i > 0; i--) {
+                if (templates[i].gap_cycles > templates[i - 1].gap_cycles)
+                        templates[i].gap_cycles = (templates[i].gap_cycles - templates[i - 1].gap_cycles) *
+                                                  cycles_per_ns;
+                else
+                        templates[i].gap_cycles = 0;
+        }
+        templates[0].gap_cycles = 0;
+}
+
+/*
+ * Packets come from the pool the manager and the other NFs use. With fast
+ * free a port puts all mbufs of a burst back in the pool of the first one,
+ * so mbufs of a pool of its own would end up mixed into the shared one.
+ */
+static int
+gen_pool_init(void) {
+        state_info->pool = rte_mempool_lookup(PKTMBUF_POOL_NAME);
+        if (state_info->pool == NULL)
+                return -ENOENT;
+
+        state_info->max_len = rte_pktmbuf_data_room_size(state_info->pool) - RTE_PKTMBUF_HEADROOM;
+        return 0;
+}
+
+/*********************************Pacing**********************************/
+
+static void
+gen_set_rate(uint64_t rate) {
+        if (rate == 0)
+                rate = 1;
+
+        state_info->cur_rate = rate;
+        state_info->cycles_per_pkt_fp = (rte_get_tsc_hz() << GEN_PACE_FP_SHIFT) / rate;
+        state_info->burst = RTE_MAX(RTE_MIN(rate / GEN_BURST_RATE_STEP, (uint64_t)state_info->max_burst), 1);
+}
+
+static void
+gen_ramp(uint64_t now) {
+        uint64_t elapsed = now - state_info->start_cycles;
+
+        state_info->last_ramp_cycles = now;
+        if (elapsed >= state_info->ramp_cycles) {
+                state_info->ramp_cycles = 0;
+                gen_set_rate(state_info->rate);
+                return;
+        }
+
+        gen_set_rate(state_info->ramp_rate + ((double)state_info->rate - state_info->ramp_rate) * elapsed /
+                                                     state_info->ramp_cycles);
+}
+
+/*
+ * Move the schedule on by the time count packets take at the current rate
+ */
+static inline void
+gen_pace_advance(uint16_t count) {
+        uint64_t fp = state_info->pace_frac + count * state_info->cycles_per_pkt_fp;
+
+        state_info->next_tsc += fp >> GEN_PACE_FP_SHIFT;
+        state_info->pace_frac = fp & ((1ULL << GEN_PACE_FP_SHIFT) - 1);
+}
+
+/*
+ * Number of templates due by now at capture timing, moves the schedule past them
+ */
+static inline uint16_t
+gen_capture_due(uint64_t now, uint16_t max) {
+        const struct gen_template *templates = state_info->templates;
+        uint32_t tpl = state_info->next_tpl;
+        uint16_t count = 0;
+
+        while (count < max && state_info->next_tsc <= now) {
+                count++;
+                tpl = tpl + 1 == state_info->num_templates ? 0 : tpl + 1;
+                state_info->next_tsc += templates[tpl].gap_cycles;
+        }
+
+        return count;
+}
+
+/*
+ * Packets left before the limits of -n and -l are reached
+ */
+static inline uint64_t
+gen_remaining(void) {
+        uint64_t left = UINT64_MAX;
+
+        if (state_info->max_pkts != 0)
+                left = state_info->max_pkts - (state_info->stats.tx + state_info->stats.alloc_fail);
+        if (state_info->max_loops != 0)
+                left = RTE_MIN(left, (state_info->max_loops - state_info->stats.loops) * state_info->num_templates -
+                                             state_info->next_tpl);
+        return left;
+}
+
+/*********************************Sending**********************************/
+
+static inline uint32_t
+gen_range_pick(const struct gen_range *range) {
+        return range->lo + (uint32_t)(((rte_rand() >> 32) * range->count) >> 32);
+}
+
+static inline void
+gen_randomize(struct rte_mbuf *pkt) {
+        struct rte_ether_hdr *eth_hdr = rte_pktmbuf_mtod(pkt, struct rte_ether_hdr *);
+
+        if (state_info->set_dst_mac)
+                rte_ether_addr_copy(&state_info->dst_mac, &eth_hdr->d_addr);
+        if (eth_hdr->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4))
+                return;
+
+        if (state_info->src_ip.count != 0)
+                onvm_pkt_set_ipv4_src(pkt, rte_cpu_to_be_32(gen_range_pick(&state_info->src_ip)));
+        if (state_info->dst_ip.count != 0)
+                onvm_pkt_set_ipv4_dst(pkt, rte_cpu_to_be_32(gen_range_pick(&state_info->dst_ip)));
+        if (state_info->src_port.count != 0)
+                onvm_pkt_set_src_port(pkt, rte_cpu_to_be_16(gen_range_pick(&state_info->src_port)));
+        if (state_info->dst_port.count != 0)
+                onvm_pkt_set_dst_port(pkt, rte_cpu_to_be_16(gen_range_pick(&state_info->dst_port)));
+}
+
+/*
+ * Copy the next count templates into packets of the pool and send them.
+ * Packets are copied rather than sent from the templates, the NFs after
+ * this one are free to rewrite them.
+ */
+static void
+gen_send_burst(struct onvm_nf *nf, uint16_t count) {
+        struct rte_mbuf *pkts[GEN_MAX_BURST];
+        const struct gen_template *tpl;
+        struct onvm_pkt_meta *meta;
+        uint16_t i;
+
+        if (unlikely(rte_pktmbuf_alloc_bulk(state_info->pool, pkts, count) != 0)) {
+                state_info->stats.alloc_fail += count;
+                return;
+        }
+
+        for (i = 0; i < count; i++) {
+                tpl = &state_info->templates[state_info->next_tpl];
+                if (++state_info->next_tpl == state_info->num_templates) {
+                        state_info->next_tpl = 0;
+                        state_info->stats.loops++;
+                }
+                rte_prefetch0(state_info->templates[state_info->next_tpl].data);
+
+                rte_memcpy(rte_pktmbuf_mtod(pkts[i], uint8_t *), tpl->data, tpl->len);
+                pkts[i]->data_len = tpl->len;
+                pkts[i]->pkt_len = tpl->len;
+                if (state_info->randomize)
+                        gen_randomize(pkts[i]);
+
+                pkts[i]->udata64 = 0;
+                meta = onvm_get_pkt_meta(pkts[i]);
+                meta->destination = state_info->destination;
+                meta->action = state_info->action_out ? ONVM_NF_ACTION_OUT : ONVM_NF_ACTION_TONF;
+                /* The checksum offload flags are those of the port the packet says it is on */
+                if (state_info->action_out)
+                        pkts[i]->port = state_info->destination;
+                state_info->stats.tx_bytes += tpl->len;
+        }
+
+        if (state_info->set_checksums)
+                onvm_pkt_set_checksums_burst(pkts, count);
+
+        state_info->stats.tx += count;
+        onvm_nflib_return_pkt_bulk(nf, pkts, count);
+}
+
+static void
+do_stats_display(uint64_t now) {
+        struct gen_stats *stats = &state_info->stats;
+        const char clr[] = {27, '[', '2', 'J', '\0'};
+        const char topLeft[] = {27, '[', '1', ';', '1', 'H', '\0'};
+        double elapsed = (double)(now - state_info->start_cycles) / rte_get_tsc_hz();
+        double interval = (double)(now - state_info->last_print_cycles) / rte_get_tsc_hz();
+        double tx_rate = (stats->tx - state_info->last_print_tx) / interval;
+        double tx_mbps = (stats->tx_bytes - state_info->last_print_tx_bytes) * 8 / interval / 1000000;
+
+        state_info->last_print_cycles = now;
+        state_info->last_print_tx = stats->tx;
+        state_info->last_print_tx_bytes = stats->tx_bytes;
+
+        /* Clear screen and move to top left */
+        printf("%s%s", clr, topLeft);
+
+        printf("Traffic generator\n");
+        printf("-----\n");
+        printf("Time elapsed   : %.2f s\n", elapsed);
+        printf("Templates      : %u\n", state_info->num_templates);
+        if (state_info->capture_timing)
+                printf("Rate (set)     : capture timing x%.2f\n", state_info->speed);
+        else
+                printf("Rate (set)     : %" PRIu64 " pps, burst %u\n", state_info->cur_rate, state_info->burst);
+        printf("Tx rate        : %.0f pps, %.2f Mbps\n", tx_rate, tx_mbps);
+        printf("Tx rate (avg)  : %.0f pps\n", stats->tx / elapsed);
+        printf("Tx packets     : %" PRIu64 "\n", stats->tx);
+        printf("Rx packets     : %" PRIu64 "\n", stats->rx);
+        printf("Loops          : %" PRIu64 "\n", stats->loops);
+        printf("Alloc failures : %" PRIu64 "\n", stats->alloc_fail);
+        printf("Fell behind    : %" PRIu64 "\n", stats->late);
+        printf("Skipped        : %" PRIu64 "\n", stats->skipped);
+        printf("\n\n");
+}
+
+static int
+callback_handler(struct onvm_nf_local_ctx *nf_local_ctx) {
+        uint64_t now = rte_get_tsc_cycles();
+        uint64_t left;
+        uint16_t bursts, count;
+
+        if (state_info->ramp_cycles != 0 && now - state_info->last_ramp_cycles >= state_info->ramp_step_cycles)
+                gen_ramp(now);
+
+        if (unlikely(now > state_info->next_tsc && now - state_info->next_tsc > state_info->max_lag_cycles)) {
+                state_info->next_tsc = now;
+                state_info->pace_frac = 0;
+                state_info->stats.late++;
+        }
+
+        for (bursts = 0; bursts < GEN_PACE_MAX_BURSTS && state_info->next_tsc <= now; bursts++) {
+                left = gen_remaining();
+                if (left == 0)
+                        break;
+                count = RTE_MIN(left, (uint64_t)state_info->burst);
+                if (state_info->capture_timing) {
+                        count = gen_capture_due(now, count);
+                } else {
+                        gen_pace_advance(count);
+                }
+                gen_send_burst(nf_local_ctx->nf, count);
+        }
+
+        if (state_info->print_delay != 0 &&
+            now - state_info->last_print_cycles > state_info->print_delay * rte_get_tsc_hz())
+                do_stats_display(now);
+
+        if (gen_remaining() == 0) {
+                do_stats_display(rte_get_tsc_cycles());
+                printf("Sent all packets, shutting down\n");
+                return 1;
+        }
+        return 0;
+}
+
+static int
+packet_handler(__attribute__((unused)) struct rte_mbuf *pkt, struct onvm_pkt_meta *meta,
+               __attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx) {
+        state_info->stats.rx++;
+        meta->action = ONVM_NF_ACTION_DROP;
+        return 0;
+}
+
+int
+main(int argc, char *argv[]) {
+        int arg_offset, ret;
+        struct onvm_nf_local_ctx *nf_local_ctx;
+        struct onvm_nf_function_table *nf_function_table;
+        const char *progname = argv[0];
+
+        nf_local_ctx = onvm_nflib_init_nf_local_ctx();
+        onvm_nflib_start_signal_handler(nf_local_ctx, NULL);
+
+        nf_function_table = onvm_nflib_init_nf_function_table();
+        nf_function_table->pkt_handler = &packet_handler;
+        nf_function_table->user_actions = &callback_handler;
+
+        if ((arg_offset = onvm_nflib_init(argc, argv, NF_TAG, nf_local_ctx, nf_function_table)) < 0) {
+                onvm_nflib_stop(nf_local_ctx);
+                if (arg_offset == ONVM_SIGNAL_TERMINATION) {
+                        printf("Exiting due to user termination\n");
+                        return 0;
+                } else {
+                        rte_exit(EXIT_FAILURE, "Failed ONVM init\n");
+                }
+        }
+
+        argc -= arg_offset;
+        argv += arg_offset;
+
+        state_info = rte_calloc("state", 1, sizeof(struct state_info), 0);
+        if (state_info == NULL) {
+                onvm_nflib_stop(nf_local_ctx);
+                rte_exit(EXIT_FAILURE, "Unable to initialize NF state");
+        }
+
+        state_info->nf = nf_local_ctx->nf;
+        state_info->rate = DEFAULT_RATE;
+        state_info->speed = 1;
+        state_info->pkt_size = DEFAULT_PKT_SIZE;
+        state_info->max_burst = GEN_MAX_BURST;
+        state_info->split_count = 1;
+        state_info->print_delay = 1;
+        memset(state_info->dst_mac.addr_bytes, 0xff, RTE_ETHER_ADDR_LEN);
+
+        ret = gen_pool_init();
+        if (ret < 0) {
+                onvm_nflib_stop(nf_local_ctx);
+                rte_exit(EXIT_FAILURE, "Unable to find the mbuf pool: %s\n", strerror(-ret));
+        }
+
+        if (parse_app_args(argc, argv, progname) < 0) {
+                onvm_nflib_stop(nf_local_ctx);
+                rte_exit(EXIT_FAILURE, "Invalid command-line arguments\n");
+        }
+
+        ret = state_info->filename != NULL ? gen_load_file() : gen_build_packet();
+        if (ret < 0) {
+                onvm_nflib_stop(nf_local_ctx);
+                rte_exit(EXIT_FAILURE, "Unable to load packets to send: %s\n", strerror(-ret));
+        }
+        gen_set_gaps();
+        state_info->randomize = state_info->set_dst_mac || state_info->src_ip.count || state_info->dst_ip.count ||
+                                state_info->src_port.count || state_info->dst_port.count;
+
+        /* Instances started together still pick different values from the ranges */
+        rte_srand(rte_rdtsc() + state_info->nf->instance_id);
+
+        state_info->capture_timing = state_info->rate == 0;
+        state_info->max_lag_cycles = rte_get_tsc_hz() / 1000000 * GEN_PACE_MAX_LAG_US;
+        state_info->ramp_step_cycles = rte_get_tsc_hz() / 1000000 * GEN_RAMP_STEP_US;
+        if (state_info->capture_timing)
+                state_info->burst = state_info->max_burst;
+        else
+                gen_set_rate(state_info->ramp_cycles != 0 ? state_info->ramp_rate : state_info->rate);
+        state_info->start_cycles = rte_get_tsc_cycles();
+        state_info->last_ramp_cycles = state_info->start_cycles;
+        state_info->last_print_cycles = state_info->start_cycles;
+        state_info->next_tsc = state_info->start_cycles;
+
+        onvm_nflib_run(nf_local_ctx);
+
+        onvm_nflib_stop(nf_local_ctx);
+        if (state_info->map != NULL)
+                munmap(state_info->map, state_info->map_len);
+        free(state_info->templates);
+        free(state_info->synthetic);
+        rte_free(state_info);
+        printf("If we reach here, program is ending!\n");
+        return 0;
+}
@@ -30,6 +30,18 @@ function usage {
         echo -e "\tRuns ONVM the same way as above, but adds a --base-virtaddr dpdk parameter to overwrite default address"
         echo -e "$0 -k 3 -n 0xF0 -m 2,3,4 -r 10 -d 2"
         echo -e "\tRuns ONVM the same way as above, but limits max service IDs to 10 and uses service ID 2 as the default"
+        echo -e "$0 -k 3 -n 0xF0 -m 2,3,4 -w /tmp/onvm -f \"tcp and port 80\" -e 10"
+        echo -e "\tRuns ONVM the same way as above, but writes 1 in 10 TCP port 80 packets to /tmp/onvm_<n>.pcapng (kill -USR1 toggles)"
+        echo -e "$0 -k 3 -n 0xF0 -m 2,3,4 -o 9100"
+        echo -e "\tRuns ONVM the same way as above, but serves OpenMetrics for Prometheus at http://<host>:9100/metrics"
+        echo -e "$0 -k 3 -n 0xF0 -m 2,3,4 -b hold:16"
+        echo -e "\tRuns ONVM the same way as above, but packets a full NF ring didn't take are retried for 16 flushes before being dropped"
+        echo -e "$0 -k 3 -n 0xF0 -m 2,3,4 -x ecn:80:40"
+        echo -e "\tRuns ONVM the same way as above, but ECN marks packets headed for a service whose rings are over 80% full until they drain below 40%"
+        echo -e "$0 -k 3 -n 0xF0 -m 2,3,4 -g 4"
+        echo -e "\tRuns ONVM the same way as above, but up to 4 instances of the default service read their own NIC RX queue"
+        echo -e "$0 -k 3 -n 0xF0 -m 2,3,4 -q forward,bridge:2"
+        echo -e "\tRuns ONVM the same way as above, but the RX thread runs the built in forward NF for the default service and bridge for service 2"
         exit 1
 }
 
@@ -112,7 +124,7 @@ then
     exit 1
 fi
 
-while getopts "a:r:d:s:t:l:p:z:cvm:k:n:j" opt; do
+while getopts "a:r:d:s:t:l:p:z:cvm:k:n:jw:f:e:o:b:x:g:q:" opt; do
     case $opt in
         a) virt_addr="--base-virtaddr=$OPTARG";;
         r) num_srvc="-r $OPTARG";;
@@ -155,6 +167,14 @@ while getopts "a:r:d:s:t:l:p:z:cvm:k:n:j" opt; do
                 nf_cores=$OPTARG
             fi;;
         j) jumbo_frames_flag="-j";;
+        w) capture_args+=(-k "$OPTARG");;
+        f) capture_args+=(-f "$OPTARG");;
+        e) capture_args+=(-e "$OPTARG");;
+        o) metrics_port="-o $OPTARG";;
+        b) backpressure="-b $OPTARG";;
+        x) congestion="-x $OPTARG";;
+        g) nf_rx_queues="-g $OPTARG";;
+        q) inline_nfs="-q $OPTARG";;
         \?) echo "Unknown option -$OPTARG" && usage
             ;;
     esac
@@ -272,7 +292,7 @@ fi
 sudo rm -rf /mnt/huge/rtemap_*
 # watch out for variable expansion
 # shellcheck disable=SC2086
-sudo "$SCRIPTPATH"/onvm_mgr/"$RTE_TARGET"/onvm_mgr -l "$cpu" -n 4 --proc-type=primary ${virt_addr} -- -p ${ports} -n ${nf_cores} ${num_srvc} ${def_srvc} ${stats} ${stats_sleep_time} ${verbosity_level} ${ttl} ${packet_limit} ${shared_cpu_flag} ${jumbo_frames_flag}
+sudo "$SCRIPTPATH"/onvm_mgr/"$RTE_TARGET"/onvm_mgr -l "$cpu" -n 4 --proc-type=primary ${virt_addr} -- -p ${ports} -n ${nf_cores} ${num_srvc} ${def_srvc} ${stats} ${stats_sleep_time} ${verbosity_level} ${ttl} ${packet_limit} ${shared_cpu_flag} ${jumbo_frames_flag} ${metrics_port} ${backpressure} ${congestion} ${nf_rx_queues} ${inline_nfs} "${capture_args[@]}"
 
 if [ "${stats}" = "-s web" ]
 then
@@ -71,7 +71,7 @@ handle_signal(int sig);
 /*******************************Worker threads********************************/
 
 /*
- * Stats thread periodically prints per-port and per-NF stats.
+ * Master thread periodically checks NF status and publishes per-port and per-NF stats.
  */
 static void
 master_thread_main(void) {
@@ -83,6 +83,12 @@ master_thread_main(void) {
         const uint32_t pkt_limit = global_pkt_limit;
         const uint64_t start_time = rte_get_tsc_cycles();
         uint64_t total_rx_pkts;
+        /* Scrapes of the metrics endpoint want fresher snapshots than the stats display */
+        const unsigned publish_ms = metrics_port ? ONVM_METRICS_PUBLISH_MS : sleeptime * 1000;
+        const unsigned publish_per_interval = RTE_MAX(sleeptime * 1000 / publish_ms, 1U);
+        const struct timespec publish_interval = {.tv_sec = publish_ms / 1000,
+                                                  .tv_nsec = (publish_ms % 1000) * 1000000L};
+        unsigned publish_count = 0;
 
         RTE_LOG(INFO, APP, "Socket %d, Core %d: Running master thread\n", rte_socket_id(), rte_lcore_id());
 
@@ -100,11 +106,21 @@ master_thread_main(void) {
         sleep(5);
 
         onvm_stats_init(verbosity_level);
-        /* Loop forever: sleep always returns 0 or <= param */
-        while (main_keep_running && sleep(sleeptime) <= sleeptime) {
+        if (onvm_metrics_start() != 0)
+                RTE_LOG(INFO, APP, "Cannot start the metrics endpoint on port %u\n", metrics_port);
+
+        /* Loop forever: nanosleep returns early only when interrupted by a signal */
+        while (main_keep_running) {
+                nanosleep(&publish_interval, NULL);
+                onvm_nf_check_congestion();
+                if (++publish_count < publish_per_interval) {
+                        onvm_stats_publish(0);
+                        continue;
+                }
+                publish_count = 0;
+
                 onvm_nf_check_status();
-                if (stats_destination != ONVM_STATS_NONE)
-                        onvm_stats_display_all(sleeptime, verbosity_level);
+                onvm_stats_publish(stats_destination != ONVM_STATS_NONE);
 
                 if (time_to_live && unlikely((rte_get_tsc_cycles() - start_time) * TIME_TTL_MULTIPLIER /
                                              rte_get_timer_hz() >= time_to_live)) {
@@ -124,6 +140,7 @@ master_thread_main(void) {
         }
 
         /* Close out file references and things */
+        onvm_metrics_stop();
         onvm_stats_cleanup();
 
 #ifdef RTE_LIBRTE_PDUMP
@@ -163,6 +180,9 @@ master_thread_main(void) {
                         rte_socket_id(), rte_lcore_id(), num_nfs);
         }
 
+        /* RX and TX threads are done, write out the remaining captured packets */
+        onvm_capture_stop();
+
         /* Clean up the shared memory */
         if (ONVM_NF_SHARE_CORES) {
                 for (i = 0; i < MAX_NFS; i++) {
@@ -183,6 +203,7 @@ rx_thread_main(void *arg) {
         uint16_t i, rx_count, cur_lcore;
         struct rte_mbuf *pkts[PACKET_READ_SIZE];
         struct queue_mgr *rx_mgr = (struct queue_mgr *)arg;
+        struct onvm_rtc_thread *rtc = onvm_rtc_get_thread(rx_mgr->id);
         cur_lcore = rte_lcore_id();
 
         onvm_stats_gen_event_info("Rx Start", ONVM_EVENT_WITH_CORE, &cur_lcore);
@@ -192,18 +213,26 @@ rx_thread_main(void *arg) {
                 /* Read ports */
                 for (i = 0; i < ports->num_ports; i++) {
                         rx_count = rte_eth_rx_burst(ports->id[i], rx_mgr->id, pkts, PACKET_READ_SIZE);
-                        ports->rx_stats.rx[ports->id[i]] += rx_count;
+                        __atomic_fetch_add(&ports->rx_stats.rx[ports->id[i]], rx_count, __ATOMIC_RELAXED);
 
                         /* Now process the NIC packets read */
                         if (likely(rx_count > 0)) {
+                                onvm_pkt_capture_batch(pkts, rx_count, cur_lcore, ports->id[i], ONVM_CAPTURE_PORT_RX);
                                 // If there is no running NF, we drop all the packets of the batch.
                                 if (!num_nfs) {
                                         onvm_pkt_drop_batch(pkts, rx_count);
+                                        onvm_drop_count(&ports->drop_stats, ONVM_DROP_NO_INSTANCE, rx_count);
+                                } else if (rtc != NULL) {
+                                        onvm_rtc_process_rx_batch(rtc, pkts, rx_count);
                                 } else {
                                         onvm_pkt_process_rx_batch(rx_mgr, pkts, rx_count);
                                 }
                         }
                 }
+
+                /* Run the inline NFs on packets from other NFs and send what they returned */
+                if (rtc != NULL)
+                        onvm_rtc_flush(rtc);
         }
 
         RTE_LOG(INFO, APP, "Socket %d, Core %d: RX thread done\n", rte_socket_id(), rte_lcore_id());
@@ -258,6 +287,8 @@ static void
 handle_signal(int sig) {
         if (sig == SIGINT || sig == SIGTERM) {
                 main_keep_running = 0;
+        } else if (sig == SIGUSR1) {
+                onvm_capture_toggle();
         }
 }
 
@@ -333,6 +364,7 @@ struct queue_mgr *rx_mgr[], struct wakeup_thread_context *wakeup_ctx[]) {
                 }
                 rte_free(rx_mgr[i]);
         }
+        onvm_rtc_free();
         if (ONVM_NF_SHARE_CORES) {
                 for (i = 0; i < ONVM_NUM_WAKEUP_THREADS; i++) {
                         if (wakeup_ctx[i] == NULL) {
@@ -403,6 +435,7 @@ main(int argc, char *argv[]) {
         /* Listen for ^C and docker stop so we can exit gracefully */
         signal(SIGINT, handle_signal);
         signal(SIGTERM, handle_signal);
+        signal(SIGUSR1, handle_signal);
 
         struct queue_mgr *tx_mgr[tx_lcores];
         struct queue_mgr *rx_mgr[rx_lcores];
@@ -453,6 +486,11 @@ main(int argc, char *argv[]) {
                         goto onvm_free;
                 }
                 cur_lcore = rte_get_next_lcore(cur_lcore, 1, 1);
+                if (onvm_rtc_init_thread(rx_mgr[i]->id, cur_lcore) != 0) {
+                        RTE_LOG(ERR, APP, "Cannot start the inline NFs of RX queue id %d\n", rx_mgr[i]->id);
+                        onvm_main_free(tx_lcores, rx_lcores, tx_mgr, rx_mgr, wakeup_ctx);
+                        return -1;
+                }
                 if (rte_eal_remote_launch(rx_thread_main, (void *)rx_mgr[i], cur_lcore) == -EBUSY) {
                         RTE_LOG(ERR, APP, "Socket %d, Core %d is already busy, can't use for RX queue id %d\n", rte_socket_id(), cur_lcore,
                                 rx_mgr[i]->id);
@@ -479,6 +517,11 @@ main(int argc, char *argv[]) {
                         }
                 }
         }
+
+        /* Captured packets are written from a low priority thread on the master core */
+        if (onvm_capture_start() != 0)
+                RTE_LOG(INFO, APP, "Cannot start the capture writer thread, not capturing\n");
+
         /* Master thread handles statistics and NF management */
         master_thread_main();
         onvm_main_free(tx_lcores,rx_lcores, tx_mgr, rx_mgr, wakeup_ctx);
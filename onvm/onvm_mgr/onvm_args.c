@@ -48,6 +48,7 @@
 ******************************************************************************/
 
 #include "onvm_mgr/onvm_args.h"
+#include "onvm_mgr/onvm_capture.h"
 #include "onvm_mgr/onvm_stats.h"
 
 /******************************Global variables*******************************/
@@ -117,6 +118,24 @@ parse_stats_sleep_time(const char *sleeptime);
 static int
 parse_verbosity_level(const char *verbosity_level);
 
+static int
+parse_capture_sample_rate(const char *sample_rate);
+
+static int
+parse_metrics_port(const char *port);
+
+static int
+parse_backpressure(const char *backpressure);
+
+static int
+parse_congestion(const char *congestion);
+
+static int
+parse_nf_rx_queues(const char *queues);
+
+static int
+parse_rtc_nfs(const char *nfs);
+
 /*********************************Interfaces**********************************/
 
 int
@@ -130,11 +149,15 @@ parse_app_args(uint8_t max_ports, int argc, char *argv[]) {
             {"stats-out", no_argument, NULL, 's'},       {"stats-sleep-time", no_argument, NULL, 'z'},
             {"time_to_live", no_argument, NULL, 't'},    {"packet_limit", no_argument, NULL, 'l'},
             {"verbocity-level", no_argument, NULL, 'v'}, {"enable_shared_cpu", no_argument, NULL, 'c'},
-            {"jumbo_frames", no_argument, NULL, 'j'}};
+            {"jumbo_frames", no_argument, NULL, 'j'},   {"capture", required_argument, NULL, 'k'},
+            {"capture-filter", required_argument, NULL, 'f'}, {"capture-sample", required_argument, NULL, 'e'},
+            {"metrics-port", required_argument, NULL, 'o'}, {"backpressure", required_argument, NULL, 'b'},
+            {"congestion", required_argument, NULL, 'x'}, {"nf-rx-queues", required_argument, NULL, 'g'},
+            {"inline-nfs", required_argument, NULL, 'q'}};
 
         progname = argv[0];
 
-        while ((opt = getopt_long(argc, argvopt, "p:r:n:d:s:t:l:z:v:cj", lgopts, &option_index)) != EOF) {
+        while ((opt = getopt_long(argc, argvopt, "p:r:n:d:s:t:l:z:v:cjk:f:e:o:b:x:g:q:", lgopts, &option_index)) != EOF) {
                 switch (opt) {
                         case 'p':
                                 if (parse_portmask(max_ports, optarg) != 0) {
@@ -199,6 +222,48 @@ parse_app_args(uint8_t max_ports, int argc, char *argv[]) {
                         case 'j':
                                 ONVM_USE_JUMBO_FRAMES = 1;
                                 break;
+                        case 'k':
+                                capture_path = optarg;
+                                break;
+                        case 'f':
+                                capture_filter = optarg;
+                                break;
+                        case 'e':
+                                if (parse_capture_sample_rate(optarg) != 0) {
+                                        usage();
+                                        return -1;
+                                }
+                                break;
+                        case 'o':
+                                if (parse_metrics_port(optarg) != 0) {
+                                        usage();
+                                        return -1;
+                                }
+                                break;
+                        case 'b':
+                                if (parse_backpressure(optarg) != 0) {
+                                        usage();
+                                        return -1;
+                                }
+                                break;
+                        case 'x':
+                                if (parse_congestion(optarg) != 0) {
+                                        usage();
+                                        return -1;
+                                }
+                                break;
+                        case 'g':
+                                if (parse_nf_rx_queues(optarg) != 0) {
+                                        usage();
+                                        return -1;
+                                }
+                                break;
+                        case 'q':
+                                if (parse_rtc_nfs(optarg) != 0) {
+                                        usage();
+                                        return -1;
+                                }
+                                break;
                         default:
                                 printf("ERROR: Unknown option '%c'\n", opt);
                                 usage();
@@ -224,7 +289,20 @@ usage(void) {
             "\t-l PACKET_LIMIT: how many millions of packets to recieve before exiting (optional)\n"
             "\t-v VERBOCITY_LEVEL: verbocity level of the stats output (optional)\n"
             "\t-c ENABLE_SHARED_CORE: allow the NFs to share a core based on mutex sleep/wakeups (optional)\n"
-            "\t-j JUMBO_FRAMES: allow the ports to send and receive jumbo frames (optional)\n",
+            "\t-j JUMBO_FRAMES: allow the ports to send and receive jumbo frames (optional)\n"
+            "\t-k CAPTURE_PATH: capture packets to rotating CAPTURE_PATH_<n>.pcapng files, SIGUSR1 toggles (optional)\n"
+            "\t-f CAPTURE_FILTER: only capture packets matching e.g. \"tcp and dst port 80\" (optional)\n"
+            "\t-e CAPTURE_SAMPLE: capture one in every CAPTURE_SAMPLE matching packets (optional)\n"
+            "\t-o METRICS_PORT: serve OpenMetrics over HTTP on METRICS_PORT at /metrics (optional)\n"
+            "\t-b BACKPRESSURE: what to do with packets a full ring didn't take, drop (default), hold[:FLUSHES] to\n"
+            "\t   retry them for up to FLUSHES flushes (8) or signal to also stop NFs reading until they drain (optional)\n"
+            "\t-x CONGESTION: drop[:HIGH:LOW] or ecn[:HIGH:LOW] packets headed for a service whose rx rings are\n"
+            "\t   over HIGH percent full (75) until they drain below LOW percent (25), ecn drops packets\n"
+            "\t   that can't be marked (optional)\n"
+            "\t-g NF_RX_QUEUES: set up NF_RX_QUEUES more RX queues on every port, each read by one instance of the\n"
+            "\t   default service instead of the manager RX threads (optional)\n"
+            "\t-q INLINE_NFS: NAME[:SERVICE][,NAME[:SERVICE]...] NFs built into the manager (bridge, forward) to\n"
+            "\t   run on the RX threads for SERVICE, the default service if not given (optional)\n",
             progname);
 }
 
@@ -414,3 +492,143 @@ parse_verbosity_level(const char *verbosity_level) {
         global_verbosity_level = (uint16_t)temp;
         return 0;
 }
+
+static int
+parse_capture_sample_rate(const char *sample_rate) {
+        char *end = NULL;
+        unsigned long temp;
+
+        temp = strtoul(sample_rate, &end, 10);
+        if (end == NULL || *end != '\0' || temp == 0 || temp > UINT32_MAX)
+                return -1;
+
+        capture_sample_rate = (uint32_t)temp;
+        return 0;
+}
+
+static int
+parse_metrics_port(const char *port) {
+        char *end = NULL;
+        unsigned long temp;
+
+        temp = strtoul(port, &end, 10);
+        if (end == NULL || *end != '\0' || temp == 0 || temp > UINT16_MAX)
+                return -1;
+
+        metrics_port = (uint16_t)temp;
+        return 0;
+}
+
+static int
+parse_backpressure(const char *backpressure) {
+        char *end = NULL;
+        unsigned long temp;
+
+        if (strcmp(backpressure, "drop") == 0) {
+                onvm_config->backpressure.policy = ONVM_BP_DROP_TAIL;
+        } else if (strcmp(backpressure, "signal") == 0) {
+                onvm_config->backpressure.policy = ONVM_BP_SIGNAL;
+        } else if (strncmp(backpressure, "hold", 4) == 0) {
+                onvm_config->backpressure.policy = ONVM_BP_HOLD;
+                if (backpressure[4] == '\0')
+                        return 0;
+                if (backpressure[4] != ':')
+                        return -1;
+                temp = strtoul(backpressure + 5, &end, 10);
+                if (end == NULL || *end != '\0' || temp == 0 || temp > UINT8_MAX)
+                        return -1;
+                onvm_config->backpressure.hold_budget = (uint8_t)temp;
+        } else {
+                return -1;
+        }
+        return 0;
+}
+
+static int
+parse_congestion(const char *congestion) {
+        const char *thresholds;
+        char *end = NULL;
+        unsigned long high, low;
+
+        if (strncmp(congestion, "drop", 4) == 0) {
+                onvm_config->congestion.action = ONVM_CONGESTION_DROP;
+                thresholds = congestion + 4;
+        } else if (strncmp(congestion, "ecn", 3) == 0) {
+                onvm_config->congestion.action = ONVM_CONGESTION_ECN;
+                thresholds = congestion + 3;
+        } else {
+                return -1;
+        }
+        if (*thresholds == '\0')
+                return 0;
+        if (*thresholds != ':')
+                return -1;
+
+        high = strtoul(thresholds + 1, &end, 10);
+        if (end == NULL || *end != ':')
+                return -1;
+        low = strtoul(end + 1, &end, 10);
+        /* The low watermark has to be below the high one or the flag would never clear */
+        if (end == NULL || *end != '\0' || high == 0 || high > 100 || low >= high)
+                return -1;
+        onvm_config->congestion.high_pct = (uint8_t)high;
+        onvm_config->congestion.low_pct = (uint8_t)low;
+        return 0;
+}
+
+static int
+parse_nf_rx_queues(const char *queues) {
+        char *end = NULL;
+        unsigned long temp;
+
+        temp = strtoul(queues, &end, 10);
+        if (end == NULL || *end != '\0' || temp > MAX_NFS)
+                return -1;
+
+        nf_rx_queues = (uint16_t)temp;
+        return 0;
+}
+
+static int
+parse_rtc_nfs(const char *nfs) {
+        char name[TAG_SIZE];
+        struct onvm_rtc_builtin *builtin;
+        const char *cur, *next;
+        char *end = NULL;
+        unsigned long service_id;
+        size_t len;
+
+        rtc_num_nfs = 0;
+        for (cur = nfs; *cur != '\0'; cur = next) {
+                if (rtc_num_nfs == ONVM_RTC_MAX_NFS)
+                        return -1;
+
+                len = strcspn(cur, ":,");
+                if (len == 0 || len >= TAG_SIZE)
+                        return -1;
+                memcpy(name, cur, len);
+                name[len] = '\0';
+                builtin = onvm_rtc_lookup_builtin(name);
+                if (builtin == NULL) {
+                        printf("ERROR: No NF named %s is built into the manager\n", name);
+                        return -1;
+                }
+
+                /* -d may come later on the command line, the default service is looked up when the NF starts */
+                service_id = ONVM_RTC_DEFAULT_SERVICE;
+                next = cur + len;
+                if (*next == ':') {
+                        service_id = strtoul(next + 1, &end, 10);
+                        if (end == next + 1 || (*end != ',' && *end != '\0') || service_id >= MAX_SERVICES)
+                                return -1;
+                        next = end;
+                }
+                if (*next == ',' && *++next == '\0')
+                        return -1;
+
+                rtc_nfs[rtc_num_nfs].builtin = builtin;
+                rtc_nfs[rtc_num_nfs].service_id = (uint16_t)service_id;
+                rtc_num_nfs++;
+        }
+        return 0;
+}
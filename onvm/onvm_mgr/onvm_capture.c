@@ -0,0 +1,441 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *            2010-2019 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ********************************************************************/
+
+/******************************************************************************
+                                 onvm_capture.c
+
+            This file contains the manager side of the packet capture
+            tap. The data path clones matching packets onto per core
+            rings, a low priority thread drains them into rotating
+            pcapng files.
+
+******************************************************************************/
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "onvm_mgr.h"
+#include "onvm_mgr/onvm_capture.h"
+
+/*********************************pcapng format*******************************/
+
+#define PCAPNG_SHB_TYPE 0x0A0D0D0A
+#define PCAPNG_IDB_TYPE 0x00000001
+#define PCAPNG_EPB_TYPE 0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_LINKTYPE_ETHERNET 1
+#define PCAPNG_OPT_END 0
+#define PCAPNG_OPT_COMMENT 1
+#define PCAPNG_IF_NAME 2
+#define PCAPNG_IF_TSRESOL 9
+#define PCAPNG_EPB_FLAGS 2
+#define PCAPNG_EPB_INBOUND 1
+#define PCAPNG_EPB_OUTBOUND 2
+#define PCAPNG_PAD(len) (((len) + 3) & ~3)
+#define CAPTURE_NS_PER_S 1000000000ULL
+
+struct pcapng_block_hdr {
+        uint32_t type;
+        uint32_t length;
+};
+
+struct pcapng_shb {
+        struct pcapng_block_hdr hdr;
+        uint32_t magic;
+        uint16_t major;
+        uint16_t minor;
+        int64_t section_length;
+} __attribute__((packed));
+
+struct pcapng_idb {
+        struct pcapng_block_hdr hdr;
+        uint16_t linktype;
+        uint16_t reserved;
+        uint32_t snaplen;
+} __attribute__((packed));
+
+struct pcapng_epb {
+        struct pcapng_block_hdr hdr;
+        uint32_t iface;
+        uint32_t ts_high;
+        uint32_t ts_low;
+        uint32_t caplen;
+        uint32_t len;
+} __attribute__((packed));
+
+struct pcapng_opt {
+        uint16_t code;
+        uint16_t length;
+};
+
+/******************************Global variables*******************************/
+
+/* capture arguments - extern in header onvm_capture.h */
+const char *capture_path = NULL;
+const char *capture_filter = "";
+uint32_t capture_sample_rate = 1;
+
+static pthread_t writer_thread;
+static volatile uint8_t writer_keep_running;
+static uint8_t writer_started;
+
+/* Only touched by the writer thread once it runs */
+static FILE *capture_file;
+static uint64_t capture_file_bytes;
+static unsigned capture_file_index;
+static uint64_t capture_base_ns;
+static uint64_t capture_base_tsc;
+static uint64_t capture_hz;
+static uint32_t port_iface[RTE_MAX_ETHPORTS];
+static uint32_t nf_iface;
+
+/***********************Internal Functions prototypes*************************/
+
+static void *
+onvm_capture_writer_main(void *arg);
+
+static unsigned
+onvm_capture_drain(void);
+
+static int
+onvm_capture_open_next_file(void);
+
+static void
+onvm_capture_write_idb(const char *name);
+
+static void
+onvm_capture_write_opt(uint16_t code, const void *data, uint16_t length);
+
+static void
+onvm_capture_write_pkt(struct rte_mbuf *clone);
+
+/*********************************Interfaces**********************************/
+
+int
+onvm_capture_init(void) {
+        const struct rte_memzone *mz_capture;
+        struct rte_ring *ring;
+        unsigned i, num_cores;
+
+        mz_capture = rte_memzone_reserve(MZ_CAPTURE_INFO, sizeof(*capture_info), rte_socket_id(), NO_FLAGS);
+        if (mz_capture == NULL)
+                return -1;
+        memset(mz_capture->addr, 0, sizeof(*capture_info));
+        capture_info = mz_capture->addr;
+
+        if (capture_path == NULL)
+                return 0;
+
+        if (onvm_pkt_capture_parse_filter(capture_filter, capture_info) != 0) {
+                printf("Invalid capture filter '%s'\n", capture_filter);
+                return -1;
+        }
+        capture_info->sample_rate = capture_sample_rate;
+
+        /* Clones carry no data, only the capture header in their private area */
+        printf("Creating mbuf pool '%s' [%u mbufs] ...\n", CAPTURE_CLONE_POOL_NAME, NUM_CAPTURE_MBUFS);
+        capture_info->clone_pool = rte_pktmbuf_pool_create(
+            CAPTURE_CLONE_POOL_NAME, NUM_CAPTURE_MBUFS, MBUF_CACHE_SIZE,
+            RTE_ALIGN(sizeof(struct onvm_capture_hdr), RTE_MBUF_PRIV_ALIGN), 0, rte_socket_id());
+        if (capture_info->clone_pool == NULL)
+                return -1;
+
+        /* One ring for every core the manager or an NF can run on */
+        num_cores = RTE_MIN(onvm_threading_get_num_cores(), RTE_MAX_LCORE);
+        for (i = 0; i < num_cores; i++) {
+                if (!rte_lcore_is_enabled(i) && !cores[i].enabled)
+                        continue;
+                ring = rte_ring_create(get_capture_ring_name(i), ONVM_CAPTURE_RING_SIZE, rte_socket_id(),
+                                       RING_F_SC_DEQ); /* multi prod, single cons */
+                if (ring == NULL)
+                        return -1;
+                capture_info->core[i].ring = ring;
+        }
+
+        printf("Capturing packets matching '%s' (1 in %u) to %s_*.pcapng\n", capture_info->filter,
+               capture_info->sample_rate, capture_path);
+        return 0;
+}
+
+int
+onvm_capture_start(void) {
+        struct sched_param param;
+        int ret;
+
+        if (capture_path == NULL)
+                return 0;
+
+        capture_hz = rte_get_tsc_hz();
+        writer_keep_running = 1;
+        ret = pthread_create(&writer_thread, NULL, onvm_capture_writer_main, NULL);
+        if (ret != 0)
+                return ret;
+        writer_started = 1;
+
+        /* Writing files must never take time away from the RX and TX threads */
+        memset(&param, 0, sizeof(param));
+        pthread_setschedparam(writer_thread, SCHED_IDLE, &param);
+
+        capture_info->enabled = 1;
+        return 0;
+}
+
+void
+onvm_capture_toggle(void) {
+        if (capture_info == NULL || !writer_started)
+                return;
+        capture_info->enabled = !capture_info->enabled;
+}
+
+void
+onvm_capture_stop(void) {
+        unsigned i;
+        uint64_t captured, missed;
+
+        if (!writer_started)
+                return;
+
+        capture_info->enabled = 0;
+        writer_keep_running = 0;
+        pthread_join(writer_thread, NULL);
+        writer_started = 0;
+
+        captured = missed = 0;
+        for (i = 0; i < RTE_MAX_LCORE; i++) {
+                captured += capture_info->core[i].captured;
+                missed += capture_info->core[i].missed;
+        }
+        RTE_LOG(INFO, APP, "Capture done: %" PRIu64 " packets written, %" PRIu64 " missed\n", captured, missed);
+}
+
+/*****************************Internal functions******************************/
+
+static void *
+onvm_capture_writer_main(__attribute__((unused)) void *arg) {
+        struct timespec now;
+        unsigned i;
+
+        clock_gettime(CLOCK_REALTIME, &now);
+        capture_base_tsc = rte_get_tsc_cycles();
+        capture_base_ns = (uint64_t)now.tv_sec * CAPTURE_NS_PER_S + now.tv_nsec;
+
+        /* Port interfaces first, all NFs share the one after them */
+        for (i = 0; i < ports->num_ports; i++)
+                port_iface[ports->id[i]] = i;
+        nf_iface = ports->num_ports;
+
+        if (onvm_capture_open_next_file() != 0)
+                return NULL;
+
+        while (writer_keep_running) {
+                if (onvm_capture_drain() == 0) {
+                        fflush(capture_file);
+                        usleep(1000);
+                }
+        }
+
+        /* Anything enqueued before the tap was turned off */
+        while (onvm_capture_drain() > 0)
+                ;
+
+        fclose(capture_file);
+        capture_file = NULL;
+        return NULL;
+}
+
+static unsigned
+onvm_capture_drain(void) {
+        struct rte_mbuf *clones[ONVM_CAPTURE_WRITE_BURST];
+        struct rte_ring *ring;
+        unsigned i, j, nb_clones, total;
+
+        total = 0;
+        for (i = 0; i < RTE_MAX_LCORE; i++) {
+                ring = capture_info->core[i].ring;
+                if (ring == NULL)
+                        continue;
+
+                nb_clones = rte_ring_dequeue_burst(ring, (void **)clones, ONVM_CAPTURE_WRITE_BURST, NULL);
+                for (j = 0; j < nb_clones; j++) {
+                        if (capture_file != NULL)
+                                onvm_capture_write_pkt(clones[j]);
+                        /* Drops the reference the tap took on the packet */
+                        rte_pktmbuf_free(clones[j]);
+                }
+                total += nb_clones;
+        }
+
+        if (capture_file != NULL && capture_file_bytes >= ONVM_CAPTURE_FILE_SIZE)
+                onvm_capture_open_next_file();
+
+        return total;
+}
+
+static int
+onvm_capture_open_next_file(void) {
+        struct pcapng_shb shb;
+        char name[256];
+        char iface_name[16];
+        uint16_t i;
+
+        if (capture_file != NULL)
+                fclose(capture_file);
+
+        snprintf(name, sizeof(name), "%s_%u.pcapng", capture_path, capture_file_index);
+        capture_file_index = (capture_file_index + 1) % ONVM_CAPTURE_MAX_FILES;
+
+        capture_file = fopen(name, "w");
+        if (capture_file == NULL) {
+                RTE_LOG(INFO, APP, "Cannot open capture file %s, capture stopped\n", name);
+                capture_info->enabled = 0;
+                return -1;
+        }
+        capture_file_bytes = 0;
+
+        memset(&shb, 0, sizeof(shb));
+        shb.hdr.type = PCAPNG_SHB_TYPE;
+        shb.hdr.length = sizeof(shb) + sizeof(uint32_t);
+        shb.magic = PCAPNG_BYTE_ORDER_MAGIC;
+        shb.major = 1;
+        shb.minor = 0;
+        shb.section_length = -1;
+        fwrite(&shb, sizeof(shb), 1, capture_file);
+        fwrite(&shb.hdr.length, sizeof(uint32_t), 1, capture_file);
+        capture_file_bytes += shb.hdr.length;
+
+        for (i = 0; i < ports->num_ports; i++) {
+                snprintf(iface_name, sizeof(iface_name), "port%u", ports->id[i]);
+                onvm_capture_write_idb(iface_name);
+        }
+        onvm_capture_write_idb("nf");
+
+        return 0;
+}
+
+static void
+onvm_capture_write_idb(const char *name) {
+        struct pcapng_idb idb;
+        uint16_t name_len;
+        uint8_t tsresol = 9; /* nanoseconds */
+
+        name_len = strlen(name);
+        memset(&idb, 0, sizeof(idb));
+        idb.hdr.type = PCAPNG_IDB_TYPE;
+        idb.hdr.length = sizeof(idb) + sizeof(struct pcapng_opt) + PCAPNG_PAD(name_len) +
+                         sizeof(struct pcapng_opt) + PCAPNG_PAD(sizeof(tsresol)) + sizeof(struct pcapng_opt) +
+                         sizeof(uint32_t);
+        idb.linktype = PCAPNG_LINKTYPE_ETHERNET;
+        idb.snaplen = ONVM_CAPTURE_SNAPLEN;
+
+        fwrite(&idb, sizeof(idb), 1, capture_file);
+        onvm_capture_write_opt(PCAPNG_IF_NAME, name, name_len);
+        onvm_capture_write_opt(PCAPNG_IF_TSRESOL, &tsresol, sizeof(tsresol));
+        onvm_capture_write_opt(PCAPNG_OPT_END, NULL, 0);
+        fwrite(&idb.hdr.length, sizeof(uint32_t), 1, capture_file);
+        capture_file_bytes += idb.hdr.length;
+}
+
+static void
+onvm_capture_write_opt(uint16_t code, const void *data, uint16_t length) {
+        static const uint8_t padding[4] = {0};
+        struct pcapng_opt opt;
+
+        opt.code = code;
+        opt.length = length;
+        fwrite(&opt, sizeof(opt), 1, capture_file);
+        if (length == 0)
+                return;
+        fwrite(data, length, 1, capture_file);
+        fwrite(padding, PCAPNG_PAD(length) - length, 1, capture_file);
+}
+
+static void
+onvm_capture_write_pkt(struct rte_mbuf *clone) {
+        static const uint8_t padding[4] = {0};
+        struct onvm_capture_hdr *hdr;
+        struct pcapng_epb epb;
+        struct rte_mbuf *seg;
+        char comment[16];
+        uint16_t comment_len;
+        uint32_t flags, caplen, left, seg_len;
+        uint64_t delta, ts;
+
+        hdr = onvm_pkt_capture_hdr(clone);
+        caplen = RTE_MIN(rte_pktmbuf_pkt_len(clone), (uint32_t)ONVM_CAPTURE_SNAPLEN);
+
+        comment_len = 0;
+        if (hdr->point == ONVM_CAPTURE_NF_TX)
+                comment_len = snprintf(comment, sizeof(comment), "nf %u", hdr->iface);
+        flags = hdr->point == ONVM_CAPTURE_PORT_RX ? PCAPNG_EPB_INBOUND : PCAPNG_EPB_OUTBOUND;
+
+        /* Split the division so the multiplication can't overflow */
+        delta = hdr->tsc - capture_base_tsc;
+        ts = capture_base_ns + (delta / capture_hz) * CAPTURE_NS_PER_S +
+             (delta % capture_hz) * CAPTURE_NS_PER_S / capture_hz;
+
+        memset(&epb, 0, sizeof(epb));
+        epb.hdr.type = PCAPNG_EPB_TYPE;
+        epb.hdr.length = sizeof(epb) + PCAPNG_PAD(caplen) + sizeof(struct pcapng_opt) + sizeof(flags) +
+                         (comment_len ? sizeof(struct pcapng_opt) + PCAPNG_PAD(comment_len) : 0) +
+                         sizeof(struct pcapng_opt) + sizeof(uint32_t);
+        epb.iface = hdr->point == ONVM_CAPTURE_NF_TX ? nf_iface : port_iface[hdr->iface];
+        epb.ts_high = (uint32_t)(ts >> 32);
+        epb.ts_low = (uint32_t)ts;
+        epb.caplen = caplen;
+        epb.len = rte_pktmbuf_pkt_len(clone);
+        fwrite(&epb, sizeof(epb), 1, capture_file);
+
+        /* The clone shares the segments of the original packet */
+        left = caplen;
+        for (seg = clone; seg != NULL && left > 0; seg = seg->next) {
+                seg_len = RTE_MIN((uint32_t)rte_pktmbuf_data_len(seg), left);
+                fwrite(rte_pktmbuf_mtod(seg, void *), seg_len, 1, capture_file);
+                left -= seg_len;
+        }
+        fwrite(padding, PCAPNG_PAD(caplen) - caplen, 1, capture_file);
+
+        onvm_capture_write_opt(PCAPNG_EPB_FLAGS, &flags, sizeof(flags));
+        if (comment_len)
+                onvm_capture_write_opt(PCAPNG_OPT_COMMENT, comment, comment_len);
+        onvm_capture_write_opt(PCAPNG_OPT_END, NULL, 0);
+        fwrite(&epb.hdr.length, sizeof(uint32_t), 1, capture_file);
+        capture_file_bytes += epb.hdr.length;
+}
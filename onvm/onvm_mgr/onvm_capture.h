@@ -0,0 +1,92 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *            2010-2019 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ********************************************************************/
+
+/******************************************************************************
+                                 onvm_capture.h
+
+            This file contains the prototypes of the manager side of the
+            packet capture tap: setting it up and writing pcapng files.
+
+******************************************************************************/
+
+#ifndef _ONVM_CAPTURE_H_
+#define _ONVM_CAPTURE_H_
+
+#include "onvm_pkt_capture.h"
+
+#define ONVM_CAPTURE_FILE_SIZE (64 * 1024 * 1024) /* rotate to the next file after this many bytes */
+#define ONVM_CAPTURE_MAX_FILES 8                  /* files are reused round robin */
+#define ONVM_CAPTURE_SNAPLEN 65535
+#define ONVM_CAPTURE_WRITE_BURST 64
+
+/* Capture arguments, set by parse_app_args */
+extern const char *capture_path;
+extern const char *capture_filter;
+extern uint32_t capture_sample_rate;
+
+/*
+ * Reserve the shared capture info and, if a capture path was given, the clone pool and per core rings.
+ *
+ * Output : 0 on success, -1 on a bad filter or allocation failure
+ */
+int
+onvm_capture_init(void);
+
+/*
+ * Start the low priority writer thread, does nothing if capturing wasn't configured.
+ *
+ * Output : 0 on success, an error code from pthread_create otherwise
+ */
+int
+onvm_capture_start(void);
+
+/*
+ * Turn the tap on or off at runtime without restarting any chain.
+ */
+void
+onvm_capture_toggle(void);
+
+/*
+ * Stop capturing, write out what is left in the rings and close the current file.
+ */
+void
+onvm_capture_stop(void);
+
+#endif  // _ONVM_CAPTURE_H_
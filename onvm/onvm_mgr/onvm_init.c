@@ -55,9 +55,12 @@ struct onvm_nf *nfs = NULL;
 struct port_info *ports = NULL;
 struct core_status *cores = NULL;
 struct onvm_configuration *onvm_config = NULL;
+struct onvm_congestion_info *congestion_info = NULL;
 struct nf_wakeup_info *nf_wakeup_infos = NULL;
 
 struct rte_mempool *pktmbuf_pool;
+struct rte_mempool *pktmbuf_clone_pool;
+struct rte_mempool *pkt_join_pool;
 struct rte_mempool *nf_init_cfg_pool;
 struct rte_mempool *nf_msg_pool;
 struct rte_ring *incoming_msg_queue;
@@ -65,6 +68,9 @@ uint16_t **services;
 uint16_t *nf_per_service_count;
 struct onvm_service_chain *default_chain;
 struct onvm_service_chain **default_sc_p;
+struct onvm_service_chain **sc_table;
+struct onvm_capture_info *capture_info;
+struct onvm_stats_snapshot *stats_snapshot;
 
 /*************************Internal Functions Prototypes***********************/
 
@@ -138,9 +144,12 @@ init(int argc, char *argv[]) {
         const struct rte_memzone *mz_port;
         const struct rte_memzone *mz_cores;
         const struct rte_memzone *mz_scp;
+        const struct rte_memzone *mz_sc_table;
         const struct rte_memzone *mz_services;
         const struct rte_memzone *mz_nf_per_service;
         const struct rte_memzone *mz_onvm_config;
+        const struct rte_memzone *mz_stats;
+        const struct rte_memzone *mz_congestion;
         uint8_t i, total_ports, port_id;
 
         /* init EAL, parsing EAL args */
@@ -164,6 +173,13 @@ init(int argc, char *argv[]) {
         memset(mz_nf->addr, 0, sizeof(*nfs) * MAX_NFS);
         nfs = mz_nf->addr;
 
+        /* set up the stats snapshot external readers consume */
+        mz_stats = rte_memzone_reserve(MZ_STATS_SNAPSHOT, sizeof(*stats_snapshot), rte_socket_id(), NO_FLAGS);
+        if (mz_stats == NULL)
+                rte_exit(EXIT_FAILURE, "Cannot reserve memory zone for stats snapshot\n");
+        memset(mz_stats->addr, 0, sizeof(*stats_snapshot));
+        stats_snapshot = mz_stats->addr;
+
         /* set up ports info */
         mz_port = rte_memzone_reserve(MZ_PORT_INFO, sizeof(*ports), rte_socket_id(), NO_FLAGS);
         if (mz_port == NULL)
@@ -195,13 +211,22 @@ init(int argc, char *argv[]) {
         nf_per_service_count = mz_nf_per_service->addr;
 
         /* set up custom flags */
-        mz_onvm_config = rte_memzone_reserve(MZ_ONVM_CONFIG, sizeof(uint16_t), rte_socket_id(), NO_FLAGS);
+        mz_onvm_config = rte_memzone_reserve(MZ_ONVM_CONFIG, sizeof(struct onvm_configuration), rte_socket_id(),
+                                             NO_FLAGS);
         if (mz_onvm_config == NULL) {
                 rte_exit(EXIT_FAILURE, "Cannot reserve memory zone for ONVM custom flags.\n");
         }
         onvm_config = mz_onvm_config->addr;
         set_default_config(onvm_config);
 
+        /* set up the congestion flags of services */
+        mz_congestion = rte_memzone_reserve(MZ_CONGESTION_INFO, sizeof(struct onvm_congestion_info), rte_socket_id(),
+                                            NO_FLAGS);
+        if (mz_congestion == NULL)
+                rte_exit(EXIT_FAILURE, "Cannot reserve memory zone for congestion info.\n");
+        memset(mz_congestion->addr, 0, sizeof(struct onvm_congestion_info));
+        congestion_info = mz_congestion->addr;
+
         /* parse additional, application arguments */
         retval = parse_app_args(total_ports, argc, argv);
         if (retval != 0)
@@ -224,6 +249,11 @@ init(int argc, char *argv[]) {
                 rte_exit(EXIT_FAILURE, "Cannot create nf message pool: %s\n", rte_strerror(rte_errno));
         }
 
+        /* set up the packet capture tap, only active when a capture path was given */
+        retval = onvm_capture_init();
+        if (retval != 0)
+                rte_exit(EXIT_FAILURE, "Cannot set up packet capture\n");
+
         /* now initialise the ports we will use */
         for (i = 0; i < ports->num_ports; i++) {
                 port_id = ports->id[i];
@@ -244,6 +274,14 @@ init(int argc, char *argv[]) {
         /* initialise the shared memory for shared core mode */
         init_shared_sem();
 
+        /* set up the table of installed service chains shared with NFs */
+        mz_sc_table = rte_memzone_reserve(MZ_SC_TABLE_INFO, sizeof(struct onvm_service_chain *) * ONVM_MAX_CHAINS,
+                                          rte_socket_id(), NO_FLAGS);
+        if (mz_sc_table == NULL)
+                rte_exit(EXIT_FAILURE, "Cannot reserve memory zone for service chain table\n");
+        memset(mz_sc_table->addr, 0, sizeof(struct onvm_service_chain *) * ONVM_MAX_CHAINS);
+        sc_table = mz_sc_table->addr;
+
         /*initialize a default service chain*/
         default_chain = onvm_sc_create();
         retval = onvm_sc_append_entry(default_chain, ONVM_NF_ACTION_TONF, 1);
@@ -275,6 +313,11 @@ init(int argc, char *argv[]) {
 static void
 set_default_config(struct onvm_configuration *config) {
         config->flags.ONVM_NF_SHARE_CORES = ONVM_NF_SHARE_CORES_DEFAULT;
+        config->backpressure.policy = ONVM_BP_DROP_TAIL;
+        config->backpressure.hold_budget = ONVM_BP_HOLD_BUDGET_DEFAULT;
+        config->congestion.action = ONVM_CONGESTION_OFF;
+        config->congestion.high_pct = ONVM_CONGESTION_HIGH_DEFAULT;
+        config->congestion.low_pct = ONVM_CONGESTION_LOW_DEFAULT;
 }
 
 /**
@@ -296,8 +339,22 @@ init_mbuf_pools(void) {
         pktmbuf_pool = rte_mempool_create(PKTMBUF_POOL_NAME, NUM_MBUFS, mbuf_size, MBUF_CACHE_SIZE,
                                           sizeof(struct rte_pktmbuf_pool_private), rte_pktmbuf_pool_init, NULL,
                                           rte_pktmbuf_init, NULL, rte_socket_id(), NO_FLAGS);
-
-        return (pktmbuf_pool == NULL); /* 0  on success */
+        if (pktmbuf_pool == NULL)
+                return 1;
+
+        /* Clones used by parallel chain stages only hold a header and a pointer to their join */
+        printf("Creating mbuf pool '%s' [%u mbufs] ...\n", PKTMBUF_CLONE_POOL_NAME, NUM_CLONE_MBUFS);
+        pktmbuf_clone_pool = rte_pktmbuf_pool_create(PKTMBUF_CLONE_POOL_NAME, NUM_CLONE_MBUFS, MBUF_CACHE_SIZE,
+                                                     RTE_ALIGN(sizeof(struct onvm_pkt_join *), RTE_MBUF_PRIV_ALIGN),
+                                                     0, rte_socket_id());
+        if (pktmbuf_clone_pool == NULL)
+                return 1;
+
+        printf("Creating mbuf pool '%s' ...\n", PKT_JOIN_POOL_NAME);
+        pkt_join_pool = rte_mempool_create(PKT_JOIN_POOL_NAME, NUM_PKT_JOINS, sizeof(struct onvm_pkt_join),
+                                           PKT_JOIN_CACHE_SIZE, 0, NULL, NULL, NULL, NULL, rte_socket_id(), NO_FLAGS);
+
+        return (pkt_join_pool == NULL); /* 0  on success */
 }
 
 /**
@@ -337,10 +394,12 @@ init_nf_init_cfg_pool(void) {
  */
 static int
 init_port(uint8_t port_num) {
-        const uint16_t rx_rings = ONVM_NUM_RX_THREADS;
+        const uint16_t rx_rings = onvm_rss_num_rx_queues();
         uint16_t rx_ring_size = RTE_MP_RX_DESC_DEFAULT;
-        /* Set the number of tx_rings equal to the tx threads. This mimics the onvm_mgr tx thread calculation. */
-        const uint16_t tx_rings = rte_lcore_count() - rx_rings - ONVM_NUM_MGR_AUX_THREADS;
+        /* Set the number of tx_rings equal to the tx threads. This mimics the onvm_mgr tx thread calculation.
+         * RX threads running NFs inline get one more each. */
+        const uint16_t tx_rings =
+            rte_lcore_count() - ONVM_NUM_RX_THREADS - ONVM_NUM_MGR_AUX_THREADS + onvm_rtc_num_tx_queues();
         uint16_t tx_ring_size = RTE_MP_TX_DESC_DEFAULT;
 
         struct rte_eth_rxconf rxq_conf;
@@ -360,7 +419,8 @@ init_port(uint8_t port_num) {
         /* Standard DPDK port initialisation - config port, then set up
          * rx and tx rings */
         rte_eth_dev_info_get(port_num, &dev_info);
-        if (dev_info.tx_offload_capa & DEV_TX_OFFLOAD_MBUF_FAST_FREE)
+        /* Capture holds clones of packets while they are sent, fast free would recycle them under the writer */
+        if ((dev_info.tx_offload_capa & DEV_TX_OFFLOAD_MBUF_FAST_FREE) && capture_path == NULL)
                 local_port_conf.txmode.offloads |= DEV_TX_OFFLOAD_MBUF_FAST_FREE;
         local_port_conf.rx_adv_conf.rss_conf.rss_hf &= dev_info.flow_type_rss_offloads;
         if (local_port_conf.rx_adv_conf.rss_conf.rss_hf != port_conf.rx_adv_conf.rss_conf.rss_hf) {
@@ -408,7 +468,12 @@ init_port(uint8_t port_num) {
         if (retval < 0)
                 return retval;
 
+        retval = onvm_rss_init_port(port_num);
+        if (retval < 0)
+                return retval;
+
         ports->init[port_num] = 1;
+        ports->fast_free[port_num] = !!(local_port_conf.txmode.offloads & DEV_TX_OFFLOAD_MBUF_FAST_FREE);
         printf("done: \n");
 
         return 0;
@@ -70,9 +70,14 @@
 #include "onvm_flow_table.h"
 #include "onvm_includes.h"
 #include "onvm_mgr/onvm_args.h"
+#include "onvm_mgr/onvm_capture.h"
+#include "onvm_mgr/onvm_metrics.h"
+#include "onvm_mgr/onvm_rss.h"
+#include "onvm_mgr/onvm_rtc.h"
 #include "onvm_mgr/onvm_stats.h"
 #include "onvm_sc_common.h"
 #include "onvm_sc_mgr.h"
+#include "onvm_stats_snapshot.h"
 #include "onvm_threading.h"
 
 /***********************************Macros************************************/
@@ -84,6 +89,7 @@
 
 #define NF_MSG_SIZE sizeof(struct onvm_nf_msg)
 #define NF_MSG_CACHE_SIZE 8
+#define PKT_JOIN_CACHE_SIZE 64
 
 #define RTE_MP_RX_DESC_DEFAULT 512
 #define RTE_MP_TX_DESC_DEFAULT 512
@@ -106,6 +112,8 @@ extern struct port_info *ports;
 extern struct core_status *cores;
 
 extern struct rte_mempool *pktmbuf_pool;
+extern struct rte_mempool *pktmbuf_clone_pool;
+extern struct rte_mempool *pkt_join_pool;
 extern struct rte_mempool *nf_msg_pool;
 extern uint16_t num_nfs;
 extern uint16_t num_services;
@@ -114,7 +122,9 @@ extern uint16_t **services;
 extern uint16_t *nf_per_service_count;
 extern unsigned num_sockets;
 extern struct onvm_service_chain *default_chain;
+extern struct onvm_service_chain **sc_table;
 extern struct onvm_ft *sdn_ft;
+extern struct onvm_stats_snapshot *stats_snapshot;
 extern ONVM_STATS_OUTPUT stats_destination;
 extern uint16_t global_stats_sleep_time;
 extern uint32_t global_time_to_live;
@@ -123,6 +133,7 @@ extern uint8_t global_verbosity_level;
 
 /* Custom flags for onvm */
 extern struct onvm_configuration *onvm_config;
+extern struct onvm_congestion_info *congestion_info;
 extern uint8_t ONVM_NF_SHARE_CORES;
 extern uint8_t ONVM_USE_JUMBO_FRAMES;
 
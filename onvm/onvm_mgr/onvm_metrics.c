@@ -0,0 +1,552 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *            2010-2019 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ********************************************************************/
+
+/******************************************************************************
+                                 onvm_metrics.c
+
+            This file contains the OpenMetrics HTTP endpoint. A low
+            priority thread serves the latest stats snapshot to
+            scrapers, it never touches the counters the data path
+            writes to.
+
+******************************************************************************/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "onvm_mgr.h"
+#include "onvm_mgr/onvm_metrics.h"
+
+#define METRICS_BUF_SIZE (64 * 1024)
+#define METRICS_BACKLOG 16
+
+#define NF_FIELD(field) offsetof(struct onvm_stats_nf_snapshot, field)
+
+struct metrics_buf {
+        char *data;
+        size_t len;
+        size_t size;
+};
+
+/* A metric family taken from one field of every NF in the snapshot */
+struct metrics_nf_field {
+        const char *name;
+        const char *help;
+        size_t offset;
+};
+
+static const struct metrics_nf_field nf_counters[] = {
+    {"onvm_nf_rx_packets", "Packets enqueued on the NF rx ring", NF_FIELD(rx)},
+    {"onvm_nf_rx_dropped_packets", "Packets dropped because the NF rx ring was full", NF_FIELD(rx_drop)},
+    {"onvm_nf_tx_packets", "Packets the NF sent on", NF_FIELD(tx)},
+    {"onvm_nf_tx_dropped_packets", "Packets dropped because the next ring was full", NF_FIELD(tx_drop)},
+    {"onvm_nf_tx_buffered_packets", "Packets the NF buffered before sending", NF_FIELD(tx_buffer)},
+    {"onvm_nf_tx_returned_packets", "Packets the NF returned to the manager", NF_FIELD(tx_returned)},
+    {"onvm_nf_action_out_packets", "Packets the NF sent out a port", NF_FIELD(act_out)},
+    {"onvm_nf_action_tonf_packets", "Packets the NF sent to another NF", NF_FIELD(act_tonf)},
+    {"onvm_nf_action_drop_packets", "Packets the NF dropped", NF_FIELD(act_drop)},
+    {"onvm_nf_action_next_packets", "Packets the NF sent to the next chain hop", NF_FIELD(act_next)},
+    {"onvm_nf_wakeups", "Times the manager woke the NF up in shared core mode", NF_FIELD(num_wakeups)},
+};
+
+static const struct metrics_nf_field nf_ring_gauges[] = {
+    {"onvm_nf_rx_ring_count", "Packets waiting on the NF rx ring", NF_FIELD(rx_q_count)},
+    {"onvm_nf_rx_ring_capacity", "Size of the NF rx ring", NF_FIELD(rx_q_capacity)},
+    {"onvm_nf_tx_ring_count", "Packets waiting on the NF tx ring", NF_FIELD(tx_q_count)},
+    {"onvm_nf_tx_ring_capacity", "Size of the NF tx ring", NF_FIELD(tx_q_capacity)},
+};
+
+/* Service totals are the sums of these NF counters over all instances */
+static const struct metrics_nf_field service_counters[] = {
+    {"onvm_service_rx_packets", "Packets enqueued on the rx rings of the service", NF_FIELD(rx)},
+    {"onvm_service_rx_dropped_packets", "Packets dropped because a rx ring of the service was full",
+     NF_FIELD(rx_drop)},
+    {"onvm_service_tx_packets", "Packets the instances of the service sent on", NF_FIELD(tx)},
+    {"onvm_service_tx_dropped_packets", "Packets of the service dropped because the next ring was full",
+     NF_FIELD(tx_drop)},
+};
+
+/******************************Global variables*******************************/
+
+/* metrics arguments - extern in header onvm_metrics.h */
+uint16_t metrics_port = 0;
+
+static pthread_t server_thread;
+static volatile uint8_t server_keep_running;
+static uint8_t server_started;
+static int listen_fd = -1;
+
+/* Only touched by the server thread once it runs */
+static struct metrics_buf body;
+static struct onvm_stats_snapshot snapshot;
+
+/***********************Internal Functions prototypes*************************/
+
+static void *
+onvm_metrics_server_main(void *arg);
+
+static void
+onvm_metrics_serve(int fd);
+
+static int
+onvm_metrics_format(struct metrics_buf *buf, const struct onvm_stats_snapshot *snap);
+
+static int
+onvm_metrics_printf(struct metrics_buf *buf, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static int
+onvm_metrics_nf_labels(struct metrics_buf *buf, const struct onvm_stats_nf_snapshot *nf, const char *extra);
+
+static int
+onvm_metrics_ring_hist(struct metrics_buf *buf, const struct onvm_stats_snapshot *snap, const char *name,
+                       const char *help, size_t offset);
+
+static int
+onvm_metrics_send(int fd, const char *data, size_t len);
+
+/*********************************Interfaces**********************************/
+
+int
+onvm_metrics_start(void) {
+        struct sockaddr_in addr;
+        struct sched_param param;
+        int one = 1;
+        int ret;
+
+        if (metrics_port == 0)
+                return 0;
+
+        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_fd < 0)
+                return -1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(metrics_port);
+        if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, METRICS_BACKLOG) < 0)
+                goto fail;
+
+        body.data = malloc(METRICS_BUF_SIZE);
+        if (body.data == NULL)
+                goto fail;
+        body.size = METRICS_BUF_SIZE;
+
+        server_keep_running = 1;
+        ret = pthread_create(&server_thread, NULL, onvm_metrics_server_main, NULL);
+        if (ret != 0)
+                goto fail;
+        server_started = 1;
+
+        /* Scrapes must never take time away from the RX and TX threads */
+        memset(&param, 0, sizeof(param));
+        pthread_setschedparam(server_thread, SCHED_IDLE, &param);
+
+        RTE_LOG(INFO, APP, "Serving OpenMetrics on port %u at %s\n", metrics_port, ONVM_METRICS_PATH);
+        return 0;
+
+fail:
+        free(body.data);
+        body.data = NULL;
+        close(listen_fd);
+        listen_fd = -1;
+        return -1;
+}
+
+void
+onvm_metrics_stop(void) {
+        if (!server_started)
+                return;
+
+        server_keep_running = 0;
+        pthread_join(server_thread, NULL);
+        server_started = 0;
+
+        close(listen_fd);
+        listen_fd = -1;
+        free(body.data);
+        body.data = NULL;
+}
+
+/*****************************Internal functions******************************/
+
+static void *
+onvm_metrics_server_main(__attribute__((unused)) void *arg) {
+        struct pollfd pfd;
+        int fd;
+
+        pfd.fd = listen_fd;
+        pfd.events = POLLIN;
+        while (server_keep_running) {
+                /* Wake up regularly so onvm_metrics_stop doesn't wait for a scrape */
+                if (poll(&pfd, 1, ONVM_METRICS_POLL_MS) <= 0)
+                        continue;
+                fd = accept(listen_fd, NULL, NULL);
+                if (fd < 0)
+                        continue;
+                onvm_metrics_serve(fd);
+                close(fd);
+        }
+
+        return NULL;
+}
+
+static void
+onvm_metrics_serve(int fd) {
+        char request[ONVM_METRICS_REQUEST_SIZE];
+        char header[256];
+        const char *status;
+        struct timeval timeout;
+        size_t path_len, len;
+        ssize_t n;
+        char *path;
+        int header_len;
+
+        timeout.tv_sec = ONVM_METRICS_RECV_TIMEOUT_S;
+        timeout.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        /* A client that stops reading must not stall the server, later scrapes wait behind it */
+        timeout.tv_sec = ONVM_METRICS_SEND_TIMEOUT_S;
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        /* Only the request line is used, read until the end of the headers or a full buffer */
+        len = 0;
+        request[0] = '\0';
+        while (len < sizeof(request) - 1 && strstr(request, "\r\n\r\n") == NULL) {
+                n = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+                if (n <= 0)
+                        break;
+                len += n;
+                request[len] = '\0';
+        }
+
+        body.len = 0;
+        path = strncmp(request, "GET ", 4) == 0 ? request + 4 : NULL;
+        path_len = path != NULL ? strcspn(path, " ?\r\n") : 0;
+        if (path == NULL) {
+                status = "405 Method Not Allowed";
+        } else if (path_len != strlen(ONVM_METRICS_PATH) || strncmp(path, ONVM_METRICS_PATH, path_len) != 0) {
+                status = "404 Not Found";
+        } else if (onvm_stats_snapshot_read(stats_snapshot, &snapshot) != 0) {
+                status = "503 Service Unavailable";
+        } else if (onvm_metrics_format(&body, &snapshot) != 0) {
+                body.len = 0;
+                status = "500 Internal Server Error";
+        } else {
+                status = "200 OK";
+        }
+
+        header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                              status, ONVM_METRICS_CONTENT_TYPE, body.len);
+        if (onvm_metrics_send(fd, header, header_len) == 0 && body.len > 0)
+                onvm_metrics_send(fd, body.data, body.len);
+}
+
+static int
+onvm_metrics_format(struct metrics_buf *buf, const struct onvm_stats_snapshot *snap) {
+        const struct onvm_stats_nf_snapshot *nf;
+        const struct onvm_stats_mempool_snapshot *pool;
+        const struct metrics_nf_field *field;
+        uint64_t sum, value64;
+        uint32_t value32;
+        char reason[40];
+        unsigned i, j, k;
+        int ret = 0;
+
+        ret |= onvm_metrics_printf(buf,
+                                   "# TYPE onvm_stats_snapshot_timestamp_seconds gauge\n"
+                                   "# HELP onvm_stats_snapshot_timestamp_seconds When the manager took the snapshot\n"
+                                   "onvm_stats_snapshot_timestamp_seconds %" PRIu64 "\n"
+                                   "# TYPE onvm_nfs gauge\n"
+                                   "# HELP onvm_nfs Running NFs\n"
+                                   "onvm_nfs %u\n",
+                                   snap->time, snap->num_nfs);
+
+        /* Ports */
+        ret |= onvm_metrics_printf(buf, "# TYPE onvm_port_rx_packets counter\n"
+                                        "# HELP onvm_port_rx_packets Packets received on the port\n");
+        for (i = 0; i < snap->num_ports; i++)
+                ret |= onvm_metrics_printf(buf, "onvm_port_rx_packets_total{port=\"%u\"} %" PRIu64 "\n",
+                                           snap->ports[i].id, snap->ports[i].rx);
+        ret |= onvm_metrics_printf(buf, "# TYPE onvm_port_tx_packets counter\n"
+                                        "# HELP onvm_port_tx_packets Packets sent out the port\n");
+        for (i = 0; i < snap->num_ports; i++)
+                ret |= onvm_metrics_printf(buf, "onvm_port_tx_packets_total{port=\"%u\"} %" PRIu64 "\n",
+                                           snap->ports[i].id, snap->ports[i].tx);
+        ret |= onvm_metrics_printf(buf, "# TYPE onvm_port_tx_dropped_packets counter\n"
+                                        "# HELP onvm_port_tx_dropped_packets Packets the port didn't accept\n");
+        for (i = 0; i < snap->num_ports; i++)
+                ret |= onvm_metrics_printf(buf, "onvm_port_tx_dropped_packets_total{port=\"%u\"} %" PRIu64 "\n",
+                                           snap->ports[i].id, snap->ports[i].tx_drop);
+
+        /* NFs, samples of a family have to be next to each other */
+        for (k = 0; k < RTE_DIM(nf_counters); k++) {
+                field = &nf_counters[k];
+                ret |= onvm_metrics_printf(buf, "# TYPE %s counter\n# HELP %s %s\n", field->name, field->name,
+                                           field->help);
+                for (i = 0; i < snap->num_nfs; i++) {
+                        nf = &snap->nfs[i];
+                        memcpy(&value64, (const char *)nf + field->offset, sizeof(value64));
+                        ret |= onvm_metrics_printf(buf, "%s_total", field->name);
+                        ret |= onvm_metrics_nf_labels(buf, nf, "");
+                        ret |= onvm_metrics_printf(buf, " %" PRIu64 "\n", value64);
+                }
+        }
+        for (k = 0; k < RTE_DIM(nf_ring_gauges); k++) {
+                field = &nf_ring_gauges[k];
+                ret |= onvm_metrics_printf(buf, "# TYPE %s gauge\n# HELP %s %s\n", field->name, field->name,
+                                           field->help);
+                for (i = 0; i < snap->num_nfs; i++) {
+                        nf = &snap->nfs[i];
+                        memcpy(&value32, (const char *)nf + field->offset, sizeof(value32));
+                        ret |= onvm_metrics_printf(buf, "%s", field->name);
+                        ret |= onvm_metrics_nf_labels(buf, nf, "");
+                        ret |= onvm_metrics_printf(buf, " %u\n", value32);
+                }
+        }
+        ret |= onvm_metrics_printf(buf, "# TYPE onvm_nf_congested gauge\n"
+                                        "# HELP onvm_nf_congested 1 while the NF rx rings are over the congestion "
+                                        "high watermark\n");
+        for (i = 0; i < snap->num_nfs; i++) {
+                nf = &snap->nfs[i];
+                ret |= onvm_metrics_printf(buf, "onvm_nf_congested");
+                ret |= onvm_metrics_nf_labels(buf, nf, "");
+                ret |= onvm_metrics_printf(buf, " %u\n", nf->congested);
+        }
+
+        ret |= onvm_metrics_printf(buf, "# TYPE onvm_nf_dropped_packets counter\n"
+                                        "# HELP onvm_nf_dropped_packets Packets dropped by reason, ring_full counts the "
+                                        "drops on the NF rx ring, the other reasons the packets the NF sent\n");
+        for (i = 0; i < snap->num_nfs; i++) {
+                nf = &snap->nfs[i];
+                for (k = 0; k < ONVM_DROP_REASON_MAX; k++) {
+                        snprintf(reason, sizeof(reason), ",reason=\"%s\"", onvm_drop_reason_name(k));
+                        ret |= onvm_metrics_printf(buf, "onvm_nf_dropped_packets_total");
+                        ret |= onvm_metrics_nf_labels(buf, nf, reason);
+                        ret |= onvm_metrics_printf(buf, " %" PRIu64 "\n", nf->drop[k]);
+                }
+        }
+        ret |= onvm_metrics_ring_hist(buf, snap, "onvm_nf_rx_ring_depth",
+                                      "Depth of the NF rx ring sampled on every burst enqueued", NF_FIELD(rx_q_hist));
+        ret |= onvm_metrics_ring_hist(buf, snap, "onvm_nf_tx_ring_depth",
+                                      "Depth of the NF tx ring sampled on every burst enqueued", NF_FIELD(tx_q_hist));
+
+        /* Drops of packets from or to a port */
+        ret |= onvm_metrics_printf(buf, "# TYPE onvm_mgr_dropped_packets counter\n"
+                                        "# HELP onvm_mgr_dropped_packets Packets from or to a port the manager dropped, "
+                                        "by reason\n");
+        for (k = 0; k < ONVM_DROP_REASON_MAX; k++)
+                ret |= onvm_metrics_printf(buf, "onvm_mgr_dropped_packets_total{reason=\"%s\"} %" PRIu64 "\n",
+                                           onvm_drop_reason_name(k), snap->drop[k]);
+
+        /* Services */
+        ret |= onvm_metrics_printf(buf, "# TYPE onvm_service_instances gauge\n"
+                                        "# HELP onvm_service_instances Running instances of the service\n");
+        for (j = 0; j < snap->num_services; j++) {
+                if (snap->nf_per_service[j] == 0)
+                        continue;
+                ret |= onvm_metrics_printf(buf, "onvm_service_instances{service_id=\"%u\"} %u\n", j,
+                                           snap->nf_per_service[j]);
+        }
+        ret |= onvm_metrics_printf(buf, "# TYPE onvm_service_congested gauge\n"
+                                        "# HELP onvm_service_congested 1 while all instances of the service are "
+                                        "congested\n");
+        for (j = 0; j < snap->num_services; j++) {
+                if (snap->nf_per_service[j] == 0)
+                        continue;
+                ret |= onvm_metrics_printf(buf, "onvm_service_congested{service_id=\"%u\"} %u\n", j,
+                                           snap->congested_nfs[j] >= snap->nf_per_service[j]);
+        }
+        for (k = 0; k < RTE_DIM(service_counters); k++) {
+                field = &service_counters[k];
+                ret |= onvm_metrics_printf(buf, "# TYPE %s counter\n# HELP %s %s\n", field->name, field->name,
+                                           field->help);
+                for (j = 0; j < snap->num_services; j++) {
+                        if (snap->nf_per_service[j] == 0)
+                                continue;
+                        sum = 0;
+                        for (i = 0; i < snap->num_nfs; i++) {
+                                if (snap->nfs[i].service_id != j)
+                                        continue;
+                                memcpy(&value64, (const char *)&snap->nfs[i] + field->offset, sizeof(value64));
+                                sum += value64;
+                        }
+                        ret |= onvm_metrics_printf(buf, "%s_total{service_id=\"%u\"} %" PRIu64 "\n", field->name, j,
+                                                   sum);
+                }
+        }
+
+        /* Chains */
+        ret |= onvm_metrics_printf(buf, "# TYPE onvm_chain_early_dropped_packets counter\n"
+                                        "# HELP onvm_chain_early_dropped_packets Packets of the chain dropped ahead "
+                                        "of a congested hop\n");
+        for (i = 0; i < snap->num_chains; i++)
+                ret |= onvm_metrics_printf(buf,
+                                           "onvm_chain_early_dropped_packets_total{chain_id=\"%u\"} %" PRIu64 "\n",
+                                           snap->chains[i].chain_id, snap->chains[i].early_drop);
+        ret |= onvm_metrics_printf(buf, "# TYPE onvm_chain_ecn_marked_packets counter\n"
+                                        "# HELP onvm_chain_ecn_marked_packets Packets of the chain marked CE ahead "
+                                        "of a congested hop\n");
+        for (i = 0; i < snap->num_chains; i++)
+                ret |= onvm_metrics_printf(buf,
+                                           "onvm_chain_ecn_marked_packets_total{chain_id=\"%u\"} %" PRIu64 "\n",
+                                           snap->chains[i].chain_id, snap->chains[i].ecn_marked);
+
+        /* Mempools */
+        ret |= onvm_metrics_printf(buf, "# TYPE onvm_mempool_size gauge\n"
+                                        "# HELP onvm_mempool_size Objects in the mempool\n");
+        for (i = 0; i < snap->num_mempools; i++) {
+                pool = &snap->mempools[i];
+                ret |= onvm_metrics_printf(buf, "onvm_mempool_size{pool=\"%s\"} %u\n", pool->name, pool->size);
+        }
+        ret |= onvm_metrics_printf(buf, "# TYPE onvm_mempool_available gauge\n"
+                                        "# HELP onvm_mempool_available Free objects in the mempool and its caches\n");
+        for (i = 0; i < snap->num_mempools; i++) {
+                pool = &snap->mempools[i];
+                ret |= onvm_metrics_printf(buf, "onvm_mempool_available{pool=\"%s\"} %u\n", pool->name,
+                                           pool->avail);
+        }
+
+        ret |= onvm_metrics_printf(buf, "# EOF\n");
+        return ret;
+}
+
+static int
+onvm_metrics_nf_labels(struct metrics_buf *buf, const struct onvm_stats_nf_snapshot *nf, const char *extra) {
+        char tag[2 * TAG_SIZE];
+        unsigned i, j;
+
+        /* Escape the tag as an OpenMetrics label value */
+        for (i = 0, j = 0; i < TAG_SIZE && nf->tag[i] != '\0' && j < sizeof(tag) - 2; i++) {
+                if (nf->tag[i] == '"' || nf->tag[i] == '\\')
+                        tag[j++] = '\\';
+                tag[j++] = nf->tag[i] == '\n' ? ' ' : nf->tag[i];
+        }
+        tag[j] = '\0';
+
+        return onvm_metrics_printf(buf, "{instance_id=\"%u\",service_id=\"%u\",core=\"%u\",tag=\"%s\"%s}",
+                                   nf->instance_id, nf->service_id, nf->core, tag, extra);
+}
+
+static int
+onvm_metrics_ring_hist(struct metrics_buf *buf, const struct onvm_stats_snapshot *snap, const char *name,
+                       const char *help, size_t offset) {
+        const struct onvm_stats_nf_snapshot *nf;
+        uint64_t hist[ONVM_RING_HIST_BUCKETS];
+        uint64_t count;
+        char le[32];
+        unsigned i, b;
+        int ret = 0;
+
+        ret |= onvm_metrics_printf(buf, "# TYPE %s histogram\n# HELP %s %s\n", name, name, help);
+        for (i = 0; i < snap->num_nfs; i++) {
+                nf = &snap->nfs[i];
+                memcpy(hist, (const char *)nf + offset, sizeof(hist));
+                /* Bucket b holds depths below 2^b, OpenMetrics buckets are cumulative */
+                count = 0;
+                for (b = 0; b < ONVM_RING_HIST_BUCKETS; b++) {
+                        count += hist[b];
+                        if (b == ONVM_RING_HIST_BUCKETS - 1)
+                                snprintf(le, sizeof(le), ",le=\"+Inf\"");
+                        else
+                                snprintf(le, sizeof(le), ",le=\"%u\"", (1U << b) - 1);
+                        ret |= onvm_metrics_printf(buf, "%s_bucket", name);
+                        ret |= onvm_metrics_nf_labels(buf, nf, le);
+                        ret |= onvm_metrics_printf(buf, " %" PRIu64 "\n", count);
+                }
+                ret |= onvm_metrics_printf(buf, "%s_count", name);
+                ret |= onvm_metrics_nf_labels(buf, nf, "");
+                ret |= onvm_metrics_printf(buf, " %" PRIu64 "\n", count);
+        }
+        return ret;
+}
+
+static int
+onvm_metrics_printf(struct metrics_buf *buf, const char *fmt, ...) {
+        va_list ap;
+        size_t size;
+        char *data;
+        int n;
+
+        for (;;) {
+                va_start(ap, fmt);
+                n = vsnprintf(buf->data + buf->len, buf->size - buf->len, fmt, ap);
+                va_end(ap);
+                if (n < 0)
+                        return -1;
+                if ((size_t)n < buf->size - buf->len) {
+                        buf->len += n;
+                        return 0;
+                }
+
+                /* Grow the buffer, it is kept for the next scrape */
+                size = buf->size * 2;
+                while (size - buf->len <= (size_t)n)
+                        size *= 2;
+                data = realloc(buf->data, size);
+                if (data == NULL)
+                        return -1;
+                buf->data = data;
+                buf->size = size;
+        }
+}
+
+static int
+onvm_metrics_send(int fd, const char *data, size_t len) {
+        ssize_t n;
+
+        while (len > 0) {
+                n = send(fd, data, len, MSG_NOSIGNAL);
+                if (n <= 0)
+                        return -1;
+                data += n;
+                len -= n;
+        }
+        return 0;
+}
@@ -0,0 +1,79 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *            2010-2019 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ********************************************************************/
+
+/******************************************************************************
+                                 onvm_metrics.h
+
+            This file contains the prototypes of the OpenMetrics HTTP
+            endpoint that serves the published stats snapshots.
+
+******************************************************************************/
+
+#ifndef _ONVM_METRICS_H_
+#define _ONVM_METRICS_H_
+
+#include <stdint.h>
+
+#define ONVM_METRICS_PATH "/metrics"
+#define ONVM_METRICS_PUBLISH_MS 100      /* how often snapshots are published while the endpoint runs */
+#define ONVM_METRICS_POLL_MS 200         /* how long the server waits for a connection before checking for exit */
+#define ONVM_METRICS_REQUEST_SIZE 2048
+#define ONVM_METRICS_RECV_TIMEOUT_S 1
+#define ONVM_METRICS_SEND_TIMEOUT_S 1
+#define ONVM_METRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/* Metrics arguments, set by parse_app_args */
+extern uint16_t metrics_port;
+
+/*
+ * Start the low priority thread serving ONVM_METRICS_PATH, does nothing if no metrics port was given.
+ *
+ * Output : 0 on success, -1 if the port can't be bound or the thread can't be started
+ */
+int
+onvm_metrics_start(void);
+
+/*
+ * Stop serving metrics and close the listening socket.
+ */
+void
+onvm_metrics_stop(void);
+
+#endif  // _ONVM_METRICS_H_
@@ -55,6 +55,17 @@
 uint16_t next_instance_id = 1;
 uint16_t starting_instance_id = 1;
 
+/*
+ * Edge rings by source and destination instance ID. Rings are never freed, a sender may still be
+ * enqueueing through a pointer it loaded before onvm_nf_clear_edges, so they stay allocated for the
+ * life of the manager and are handed out again once that sender is known to be done with them.
+ */
+static struct rte_ring *edge_rings[MAX_NFS][MAX_NFS];
+/* tx_seq of the sender when the ring from it was retired, odd if it may have been enqueueing */
+static uint32_t edge_retired_seq[MAX_NFS][MAX_NFS];
+/* Suffix that keeps the names of rings replacing ones still in use unique */
+static uint32_t edge_ring_gen;
+
 /************************Internal functions prototypes************************/
 
 /*
@@ -117,6 +128,33 @@ onvm_nf_init_lpm_region(struct lpm_request *req_lpm);
 static void
 onvm_nf_init_ft(struct ft_request *ft);
 
+/*
+ * Function that creates the direct ring between two NFs
+ *
+ * Input : the address of an onvm_nf_edge_request struct
+ */
+static void
+onvm_nf_init_edge(struct onvm_nf_edge_request *req);
+
+/*
+ * Function that drops the packets left in a direct ring
+ *
+ * Input  : the ring
+ * Output : none
+ */
+static void
+onvm_nf_drain_edge(struct rte_ring *ring);
+
+/*
+ * Function that retires the direct rings into a stopping NF
+ * and forgets the rings it had to other NFs
+ *
+ * Input  : An nf struct
+ * Output : none
+ */
+static void
+onvm_nf_clear_edges(struct onvm_nf *nf);
+
 /*
  * Function that clears the tx, rx, & msg_q rings
  * in case an NF uses this iid in the future
@@ -174,6 +212,55 @@ onvm_nf_next_instance_id(void) {
         return MAX_NFS;
 }
 
+struct onvm_nf *
+onvm_nf_start_inline(uint16_t service_id, const char *tag, struct onvm_nf_function_table *function_table,
+                     uint16_t core) {
+        struct onvm_nf *nf;
+        uint16_t nf_id;
+
+        if (service_id >= MAX_SERVICES || nf_per_service_count[service_id] >= MAX_NFS_PER_SERVICE)
+                return NULL;
+
+        nf_id = onvm_nf_next_instance_id();
+        if (nf_id >= MAX_NFS)
+                return NULL;
+        nf = &nfs[nf_id];
+
+        nf->tag = rte_malloc("nf_tag", TAG_SIZE, 0);
+        if (nf->tag == NULL)
+                return NULL;
+        strncpy(nf->tag, tag, TAG_SIZE);
+        nf->tag[TAG_SIZE - 1] = '\0';
+
+        nf->instance_id = nf_id;
+        nf->service_id = service_id;
+        nf->status = NF_STARTING;
+        nf->function_table = function_table;
+        nf->nf_tx_mgr = NULL;
+        nf->thread_info.core = core;
+        nf->thread_info.parent = 0;
+        memset(&nf->flags, 0, sizeof(nf->flags));
+        nf->flags.run_inline = 1;
+        memset(&nf->edges, 0, sizeof(nf->edges));
+        memset(&nf->nic_rx, 0, sizeof(nf->nic_rx));
+        onvm_nf_init_rings(nf);
+
+        if (onvm_nf_ready(nf) != 0)
+                return NULL;
+        return nf;
+}
+
+void
+onvm_nf_check_congestion(void) {
+        uint16_t i;
+
+        if (onvm_config->congestion.action == ONVM_CONGESTION_OFF)
+                return;
+
+        for (i = 0; i < MAX_NFS; i++)
+                onvm_pkt_congestion_recover(&nfs[i]);
+}
+
 void
 onvm_nf_check_status(void) {
         int i;
@@ -183,6 +270,7 @@ onvm_nf_check_status(void) {
         struct onvm_nf_init_cfg *nf_init_cfg;
         struct lpm_request *req_lpm;
         struct ft_request *ft;
+        struct onvm_nf_edge_request *req_edge;
         uint16_t stop_nf_id;
         int num_msgs = rte_ring_count(incoming_msg_queue);
 
@@ -205,6 +293,11 @@ onvm_nf_check_status(void) {
                                 ft = (struct ft_request *)msg->msg_data;
                                 onvm_nf_init_ft(ft);
                                 break;
+                        case MSG_REQUEST_EDGE:
+                                req_edge = (struct onvm_nf_edge_request *)msg->msg_data;
+                                onvm_nf_init_edge(req_edge);
+                                rte_free(req_edge);
+                                break;
                         case MSG_NF_STARTING:
                                 nf_init_cfg = (struct onvm_nf_init_cfg *)msg->msg_data;
                                 if (onvm_nf_start(nf_init_cfg) == 0) {
@@ -308,6 +401,8 @@ onvm_nf_start(struct onvm_nf_init_cfg *nf_init_cfg) {
         spawned_nf->thread_info.core = nf_init_cfg->core;
         spawned_nf->flags.time_to_live = nf_init_cfg->time_to_live;
         spawned_nf->flags.pkt_limit = nf_init_cfg->pkt_limit;
+        memset(&spawned_nf->edges, 0, sizeof(spawned_nf->edges));
+        memset(&spawned_nf->nic_rx, 0, sizeof(spawned_nf->nic_rx));
         onvm_nf_init_rings(spawned_nf);
 
         // Let the NF continue its init process
@@ -326,6 +421,7 @@ onvm_nf_ready(struct onvm_nf *nf) {
         num_nfs++;
         // Register this NF running within its service
         nf->status = NF_RUNNING;
+        onvm_rss_nf_ready(nf);
         return 0;
 }
 
@@ -362,6 +458,9 @@ onvm_nf_stop(struct onvm_nf *nf) {
         nf->status = NF_STOPPED;
         nfs[nf->instance_id].status = NF_STOPPED;
 
+        /* Stop packets from reaching the NIC RX queue the NF read */
+        onvm_rss_nf_stop(&nfs[nf_id]);
+
         /* Tell parent we stopped running */
         if (nfs[nf_id].thread_info.parent != 0)
                 rte_atomic16_dec(&nfs[nfs[nf_id].thread_info.parent].thread_info.children_cnt);
@@ -373,12 +472,15 @@ onvm_nf_stop(struct onvm_nf *nf) {
         /* Clean up possible left over objects in rings */
         while ((nb_pkts = rte_ring_dequeue_burst(nfs[nf_id].rx_q, (void **)pkts, PACKET_READ_SIZE, NULL)) > 0) {
                 for (i = 0; i < nb_pkts; i++)
-                        rte_pktmbuf_free(pkts[i]);
+                        onvm_pkt_release(pkts[i]);
         }
         while ((nb_pkts = rte_ring_dequeue_burst(nfs[nf_id].tx_q, (void **)pkts, PACKET_READ_SIZE, NULL)) > 0) {
                 for (i = 0; i < nb_pkts; i++)
-                        rte_pktmbuf_free(pkts[i]);
+                        onvm_pkt_release(pkts[i]);
         }
+        /* A stopped NF no longer holds its service back */
+        onvm_pkt_congestion_recover(&nfs[nf_id]);
+        onvm_nf_clear_edges(&nfs[nf_id]);
         nf_msg_pool = rte_mempool_lookup(_NF_MSG_POOL_NAME);
         while (rte_ring_dequeue(nfs[nf_id].msg_q, (void **)(&msg)) == 0) {
                 rte_mempool_put(nf_msg_pool, (void *)msg);
@@ -467,6 +569,107 @@ onvm_nf_init_ft(struct ft_request *ft) {
         }
 }
 
+static void
+onvm_nf_init_edge(struct onvm_nf_edge_request *req) {
+        char ring_name[RTE_RING_NAMESIZE];
+        struct onvm_nf *src, *dst;
+        struct rte_ring *ring;
+        uint32_t seq;
+        uint16_t i;
+
+        if (req->src >= MAX_NFS || req->dst >= MAX_NFS)
+                return;
+
+        src = &nfs[req->src];
+        dst = &nfs[req->dst];
+
+        /* Either side went away, let the sender ask again for whoever takes the ID */
+        if (!onvm_nf_is_valid(src) || !onvm_nf_is_valid(dst) || !dst->edges.enabled) {
+                src->edges.requested[req->dst] = 0;
+                return;
+        }
+
+        /* A previous NF with the same source ID may already feed this one */
+        ring = edge_rings[req->src][req->dst];
+        for (i = 0; ring != NULL && i < dst->edges.rx_count; i++)
+                if (dst->edges.rx[i] == ring)
+                        break;
+        if (ring == NULL || i == dst->edges.rx_count) {
+                /* Requested flag stays set, the sender keeps using the rx ring */
+                if (dst->edges.rx_count >= ONVM_MAX_NF_EDGES)
+                        return;
+
+                /* Retired by onvm_nf_clear_edges, reused once its sender has moved past the enqueue it was in */
+                seq = edge_retired_seq[req->src][req->dst];
+                if (ring != NULL && (seq & 1) && __atomic_load_n(&src->edges.tx_seq, __ATOMIC_ACQUIRE) == seq)
+                        ring = NULL;
+
+                if (ring == NULL) {
+                        /* A ring a late sender may still hold stays allocated, the new one gets a name of its own */
+                        snprintf(ring_name, sizeof(ring_name), "%s_%u", get_edge_queue_name(req->src, req->dst),
+                                 edge_ring_gen++);
+                        ring = rte_ring_create(ring_name, NF_EDGE_RINGSIZE, rte_socket_id(),
+                                               RING_F_SP_ENQ | RING_F_SC_DEQ); /* single prod, single cons */
+                        if (ring == NULL) {
+                                RTE_LOG(INFO, APP, "Cannot create ring from NF %u to NF %u\n", req->src,
+                                        req->dst);
+                                return;
+                        }
+                        edge_rings[req->src][req->dst] = ring;
+                } else {
+                        /* No sender is left on it, drop what a late one put in before the drain of clear_edges */
+                        onvm_nf_drain_edge(ring);
+                }
+
+                /* Publish the ring before the count so the receiver never polls a NULL ring */
+                dst->edges.rx[dst->edges.rx_count] = ring;
+                rte_wmb();
+                dst->edges.rx_count++;
+        }
+
+        src->edges.tx[req->dst] = ring;
+}
+
+static void
+onvm_nf_drain_edge(struct rte_ring *ring) {
+        struct rte_mbuf *pkts[PACKET_READ_SIZE];
+        uint16_t nb_pkts, i;
+
+        while ((nb_pkts = rte_ring_dequeue_burst(ring, (void **)pkts, PACKET_READ_SIZE, NULL)) > 0) {
+                for (i = 0; i < nb_pkts; i++)
+                        onvm_pkt_release(pkts[i]);
+        }
+}
+
+static void
+onvm_nf_clear_edges(struct onvm_nf *nf) {
+        uint16_t nf_id, i;
+
+        nf_id = nf->instance_id;
+        nf->edges.enabled = 0;
+
+        /* Stop the senders first, then no new enqueue picks the rings up */
+        for (i = 0; i < MAX_NFS; i++) {
+                nfs[i].edges.tx[nf_id] = NULL;
+                nfs[i].edges.requested[nf_id] = 0;
+        }
+        rte_mb();
+
+        /* A sender whose sequence is odd now may hold the old pointer until the sequence moves on */
+        for (i = 0; i < MAX_NFS; i++)
+                edge_retired_seq[i][nf_id] = __atomic_load_n(&nfs[i].edges.tx_seq, __ATOMIC_ACQUIRE);
+
+        for (i = 0; i < nf->edges.rx_count; i++) {
+                /* The ring stays in edge_rings, onvm_nf_init_edge hands it to the next NF with this ID */
+                onvm_nf_drain_edge(nf->edges.rx[i]);
+                nf->edges.rx[i] = NULL;
+        }
+        nf->edges.rx_count = 0;
+
+        memset(nf->edges.tx, 0, sizeof(nf->edges.tx));
+        memset(nf->edges.requested, 0, sizeof(nf->edges.requested));
+}
+
 inline int
 onvm_nf_relocate_nf(uint16_t dest, uint16_t new_core) {
         uint16_t *msg_data;
@@ -63,6 +63,18 @@
 uint16_t
 onvm_nf_next_instance_id(void);
 
+/*
+ * Interface registering an NF the manager runs itself on one of its threads,
+ * see onvm_mgr/onvm_rtc.h. The NF gets rings and joins its service like any
+ * other instance, it runs until the manager exits.
+ *
+ * Input  : the service ID, the tag, the NF's function table and the core of the thread running it
+ * Output : a pointer to the running NF, NULL if no instance could be added
+ */
+struct onvm_nf *
+onvm_nf_start_inline(uint16_t service_id, const char *tag, struct onvm_nf_function_table *function_table,
+                     uint16_t core);
+
 /*
  * Interface looking through all registered NFs if one needs to start or stop.
  *
@@ -70,6 +82,14 @@ onvm_nf_next_instance_id(void);
 void
 onvm_nf_check_status(void);
 
+/*
+ * Interface clearing the congested flag of NFs whose rings drained, for NFs
+ * that don't read their rings through the NF library loop.
+ *
+ */
+void
+onvm_nf_check_congestion(void);
+
 /*
  * Interface to send a message to a certain NF.
  *
@@ -55,45 +55,63 @@
 
 void
 onvm_pkt_process_rx_batch(struct queue_mgr *rx_mgr, struct rte_mbuf *pkts[], uint16_t rx_count) {
+        if (rx_mgr == NULL || pkts == NULL)
+                return;
+
+        onvm_pkt_enqueue_rx_batch(rx_mgr, pkts, rx_count);
+        onvm_pkt_flush_all_nfs(rx_mgr, NULL);
+}
+
+void
+onvm_pkt_enqueue_rx_batch(struct queue_mgr *rx_mgr, struct rte_mbuf *pkts[], uint16_t rx_count) {
         uint16_t i;
         struct onvm_pkt_meta *meta;
+        struct onvm_service_chain *sc;
 #ifdef FLOW_LOOKUP
         struct onvm_flow_entry *flow_entry;
-        struct onvm_service_chain *sc;
         int ret;
 #endif
 
         if (rx_mgr == NULL || pkts == NULL)
                 return;
 
+        /* The driver only wrote the first cache line of the mbufs, the meta is in the second */
+        onvm_pkt_prefetch_burst(pkts, rx_count);
         for (i = 0; i < rx_count; i++) {
+                onvm_pkt_prefetch_ahead(pkts, i, rx_count);
                 meta = (struct onvm_pkt_meta *)&(((struct rte_mbuf *)pkts[i])->udata64);
                 meta->src = 0;
                 meta->chain_index = 0;
+                meta->chain_id = ONVM_SC_NO_ID;
 #ifdef FLOW_LOOKUP
                 ret = onvm_flow_dir_get_pkt(pkts[i], &flow_entry);
                 if (ret >= 0) {
-                        sc = flow_entry->sc;
-                        meta->action = onvm_sc_next_action(sc, pkts[i]);
-                        meta->destination = onvm_sc_next_destination(sc, pkts[i]);
+                        /* Later hops find the chain by ID, which also picks up runtime chain updates */
+                        meta->chain_id = flow_entry->sc->chain_id;
+                        sc = onvm_sc_lookup(meta->chain_id, flow_entry->sc);
                 } else {
 #endif
-                        meta->action = onvm_sc_next_action(default_chain, pkts[i]);
-                        meta->destination = onvm_sc_next_destination(default_chain, pkts[i]);
+                        sc = default_chain;
 #ifdef FLOW_LOOKUP
                 }
 #endif
+                meta->action = onvm_sc_next_action(sc, pkts[i]);
+                meta->destination = onvm_sc_next_destination(sc, pkts[i]);
                 /* PERF: this might hurt performance since it will cause cache
                  * invalidations. Ideally the data modified by the NF manager
                  * would be a different line than that modified/read by NFs.
                  * That may not be possible.
                  */
 
-                (meta->chain_index)++;
-                onvm_pkt_enqueue_nf(rx_mgr, meta->destination, pkts[i], NULL);
+                meta->chain_index = onvm_sc_next_index(sc, meta->chain_index);
+                /* Don't spend the chain's work on a packet a congested hop further on would drop */
+                if (unlikely(onvm_pkt_congestion_check(sc, meta->chain_index, pkts[i], NULL)))
+                        continue;
+                if (unlikely(onvm_sc_is_parallel(sc, meta->chain_index)))
+                        onvm_pkt_enqueue_parallel(rx_mgr, sc, meta->chain_index, pkts[i], NULL);
+                else
+                        onvm_pkt_enqueue_nf(rx_mgr, meta->destination, pkts[i], NULL);
         }
-
-        onvm_pkt_flush_all_nfs(rx_mgr, NULL);
 }
 
 void
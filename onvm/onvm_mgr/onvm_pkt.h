@@ -64,6 +64,18 @@
 void
 onvm_pkt_process_rx_batch(struct queue_mgr *rx_mgr, struct rte_mbuf *pkts[], uint16_t rx_count);
 
+/*
+ * Interface to start packets read from a port on their service chain, they
+ * are left in the NF buffers of the rx queue for the caller to flush.
+ *
+ * Inputs : a pointer to the rx queue
+ *          an array of packets
+ *          the size of the array
+ *
+ */
+void
+onvm_pkt_enqueue_rx_batch(struct queue_mgr *rx_mgr, struct rte_mbuf *pkts[], uint16_t rx_count);
+
 /*
  * Interface to send packets to all ports after processing them.
  *
@@ -0,0 +1,199 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *            2010-2019 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ********************************************************************/
+
+/******************************************************************************
+                                 onvm_rss.c
+
+            This file contains the management of the NIC RX queues
+            read by NF instances. The RSS redirection table of every
+            port is spread over the queues of the running instances
+            of the first service of the default chain, and handed
+            back to the manager RX threads when none is left.
+
+******************************************************************************/
+
+#include "onvm_mgr.h"
+#include "onvm_mgr/onvm_rss.h"
+#include "onvm_pkt.h"
+
+/* rte_eth_dev_rss_reta_update takes the table in groups of RTE_RETA_GROUP_SIZE entries */
+#define RSS_RETA_GROUPS (ETH_RSS_RETA_SIZE_512 / RTE_RETA_GROUP_SIZE)
+
+/******************************Global variables*******************************/
+
+/* NF RX queue arguments - extern in header onvm_rss.h */
+uint16_t nf_rx_queues = 0;
+
+/* Instance ID of the NF reading each NF queue, 0 while the queue is free */
+static uint16_t queue_owner[MAX_NFS];
+static uint16_t reta_size[RTE_MAX_ETHPORTS];
+
+/*********************Internal Functions Prototypes***************************/
+
+/*
+ * Spread the redirection table of a port over the NF queues in use, or over
+ * the manager RX queues if there are none.
+ *
+ * Input  : the port
+ * Output : 0 on success, a negative errno otherwise
+ *
+ */
+static int
+onvm_rss_update_reta(uint16_t port);
+
+/*
+ * Update the redirection tables of all ports after an NF queue was taken or freed.
+ */
+static void
+onvm_rss_update_all(void);
+
+/*********************************Interfaces**********************************/
+
+uint16_t
+onvm_rss_num_rx_queues(void) {
+        return ONVM_NUM_RX_THREADS + nf_rx_queues;
+}
+
+int
+onvm_rss_init_port(uint16_t port) {
+        struct rte_eth_dev_info dev_info;
+
+        if (nf_rx_queues == 0)
+                return 0;
+
+        rte_eth_dev_info_get(port, &dev_info);
+        if (dev_info.reta_size == 0 || dev_info.reta_size > ETH_RSS_RETA_SIZE_512) {
+                printf("Port %u has no RSS redirection table to spread packets over NF queues\n", port);
+                return -ENOTSUP;
+        }
+        reta_size[port] = dev_info.reta_size;
+
+        /* The table the driver starts with covers the NF queues as well, which nobody reads yet */
+        return onvm_rss_update_reta(port);
+}
+
+void
+onvm_rss_nf_ready(struct onvm_nf *nf) {
+        uint16_t q;
+
+        /* Sleeping NFs are only woken up for packets on their rings */
+        if (nf_rx_queues == 0 || !nf->nic_rx.capable || nf->service_id != default_service || ONVM_NF_SHARE_CORES)
+                return;
+
+        for (q = 0; q < nf_rx_queues; q++) {
+                if (queue_owner[q] == 0)
+                        break;
+        }
+        if (q == nf_rx_queues) {
+                RTE_LOG(INFO, APP, "No NIC RX queue left for NF %u, it gets packets through the manager\n",
+                        nf->instance_id);
+                return;
+        }
+
+        queue_owner[q] = nf->instance_id;
+        nf->nic_rx.queue = ONVM_NUM_RX_THREADS + q;
+        /* The NF polls the queue before the redirection table sends packets to it */
+        rte_wmb();
+        nf->nic_rx.enabled = 1;
+        onvm_rss_update_all();
+        RTE_LOG(INFO, APP, "NF %u reads NIC RX queue %u\n", nf->instance_id, nf->nic_rx.queue);
+}
+
+void
+onvm_rss_nf_stop(struct onvm_nf *nf) {
+        struct rte_mbuf *pkts[PACKET_READ_SIZE];
+        uint16_t i, q, nb_pkts;
+
+        if (!nf->nic_rx.enabled)
+                return;
+
+        q = nf->nic_rx.queue;
+        nf->nic_rx.enabled = 0;
+        queue_owner[q - ONVM_NUM_RX_THREADS] = 0;
+        onvm_rss_update_all();
+
+        /* The NF stopped reading, nothing else will empty the queue before its next owner */
+        for (i = 0; i < ports->num_ports; i++) {
+                while ((nb_pkts = rte_eth_rx_burst(ports->id[i], q, pkts, PACKET_READ_SIZE)) > 0) {
+                        __atomic_fetch_add(&ports->rx_stats.rx[ports->id[i]], nb_pkts, __ATOMIC_RELAXED);
+                        onvm_drop_count(&ports->drop_stats, ONVM_DROP_NF_NOT_RUNNING, nb_pkts);
+                        onvm_pkt_drop_batch(pkts, nb_pkts);
+                }
+        }
+}
+
+/*****************************Internal functions******************************/
+
+static int
+onvm_rss_update_reta(uint16_t port) {
+        struct rte_eth_rss_reta_entry64 reta_conf[RSS_RETA_GROUPS];
+        uint16_t queues[MAX_NFS];
+        uint16_t i, n;
+
+        n = 0;
+        for (i = 0; i < nf_rx_queues; i++) {
+                if (queue_owner[i] != 0)
+                        queues[n++] = ONVM_NUM_RX_THREADS + i;
+        }
+        if (n == 0) {
+                for (i = 0; i < ONVM_NUM_RX_THREADS; i++)
+                        queues[n++] = i;
+        }
+
+        memset(reta_conf, 0, sizeof(reta_conf));
+        for (i = 0; i < reta_size[port]; i++) {
+                reta_conf[i / RTE_RETA_GROUP_SIZE].mask |= 1ULL << (i % RTE_RETA_GROUP_SIZE);
+                reta_conf[i / RTE_RETA_GROUP_SIZE].reta[i % RTE_RETA_GROUP_SIZE] = queues[i % n];
+        }
+        return rte_eth_dev_rss_reta_update(port, reta_conf, reta_size[port]);
+}
+
+static void
+onvm_rss_update_all(void) {
+        uint16_t i;
+        int ret;
+
+        for (i = 0; i < ports->num_ports; i++) {
+                ret = onvm_rss_update_reta(ports->id[i]);
+                if (ret < 0)
+                        RTE_LOG(ERR, APP, "Cannot update the RSS redirection table of port %u (%d)\n",
+                                ports->id[i], ret);
+        }
+}
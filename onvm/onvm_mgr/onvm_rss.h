@@ -0,0 +1,92 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *            2010-2019 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ********************************************************************/
+
+/******************************************************************************
+                                 onvm_rss.h
+
+            This file contains the prototypes for giving NIC RX queues
+            to the NF instances of the first service of the default
+            chain, so they read packets from the ports themselves
+            instead of through the manager RX threads.
+
+******************************************************************************/
+
+#ifndef _ONVM_RSS_H_
+#define _ONVM_RSS_H_
+
+#include <stdint.h>
+
+#include "onvm_common.h"
+
+/* NF RX queue arguments, set by parse_app_args */
+extern uint16_t nf_rx_queues;
+
+/*
+ * Number of RX queues to set up on every port, the queues of the manager RX
+ * threads come first and the NF queues after them.
+ */
+uint16_t
+onvm_rss_num_rx_queues(void);
+
+/*
+ * Check a port can spread packets over the NF queues and point its RSS
+ * redirection table at the manager RX queues, called once the port started.
+ *
+ * Output : 0 on success, a negative errno otherwise
+ */
+int
+onvm_rss_init_port(uint16_t port);
+
+/*
+ * Give a NF that just became ready a queue if it is an instance of the first
+ * service of the default chain and reads packets through the NF library, then
+ * spread the redirection tables of all ports over the NF queues in use.
+ */
+void
+onvm_rss_nf_ready(struct onvm_nf *nf);
+
+/*
+ * Take the queue of a stopping NF back, rebalance the redirection tables over
+ * the remaining NF queues and drop what is left in the queue.
+ */
+void
+onvm_rss_nf_stop(struct onvm_nf *nf);
+
+#endif  // _ONVM_RSS_H_
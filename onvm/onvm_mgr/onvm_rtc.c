@@ -0,0 +1,352 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *            2010-2019 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ********************************************************************/
+
+/******************************************************************************
+                                 onvm_rtc.c
+
+            This file contains the NFs built into the manager and the
+            code running them to completion on the RX threads. Every
+            RX thread gets its own instance of each inline NF and a
+            port TX queue of its own, so a packet read from a port can
+            go through a whole chain of inline NFs and back out of a
+            port on the same core without touching a ring.
+
+******************************************************************************/
+
+#include "onvm_mgr.h"
+#include "onvm_mgr/onvm_rtc.h"
+#include "onvm_nf.h"
+#include "onvm_pkt.h"
+#include "onvm_stats.h"
+
+/******************************Global variables*******************************/
+
+/* Inline NF arguments - extern in header onvm_rtc.h */
+struct onvm_rtc_cfg rtc_nfs[ONVM_RTC_MAX_NFS];
+uint8_t rtc_num_nfs = 0;
+
+/* State of each RX thread, NULL for threads running no NF inline */
+static struct onvm_rtc_thread *rtc_threads[ONVM_NUM_RX_THREADS];
+
+/*********************Internal Functions Prototypes***************************/
+
+/*
+ * Packet handler of the bridge builtin, sends packets out of port 1 if they
+ * came in on port 0 and out of port 0 otherwise like examples/bridge.
+ */
+static int
+onvm_rtc_bridge_handler(struct rte_mbuf *pkt, struct onvm_pkt_meta *meta,
+                        __attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx);
+
+/*
+ * Packet handler of the forward builtin, passes packets on to the next hop of their chain.
+ */
+static int
+onvm_rtc_forward_handler(struct rte_mbuf *pkt, struct onvm_pkt_meta *meta,
+                         __attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx);
+
+/*
+ * Give packets to the packet handler of an inline NF and send on the ones it
+ * returns, as the TX threads do with what an NF puts in its tx ring.
+ *
+ * Inputs : a pointer to the thread state
+ *          a pointer to the context of the NF
+ *          an array of packets
+ *          the size of the array
+ *
+ */
+static void
+onvm_rtc_run_nf(struct onvm_rtc_thread *rtc, struct onvm_nf_local_ctx *nf_local_ctx, struct rte_mbuf *pkts[],
+                uint16_t count);
+
+/*
+ * Run the inline NFs on the packets buffered for them until there are none
+ * left, every pass takes the packets one hop further along their chains.
+ *
+ * Input  : a pointer to the thread state
+ *
+ */
+static void
+onvm_rtc_run_buffered(struct onvm_rtc_thread *rtc);
+
+/*
+ * NFs that can run inline, selected by name on the command line. Add an entry
+ * to build another NF into the manager.
+ */
+static struct onvm_rtc_builtin builtins[] = {
+        {"bridge", {.pkt_handler = &onvm_rtc_bridge_handler}},
+        {"forward", {.pkt_handler = &onvm_rtc_forward_handler}},
+};
+
+/*********************************Interfaces**********************************/
+
+struct onvm_rtc_builtin *
+onvm_rtc_lookup_builtin(const char *name) {
+        unsigned i;
+
+        for (i = 0; i < RTE_DIM(builtins); i++) {
+                if (strcmp(builtins[i].name, name) == 0)
+                        return &builtins[i];
+        }
+        return NULL;
+}
+
+uint16_t
+onvm_rtc_num_tx_queues(void) {
+        return rtc_num_nfs > 0 ? ONVM_NUM_RX_THREADS : 0;
+}
+
+int
+onvm_rtc_init_thread(uint16_t rx_queue, uint16_t core) {
+        struct onvm_rtc_thread *rtc;
+        struct onvm_nf_local_ctx *nf_local_ctx;
+        struct onvm_nf *nf;
+        uint16_t service_id;
+        uint8_t i;
+
+        if (rtc_num_nfs == 0 || rx_queue >= ONVM_NUM_RX_THREADS)
+                return 0;
+
+        /* The wakeup threads expect every NF to sleep on its own semaphore */
+        if (ONVM_NF_SHARE_CORES) {
+                RTE_LOG(INFO, APP, "Inline NFs can't run in shared core mode, not starting them\n");
+                return 0;
+        }
+
+        rtc = rte_zmalloc(NULL, sizeof(struct onvm_rtc_thread), RTE_CACHE_LINE_SIZE);
+        if (rtc == NULL)
+                return -1;
+        rtc_threads[rx_queue] = rtc;
+
+        /* The TX threads own the first port TX queues, see init_port */
+        rtc->tx_mgr.mgr_type_t = MGR;
+        rtc->tx_mgr.id = rte_lcore_count() - ONVM_NUM_RX_THREADS - ONVM_NUM_MGR_AUX_THREADS + rx_queue;
+        rtc->tx_mgr.tx_thread_info = rte_calloc(NULL, 1, sizeof(struct tx_thread_info), RTE_CACHE_LINE_SIZE);
+        if (rtc->tx_mgr.tx_thread_info == NULL)
+                return -1;
+        rtc->tx_mgr.tx_thread_info->port_tx_bufs =
+            rte_calloc(NULL, RTE_MAX_ETHPORTS, sizeof(struct packet_buf), RTE_CACHE_LINE_SIZE);
+        rtc->tx_mgr.nf_rx_bufs = rte_calloc(NULL, MAX_NFS, sizeof(struct packet_buf), RTE_CACHE_LINE_SIZE);
+        rtc->tx_mgr.local_nfs = rtc->service_nfs;
+        if (rtc->tx_mgr.tx_thread_info->port_tx_bufs == NULL || rtc->tx_mgr.nf_rx_bufs == NULL)
+                return -1;
+
+        for (i = 0; i < rtc_num_nfs; i++) {
+                nf_local_ctx = rte_zmalloc(NULL, sizeof(struct onvm_nf_local_ctx), 0);
+                if (nf_local_ctx == NULL)
+                        return -1;
+
+                service_id = rtc_nfs[i].service_id;
+                if (service_id == ONVM_RTC_DEFAULT_SERVICE)
+                        service_id = default_service;
+                nf = onvm_nf_start_inline(service_id, rtc_nfs[i].builtin->name, &rtc_nfs[i].builtin->function_table,
+                                          core);
+                if (nf == NULL) {
+                        RTE_LOG(ERR, APP, "Cannot start inline NF %s for service %u\n", rtc_nfs[i].builtin->name,
+                                service_id);
+                        rte_free(nf_local_ctx);
+                        return -1;
+                }
+                nf_local_ctx->nf = nf;
+                rte_atomic16_init(&nf_local_ctx->nf_init_finished);
+                rte_atomic16_init(&nf_local_ctx->keep_running);
+                rte_atomic16_init(&nf_local_ctx->nf_stopped);
+                rte_atomic16_set(&nf_local_ctx->nf_init_finished, 1);
+                rte_atomic16_set(&nf_local_ctx->keep_running, 1);
+                rtc->nf_local_ctx[rtc->num_nfs++] = nf_local_ctx;
+                /* With two inline NFs of one service the first one gets the thread's packets */
+                if (service_id < MAX_SERVICES && rtc->service_nfs[service_id] == 0)
+                        rtc->service_nfs[service_id] = nf->instance_id;
+
+                if (nf->function_table->setup != NULL)
+                        (*nf->function_table->setup)(nf_local_ctx);
+                onvm_stats_gen_event_nf_info("NF Ready", nf);
+        }
+
+        RTE_LOG(INFO, APP, "RX queue %u runs %u NFs inline and sends on port TX queue %u\n", rx_queue, rtc->num_nfs,
+                rtc->tx_mgr.id);
+        return 0;
+}
+
+struct onvm_rtc_thread *
+onvm_rtc_get_thread(uint16_t rx_queue) {
+        return rx_queue < ONVM_NUM_RX_THREADS ? rtc_threads[rx_queue] : NULL;
+}
+
+void
+onvm_rtc_process_rx_batch(struct onvm_rtc_thread *rtc, struct rte_mbuf *pkts[], uint16_t rx_count) {
+        if (rtc == NULL || pkts == NULL)
+                return;
+
+        onvm_pkt_enqueue_rx_batch(&rtc->tx_mgr, pkts, rx_count);
+        onvm_rtc_run_buffered(rtc);
+}
+
+void
+onvm_rtc_flush(struct onvm_rtc_thread *rtc) {
+        struct rte_mbuf *pkts[PACKET_READ_SIZE];
+        struct onvm_nf_local_ctx *nf_local_ctx;
+        struct onvm_nf *nf;
+        uint16_t count;
+        uint8_t i;
+
+        if (rtc == NULL)
+                return;
+
+        for (i = 0; i < rtc->num_nfs; i++) {
+                nf_local_ctx = rtc->nf_local_ctx[i];
+                nf = nf_local_ctx->nf;
+
+                /* Packets from NFs in other processes and other RX threads come through the rx ring */
+                count = rte_ring_dequeue_burst(nf->rx_q, (void **)pkts, PACKET_READ_SIZE, NULL);
+                if (count > 0)
+                        onvm_rtc_run_nf(rtc, nf_local_ctx, pkts, count);
+                if (unlikely(rte_atomic16_read(&nf->congested)))
+                        onvm_pkt_congestion_recover(nf);
+
+                /* Inline NFs live as long as the manager, what user actions return is ignored */
+                if (nf->function_table->user_actions != NULL)
+                        (*nf->function_table->user_actions)(nf_local_ctx);
+        }
+        onvm_rtc_run_buffered(rtc);
+
+        onvm_pkt_flush_all_ports(&rtc->tx_mgr);
+        onvm_pkt_flush_all_nfs(&rtc->tx_mgr, NULL);
+}
+
+void
+onvm_rtc_free(void) {
+        struct onvm_rtc_thread *rtc;
+        uint16_t i, j;
+
+        for (i = 0; i < ONVM_NUM_RX_THREADS; i++) {
+                rtc = rtc_threads[i];
+                if (rtc == NULL)
+                        continue;
+                for (j = 0; j < rtc->num_nfs; j++)
+                        rte_free(rtc->nf_local_ctx[j]);
+                rte_free(rtc->tx_mgr.nf_rx_bufs);
+                if (rtc->tx_mgr.tx_thread_info != NULL)
+                        rte_free(rtc->tx_mgr.tx_thread_info->port_tx_bufs);
+                rte_free(rtc->tx_mgr.tx_thread_info);
+                rte_free(rtc);
+                rtc_threads[i] = NULL;
+        }
+}
+
+/******************************Internal functions*****************************/
+
+static int
+onvm_rtc_bridge_handler(struct rte_mbuf *pkt, struct onvm_pkt_meta *meta,
+                        __attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx) {
+        meta->destination = pkt->port == 0 ? 1 : 0;
+        meta->action = ONVM_NF_ACTION_OUT;
+        return 0;
+}
+
+static int
+onvm_rtc_forward_handler(__attribute__((unused)) struct rte_mbuf *pkt, struct onvm_pkt_meta *meta,
+                         __attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx) {
+        meta->action = ONVM_NF_ACTION_NEXT;
+        return 0;
+}
+
+static void
+onvm_rtc_run_nf(struct onvm_rtc_thread *rtc, struct onvm_nf_local_ctx *nf_local_ctx, struct rte_mbuf *pkts[],
+                uint16_t count) {
+        struct onvm_nf *nf;
+        struct onvm_pkt_meta *meta;
+        uint16_t i, tx_count;
+
+        nf = nf_local_ctx->nf;
+        onvm_pkt_prefetch_burst(pkts, count);
+        if (nf->function_table->pkt_bulk_handler != NULL) {
+                tx_count = (*nf->function_table->pkt_bulk_handler)(pkts, count, nf_local_ctx);
+        } else {
+                tx_count = 0;
+                for (i = 0; i < count; i++) {
+                        onvm_pkt_prefetch_ahead(pkts, i, count);
+                        meta = onvm_get_pkt_meta(pkts[i]);
+                        /* NF returns 0 to return packets or 1 to buffer */
+                        if (likely((*nf->function_table->pkt_handler)(pkts[i], meta, nf_local_ctx) == 0))
+                                pkts[tx_count++] = pkts[i];
+                }
+        }
+        nf->stats.tx_buffer += count - tx_count;
+        /* Counted where an NF in its own process puts them in its tx ring */
+        nf->stats.tx += tx_count;
+
+        if (tx_count > 0)
+                onvm_pkt_process_tx_batch(&rtc->tx_mgr, pkts, tx_count, nf);
+}
+
+static void
+onvm_rtc_run_buffered(struct onvm_rtc_thread *rtc) {
+        struct rte_mbuf *pkts[PACKET_READ_SIZE];
+        struct onvm_nf_local_ctx *nf_local_ctx;
+        struct packet_buf *nf_buf;
+        struct onvm_nf *nf;
+        uint16_t count, pass;
+        uint8_t i, ran;
+
+        /* No chain takes a packet through more hops, anything still buffered after that goes through the rx ring */
+        for (pass = 0; pass < ONVM_MAX_CHAIN_LENGTH; pass++) {
+                ran = 0;
+                for (i = 0; i < rtc->num_nfs; i++) {
+                        nf_local_ctx = rtc->nf_local_ctx[i];
+                        nf = nf_local_ctx->nf;
+                        nf_buf = &rtc->tx_mgr.nf_rx_bufs[nf->instance_id];
+                        if (nf_buf->count == 0)
+                                continue;
+
+                        /* The handlers may send packets to this very buffer again */
+                        count = nf_buf->count;
+                        rte_memcpy(pkts, nf_buf->buffer, count * sizeof(struct rte_mbuf *));
+                        nf_buf->count = 0;
+                        nf_buf->held = 0;
+                        nf->stats.rx += count;
+
+                        onvm_rtc_run_nf(rtc, nf_local_ctx, pkts, count);
+                        ran = 1;
+                }
+                if (!ran)
+                        break;
+        }
+}
@@ -0,0 +1,150 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *            2010-2019 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ********************************************************************/
+
+/******************************************************************************
+                                 onvm_rtc.h
+
+            This file contains the prototypes for running NFs built
+            into the manager to completion on its RX threads. Packets
+            read from a port go through the NF packet handlers of the
+            thread and out of the port without crossing any ring.
+
+******************************************************************************/
+
+#ifndef _ONVM_RTC_H_
+#define _ONVM_RTC_H_
+
+#include <stdint.h>
+
+#include "onvm_common.h"
+
+/* Most NFs one RX thread runs inline */
+#define ONVM_RTC_MAX_NFS 8
+/* Service ID of inline NFs of the default service */
+#define ONVM_RTC_DEFAULT_SERVICE UINT16_MAX
+
+/* An NF compiled into the manager, see the builtins table in onvm_rtc.c */
+struct onvm_rtc_builtin {
+        const char *name;
+        struct onvm_nf_function_table function_table;
+};
+
+/* An NF to run inline on every RX thread, set by parse_app_args */
+struct onvm_rtc_cfg {
+        struct onvm_rtc_builtin *builtin;
+        uint16_t service_id;
+};
+
+/* State of an RX thread running NFs inline */
+struct onvm_rtc_thread {
+        /* Sends to NFs and ports from the thread, id is the port TX queue it owns */
+        struct queue_mgr tx_mgr;
+        uint8_t num_nfs;
+        struct onvm_nf_local_ctx *nf_local_ctx[ONVM_RTC_MAX_NFS];
+        /* Inline instance of each service, packets of the thread stay on it instead of spreading by RSS */
+        uint16_t service_nfs[MAX_SERVICES];
+};
+
+/* Inline NF arguments, set by parse_app_args */
+extern struct onvm_rtc_cfg rtc_nfs[ONVM_RTC_MAX_NFS];
+extern uint8_t rtc_num_nfs;
+
+/*
+ * Look up an NF built into the manager by name.
+ *
+ * Output : a pointer to the builtin, NULL if there is none by that name
+ */
+struct onvm_rtc_builtin *
+onvm_rtc_lookup_builtin(const char *name);
+
+/*
+ * Number of TX queues to set up on every port on top of the TX threads' ones,
+ * one per RX thread if NFs run inline.
+ */
+uint16_t
+onvm_rtc_num_tx_queues(void);
+
+/*
+ * Start the inline NFs of an RX thread and set up its port TX queue, called
+ * before the thread is launched.
+ *
+ * Input  : the RX queue of the thread and the core it runs on
+ * Output : 0 on success or without inline NFs, -1 otherwise
+ */
+int
+onvm_rtc_init_thread(uint16_t rx_queue, uint16_t core);
+
+/*
+ * State of the RX thread reading an RX queue.
+ *
+ * Output : a pointer to the state, NULL if the thread runs no NF inline
+ */
+struct onvm_rtc_thread *
+onvm_rtc_get_thread(uint16_t rx_queue);
+
+/*
+ * Interface to process packets read from a port by an RX thread running NFs
+ * inline. Packets for those NFs go through their handlers right away, the
+ * others stay buffered until onvm_rtc_flush.
+ *
+ * Inputs : a pointer to the thread state
+ *          an array of packets
+ *          the size of the array
+ */
+void
+onvm_rtc_process_rx_batch(struct onvm_rtc_thread *rtc, struct rte_mbuf *pkts[], uint16_t rx_count);
+
+/*
+ * Run the inline NFs on what other NFs sent them and call their user actions,
+ * then send everything buffered to the NFs and ports. Called once per loop of
+ * the RX thread after reading the ports.
+ *
+ * Input  : a pointer to the thread state
+ */
+void
+onvm_rtc_flush(struct onvm_rtc_thread *rtc);
+
+/*
+ * Free the state of all RX threads.
+ */
+void
+onvm_rtc_free(void);
+
+#endif  // _ONVM_RTC_H_
@@ -46,6 +46,9 @@
 
 ******************************************************************************/
 
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
 #include <stdio.h>
 #include <time.h>
 #include <unistd.h>
@@ -56,6 +59,29 @@
 
 /************************Internal Functions Prototypes************************/
 
+/*
+ * Stats thread, formats every snapshot the master thread publishes
+ *
+ */
+static void *
+onvm_stats_writer_main(void *arg);
+
+/*
+ * Add the usage of a mempool to the snapshot, pools that weren't created are skipped
+ *
+ */
+static void
+onvm_stats_publish_mempool(struct onvm_stats_snapshot *snapshot, uint16_t *count, struct rte_mempool *mp);
+
+/*
+ * Function displaying all statistics of a snapshot
+ *
+ * Input : the snapshot, time passed since the previous one (to compute packet rate)
+ *
+ */
+static void
+onvm_stats_display_all(const struct onvm_stats_snapshot *snapshot, unsigned difftime, uint8_t verbosity_level);
+
 /*
  * Function to send json events to web view
  *
@@ -70,14 +96,21 @@ onvm_stats_add_event(struct onvm_event *event_info);
  *
  */
 static void
-onvm_stats_display_ports(unsigned difftime, uint8_t verbosity_level);
+onvm_stats_display_ports(const struct onvm_stats_snapshot *snapshot, unsigned difftime, uint8_t verbosity_level);
 
 /*
  * Function displaying statistics for all NFs
  *
  */
 static void
-onvm_stats_display_nfs(unsigned difftime, uint8_t verbosity_level);
+onvm_stats_display_nfs(const struct onvm_stats_snapshot *snapshot, unsigned difftime, uint8_t verbosity_level);
+
+/*
+ * Function displaying drops by reason for the manager and all NFs
+ *
+ */
+static void
+onvm_stats_display_drops(const struct onvm_stats_snapshot *snapshot);
 
 /*
  * Function clearing the terminal and moving back the cursor to the top left.
@@ -112,7 +145,7 @@ onvm_stats_truncate(void);
  * Free and reset the cJSON variables to build new json string with
  */
 static void
-onvm_json_reset_objects(void);
+onvm_json_reset_objects(const struct onvm_stats_snapshot *snapshot);
 
 /*********************Stats Output Streams************************************/
 
@@ -120,6 +153,17 @@ static FILE *stats_out;
 static FILE *json_stats_out;
 static FILE *json_events_out;
 
+/*********************Stats Thread********************************************/
+
+static pthread_t writer_thread;
+static sem_t writer_sem;
+static volatile uint8_t writer_keep_running;
+static uint8_t writer_started;
+static uint8_t writer_verbosity_level;
+
+/* Events are added by the manager threads and written out by the stats thread */
+static pthread_mutex_t events_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /****************************Global variables***************************************/
 
 /* Holds current timestamp, might want to make this not global */
@@ -129,10 +173,130 @@ char buffer[20];
 
 void
 onvm_stats_init(uint8_t verbosity_level) {
+        struct sched_param param;
+        int ret;
+
         if (verbosity_level == ONVM_RAW_STATS_DUMP) {
                 printf("%s", ONVM_STATS_RAW_DUMP_PORT_MSG);
                 printf("%s", ONVM_STATS_RAW_DUMP_NF_MSG);
         }
+
+        if (stats_destination == ONVM_STATS_NONE)
+                return;
+
+        writer_verbosity_level = verbosity_level;
+        writer_keep_running = 1;
+        if (sem_init(&writer_sem, 0, 0) != 0) {
+                RTE_LOG(ERR, APP, "Cannot create the stats thread semaphore, not displaying stats\n");
+                return;
+        }
+        ret = pthread_create(&writer_thread, NULL, onvm_stats_writer_main, NULL);
+        if (ret != 0) {
+                RTE_LOG(ERR, APP, "Cannot start the stats thread, not displaying stats\n");
+                sem_destroy(&writer_sem);
+                return;
+        }
+        writer_started = 1;
+
+        /* Formatting and writing files must never delay NF status checks */
+        memset(&param, 0, sizeof(param));
+        pthread_setschedparam(writer_thread, SCHED_IDLE, &param);
+}
+
+void
+onvm_stats_publish(uint8_t display) {
+        struct onvm_stats_snapshot *snapshot = stats_snapshot;
+        struct onvm_stats_port_snapshot *port;
+        struct onvm_stats_nf_snapshot *nf;
+        uint16_t i, j, n;
+
+        onvm_stats_snapshot_write_begin(snapshot);
+
+        snapshot->tsc = rte_rdtsc();
+        snapshot->tsc_hz = rte_get_tsc_hz();
+        snapshot->time = (uint64_t)time(NULL);
+
+        for (i = 0; i < ports->num_ports; i++) {
+                port = &snapshot->ports[i];
+                port->id = ports->id[i];
+                port->rx = ports->rx_stats.rx[port->id];
+                port->tx = ports->tx_stats.tx[port->id];
+                port->tx_drop = ports->tx_stats.tx_drop[port->id];
+        }
+        snapshot->num_ports = ports->num_ports;
+        for (j = 0; j < ONVM_DROP_REASON_MAX; j++)
+                snapshot->drop[j] = ports->drop_stats.drop[j];
+
+        n = 0;
+        for (i = 0; i < MAX_NFS; i++) {
+                if (!onvm_nf_is_valid(&nfs[i]))
+                        continue;
+                nf = &snapshot->nfs[n++];
+                if (nfs[i].tag != NULL)
+                        snprintf(nf->tag, sizeof(nf->tag), "%s", nfs[i].tag);
+                else
+                        nf->tag[0] = '\0';
+                nf->instance_id = nfs[i].instance_id;
+                nf->service_id = nfs[i].service_id;
+                nf->core = nfs[i].thread_info.core;
+                nf->parent = nfs[i].thread_info.parent;
+                nf->children_cnt = rte_atomic16_read(&nfs[i].thread_info.children_cnt);
+                nf->status = nfs[i].status;
+                nf->sleeping = ONVM_NF_SHARE_CORES && rte_atomic16_read(nf_wakeup_infos[i].shm_server);
+                nf->congested = rte_atomic16_read(&nfs[i].congested);
+                nf->rx = nfs[i].stats.rx;
+                nf->rx_drop = nfs[i].stats.rx_drop;
+                nf->tx = nfs[i].stats.tx;
+                nf->tx_drop = nfs[i].stats.tx_drop;
+                nf->tx_buffer = nfs[i].stats.tx_buffer;
+                nf->tx_returned = nfs[i].stats.tx_returned;
+                nf->act_out = nfs[i].stats.act_out;
+                nf->act_tonf = nfs[i].stats.act_tonf;
+                nf->act_drop = nfs[i].stats.act_drop;
+                nf->act_next = nfs[i].stats.act_next;
+                nf->num_wakeups = nf_wakeup_infos[i].num_wakeups;
+                for (j = 0; j < ONVM_DROP_REASON_MAX; j++)
+                        nf->drop[j] = nfs[i].stats.drops.drop[j];
+                for (j = 0; j < ONVM_RING_HIST_BUCKETS; j++) {
+                        nf->rx_q_hist[j] = nfs[i].stats.rx_q_hist[j];
+                        nf->tx_q_hist[j] = nfs[i].stats.tx_q_hist[j];
+                }
+                nf->rx_q_count = rte_ring_count(nfs[i].rx_q);
+                nf->rx_q_capacity = rte_ring_get_capacity(nfs[i].rx_q);
+                nf->tx_q_count = rte_ring_count(nfs[i].tx_q);
+                nf->tx_q_capacity = rte_ring_get_capacity(nfs[i].tx_q);
+        }
+        snapshot->num_nfs = n;
+
+        n = 0;
+        onvm_stats_publish_mempool(snapshot, &n, pktmbuf_pool);
+        onvm_stats_publish_mempool(snapshot, &n, pktmbuf_clone_pool);
+        onvm_stats_publish_mempool(snapshot, &n, pkt_join_pool);
+        onvm_stats_publish_mempool(snapshot, &n, nf_msg_pool);
+        onvm_stats_publish_mempool(snapshot, &n, capture_info->clone_pool);
+        snapshot->num_mempools = n;
+
+        snapshot->num_services = RTE_MIN(num_services, MAX_SERVICES);
+        for (i = 0; i < snapshot->num_services; i++) {
+                snapshot->nf_per_service[i] = nf_per_service_count[i];
+                snapshot->congested_nfs[i] = rte_atomic16_read(&congestion_info->congested_nfs[i]);
+        }
+
+        n = 0;
+        for (i = 0; i < ONVM_MAX_CHAINS; i++) {
+                if (congestion_info->chains[i].early_drop == 0 && congestion_info->chains[i].ecn_marked == 0)
+                        continue;
+                snapshot->chains[n].chain_id = i;
+                snapshot->chains[n].early_drop = congestion_info->chains[i].early_drop;
+                snapshot->chains[n].ecn_marked = congestion_info->chains[i].ecn_marked;
+                n++;
+        }
+        snapshot->num_chains = n;
+
+        onvm_stats_snapshot_write_end(snapshot);
+
+        if (display && writer_started)
+                sem_post(&writer_sem);
 }
 
 void
@@ -168,6 +332,14 @@ onvm_stats_set_output(ONVM_STATS_OUTPUT output) {
 
 void
 onvm_stats_cleanup(void) {
+        if (writer_started) {
+                writer_keep_running = 0;
+                sem_post(&writer_sem);
+                pthread_join(writer_thread, NULL);
+                sem_destroy(&writer_sem);
+                writer_started = 0;
+        }
+
         if (stats_destination == ONVM_STATS_WEB) {
                 fclose(stats_out);
                 fclose(json_stats_out);
@@ -178,35 +350,6 @@ onvm_stats_cleanup(void) {
         }
 }
 
-void
-onvm_stats_display_all(unsigned difftime, uint8_t verbosity_level) {
-        time_t time_raw_format;
-        struct tm *ptr_time;
-        time(&time_raw_format);
-        ptr_time = localtime(&time_raw_format);
-        if (strftime(buffer, 20, "%F %T", ptr_time) == 0) {
-                perror("Couldn't prepare formatted string");
-        }
-
-        if (stats_out == stdout) {
-                if (verbosity_level != ONVM_RAW_STATS_DUMP)
-                        onvm_stats_clear_terminal();
-        } else {
-                onvm_stats_truncate();
-                onvm_json_reset_objects();
-        }
-
-        onvm_stats_display_ports(difftime, verbosity_level);
-        onvm_stats_display_nfs(difftime, verbosity_level);
-
-        if (stats_destination == ONVM_STATS_WEB) {
-                fprintf(json_stats_out, "%s\n", cJSON_Print(onvm_json_root));
-                fprintf(json_events_out, "%s\n", cJSON_Print(onvm_json_events_arr));
-        }
-
-        onvm_stats_flush();
-}
-
 void
 onvm_stats_clear_all_nfs(void) {
         unsigned i;
@@ -218,11 +361,17 @@ onvm_stats_clear_all_nfs(void) {
 
 void
 onvm_stats_clear_nf(uint16_t id) {
+        unsigned i;
+
         nfs[id].stats.rx = nfs[id].stats.rx_drop = 0;
         nfs[id].stats.tx = nfs[id].stats.tx_drop = 0;
         nfs[id].stats.act_drop = nfs[id].stats.act_tonf = 0;
         nfs[id].stats.act_next = nfs[id].stats.act_out = 0;
         nfs[id].stats.tx_returned = nfs[id].stats.tx_buffer = 0;
+        for (i = 0; i < ONVM_DROP_REASON_MAX; i++)
+                nfs[id].stats.drops.drop[i] = 0;
+        for (i = 0; i < ONVM_RING_HIST_BUCKETS; i++)
+                nfs[id].stats.rx_q_hist[i] = nfs[id].stats.tx_q_hist[i] = 0;
 }
 
 void
@@ -261,6 +410,93 @@ onvm_stats_gen_event_nf_info(const char *msg, struct onvm_nf *nf) {
 
 /****************************Internal functions*******************************/
 
+static void
+onvm_stats_publish_mempool(struct onvm_stats_snapshot *snapshot, uint16_t *count, struct rte_mempool *mp) {
+        struct onvm_stats_mempool_snapshot *pool;
+
+        if (mp == NULL || *count >= ONVM_STATS_SNAPSHOT_MAX_MEMPOOLS)
+                return;
+        pool = &snapshot->mempools[(*count)++];
+        snprintf(pool->name, sizeof(pool->name), "%s", mp->name);
+        pool->size = mp->size;
+        pool->avail = rte_mempool_avail_count(mp);
+}
+
+static void *
+onvm_stats_writer_main(__attribute__((unused)) void *arg) {
+        /* Too big for the stack of a helper thread */
+        static struct onvm_stats_snapshot snapshot;
+        uint32_t last_seq = 0;
+        uint64_t last_tsc = 0;
+        unsigned difftime;
+
+        for (;;) {
+                if (sem_wait(&writer_sem) != 0)
+                        continue;
+                if (!writer_keep_running)
+                        break;
+                if (onvm_stats_snapshot_read(stats_snapshot, &snapshot) != 0 || snapshot.seq == last_seq)
+                        continue;
+
+                /* Rates are per second over the time the manager actually took between snapshots */
+                if (last_tsc == 0)
+                        difftime = global_stats_sleep_time;
+                else
+                        difftime = (snapshot.tsc - last_tsc + snapshot.tsc_hz / 2) / snapshot.tsc_hz;
+                if (difftime == 0)
+                        difftime = 1;
+                last_seq = snapshot.seq;
+                last_tsc = snapshot.tsc;
+
+                onvm_stats_display_all(&snapshot, difftime, writer_verbosity_level);
+        }
+
+        return NULL;
+}
+
+static void
+onvm_stats_display_all(const struct onvm_stats_snapshot *snapshot, unsigned difftime, uint8_t verbosity_level) {
+        time_t time_raw_format;
+        struct tm *ptr_time;
+        char *json;
+
+        time_raw_format = (time_t)snapshot->time;
+        ptr_time = localtime(&time_raw_format);
+        if (strftime(buffer, 20, "%F %T", ptr_time) == 0) {
+                perror("Couldn't prepare formatted string");
+        }
+
+        if (stats_out == stdout) {
+                if (verbosity_level != ONVM_RAW_STATS_DUMP)
+                        onvm_stats_clear_terminal();
+        } else {
+                onvm_stats_truncate();
+                onvm_json_reset_objects(snapshot);
+        }
+
+        onvm_stats_display_ports(snapshot, difftime, verbosity_level);
+        onvm_stats_display_nfs(snapshot, difftime, verbosity_level);
+        if (verbosity_level == 2)
+                onvm_stats_display_drops(snapshot);
+
+        if (stats_destination == ONVM_STATS_WEB) {
+                json = cJSON_Print(onvm_json_root);
+                if (json != NULL) {
+                        fprintf(json_stats_out, "%s\n", json);
+                        cJSON_free(json);
+                }
+                pthread_mutex_lock(&events_lock);
+                json = cJSON_Print(onvm_json_events_arr);
+                pthread_mutex_unlock(&events_lock);
+                if (json != NULL) {
+                        fprintf(json_events_out, "%s\n", json);
+                        cJSON_free(json);
+                }
+        }
+
+        onvm_stats_flush();
+}
+
 static void
 onvm_stats_add_event(struct onvm_event *event_info) {
         if (event_info == NULL || stats_destination != ONVM_STATS_WEB) {
@@ -274,6 +510,7 @@ onvm_stats_add_event(struct onvm_event *event_info) {
         time_t time_raw_format;
         time(&time_raw_format);
         type = event_info->type;
+        pthread_mutex_lock(&events_lock);
 
         ptr_time = localtime(&time_raw_format);
         if (strftime(event_time_buf, 20, "%F %T", ptr_time) == 0) {
@@ -306,11 +543,12 @@ onvm_stats_add_event(struct onvm_event *event_info) {
 
         cJSON_AddItemToObject(new_event, "source", source);
         cJSON_AddItemToArray(onvm_json_events_arr, new_event);
+        pthread_mutex_unlock(&events_lock);
         rte_free(event_info);
 }
 
 static void
-onvm_stats_display_ports(unsigned difftime, uint8_t verbosity_level) {
+onvm_stats_display_ports(const struct onvm_stats_snapshot *snapshot, unsigned difftime, uint8_t verbosity_level) {
         unsigned i = 0;
         uint64_t nic_rx_pkts = 0;
         uint64_t nic_tx_pkts = 0;
@@ -327,25 +565,25 @@ onvm_stats_display_ports(unsigned difftime, uint8_t verbosity_level) {
         fprintf(stats_out, "%s", PORT_MSG[verbosity_level - 1]);
 
         if (verbosity_level != ONVM_RAW_STATS_DUMP) {
-                for (i = 0; i < ports->num_ports; i++)
-                        fprintf(stats_out, "Port %u: '%s'\t", (unsigned)ports->id[i],
-                                onvm_stats_print_MAC(ports->id[i]));
+                for (i = 0; i < snapshot->num_ports; i++)
+                        fprintf(stats_out, "Port %u: '%s'\t", (unsigned)snapshot->ports[i].id,
+                                onvm_stats_print_MAC(snapshot->ports[i].id));
                 fprintf(stats_out, "\n\n");
         }
-        for (i = 0; i < ports->num_ports; i++) {
-                nic_rx_pkts = ports->rx_stats.rx[ports->id[i]];
-                nic_tx_pkts = ports->tx_stats.tx[ports->id[i]];
+        for (i = 0; i < snapshot->num_ports; i++) {
+                nic_rx_pkts = snapshot->ports[i].rx;
+                nic_tx_pkts = snapshot->ports[i].tx;
 
                 nic_rx_pps = (nic_rx_pkts - rx_last[i]) / difftime;
                 nic_tx_pps = (nic_tx_pkts - tx_last[i]) / difftime;
 
                 if (verbosity_level == ONVM_RAW_STATS_DUMP) {
                         fprintf(stats_out, ONVM_STATS_RAW_DUMP_PORTS_CONTENT, buffer,
-                                (unsigned)ports->id[i], nic_rx_pkts, nic_rx_pps, nic_tx_pkts, nic_tx_pps);
+                                (unsigned)snapshot->ports[i].id, nic_rx_pkts, nic_rx_pps, nic_tx_pkts, nic_tx_pps);
 
                 } else {
                         fprintf(stats_out, ONVM_STATS_REG_PORTS,
-                                (unsigned)ports->id[i], nic_rx_pkts, nic_rx_pps, nic_tx_pkts, nic_tx_pps);
+                                (unsigned)snapshot->ports[i].id, nic_rx_pkts, nic_rx_pps, nic_tx_pkts, nic_tx_pps);
                 }
 
                 /* Only print this information out if we haven't already printed it to the console above */
@@ -368,34 +606,29 @@ onvm_stats_display_ports(unsigned difftime, uint8_t verbosity_level) {
 }
 
 static void
-onvm_stats_display_client_wakeup_thread_context(int difftime) {
-        uint64_t num_wakeups = 0;
-        uint64_t prev_num_wakeups = 0;
+onvm_stats_display_client_wakeup_thread_context(uint64_t num_wakeups, uint64_t prev_num_wakeups, unsigned difftime) {
         uint64_t wakeup_rate;
-        unsigned i = 0;
-
-        for (i = 0; i < MAX_NFS; i++) {
-                if (!onvm_nf_is_valid(&nfs[i]))
-                        continue;
-                num_wakeups += nf_wakeup_infos[i].num_wakeups;
-                prev_num_wakeups += nf_wakeup_infos[i].prev_num_wakeups;
-                nf_wakeup_infos[i].prev_num_wakeups = nf_wakeup_infos[i].num_wakeups;
-        }
 
         wakeup_rate = (num_wakeups - prev_num_wakeups) / difftime;
         fprintf(stats_out, "Total wakeups = %"PRIu64", Wakeup rate = %"PRIu64"\n", num_wakeups, wakeup_rate);
 }
 
 static void
-onvm_stats_display_nfs(unsigned difftime, uint8_t verbosity_level) {
+onvm_stats_display_nfs(const struct onvm_stats_snapshot *snapshot, unsigned difftime, uint8_t verbosity_level) {
+        const struct onvm_stats_nf_snapshot *nf;
         char *nf_label = NULL;
         unsigned i = 0;
+        unsigned j;
         /* Arrays to store last TX/RX count for NFs to calculate rate */
         static uint64_t nf_tx_last[MAX_NFS];
         static uint64_t nf_rx_last[MAX_NFS];
         /* Arrays to store last TX/RX pkts dropped for NFs to calculate drop rate */
         static uint64_t nf_tx_drop_last[MAX_NFS];
         static uint64_t nf_rx_drop_last[MAX_NFS];
+        /* Wakeups of each NF at the last display to calculate wakeup rate */
+        static uint64_t nf_wakeup_last[MAX_NFS];
+        uint64_t total_wakeups = 0;
+        uint64_t total_wakeups_last = 0;
         static const char *NF_MSG[3];
 
         NF_MSG[0] = ONVM_STATS_MSG;
@@ -423,7 +656,7 @@ onvm_stats_display_nfs(unsigned difftime, uint8_t verbosity_level) {
         uint64_t act_buffer_for_service[MAX_SERVICES];
         uint64_t act_returned_for_service[MAX_SERVICES];
         for (i = 0; i < MAX_SERVICES; i++) {
-                if (nf_per_service_count[i] > 1)
+                if (i < snapshot->num_services && snapshot->nf_per_service[i] > 1)
                         print_total_stats = 1;
                 rx_for_service[i] = 0;
                 tx_for_service[i] = 0;
@@ -442,19 +675,21 @@ onvm_stats_display_nfs(unsigned difftime, uint8_t verbosity_level) {
         }
 
         fprintf(stats_out, "%s", NF_MSG[verbosity_level - 1]);
-        for (i = 0; i < MAX_NFS; i++) {
-                if (!onvm_nf_is_valid(&nfs[i]))
+        for (j = 0; j < snapshot->num_nfs; j++) {
+                nf = &snapshot->nfs[j];
+                i = nf->instance_id;
+                if (unlikely(i >= MAX_NFS))
                         continue;
-                const uint64_t rx = nfs[i].stats.rx;
-                const uint64_t rx_drop = nfs[i].stats.rx_drop;
-                const uint64_t tx = nfs[i].stats.tx;
-                const uint64_t tx_drop = nfs[i].stats.tx_drop;
-                const uint64_t act_out = nfs[i].stats.act_out;
-                const uint64_t act_tonf = nfs[i].stats.act_tonf;
-                const uint64_t act_drop = nfs[i].stats.act_drop;
-                const uint64_t act_next = nfs[i].stats.act_next;
-                const uint64_t act_buffer = nfs[i].stats.tx_buffer;
-                const uint64_t act_returned = nfs[i].stats.tx_returned;
+                const uint64_t rx = nf->rx;
+                const uint64_t rx_drop = nf->rx_drop;
+                const uint64_t tx = nf->tx;
+                const uint64_t tx_drop = nf->tx_drop;
+                const uint64_t act_out = nf->act_out;
+                const uint64_t act_tonf = nf->act_tonf;
+                const uint64_t act_drop = nf->act_drop;
+                const uint64_t act_next = nf->act_next;
+                const uint64_t act_buffer = nf->tx_buffer;
+                const uint64_t act_returned = nf->tx_returned;
 
                 /* On onvm_stats_clear_nf, subtraction causes underflow */
                 if (unlikely(rx == 0))
@@ -470,57 +705,51 @@ onvm_stats_display_nfs(unsigned difftime, uint8_t verbosity_level) {
                         nf_tx_drop_last[i] = 0;
                 const uint64_t tx_drop_rate = (tx_drop - nf_tx_drop_last[i]) / difftime;
 
-                const uint64_t num_wakeups = nf_wakeup_infos[i].num_wakeups;
-                const uint64_t prev_num_wakeups = nf_wakeup_infos[i].prev_num_wakeups;
-                const uint64_t wakeup_rate = (num_wakeups - prev_num_wakeups) / difftime;
-                char state;
-
-                uint8_t active = 0;
-                if (ONVM_NF_SHARE_CORES)
-                        active = rte_atomic16_read(nf_wakeup_infos[i].shm_server);
-                if (!active) {
-                        state = 'W';
-                } else {
-                        state = 'S';
-                }
+                const uint64_t num_wakeups = nf->num_wakeups;
+                if (unlikely(num_wakeups < nf_wakeup_last[i]))
+                        nf_wakeup_last[i] = 0;
+                const uint64_t wakeup_rate = (num_wakeups - nf_wakeup_last[i]) / difftime;
+                total_wakeups += num_wakeups;
+                total_wakeups_last += nf_wakeup_last[i];
+                const char state = nf->sleeping ? 'S' : 'W';
 
                 /* Save stats for NFs with same service id */
                 if (print_total_stats) {
-                        rx_for_service[nfs[i].service_id] += rx;
-                        tx_for_service[nfs[i].service_id] += tx;
-                        rx_drop_for_service[nfs[i].service_id] += rx_drop;
-                        tx_drop_for_service[nfs[i].service_id] += tx_drop;
-                        rx_pps_for_service[nfs[i].service_id] += rx_pps;
-                        tx_pps_for_service[nfs[i].service_id] += tx_pps;
-                        rx_drop_rate_for_service[nfs[i].service_id] += rx_drop_rate;
-                        tx_drop_rate_for_service[nfs[i].service_id] += tx_drop_rate;
-                        act_out_for_service[nfs[i].service_id] += act_out;
-                        act_tonf_for_service[nfs[i].service_id] += act_tonf;
-                        act_drop_for_service[nfs[i].service_id] += act_drop;
-                        act_next_for_service[nfs[i].service_id] += act_next;
-                        act_buffer_for_service[nfs[i].service_id] += act_buffer;
-                        act_returned_for_service[nfs[i].service_id] += act_returned;
+                        rx_for_service[nf->service_id] += rx;
+                        tx_for_service[nf->service_id] += tx;
+                        rx_drop_for_service[nf->service_id] += rx_drop;
+                        tx_drop_for_service[nf->service_id] += tx_drop;
+                        rx_pps_for_service[nf->service_id] += rx_pps;
+                        tx_pps_for_service[nf->service_id] += tx_pps;
+                        rx_drop_rate_for_service[nf->service_id] += rx_drop_rate;
+                        tx_drop_rate_for_service[nf->service_id] += tx_drop_rate;
+                        act_out_for_service[nf->service_id] += act_out;
+                        act_tonf_for_service[nf->service_id] += act_tonf;
+                        act_drop_for_service[nf->service_id] += act_drop;
+                        act_next_for_service[nf->service_id] += act_next;
+                        act_buffer_for_service[nf->service_id] += act_buffer;
+                        act_returned_for_service[nf->service_id] += act_returned;
                 }
 
                 if (verbosity_level == ONVM_RAW_STATS_DUMP) {
                         fprintf(stats_out, ONVM_STATS_RAW_DUMP_CONTENT,
-                                buffer, nfs[i].tag, nfs[i].instance_id, nfs[i].service_id, nfs[i].thread_info.core,
-                                nfs[i].thread_info.parent, state, rte_atomic16_read(&nfs[i].thread_info.children_cnt),
+                                buffer, nf->tag, nf->instance_id, nf->service_id, nf->core,
+                                nf->parent, state, nf->children_cnt,
                                 rx, tx, rx_pps, tx_pps, rx_drop, tx_drop, rx_drop_rate, tx_drop_rate,
                                 act_out, act_tonf, act_drop, act_next, act_buffer, act_returned,
                                 num_wakeups, wakeup_rate);
                 } else if (verbosity_level == 2) {
                         fprintf(stats_out, ONVM_STATS_ADV_CONTENT,
-                                nfs[i].tag, nfs[i].instance_id, nfs[i].service_id, nfs[i].thread_info.core,
+                                nf->tag, nf->instance_id, nf->service_id, nf->core,
                                 rx_pps, tx_pps, rx, tx, act_out, act_tonf, act_drop,
-                                nfs[i].thread_info.parent, state, rte_atomic16_read(&nfs[i].thread_info.children_cnt),
+                                nf->parent, state, nf->children_cnt,
                                 rx_drop_rate, tx_drop_rate, rx_drop, tx_drop, act_next, act_buffer, act_returned);
                         if (ONVM_NF_SHARE_CORES)
                                 fprintf(stats_out, ONVM_STATS_SHARED_CORE_CONTENT, num_wakeups, wakeup_rate);
                         fprintf(stats_out, "\n");
                 } else {
                         fprintf(stats_out, ONVM_STATS_REG_CONTENT,
-                                nfs[i].tag, nfs[i].instance_id, nfs[i].service_id, nfs[i].thread_info.core,
+                                nf->tag, nf->instance_id, nf->service_id, nf->core,
                                 rx_pps, tx_pps, rx_drop, tx_drop, act_out, act_tonf, act_drop);
                 }
                 /* Only print this information out if we haven't already printed it to the console above */
@@ -535,19 +764,19 @@ onvm_stats_display_nfs(unsigned difftime, uint8_t verbosity_level) {
                         cJSON_AddNumberToObject(onvm_json_nf_stats[i], "TX", tx_pps);
                         cJSON_AddNumberToObject(onvm_json_nf_stats[i], "TX_Drop_Rate", tx_drop_rate);
                         cJSON_AddNumberToObject(onvm_json_nf_stats[i], "RX_Drop_Rate", rx_drop_rate);
-                        cJSON_AddNumberToObject(onvm_json_nf_stats[i], "service_id", (int16_t)nfs[i].service_id);
-                        cJSON_AddNumberToObject(onvm_json_nf_stats[i], "instance_id",
-                                                (int16_t)nfs[i].instance_id);
-                        cJSON_AddNumberToObject(onvm_json_nf_stats[i], "core", (int16_t)nfs[i].thread_info.core);
+                        cJSON_AddNumberToObject(onvm_json_nf_stats[i], "service_id", (int16_t)nf->service_id);
+                        cJSON_AddNumberToObject(onvm_json_nf_stats[i], "instance_id", (int16_t)nf->instance_id);
+                        cJSON_AddNumberToObject(onvm_json_nf_stats[i], "core", (int16_t)nf->core);
 
                         free(nf_label);
                         nf_label = NULL;
                 }
 
-                nf_rx_last[i] = nfs[i].stats.rx;
-                nf_tx_last[i] = nfs[i].stats.tx;
+                nf_rx_last[i] = rx;
+                nf_tx_last[i] = tx;
                 nf_rx_drop_last[i] = rx_drop;
                 nf_tx_drop_last[i] = tx_drop;
+                nf_wakeup_last[i] = num_wakeups;
         }
 
         if (verbosity_level == ONVM_RAW_STATS_DUMP)
@@ -557,7 +786,7 @@ onvm_stats_display_nfs(unsigned difftime, uint8_t verbosity_level) {
                 fprintf(stats_out, "\nService id totals\n");
                 fprintf(stats_out, "-----------------\n");
                 for (i = 0; i < MAX_SERVICES; i++) {
-                        uint16_t nfs_for_service = nf_per_service_count[i];
+                        uint16_t nfs_for_service = i < snapshot->num_services ? snapshot->nf_per_service[i] : 0;
                         const char *nf_count = nfs_for_service == 1 ? "NF " : "NFs";
                         if (nfs_for_service == 0)
                                 continue;
@@ -580,8 +809,38 @@ onvm_stats_display_nfs(unsigned difftime, uint8_t verbosity_level) {
         if (ONVM_NF_SHARE_CORES) {
                 fprintf(stats_out, "\n\nShared core stats\n");
                 fprintf(stats_out, "-----------------\n");
-                onvm_stats_display_client_wakeup_thread_context(difftime);
+                onvm_stats_display_client_wakeup_thread_context(total_wakeups, total_wakeups_last, difftime);
+        }
+}
+
+static void
+onvm_stats_display_drops(const struct onvm_stats_snapshot *snapshot) {
+        const struct onvm_stats_nf_snapshot *nf;
+        unsigned i, j;
+
+        fprintf(stats_out, "\nDrops by reason\n---------------\n%-20s", "");
+        for (i = 0; i < ONVM_DROP_REASON_MAX; i++)
+                fprintf(stats_out, " %15s", onvm_drop_reason_name(i));
+        fprintf(stats_out, "\n%-20s", "Manager");
+        for (i = 0; i < ONVM_DROP_REASON_MAX; i++)
+                fprintf(stats_out, " %15" PRIu64, snapshot->drop[i]);
+        fprintf(stats_out, "\n");
+
+        for (j = 0; j < snapshot->num_nfs; j++) {
+                nf = &snapshot->nfs[j];
+                fprintf(stats_out, "%-14s %5u", nf->tag, nf->instance_id);
+                for (i = 0; i < ONVM_DROP_REASON_MAX; i++)
+                        fprintf(stats_out, " %15" PRIu64, nf->drop[i]);
+                fprintf(stats_out, "%s\n", nf->congested ? " congested" : "");
         }
+
+        if (snapshot->num_chains == 0)
+                return;
+        fprintf(stats_out, "\nCongestion by chain\n-------------------\n%-20s %15s %15s\n", "Chain", "early_drop",
+                "ecn_marked");
+        for (j = 0; j < snapshot->num_chains; j++)
+                fprintf(stats_out, "%-20u %15" PRIu64 " %15" PRIu64 "\n", snapshot->chains[j].chain_id,
+                        snapshot->chains[j].early_drop, snapshot->chains[j].ecn_marked);
 }
 
 /***************************Helper functions**********************************/
@@ -640,7 +899,7 @@ onvm_stats_truncate(void) {
 }
 
 static void
-onvm_json_reset_objects(void) {
+onvm_json_reset_objects(const struct onvm_stats_snapshot *snapshot) {
         time_t current_time;
 
         if (onvm_json_root) {
@@ -650,7 +909,7 @@ onvm_json_reset_objects(void) {
 
         onvm_json_root = cJSON_CreateObject();
 
-        current_time = time(0);
+        current_time = (time_t)snapshot->time;
 
         cJSON_AddStringToObject(onvm_json_root, ONVM_JSON_TIMESTAMP_KEY, ctime(&current_time));
         cJSON_AddItemToObject(onvm_json_root, ONVM_JSON_PORT_STATS_KEY,
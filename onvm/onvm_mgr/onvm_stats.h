@@ -148,7 +148,8 @@ cJSON* onvm_json_events_arr;
 /*********************************Interfaces**********************************/
 
 /*
- * Function for initializing stats
+ * Function for initializing stats, starts the low priority thread that
+ * formats the published snapshots if stats output is enabled
  *
  * Input : Verbosity level
  *
@@ -156,6 +157,16 @@ cJSON* onvm_json_events_arr;
 void
 onvm_stats_init(uint8_t verbosity_level);
 
+/*
+ * Interface called by the master thread to copy the port, NF, ring and mempool
+ * counters into the shared MZ_STATS_SNAPSHOT memzone.
+ *
+ * Input : whether the stats thread should format and write out this snapshot
+ *
+ */
+void
+onvm_stats_publish(uint8_t display);
+
 /*
  * Interface called by the manager to tell the stats module where to print
  * You should only call this once
@@ -169,22 +180,12 @@ void
 onvm_stats_set_output(ONVM_STATS_OUTPUT output);
 
 /*
- * Interface to close out file descriptions and clean up memory
+ * Interface to stop the stats thread, close out file descriptions and clean up memory
  * To be called when the stats loop is done
  */
 void
 onvm_stats_cleanup(void);
 
-/*
- * Interface called by the ONVM Manager to display all statistics
- * available.
- *
- * Input : time passed since last display (to compute packet rate)
- *
- */
-void
-onvm_stats_display_all(unsigned difftime, uint8_t verbosity_level);
-
 /*
  * Interface called by the ONVM Manager to clear all NFs statistics
  * available.
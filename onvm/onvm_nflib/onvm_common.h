@@ -55,24 +55,36 @@
 #include <rte_mbuf.h>
 #include <rte_hash.h>
 #include <rte_ethdev.h>
+#include <rte_ring.h>
 
 #include "onvm_config_common.h"
 #include "onvm_msg_common.h"
 
 #define ONVM_NF_HANDLE_TX 1                   // should be true if NFs primarily pass packets to each other
 #define ONVM_NF_SHUTDOWN_CORE_REASSIGNMENT 0  // should be true if on NF shutdown onvm_mgr tries to reallocate cores
+#define ONVM_NF_DIRECT_RINGS 1                // should be true if NFs handling TX use a SPSC ring per NF to NF edge
 
-#define ONVM_MAX_CHAIN_LENGTH 4  // the maximum chain length
+#define ONVM_MAX_CHAIN_LENGTH 32 // the maximum chain length
+#define ONVM_MAX_CHAINS 256      // total number of service chains that can be installed (ID 0 is reserved)
 #define MAX_NFS 128              // total number of concurrent NFs allowed (-1 because ID 0 is reserved)
 #define MAX_SERVICES 32          // total number of unique services allowed
 #define MAX_NFS_PER_SERVICE 32   // max number of NFs per service.
 
 #define NUM_MBUFS 32767          // total number of mbufs (2^15 - 1)
+#define NUM_CLONE_MBUFS 8191     // total number of header-only mbufs used to fan packets out to parallel stages
+#define NUM_PKT_JOINS 4095       // total number of packets that can wait on a parallel join at once
 #define NF_QUEUE_RINGSIZE 16384  // size of queue for NFs
+#define NF_EDGE_RINGSIZE 4096    // size of the direct ring between two NFs
+#define ONVM_MAX_NF_EDGES 16     // max number of upstream NFs with a direct ring into one NF
 
 #define PACKET_READ_SIZE ((uint16_t)32)
 
+#define ONVM_RING_HIST_BUCKETS 16  // ring depth histogram buckets, bucket i holds depths in [2^(i-1), 2^i)
+
 #define ONVM_NF_SHARE_CORES_DEFAULT 0  // default value for shared core logic, if true NFs sleep while waiting for packets
+#define ONVM_BP_HOLD_BUDGET_DEFAULT 8  // flushes packets a ring didn't take are retried for with ONVM_BP_HOLD
+#define ONVM_CONGESTION_HIGH_DEFAULT 75  // rx ring fill percentage at which an NF becomes congested
+#define ONVM_CONGESTION_LOW_DEFAULT 25   // rx ring fill percentage at which a congested NF recovers
 
 #define ONVM_NF_ACTION_DROP 0  // drop packet
 #define ONVM_NF_ACTION_NEXT 1  // to whatever the next action is configured by the SDN controller in the flow table
@@ -109,10 +121,11 @@
 
 struct onvm_pkt_meta {
         uint8_t action;       /* Action to be performed */
+        uint8_t chain_index;  /*index of the current step in the service chain*/
         uint16_t destination; /* where to go next */
         uint16_t src;         /* who processed the packet last */
-        uint8_t chain_index;  /*index of the current step in the service chain*/
         uint8_t flags;        /* bits for custom NF data. Use with caution to prevent collisions from different NFs. */
+        uint8_t chain_id;     /* ID of the installed service chain, 0 if the flow director has to be consulted */
 };
 
 static inline struct onvm_pkt_meta *
@@ -157,6 +170,8 @@ struct tx_thread_info {
 struct packet_buf {
         struct rte_mbuf *buffer[PACKET_READ_SIZE];
         uint16_t count;
+        /* Flushes in a row that left packets behind, see enum onvm_backpressure_policy */
+        uint8_t held;
 };
 
 /*
@@ -171,6 +186,8 @@ struct queue_mgr {
                 struct packet_buf *to_tx_buf;
         };
         struct packet_buf *nf_rx_bufs;
+        /* Instance of each service the thread runs inline, 0 if none, NULL outside run to completion */
+        uint16_t *local_nfs;
 };
 
 /* NFs wakeup Info: used by manager to update NFs pool and wakeup stats */
@@ -185,13 +202,35 @@ struct nf_wakeup_info {
         key_t shm_key;
         rte_atomic16_t *shm_server;
         uint64_t num_wakeups;
-        uint64_t prev_num_wakeups;
 };
 
+/* Several RX threads and NFs read the queues of a port, counts are only added atomically */
 struct rx_stats {
         uint64_t rx[RTE_MAX_ETHPORTS];
 };
 
+/* Why a packet was dropped, see struct drop_stats for who counts it */
+enum onvm_drop_reason {
+        ONVM_DROP_RING_FULL = 0,    // destination NF rx ring was full
+        ONVM_DROP_NO_INSTANCE,      // no running instance of the destination service
+        ONVM_DROP_NF_NOT_RUNNING,   // destination instance is not running
+        ONVM_DROP_INVALID_ACTION,   // packet meta action is none of ONVM_NF_ACTION_*
+        ONVM_DROP_TX_QUEUE_FULL,    // NF tx ring or port tx queue was full
+        ONVM_DROP_MBUF_ALLOC_FAIL,  // no clone mbuf, join or private copy left for a parallel stage
+        ONVM_DROP_CONGESTION,       // a later hop of the packet's chain is congested
+        ONVM_DROP_REASON_MAX
+};
+
+/*
+ * Drops by reason. Ring full drops are counted by the NF whose rx ring was full,
+ * the others by the NF that sent the packet. Packets the manager got from a port
+ * or sends out of one are counted in port_info. Several lcores and NFs count into
+ * the same struct, add with onvm_drop_count.
+ */
+struct drop_stats {
+        uint64_t drop[ONVM_DROP_REASON_MAX];
+};
+
 struct tx_stats {
         uint64_t tx[RTE_MAX_ETHPORTS];
         uint64_t tx_drop[RTE_MAX_ETHPORTS];
@@ -201,15 +240,57 @@ struct port_info {
         uint8_t num_ports;
         uint8_t id[RTE_MAX_ETHPORTS];
         uint8_t init[RTE_MAX_ETHPORTS];
+        uint8_t fast_free[RTE_MAX_ETHPORTS];  // port runs with DEV_TX_OFFLOAD_MBUF_FAST_FREE
         struct rte_ether_addr mac[RTE_MAX_ETHPORTS];
         volatile struct rx_stats rx_stats;
         volatile struct tx_stats tx_stats;
+        volatile struct drop_stats drop_stats;
+};
+
+/* What to do with the packets of a burst a full ring didn't take */
+enum onvm_backpressure_policy {
+        ONVM_BP_DROP_TAIL = 0,  // drop them
+        ONVM_BP_HOLD,           // keep them buffered for the next flush, drop them after hold_budget flushes
+        ONVM_BP_SIGNAL,         // like ONVM_BP_HOLD without a budget, an NF holding packets stops reading its rx ring
+};
+
+/* What to do with a packet whose chain has a congested hop further on */
+enum onvm_congestion_action {
+        ONVM_CONGESTION_OFF = 0,  // nothing, NFs are not tracked
+        ONVM_CONGESTION_DROP,     // drop it before any more work is spent on it
+        ONVM_CONGESTION_ECN,      // set CE on ECN capable IP packets, drop the others
 };
 
 struct onvm_configuration {
         struct {
                 uint8_t ONVM_NF_SHARE_CORES;
         } flags;
+        struct {
+                uint8_t policy;
+                uint8_t hold_budget;
+        } backpressure;
+        struct {
+                uint8_t action;
+                /* rx ring fill percentages, the gap between them keeps the flag from flapping */
+                uint8_t high_pct;
+                uint8_t low_pct;
+        } congestion;
+};
+
+/*
+ * Congestion state shared by the manager and NFs. An NF is congested from the
+ * time its rx ring fills past high_pct until it drains below low_pct, a service
+ * is congested while all of its instances are.
+ */
+struct onvm_congestion_info {
+        /* Number of congested NFs, lets the packet path skip walking chains */
+        rte_atomic16_t congested_total;
+        rte_atomic16_t congested_nfs[MAX_SERVICES];
+        /* Packets stopped or marked ahead of a congested hop, indexed by chain ID (0 for the default chain) */
+        struct {
+                volatile uint64_t early_drop;
+                volatile uint64_t ecn_marked;
+        } chains[ONVM_MAX_CHAINS];
 };
 
 struct core_status {
@@ -223,6 +304,13 @@ struct onvm_nf;
 /* Function prototype for NF packet handlers */
 typedef int (*nf_pkt_handler_fn)(struct rte_mbuf *pkt, struct onvm_pkt_meta *meta,
                                  __attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx);
+/*
+ * Function prototype for NF packet handlers taking a whole burst, used instead of the pkt_handler if set.
+ * Every packet gets its meta set, the ones to send on are moved to the front of pkts and their number is
+ * returned. The NF keeps the others, as if the pkt_handler had returned 1 for them.
+ */
+typedef uint16_t (*nf_pkt_bulk_handler_fn)(struct rte_mbuf **pkts, uint16_t nb_pkts,
+                                           struct onvm_nf_local_ctx *nf_local_ctx);
 /* Function prototype for NF the callback */
 typedef int (*nf_user_actions_fn)(__attribute__((unused)) struct onvm_nf_local_ctx *nf_local_ctx);
 /* Function prototype for NFs that want extra initalization/setup before running */
@@ -238,6 +326,7 @@ struct onvm_nf_function_table {
         nf_msg_handler_fn  msg_handler;
         nf_user_actions_fn user_actions;
         nf_pkt_handler_fn  pkt_handler;
+        nf_pkt_bulk_handler_fn pkt_bulk_handler;
 };
 
 /* Information needed to initialize a new NF child thread */
@@ -281,17 +370,51 @@ struct onvm_nf {
                 rte_atomic16_t children_cnt;
         } thread_info;
 
+        /* Set while the rx ring is congested, see struct onvm_congestion_info */
+        rte_atomic16_t congested;
+
+        /* NIC RX queue the NF reads on every port itself, see onvm_mgr/onvm_rss.h */
+        struct {
+                /* Set by the NF library before the NF is ready if it reads packets in its main loop */
+                volatile uint8_t capable;
+                /* Set by the manager once queue is the NF's, before any packet is redirected to it */
+                volatile uint8_t enabled;
+                uint16_t queue;
+        } nic_rx;
+
         struct {
                 uint16_t init_options;
                 /* If set NF will stop after time reaches time_to_live */
                 uint16_t time_to_live;
                 /* If set NF will stop after pkts TX reach pkt_limit */
                 uint16_t pkt_limit;
+                /* Set if a manager thread runs the NF, see onvm_mgr/onvm_rtc.h */
+                uint8_t run_inline;
         } flags;
 
         /* NF specific functions */
         struct onvm_nf_function_table *function_table;
 
+        /*
+         * Direct SPSC rings between NFs, created by the manager the first time an
+         * NF sends to another NF that polls its rings through the NF library.
+         */
+        struct {
+                /* Set while this NF polls its edge rings, NFs reading rx_q directly never get any */
+                volatile uint8_t enabled;
+                /* Number of upstream rings in rx, published after the ring pointer */
+                volatile uint16_t rx_count;
+                /* Round robin start for polling, only used by this NF */
+                uint16_t rx_next;
+                struct rte_ring *rx[ONVM_MAX_NF_EDGES];
+                /* Ring to each destination instance ID, NULL until the manager creates it */
+                struct rte_ring *tx[MAX_NFS];
+                /* Set once this NF asked the manager for a ring to a destination */
+                uint8_t requested[MAX_NFS];
+                /* Odd while this NF may be enqueueing on an edge ring, see onvm_nf_clear_edges */
+                volatile uint32_t tx_seq;
+        } edges;
+
         /*
          * Define a structure with stats from the NFs.
          *
@@ -312,6 +435,10 @@ struct onvm_nf {
                 volatile uint64_t act_drop;
                 volatile uint64_t act_next;
                 volatile uint64_t act_buffer;
+                volatile struct drop_stats drops;
+                /* Ring depth seen by each burst enqueued on rx_q and tx_q, see onvm_ring_hist_sample */
+                volatile uint64_t rx_q_hist[ONVM_RING_HIST_BUCKETS];
+                volatile uint64_t tx_q_hist[ONVM_RING_HIST_BUCKETS];
         } stats;
 
         struct {
@@ -348,12 +475,41 @@ struct onvm_nf_init_cfg {
 struct onvm_service_chain_entry {
         uint16_t destination;
         uint8_t action;
+        /* Set on the first entry of a parallel stage: number of entries in the stage and whether they must all
+         * approve the packet before it continues */
+        uint8_t branches;
+        uint8_t join;
+};
+
+/*
+ * Tracks a packet held at a parallel join. Each branch gets an indirect clone pointing at this struct
+ * through its private area; the last branch to finish releases the original packet.
+ */
+struct onvm_pkt_join {
+        struct rte_mbuf *pkt;
+        rte_atomic16_t pending;
+        rte_atomic16_t vetoed;
 };
 
+/*
+ * Service chains are allocated in hugepages sized to their maximum length and
+ * registered in the shared chain table, so packets only need to carry the
+ * chain ID. Entry 0 is reserved, entries 1..chain_length are the hops.
+ */
 struct onvm_service_chain {
-        struct onvm_service_chain_entry sc[ONVM_MAX_CHAIN_LENGTH];
         uint8_t chain_length;
+        uint8_t max_length;
+        uint8_t chain_id;
         int ref_cnt;
+        struct onvm_service_chain_entry sc[];
+};
+
+/*
+ * Structure used to ask the manager for a direct ring between two NFs
+ */
+struct onvm_nf_edge_request {
+        uint16_t src;
+        uint16_t dst;
 };
 
 struct lpm_request {
@@ -375,8 +531,11 @@ struct ft_request {
 /* define common names for structures shared between server and NF */
 #define MP_NF_RXQ_NAME "MProc_Client_%u_RX"
 #define MP_NF_TXQ_NAME "MProc_Client_%u_TX"
+#define MP_NF_EDGEQ_NAME "MProc_Edge_%u_%u"
 #define MP_CLIENT_SEM_NAME "MProc_Client_%u_SEM"
 #define PKTMBUF_POOL_NAME "MProc_pktmbuf_pool"
+#define PKTMBUF_CLONE_POOL_NAME "MProc_pktmbuf_clone_pool"
+#define PKT_JOIN_POOL_NAME "MProc_pkt_join_pool"
 #define MZ_PORT_INFO "MProc_port_info"
 #define MZ_CORES_STATUS "MProc_cores_info"
 #define MZ_NF_INFO "MProc_nf_init_cfg"
@@ -385,6 +544,9 @@ struct ft_request {
 #define MZ_ONVM_CONFIG "MProc_onvm_config"
 #define MZ_SCP_INFO "MProc_scp_info"
 #define MZ_FTP_INFO "MProc_ftp_info"
+#define MZ_FTP6_INFO "MProc_ftp6_info"
+#define MZ_SC_TABLE_INFO "MProc_sc_table_info"
+#define MZ_CONGESTION_INFO "MProc_congestion_info"
 
 #define _MGR_MSG_QUEUE_NAME "MSG_MSG_QUEUE"
 #define _NF_MSG_QUEUE_NAME "NF_%u_MSG_QUEUE"
@@ -414,6 +576,53 @@ struct ft_request {
 
 #define NF_NO_ID -1
 
+/*
+ * Record the depth of a ring in a histogram, free_space is what the last
+ * enqueue on the ring reported. Sampling on the enqueue keeps this to a
+ * single increment per burst.
+ */
+static inline void
+onvm_ring_hist_sample(volatile uint64_t *hist, const struct rte_ring *ring, unsigned int free_space) {
+        unsigned int depth = rte_ring_get_capacity(ring) - free_space;
+        unsigned int bucket = depth == 0 ? 0 : 32 - __builtin_clz(depth);
+
+        /* Every sender to the ring samples it */
+        __atomic_fetch_add(&hist[RTE_MIN(bucket, ONVM_RING_HIST_BUCKETS - 1)], 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Count dropped packets, atomically as senders on other lcores count into the same struct
+ */
+static inline void
+onvm_drop_count(volatile struct drop_stats *stats, enum onvm_drop_reason reason, uint64_t count) {
+        __atomic_fetch_add(&stats->drop[reason], count, __ATOMIC_RELAXED);
+}
+
+/*
+ * Short name of a drop reason, used as the label in stats output
+ */
+static inline const char *
+onvm_drop_reason_name(enum onvm_drop_reason reason) {
+        switch (reason) {
+                case ONVM_DROP_RING_FULL:
+                        return "ring_full";
+                case ONVM_DROP_NO_INSTANCE:
+                        return "no_instance";
+                case ONVM_DROP_NF_NOT_RUNNING:
+                        return "nf_not_running";
+                case ONVM_DROP_INVALID_ACTION:
+                        return "invalid_action";
+                case ONVM_DROP_TX_QUEUE_FULL:
+                        return "tx_queue_full";
+                case ONVM_DROP_MBUF_ALLOC_FAIL:
+                        return "mbuf_alloc_fail";
+                case ONVM_DROP_CONGESTION:
+                        return "congestion";
+                default:
+                        return "unknown";
+        }
+}
+
 /*
  * Given the rx queue name template above, get the queue name
  */
@@ -440,6 +649,19 @@ get_tx_queue_name(unsigned id) {
         return buffer;
 }
 
+/*
+ * Given the edge queue name template above, get the name of the ring from src to dst
+ */
+static inline const char *
+get_edge_queue_name(unsigned src, unsigned dst) {
+        /* buffer for return value. Size calculated by each %u being replaced
+         * by maximum 3 digits (plus an extra byte for safety) */
+        static char buffer[sizeof(MP_NF_EDGEQ_NAME) + 4];
+
+        snprintf(buffer, sizeof(buffer) - 1, MP_NF_EDGEQ_NAME, src, dst);
+        return buffer;
+}
+
 /*
  * Given the name template above, get the mgr -> NF msg queue name
  */
@@ -482,9 +704,23 @@ get_sem_name(unsigned id) {
         return buffer;
 }
 
+/*
+ * Number of packets waiting for an NF on its rx queue and direct edge rings
+ */
+static inline unsigned
+onvm_nf_rx_pending(struct onvm_nf *nf) {
+        unsigned count;
+        uint16_t i;
+
+        count = rte_ring_count(nf->rx_q);
+        for (i = 0; i < nf->edges.rx_count; i++)
+                count += rte_ring_count(nf->edges.rx[i]);
+        return count;
+}
+
 static inline int
 whether_wakeup_client(struct onvm_nf *nf, struct nf_wakeup_info *nf_wakeup_info) {
-        if (rte_ring_count(nf->rx_q) < PKT_WAKEUP_THRESHOLD && rte_ring_count(nf->msg_q) < MSG_WAKEUP_THRESHOLD)
+        if (onvm_nf_rx_pending(nf) < PKT_WAKEUP_THRESHOLD && rte_ring_count(nf->msg_q) < MSG_WAKEUP_THRESHOLD)
                 return 0;
 
         /* Check if its already woken up */
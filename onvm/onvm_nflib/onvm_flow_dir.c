@@ -48,12 +48,15 @@
 #include <stdlib.h>
 #include "onvm_common.h"
 #include "onvm_flow_table.h"
+#include "onvm_sc_mgr.h"
 
 #define NO_FLAGS 0
 #define SDN_FT_ENTRIES 1024
 
 struct onvm_ft *sdn_ft;
 struct onvm_ft **sdn_ft_p;
+struct onvm_ft *sdn_ft_ipv6;
+struct onvm_ft **sdn_ft_ipv6_p;
 
 int
 onvm_flow_dir_init(void) {
@@ -71,6 +74,17 @@ onvm_flow_dir_init(void) {
         sdn_ft_p = mz_ftp->addr;
         *sdn_ft_p = sdn_ft;
 
+        sdn_ft_ipv6 = onvm_ft_create_ipv6(SDN_FT_ENTRIES, sizeof(struct onvm_flow_entry));
+        if (sdn_ft_ipv6 == NULL) {
+                rte_exit(EXIT_FAILURE, "Unable to create IPv6 flow table\n");
+        }
+        mz_ftp = rte_memzone_reserve(MZ_FTP6_INFO, sizeof(struct onvm_ft *), rte_socket_id(), NO_FLAGS);
+        if (mz_ftp == NULL) {
+                rte_exit(EXIT_FAILURE, "Cannot reserve memory zone for IPv6 flow table pointer\n");
+        }
+        sdn_ft_ipv6_p = mz_ftp->addr;
+        *sdn_ft_ipv6_p = sdn_ft_ipv6;
+
         return 0;
 }
 
@@ -85,13 +99,22 @@ onvm_flow_dir_nf_init(void) {
         ftp = mz_ftp->addr;
         sdn_ft = *ftp;
 
+        mz_ftp = rte_memzone_lookup(MZ_FTP6_INFO);
+        if (mz_ftp == NULL)
+                rte_exit(EXIT_FAILURE, "Cannot get IPv6 table pointer\n");
+        ftp = mz_ftp->addr;
+        sdn_ft_ipv6 = *ftp;
+
         return 0;
 }
 
+/* IPv4 is tried first so its lookups cost the same as before, other packets fall through to the IPv6 table */
 int
 onvm_flow_dir_get_pkt(struct rte_mbuf *pkt, struct onvm_flow_entry **flow_entry) {
         int ret;
         ret = onvm_ft_lookup_pkt(sdn_ft, pkt, (char **)flow_entry);
+        if (ret == -EPROTONOSUPPORT)
+                ret = onvm_ft_lookup_pkt_ipv6(sdn_ft_ipv6, pkt, (char **)flow_entry);
 
         return ret;
 }
@@ -100,6 +123,8 @@ int
 onvm_flow_dir_add_pkt(struct rte_mbuf *pkt, struct onvm_flow_entry **flow_entry) {
         int ret;
         ret = onvm_ft_add_pkt(sdn_ft, pkt, (char **)flow_entry);
+        if (ret == -EPROTONOSUPPORT)
+                ret = onvm_ft_add_pkt_ipv6(sdn_ft_ipv6, pkt, (char **)flow_entry);
 
         return ret;
 }
@@ -128,9 +153,11 @@ onvm_flow_dir_del_and_free_pkt(struct rte_mbuf *pkt) {
 
         ret = onvm_flow_dir_get_pkt(pkt, &flow_entry);
         if (ret >= 0) {
-                rte_free(flow_entry->sc);
+                onvm_sc_free(flow_entry->sc);
                 rte_free(flow_entry->key);
                 ret = onvm_ft_remove_pkt(sdn_ft, pkt);
+                if (ret == -EPROTONOSUPPORT)
+                        ret = onvm_ft_remove_pkt_ipv6(sdn_ft_ipv6, pkt);
         }
 
         return ret;
@@ -176,10 +203,52 @@ onvm_flow_dir_del_and_free_key(struct onvm_ft_ipv4_5tuple *key) {
 
         ret = onvm_flow_dir_get_key(key, &flow_entry);
         if (ret >= 0) {
-                rte_free(flow_entry->sc);
+                onvm_sc_free(flow_entry->sc);
                 rte_free(flow_entry->key);
                 ret = onvm_ft_remove_key(sdn_ft, key);
         }
 
         return ret;
 }
+
+int
+onvm_flow_dir_get_key_ipv6(struct onvm_ft_ipv6_5tuple *key, struct onvm_flow_entry **flow_entry) {
+        return onvm_ft_lookup_key_ipv6(sdn_ft_ipv6, key, (char **)flow_entry);
+}
+
+int
+onvm_flow_dir_add_key_ipv6(struct onvm_ft_ipv6_5tuple *key, struct onvm_flow_entry **flow_entry) {
+        return onvm_ft_add_key_ipv6(sdn_ft_ipv6, key, (char **)flow_entry);
+}
+
+int
+onvm_flow_dir_del_key_ipv6(struct onvm_ft_ipv6_5tuple *key) {
+        int ret;
+        struct onvm_flow_entry *flow_entry;
+        int ref_cnt;
+
+        ret = onvm_flow_dir_get_key_ipv6(key, &flow_entry);
+        if (ret >= 0) {
+                ref_cnt = flow_entry->sc->ref_cnt--;
+                if (ref_cnt <= 0) {
+                        ret = onvm_flow_dir_del_and_free_key_ipv6(key);
+                }
+        }
+
+        return ret;
+}
+
+int
+onvm_flow_dir_del_and_free_key_ipv6(struct onvm_ft_ipv6_5tuple *key) {
+        int ret;
+        struct onvm_flow_entry *flow_entry;
+
+        ret = onvm_flow_dir_get_key_ipv6(key, &flow_entry);
+        if (ret >= 0) {
+                onvm_sc_free(flow_entry->sc);
+                rte_free(flow_entry->key_ipv6);
+                ret = onvm_ft_remove_key_ipv6(sdn_ft_ipv6, key);
+        }
+
+        return ret;
+}
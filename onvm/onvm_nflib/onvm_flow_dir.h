@@ -46,9 +46,15 @@
 
 extern struct onvm_ft* sdn_ft;
 extern struct onvm_ft** sdn_ft_p;
+/* IPv6 flows are kept in a table of their own, the _pkt functions pick the table by IP version */
+extern struct onvm_ft* sdn_ft_ipv6;
+extern struct onvm_ft** sdn_ft_ipv6_p;
 
 struct onvm_flow_entry {
-        struct onvm_ft_ipv4_5tuple* key;
+        union {
+                struct onvm_ft_ipv4_5tuple* key;
+                struct onvm_ft_ipv6_5tuple* key_ipv6;
+        };
         struct onvm_service_chain* sc;
         uint64_t ref_cnt;
         uint16_t idle_timeout;
@@ -85,4 +91,12 @@ int
 onvm_flow_dir_del_key(struct onvm_ft_ipv4_5tuple* key);
 int
 onvm_flow_dir_del_and_free_key(struct onvm_ft_ipv4_5tuple* key);
+int
+onvm_flow_dir_get_key_ipv6(struct onvm_ft_ipv6_5tuple* key, struct onvm_flow_entry** flow_entry);
+int
+onvm_flow_dir_add_key_ipv6(struct onvm_ft_ipv6_5tuple* key, struct onvm_flow_entry** flow_entry);
+int
+onvm_flow_dir_del_key_ipv6(struct onvm_ft_ipv6_5tuple* key);
+int
+onvm_flow_dir_del_and_free_key_ipv6(struct onvm_ft_ipv6_5tuple* key);
 #endif  // _ONVM_FLOW_DIR_H_
@@ -54,9 +54,9 @@ uint8_t rss_symmetric_key[40] = {
 };
 
 /* Create a new flow table made of an rte_hash table and a fixed size
- * data array for storing values. Only supports IPv4 5-tuple lookups. */
-struct onvm_ft *
-onvm_ft_create(int cnt, int entry_size) {
+ * data array for storing values. Keys are key_len bytes. */
+static struct onvm_ft *
+onvm_ft_create_key_len(int cnt, int entry_size, uint32_t key_len) {
         struct rte_hash *hash;
         struct rte_hash_parameters *ipv4_hash_params;
         struct onvm_ft *ft;
@@ -70,7 +70,7 @@ onvm_ft_create(int cnt, int entry_size) {
         char *name = rte_malloc(NULL, 64, 0);
         /* create ipv4 hash table. use core number and cycle counter to get a unique name. */
         ipv4_hash_params->entries = cnt;
-        ipv4_hash_params->key_len = sizeof(struct onvm_ft_ipv4_5tuple);
+        ipv4_hash_params->key_len = key_len;
         ipv4_hash_params->hash_func = NULL;
         ipv4_hash_params->hash_func_init_val = 0;
         ipv4_hash_params->name = name;
@@ -109,6 +109,18 @@ onvm_ft_create(int cnt, int entry_size) {
         return ft;
 }
 
+/* Create a table for IPv4 5-tuple lookups */
+struct onvm_ft *
+onvm_ft_create(int cnt, int entry_size) {
+        return onvm_ft_create_key_len(cnt, entry_size, sizeof(struct onvm_ft_ipv4_5tuple));
+}
+
+/* Create a table for IPv6 5-tuple lookups, only the _ipv6 functions may be used on it */
+struct onvm_ft *
+onvm_ft_create_ipv6(int cnt, int entry_size) {
+        return onvm_ft_create_key_len(cnt, entry_size, sizeof(struct onvm_ft_ipv6_5tuple));
+}
+
 /* Add an entry in flow table and set data to point to the new value.
 Returns:
  index in the array on success
@@ -213,6 +225,106 @@ onvm_ft_remove_key(struct onvm_ft *table, struct onvm_ft_ipv4_5tuple *key) {
         return rte_hash_del_key_with_hash(table->hash, (const void *)key, softrss);
 }
 
+/* Lookup a burst of at most RTE_HASH_LOOKUP_BULK_MAX keys, all hashes are computed before the table is touched.
+   positions[i] is set like the return value of onvm_ft_lookup_key and data[i] points to the value of the keys found.
+   Returns:
+    the number of keys found.
+    -EINVAL if the parameters are invalid.
+*/
+int
+onvm_ft_lookup_key_bulk(struct onvm_ft *table, struct onvm_ft_ipv4_5tuple *keys, uint32_t count,
+                        int32_t *positions, char **data) {
+        uint32_t softrss[RTE_HASH_LOOKUP_BULK_MAX];
+        uint32_t i;
+        int found;
+
+        if (count > RTE_HASH_LOOKUP_BULK_MAX) {
+                return -EINVAL;
+        }
+
+        for (i = 0; i < count; i++) {
+                softrss[i] = onvm_softrss(&keys[i]);
+        }
+
+        found = 0;
+        for (i = 0; i < count; i++) {
+                positions[i] = rte_hash_lookup_with_hash(table->hash, (const void *)&keys[i], softrss[i]);
+                if (positions[i] >= 0) {
+                        data[i] = onvm_ft_get_data(table, positions[i]);
+                        found++;
+                }
+        }
+
+        return found;
+}
+
+/* The IPv6 functions follow the IPv4 ones above. The NIC hash of an IPv6
+ * packet is not the key hash, so packets are hashed from their key too. */
+int
+onvm_ft_add_pkt_ipv6(struct onvm_ft *table, struct rte_mbuf *pkt, char **data) {
+        struct onvm_ft_ipv6_5tuple key;
+        int ret;
+
+        ret = onvm_ft_fill_key_ipv6(&key, pkt);
+        if (ret < 0) {
+                return ret;
+        }
+        return onvm_ft_add_key_ipv6(table, &key, data);
+}
+
+int
+onvm_ft_lookup_pkt_ipv6(struct onvm_ft *table, struct rte_mbuf *pkt, char **data) {
+        struct onvm_ft_ipv6_5tuple key;
+        int ret;
+
+        ret = onvm_ft_fill_key_ipv6(&key, pkt);
+        if (ret < 0) {
+                return ret;
+        }
+        return onvm_ft_lookup_key_ipv6(table, &key, data);
+}
+
+int32_t
+onvm_ft_remove_pkt_ipv6(struct onvm_ft *table, struct rte_mbuf *pkt) {
+        struct onvm_ft_ipv6_5tuple key;
+        int ret;
+
+        ret = onvm_ft_fill_key_ipv6(&key, pkt);
+        if (ret < 0) {
+                return ret;
+        }
+        return onvm_ft_remove_key_ipv6(table, &key);
+}
+
+int
+onvm_ft_add_key_ipv6(struct onvm_ft *table, struct onvm_ft_ipv6_5tuple *key, char **data) {
+        int32_t tbl_index;
+
+        tbl_index = rte_hash_add_key_with_hash(table->hash, (const void *)key, onvm_ft_ipv6_hash(key));
+        if (tbl_index >= 0) {
+                *data = onvm_ft_get_data(table, tbl_index);
+        }
+
+        return tbl_index;
+}
+
+int
+onvm_ft_lookup_key_ipv6(struct onvm_ft *table, struct onvm_ft_ipv6_5tuple *key, char **data) {
+        int32_t tbl_index;
+
+        tbl_index = rte_hash_lookup_with_hash(table->hash, (const void *)key, onvm_ft_ipv6_hash(key));
+        if (tbl_index >= 0) {
+                *data = onvm_ft_get_data(table, tbl_index);
+        }
+
+        return tbl_index;
+}
+
+int32_t
+onvm_ft_remove_key_ipv6(struct onvm_ft *table, struct onvm_ft_ipv6_5tuple *key) {
+        return rte_hash_del_key_with_hash(table->hash, (const void *)key, onvm_ft_ipv6_hash(key));
+}
+
 /* Iterate through the hash table, returning key-value pairs.
    Parameters:
      key: Output containing the key where current iterator was pointing at
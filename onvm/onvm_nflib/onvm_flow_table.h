@@ -41,9 +41,11 @@
 #ifndef _ONVM_FLOW_TABLE_H_
 #define _ONVM_FLOW_TABLE_H_
 
+#include <arpa/inet.h>
 #include <rte_common.h>
 #include <rte_ip.h>
 #include <rte_mbuf.h>
+#include <rte_memcpy.h>
 #include <rte_tcp.h>
 #include <rte_thash.h>
 #include <rte_udp.h>
@@ -76,6 +78,15 @@ struct onvm_ft_ipv4_5tuple {
         uint8_t proto;
 };
 
+/* The addresses are back to back as in the IPv6 header, so a key takes a single 32 byte copy of them */
+struct onvm_ft_ipv6_5tuple {
+        uint8_t src_addr[16];
+        uint8_t dst_addr[16];
+        uint16_t src_port;
+        uint16_t dst_port;
+        uint8_t proto;
+};
+
 /* from l2_forward example, but modified to include port. This should
  * be automatically included in the hash functions since it hashes
  * the struct in 4byte chunks. */
@@ -113,6 +124,32 @@ onvm_ft_lookup_key(struct onvm_ft *table, struct onvm_ft_ipv4_5tuple *key, char
 int32_t
 onvm_ft_remove_key(struct onvm_ft *table, struct onvm_ft_ipv4_5tuple *key);
 
+int
+onvm_ft_lookup_key_bulk(struct onvm_ft *table, struct onvm_ft_ipv4_5tuple *keys, uint32_t count,
+                        int32_t *positions, char **data);
+
+/* IPv6 tables are created apart since their keys are larger, the key functions below mirror the IPv4 ones */
+struct onvm_ft *
+onvm_ft_create_ipv6(int cnt, int entry_size);
+
+int
+onvm_ft_add_pkt_ipv6(struct onvm_ft *table, struct rte_mbuf *pkt, char **data);
+
+int
+onvm_ft_lookup_pkt_ipv6(struct onvm_ft *table, struct rte_mbuf *pkt, char **data);
+
+int32_t
+onvm_ft_remove_pkt_ipv6(struct onvm_ft *table, struct rte_mbuf *pkt);
+
+int
+onvm_ft_add_key_ipv6(struct onvm_ft *table, struct onvm_ft_ipv6_5tuple *key, char **data);
+
+int
+onvm_ft_lookup_key_ipv6(struct onvm_ft *table, struct onvm_ft_ipv6_5tuple *key, char **data);
+
+int32_t
+onvm_ft_remove_key_ipv6(struct onvm_ft *table, struct onvm_ft_ipv6_5tuple *key);
+
 int32_t
 onvm_ft_iterate(struct onvm_ft *table, const void **key, void **data, uint32_t *next);
 
@@ -133,6 +170,16 @@ _onvm_ft_print_key(struct onvm_ft_ipv4_5tuple *key) {
         printf("Port: %d %d Proto: %d\n", key->src_port, key->dst_port, key->proto);
 }
 
+static inline void
+_onvm_ft_print_key_ipv6(struct onvm_ft_ipv6_5tuple *key) {
+        char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+
+        inet_ntop(AF_INET6, key->src_addr, src, sizeof(src));
+        inet_ntop(AF_INET6, key->dst_addr, dst, sizeof(dst));
+        printf("IP: %s-%s ", src, dst);
+        printf("Port: %d %d Proto: %d\n", key->src_port, key->dst_port, key->proto);
+}
+
 static inline char *
 onvm_ft_get_data(struct onvm_ft *table, int32_t index) {
         return &table->data[index * table->entry_size];
@@ -167,12 +214,9 @@ onvm_ft_fill_key(struct onvm_ft_ipv4_5tuple *key, struct rte_mbuf *pkt) {
         return 0;
 }
 
-static inline int
-onvm_ft_fill_key_symmetric(struct onvm_ft_ipv4_5tuple *key, struct rte_mbuf *pkt) {
-        if (onvm_ft_fill_key(key, pkt) < 0) {
-                return -EPROTONOSUPPORT;
-        }
-
+/* Normalize a key so that both directions of a flow give the same key */
+static inline void
+onvm_ft_key_symmetric(struct onvm_ft_ipv4_5tuple *key) {
         if (key->dst_addr > key->src_addr) {
                 uint32_t temp = key->dst_addr;
                 key->dst_addr = key->src_addr;
@@ -184,10 +228,82 @@ onvm_ft_fill_key_symmetric(struct onvm_ft_ipv4_5tuple *key, struct rte_mbuf *pkt
                 key->dst_port = key->src_port;
                 key->src_port = temp;
         }
+}
+
+static inline int
+onvm_ft_fill_key_symmetric(struct onvm_ft_ipv4_5tuple *key, struct rte_mbuf *pkt) {
+        if (onvm_ft_fill_key(key, pkt) < 0) {
+                return -EPROTONOSUPPORT;
+        }
 
+        onvm_ft_key_symmetric(key);
+
+        return 0;
+}
+
+/*
+ * IPv6 keys only carry ports when TCP or UDP directly follows the fixed
+ * header, extension headers are not walked
+ */
+static inline int
+onvm_ft_fill_key_ipv6(struct onvm_ft_ipv6_5tuple *key, struct rte_mbuf *pkt) {
+        struct rte_ipv6_hdr *ipv6_hdr;
+        const uint16_t *ports;
+
+        ipv6_hdr = onvm_pkt_ipv6_hdr(pkt);
+        if (unlikely(ipv6_hdr == NULL)) {
+                return -EPROTONOSUPPORT;
+        }
+        memset(key, 0, sizeof(struct onvm_ft_ipv6_5tuple));
+        /* Source and destination are adjacent in the header too, rte_memcpy moves them with vector loads */
+        rte_memcpy(key->src_addr, ipv6_hdr->src_addr, sizeof(key->src_addr) + sizeof(key->dst_addr));
+        key->proto = ipv6_hdr->proto;
+        if (key->proto == IP_PROTOCOL_TCP || key->proto == IP_PROTOCOL_UDP) {
+                /* Ports sit at the same offset for TCP and UDP */
+                ports = (const uint16_t *)(ipv6_hdr + 1);
+                key->src_port = ports[0];
+                key->dst_port = ports[1];
+        }
         return 0;
 }
 
+static inline void
+onvm_ft_key_ipv6_symmetric(struct onvm_ft_ipv6_5tuple *key) {
+        uint8_t temp[16];
+
+        if (memcmp(key->dst_addr, key->src_addr, sizeof(temp)) > 0) {
+                memcpy(temp, key->dst_addr, sizeof(temp));
+                memcpy(key->dst_addr, key->src_addr, sizeof(temp));
+                memcpy(key->src_addr, temp, sizeof(temp));
+        }
+
+        if (key->dst_port > key->src_port) {
+                uint16_t port = key->dst_port;
+                key->dst_port = key->src_port;
+                key->src_port = port;
+        }
+}
+
+static inline int
+onvm_ft_fill_key_ipv6_symmetric(struct onvm_ft_ipv6_5tuple *key, struct rte_mbuf *pkt) {
+        if (onvm_ft_fill_key_ipv6(key, pkt) < 0) {
+                return -EPROTONOSUPPORT;
+        }
+
+        onvm_ft_key_ipv6_symmetric(key);
+
+        return 0;
+}
+
+/*
+ * Table hash of an IPv6 key. The software Toeplitz hash walks the input bit
+ * by bit, so the 40 byte keys are hashed with the CRC32 instruction instead.
+ */
+static inline uint32_t
+onvm_ft_ipv6_hash(const struct onvm_ft_ipv6_5tuple *key) {
+        return DEFAULT_HASH_FUNC(key, sizeof(struct onvm_ft_ipv6_5tuple), 0);
+}
+
 /* Hash a flow key to get an int. From L3 fwd example */
 static inline uint32_t
 onvm_ft_ipv4_hash_crc(const void *data, __rte_unused uint32_t data_len, uint32_t init_val) {
@@ -234,4 +350,29 @@ onvm_softrss(struct onvm_ft_ipv4_5tuple *key) {
         return rss_l3l4;
 }
 
+/* RSS hash the NIC computes for an IPv6 flow, e.g. to predict which instance of a service gets it */
+static inline uint32_t
+onvm_softrss_ipv6(struct onvm_ft_ipv6_5tuple *key) {
+        union rte_thash_tuple tuple;
+        uint8_t rss_key_be[RTE_DIM(rss_symmetric_key)];
+        uint32_t word;
+        int i;
+
+        rte_convert_rss_key((uint32_t *)rss_symmetric_key, (uint32_t *)rss_key_be, RTE_DIM(rss_symmetric_key));
+
+        /* rte_softrss_be takes the addresses as host order 32 bit words */
+        for (i = 0; i < 4; i++) {
+                memcpy(&word, &key->src_addr[i * 4], sizeof(word));
+                word = rte_be_to_cpu_32(word);
+                memcpy(&tuple.v6.src_addr[i * 4], &word, sizeof(word));
+                memcpy(&word, &key->dst_addr[i * 4], sizeof(word));
+                word = rte_be_to_cpu_32(word);
+                memcpy(&tuple.v6.dst_addr[i * 4], &word, sizeof(word));
+        }
+        tuple.v6.sport = rte_be_to_cpu_16(key->src_port);
+        tuple.v6.dport = rte_be_to_cpu_16(key->dst_port);
+
+        return rte_softrss_be((uint32_t *)&tuple, RTE_THASH_V6_L4_LEN, rss_key_be);
+}
+
 #endif  // _ONVM_FLOW_TABLE_H_
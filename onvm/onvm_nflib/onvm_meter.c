@@ -0,0 +1,286 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * onvm_meter.c - srTCM/trTCM metering with many buckets
+ ********************************************************************/
+
+#include <errno.h>
+#include <string.h>
+
+#include <rte_byteorder.h>
+#include <rte_cycles.h>
+#include <rte_hash.h>
+#include <rte_ip.h>
+#include <rte_malloc.h>
+#include <rte_prefetch.h>
+
+#include "onvm_meter.h"
+#include "onvm_pkt_helper.h"
+
+/* Packets whose buckets are looked up together */
+#define ONVM_METER_BURST RTE_HASH_LOOKUP_BULK_MAX
+
+/*********************************Internal Functions**********************************/
+
+static inline int
+onvm_meter_fill_key(struct onvm_meter *meter, struct rte_mbuf *pkt, struct onvm_ft_ipv4_5tuple *key) {
+        struct rte_ipv4_hdr *ipv4_hdr;
+
+        if (meter->key_type == ONVM_METER_KEY_FLOW)
+                return onvm_ft_fill_key(key, pkt);
+
+        if (unlikely(!onvm_pkt_is_ipv4(pkt)))
+                return -EPROTONOSUPPORT;
+        ipv4_hdr = onvm_pkt_ipv4_hdr(pkt);
+        memset(key, 0, sizeof(struct onvm_ft_ipv4_5tuple));
+        if (meter->key_type == ONVM_METER_KEY_SRC_SUBNET)
+                key->src_addr = ipv4_hdr->src_addr & meter->mask;
+        else
+                key->dst_addr = ipv4_hdr->dst_addr & meter->mask;
+        return 0;
+}
+
+static void
+onvm_meter_bucket_config(struct onvm_meter *meter, struct onvm_meter_bucket *bucket, uint16_t profile_id) {
+        struct onvm_meter_profile *profile = &meter->profiles[profile_id];
+
+        memset(bucket, 0, sizeof(struct onvm_meter_bucket));
+        bucket->profile_id = profile_id;
+        if (profile->type == ONVM_METER_SRTCM)
+                rte_meter_srtcm_config(&bucket->srtcm, &profile->srtcm);
+        else
+                rte_meter_trtcm_config(&bucket->trtcm, &profile->trtcm);
+}
+
+/*
+ * Slow path for a key without a bucket, an earlier packet of the same burst may have added it already
+ */
+static struct onvm_meter_bucket *
+onvm_meter_new_bucket(struct onvm_meter *meter, struct onvm_ft_ipv4_5tuple *key) {
+        char *data;
+
+        if (onvm_ft_lookup_key(meter->ft, key, &data) >= 0)
+                return (struct onvm_meter_bucket *)data;
+        if (meter->default_profile < 0 || onvm_ft_add_key(meter->ft, key, &data) < 0)
+                return NULL;
+        onvm_meter_bucket_config(meter, (struct onvm_meter_bucket *)data, meter->default_profile);
+        return (struct onvm_meter_bucket *)data;
+}
+
+/*********************************Interfaces**********************************/
+
+struct onvm_meter *
+onvm_meter_create(int max_buckets, enum onvm_meter_key_type key_type, uint8_t depth) {
+        struct onvm_meter *meter;
+
+        if (depth > 32)
+                return NULL;
+
+        meter = rte_zmalloc("onvm_meter", sizeof(struct onvm_meter), RTE_CACHE_LINE_SIZE);
+        if (meter == NULL)
+                return NULL;
+
+        meter->ft = onvm_ft_create(max_buckets, sizeof(struct onvm_meter_bucket));
+        if (meter->ft == NULL) {
+                rte_free(meter);
+                return NULL;
+        }
+        meter->key_type = key_type;
+        meter->mask = depth == 0 ? 0 : rte_cpu_to_be_32(~0U << (32 - depth));
+        meter->default_profile = -1;
+
+        return meter;
+}
+
+void
+onvm_meter_free(struct onvm_meter *meter) {
+        if (meter == NULL)
+                return;
+        onvm_ft_free(meter->ft);
+        rte_free(meter);
+}
+
+int
+onvm_meter_add_profile(struct onvm_meter *meter, const struct onvm_meter_params *params) {
+        struct onvm_meter_profile *profile;
+        struct onvm_meter_params local_params;
+        int ret;
+
+        if (meter->num_profiles == ONVM_METER_MAX_PROFILES)
+                return -ENOSPC;
+
+        /* rte_meter takes the parameters as non const */
+        local_params = *params;
+        profile = &meter->profiles[meter->num_profiles];
+        profile->type = params->type;
+        if (params->type == ONVM_METER_SRTCM)
+                ret = rte_meter_srtcm_profile_config(&profile->srtcm, &local_params.srtcm);
+        else if (params->type == ONVM_METER_TRTCM)
+                ret = rte_meter_trtcm_profile_config(&profile->trtcm, &local_params.trtcm);
+        else
+                ret = -EINVAL;
+        if (ret < 0)
+                return ret;
+
+        return meter->num_profiles++;
+}
+
+int
+onvm_meter_set_default_profile(struct onvm_meter *meter, int profile_id) {
+        if (profile_id >= meter->num_profiles)
+                return -EINVAL;
+        meter->default_profile = profile_id < 0 ? -1 : profile_id;
+        return 0;
+}
+
+void
+onvm_meter_subnet_key(struct onvm_meter *meter, uint32_t ip, struct onvm_ft_ipv4_5tuple *key) {
+        memset(key, 0, sizeof(struct onvm_ft_ipv4_5tuple));
+        if (meter->key_type == ONVM_METER_KEY_DST_SUBNET)
+                key->dst_addr = rte_cpu_to_be_32(ip) & meter->mask;
+        else
+                key->src_addr = rte_cpu_to_be_32(ip) & meter->mask;
+}
+
+int
+onvm_meter_add_bucket(struct onvm_meter *meter, struct onvm_ft_ipv4_5tuple *key, uint16_t profile_id) {
+        char *data;
+        int ret;
+
+        if (profile_id >= meter->num_profiles)
+                return -EINVAL;
+
+        ret = onvm_ft_add_key(meter->ft, key, &data);
+        if (ret < 0)
+                return ret;
+        onvm_meter_bucket_config(meter, (struct onvm_meter_bucket *)data, profile_id);
+        return 0;
+}
+
+uint16_t
+onvm_meter_color_burst(struct onvm_meter *meter, struct rte_mbuf **pkts, uint16_t count, enum rte_color *colors) {
+        struct onvm_ft_ipv4_5tuple keys[ONVM_METER_BURST];
+        struct onvm_meter_bucket *buckets[ONVM_METER_BURST];
+        int32_t positions[ONVM_METER_BURST];
+        uint8_t valid[ONVM_METER_BURST];
+        struct onvm_meter_profile *profile;
+        struct onvm_meter_bucket *bucket;
+        enum rte_color color;
+        uint16_t done, n, i, red;
+        uint32_t len;
+        uint64_t now;
+
+        /* A single timestamp for the burst, its packets arrived together */
+        now = rte_rdtsc();
+        red = 0;
+        for (done = 0; done < count; done += n) {
+                n = RTE_MIN(count - done, ONVM_METER_BURST);
+
+                for (i = 0; i < n; i++) {
+                        valid[i] = onvm_meter_fill_key(meter, pkts[done + i], &keys[i]) == 0;
+                        if (unlikely(!valid[i]))
+                                memset(&keys[i], 0, sizeof(struct onvm_ft_ipv4_5tuple));
+                }
+
+                onvm_ft_lookup_key_bulk(meter->ft, keys, n, positions, (char **)buckets);
+                for (i = 0; i < n; i++) {
+                        if (positions[i] >= 0)
+                                rte_prefetch0(buckets[i]);
+                }
+
+                for (i = 0; i < n; i++) {
+                        colors[done + i] = RTE_COLOR_GREEN;
+                        if (unlikely(!valid[i])) {
+                                meter->unmetered++;
+                                continue;
+                        }
+
+                        bucket = positions[i] >= 0 ? buckets[i] : onvm_meter_new_bucket(meter, &keys[i]);
+                        if (unlikely(bucket == NULL)) {
+                                meter->unmetered++;
+                                continue;
+                        }
+
+                        profile = &meter->profiles[bucket->profile_id];
+                        len = pkts[done + i]->pkt_len;
+                        if (profile->type == ONVM_METER_SRTCM)
+                                color = rte_meter_srtcm_color_blind_check(&bucket->srtcm, &profile->srtcm, now, len);
+                        else
+                                color = rte_meter_trtcm_color_blind_check(&bucket->trtcm, &profile->trtcm, now, len);
+
+                        colors[done + i] = color;
+                        bucket->pkts[color]++;
+                        bucket->bytes[color] += len;
+                        red += color == RTE_COLOR_RED;
+                }
+        }
+
+        return red;
+}
+
+void
+onvm_meter_mark_burst(struct rte_mbuf **pkts, const enum rte_color *colors, uint16_t count,
+                      const int8_t dscp[RTE_COLORS]) {
+        struct rte_ipv4_hdr *ipv4_hdr;
+        uint16_t old_word;
+        uint8_t tos;
+        uint16_t i;
+
+        for (i = 0; i < count; i++) {
+                if (dscp[colors[i]] == ONVM_METER_DSCP_KEEP)
+                        continue;
+                ipv4_hdr = onvm_pkt_ipv4_hdr(pkts[i]);
+                if (ipv4_hdr == NULL)
+                        continue;
+                /* DSCP is the top 6 bits of the TOS byte, the bottom 2 are ECN */
+                tos = (dscp[colors[i]] << 2) | (ipv4_hdr->type_of_service & 0x3);
+                if (tos == ipv4_hdr->type_of_service)
+                        continue;
+                /* The TOS shares its 16 bit word with version_ihl */
+                old_word = rte_cpu_to_be_16((ipv4_hdr->version_ihl << 8) | ipv4_hdr->type_of_service);
+                ipv4_hdr->type_of_service = tos;
+                ipv4_hdr->hdr_checksum = onvm_pkt_cksum_update16(
+                        ipv4_hdr->hdr_checksum, old_word,
+                        rte_cpu_to_be_16((ipv4_hdr->version_ihl << 8) | ipv4_hdr->type_of_service));
+        }
+}
+
+int32_t
+onvm_meter_iterate(struct onvm_meter *meter, const struct onvm_ft_ipv4_5tuple **key,
+                   struct onvm_meter_bucket **bucket, uint32_t *next) {
+        return onvm_ft_iterate(meter->ft, (const void **)key, (void **)bucket, next);
+}
@@ -0,0 +1,143 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * onvm_meter.h - srTCM/trTCM metering with many buckets
+ ********************************************************************/
+
+#ifndef _ONVM_METER_H_
+#define _ONVM_METER_H_
+
+#include <stdint.h>
+
+#include <rte_common.h>
+#include <rte_mbuf.h>
+#include <rte_meter.h>
+
+#include "onvm_flow_table.h"
+
+#define ONVM_METER_MAX_PROFILES 64
+/* Leave the DSCP of packets of a color unchanged in onvm_meter_mark_burst */
+#define ONVM_METER_DSCP_KEEP -1
+
+enum onvm_meter_type {
+        ONVM_METER_SRTCM = 0,  // single rate three color marker, RFC 2697
+        ONVM_METER_TRTCM,      // two rate three color marker, RFC 2698
+};
+
+/* What the packets that share a bucket have in common */
+enum onvm_meter_key_type {
+        ONVM_METER_KEY_FLOW = 0,    // IPv4 5 tuple
+        ONVM_METER_KEY_SRC_SUBNET,  // source address under the subnet mask
+        ONVM_METER_KEY_DST_SUBNET,  // destination address under the subnet mask
+};
+
+/* Profile parameters, rates are in bytes per second and bucket sizes in bytes as for rte_meter */
+struct onvm_meter_params {
+        enum onvm_meter_type type;
+        union {
+                struct rte_meter_srtcm_params srtcm;
+                struct rte_meter_trtcm_params trtcm;
+        };
+};
+
+struct onvm_meter_profile {
+        enum onvm_meter_type type;
+        union {
+                struct rte_meter_srtcm_profile srtcm;
+                struct rte_meter_trtcm_profile trtcm;
+        };
+};
+
+/* Bucket state and conformance stats, kept as the flow table entry */
+struct onvm_meter_bucket {
+        union {
+                struct rte_meter_srtcm srtcm;
+                struct rte_meter_trtcm trtcm;
+        };
+        uint16_t profile_id;
+        uint64_t pkts[RTE_COLORS];
+        uint64_t bytes[RTE_COLORS];
+};
+
+struct onvm_meter {
+        struct onvm_ft *ft;
+        enum onvm_meter_key_type key_type;
+        uint32_t mask;         // subnet mask in network byte order
+        int default_profile;   // profile of buckets added on the fly, -1 to only meter configured buckets
+        uint16_t num_profiles;
+        uint64_t unmetered;    // packets without a bucket, they are colored green
+        struct onvm_meter_profile profiles[ONVM_METER_MAX_PROFILES];
+};
+
+/* Create a meter with room for max_buckets, depth is the subnet mask length for subnet keys */
+struct onvm_meter *
+onvm_meter_create(int max_buckets, enum onvm_meter_key_type key_type, uint8_t depth);
+
+void
+onvm_meter_free(struct onvm_meter *meter);
+
+/* Returns the profile id or a negative errno */
+int
+onvm_meter_add_profile(struct onvm_meter *meter, const struct onvm_meter_params *params);
+
+/* Buckets for keys that have no bucket yet are added with this profile, -1 to disable */
+int
+onvm_meter_set_default_profile(struct onvm_meter *meter, int profile_id);
+
+/* Build the bucket key of a subnet meter for an address in host byte order */
+void
+onvm_meter_subnet_key(struct onvm_meter *meter, uint32_t ip, struct onvm_ft_ipv4_5tuple *key);
+
+/* Add or reconfigure the bucket of a key, returns 0 or a negative errno */
+int
+onvm_meter_add_bucket(struct onvm_meter *meter, struct onvm_ft_ipv4_5tuple *key, uint16_t profile_id);
+
+/* Color a burst of packets, all of them are metered at the same timestamp. Returns the number of red packets. */
+uint16_t
+onvm_meter_color_burst(struct onvm_meter *meter, struct rte_mbuf **pkts, uint16_t count, enum rte_color *colors);
+
+/* Rewrite the DSCP of IPv4 packets to dscp[color], ONVM_METER_DSCP_KEEP leaves a color unchanged */
+void
+onvm_meter_mark_burst(struct rte_mbuf **pkts, const enum rte_color *colors, uint16_t count,
+                      const int8_t dscp[RTE_COLORS]);
+
+/* Walk the buckets and their stats, same semantics as onvm_ft_iterate */
+int32_t
+onvm_meter_iterate(struct onvm_meter *meter, const struct onvm_ft_ipv4_5tuple **key,
+                   struct onvm_meter_bucket **bucket, uint32_t *next);
+
+#endif  // _ONVM_METER_H_
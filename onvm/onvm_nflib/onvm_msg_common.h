@@ -55,6 +55,7 @@
 #define MSG_REQUEST_LPM_REGION 7
 #define MSG_CHANGE_CORE 8
 #define MSG_REQUEST_FT 9
+#define MSG_REQUEST_EDGE 10
 
 struct onvm_nf_msg {
         uint8_t msg_type; /* Constant saying what type of message is */
@@ -55,6 +55,7 @@
 
 /******************************DPDK libraries*********************************/
 #include "rte_malloc.h"
+#include <rte_pause.h>
 
 /*****************************Internal headers********************************/
 
@@ -95,6 +96,13 @@ static struct rte_mempool *nf_init_cfg_mp;
 // Shared pool for mgr <--> NF messages
 static struct rte_mempool *nf_msg_pool;
 
+// Shared pools for fanning packets out to parallel chain stages
+struct rte_mempool *pktmbuf_clone_pool;
+struct rte_mempool *pkt_join_pool;
+
+// Shared capture tap configuration, set up by the manager
+struct onvm_capture_info *capture_info;
+
 // Global NF context to manage signal termination
 static struct onvm_nf_local_ctx *main_nf_local_ctx;
 
@@ -104,9 +112,15 @@ static handle_signal_func global_nf_signal_handler = NULL;
 // Shared data for default service chain
 struct onvm_service_chain *default_chain;
 
+// Shared table of installed service chains, indexed by chain ID
+struct onvm_service_chain **sc_table;
+
 /* Shared data for onvm config */
 struct onvm_configuration *onvm_config;
 
+/* Shared congestion flags of services and per chain counters */
+struct onvm_congestion_info *congestion_info;
+
 /* Flag to check if shared core mutex sleep/wakeup is enabled */
 uint8_t ONVM_NF_SHARE_CORES;
 
@@ -149,6 +163,16 @@ static inline uint16_t
 onvm_nflib_dequeue_packets(void **pkts, struct onvm_nf_local_ctx *nf_local_ctx,
                            nf_pkt_handler_fn handler) __attribute__((always_inline));
 
+/*
+ * Read packets from the NIC RX queue the manager gave this NF on every port,
+ * they start at the first hop of the default chain like packets from the manager
+ *
+ * Input  : a pointer to the NF, the array to fill and its size
+ * Output : the number of packets read
+ */
+static inline uint16_t
+onvm_nflib_nic_rx(struct onvm_nf *nf, void **pkts, uint16_t max_pkts);
+
 /*
  * Check if there is a message available for this NF and process it
  */
@@ -574,6 +598,7 @@ onvm_nflib_thread_main_loop(void *arg) {
         struct onvm_nf_local_ctx *nf_local_ctx;
         struct onvm_nf *nf;
         uint16_t nb_pkts_added;
+        uint32_t held = 0;
         uint64_t start_time;
         int ret;
 
@@ -581,11 +606,18 @@ onvm_nflib_thread_main_loop(void *arg) {
         nf = nf_local_ctx->nf;
         onvm_threading_core_affinitize(nf->thread_info.core);
 
+        /* Packets are read in this loop, so the manager may give the NF a NIC RX queue when it becomes ready */
+        nf->nic_rx.capable = 1;
+
         printf("Sending NF_READY message to manager...\n");
         ret = onvm_nflib_nf_ready(nf);
         if (ret != 0)
                 rte_exit(EXIT_FAILURE, "Unable to message manager\n");
 
+        /* Packets are dequeued below, so other NFs may get direct rings into this one */
+        if (ONVM_NF_DIRECT_RINGS)
+                nf->edges.enabled = 1;
+
         /* Run the setup function (this might send pkts so done after the state change) */
         if (nf->function_table->setup != NULL)
                 nf->function_table->setup(nf_local_ctx);
@@ -594,14 +626,19 @@ onvm_nflib_thread_main_loop(void *arg) {
         for (;rte_atomic16_read(&nf_local_ctx->keep_running) && rte_atomic16_read(&main_nf_local_ctx->keep_running);) {
                 /* Possibly sleep if in shared core mode, otherwise continue */
                 if (ONVM_NF_SHARE_CORES) {
-                        if (unlikely(rte_ring_count(nf->rx_q) == 0) && likely(rte_ring_count(nf->msg_q) == 0)) {
+                        if (unlikely(onvm_nf_rx_pending(nf) == 0) && likely(rte_ring_count(nf->msg_q) == 0) &&
+                            held == 0) {
                                 rte_atomic16_set(nf->shared_core.sleep_state, 1);
                                 sem_wait(nf->shared_core.nf_mutex);
                         }
                 }
 
-                nb_pkts_added =
-                        onvm_nflib_dequeue_packets((void **)pkts, nf_local_ctx, nf->function_table->pkt_handler);
+                /* While packets wait for room downstream let the rx ring fill, so upstream sees it as well */
+                if (unlikely(held > 0) && onvm_config->backpressure.policy == ONVM_BP_SIGNAL)
+                        nb_pkts_added = 0;
+                else
+                        nb_pkts_added = onvm_nflib_dequeue_packets((void **)pkts, nf_local_ctx,
+                                                                   nf->function_table->pkt_handler);
 
                 if (likely(nb_pkts_added > 0)) {
                         onvm_pkt_process_tx_batch(nf->nf_tx_mgr, pkts, nb_pkts_added, nf);
@@ -609,7 +646,7 @@ onvm_nflib_thread_main_loop(void *arg) {
 
                 /* Flush the packet buffers */
                 onvm_pkt_enqueue_tx_thread(nf->nf_tx_mgr->to_tx_buf, nf);
-                onvm_pkt_flush_all_nfs(nf->nf_tx_mgr, nf);
+                held = nf->nf_tx_mgr->to_tx_buf->count + onvm_pkt_flush_all_nfs(nf->nf_tx_mgr, nf);
 
                 onvm_nflib_dequeue_messages(nf_local_ctx);
                 if (nf->function_table->user_actions != ONVM_NO_CALLBACK) {
@@ -639,17 +676,26 @@ onvm_nflib_return_pkt(struct onvm_nf *nf, struct rte_mbuf *pkt) {
 
 int
 onvm_nflib_return_pkt_bulk(struct onvm_nf *nf, struct rte_mbuf **pkts, uint16_t count) {
-        unsigned int i;
+        unsigned int i, sent, free_space, tries;
         if (pkts == NULL || count == 0)
                 return -1;
-        if (unlikely(rte_ring_enqueue_bulk(nf->tx_q, (void **)pkts, count, NULL) == 0)) {
-                nf->stats.tx_drop += count;
-                for (i = 0; i < count; i++) {
+        sent = rte_ring_enqueue_burst(nf->tx_q, (void **)pkts, count, &free_space);
+        onvm_ring_hist_sample(nf->stats.tx_q_hist, nf->tx_q, free_space);
+        /* The caller gives the packets up, so holding them means a bounded number of retries here */
+        if (unlikely(sent < count) && onvm_config->backpressure.policy != ONVM_BP_DROP_TAIL) {
+                for (tries = 0; sent < count && tries < onvm_config->backpressure.hold_budget; tries++) {
+                        rte_pause();
+                        sent += rte_ring_enqueue_burst(nf->tx_q, (void **)pkts + sent, count - sent, NULL);
+                }
+        }
+        nf->stats.tx_returned += sent;
+        if (unlikely(sent < count)) {
+                nf->stats.tx_drop += count - sent;
+                onvm_drop_count(&nf->stats.drops, ONVM_DROP_TX_QUEUE_FULL, count - sent);
+                for (i = sent; i < count; i++) {
                         rte_pktmbuf_free(pkts[i]);
                 }
                 return -ENOBUFS;
-        } else {
-                nf->stats.tx_returned += count;
         }
 
         return 0;
@@ -891,9 +937,12 @@ onvm_nflib_lookup_shared_structs(void) {
         const struct rte_memzone *mz_port;
         const struct rte_memzone *mz_cores;
         const struct rte_memzone *mz_scp;
+        const struct rte_memzone *mz_sc_table;
         const struct rte_memzone *mz_services;
         const struct rte_memzone *mz_nf_per_service;
         const struct rte_memzone *mz_onvm_config;
+        const struct rte_memzone *mz_capture;
+        const struct rte_memzone *mz_congestion;
         struct rte_mempool *mp;
         struct onvm_service_chain **scp;
 
@@ -911,6 +960,14 @@ onvm_nflib_lookup_shared_structs(void) {
         if (mp == NULL)
                 rte_exit(EXIT_FAILURE, "Cannot get mempool for mbufs\n");
 
+        pktmbuf_clone_pool = rte_mempool_lookup(PKTMBUF_CLONE_POOL_NAME);
+        if (pktmbuf_clone_pool == NULL)
+                rte_exit(EXIT_FAILURE, "Cannot get mempool for mbuf clones\n");
+
+        pkt_join_pool = rte_mempool_lookup(PKT_JOIN_POOL_NAME);
+        if (pkt_join_pool == NULL)
+                rte_exit(EXIT_FAILURE, "Cannot get mempool for packet joins\n");
+
         /* Lookup mempool for NF structs */
         mz_nf = rte_memzone_lookup(MZ_NF_INFO);
         if (mz_nf == NULL)
@@ -952,6 +1009,21 @@ onvm_nflib_lookup_shared_structs(void) {
         default_chain = *scp;
         onvm_sc_print(default_chain);
 
+        mz_sc_table = rte_memzone_lookup(MZ_SC_TABLE_INFO);
+        if (mz_sc_table == NULL)
+                rte_exit(EXIT_FAILURE, "Cannot get service chain table\n");
+        sc_table = mz_sc_table->addr;
+
+        mz_congestion = rte_memzone_lookup(MZ_CONGESTION_INFO);
+        if (mz_congestion == NULL)
+                rte_exit(EXIT_FAILURE, "Cannot get congestion info structure\n");
+        congestion_info = mz_congestion->addr;
+
+        mz_capture = rte_memzone_lookup(MZ_CAPTURE_INFO);
+        if (mz_capture == NULL)
+                rte_exit(EXIT_FAILURE, "Cannot get capture info structure\n");
+        capture_info = mz_capture->addr;
+
         mgr_msg_queue = rte_ring_lookup(_MGR_MSG_QUEUE_NAME);
         if (mgr_msg_queue == NULL)
                 rte_exit(EXIT_FAILURE, "Cannot get mgr message ring");
@@ -968,40 +1040,101 @@ static inline uint16_t
 onvm_nflib_dequeue_packets(void **pkts, struct onvm_nf_local_ctx *nf_local_ctx, nf_pkt_handler_fn  handler) {
         struct onvm_nf *nf;
         struct onvm_pkt_meta *meta;
-        uint16_t i, nb_pkts;
+        uint16_t i, nb_pkts, tx_count;
         struct packet_buf tx_buf;
+        struct rte_ring *rx_q;
+        uint16_t nb_rings, ring, r;
         int ret_act;
 
         nf = nf_local_ctx->nf;
 
-        /* Dequeue all packets in ring up to max possible. */
-        nb_pkts = rte_ring_dequeue_burst(nf->rx_q, pkts, PACKET_READ_SIZE, NULL);
+        /* Dequeue all packets in ring up to max possible.
+         * Direct rings from other NFs are polled round robin together with the rx ring,
+         * starting from a different one each time so no sender can starve the others. */
+        nb_pkts = 0;
+        if (nf->nic_rx.enabled)
+                nb_pkts = onvm_nflib_nic_rx(nf, pkts, PACKET_READ_SIZE);
+        nb_rings = nf->edges.rx_count + 1;
+        ring = nf->edges.rx_next < nb_rings ? nf->edges.rx_next : 0;
+        for (r = 0; r < nb_rings && nb_pkts < PACKET_READ_SIZE; r++) {
+                rx_q = ring < nb_rings - 1 ? nf->edges.rx[ring] : nf->rx_q;
+                nb_pkts += rte_ring_dequeue_burst(rx_q, pkts + nb_pkts, PACKET_READ_SIZE - nb_pkts, NULL);
+                if (++ring == nb_rings)
+                        ring = 0;
+        }
+        nf->edges.rx_next = nf->edges.rx_next + 1 < nb_rings ? nf->edges.rx_next + 1 : 0;
+
+        /* Only the NF sees its rings drain once upstream stops sending */
+        if (unlikely(rte_atomic16_read(&nf->congested)))
+                onvm_pkt_congestion_recover(nf);
 
         if (unlikely(nb_pkts == 0)) {
                 return 0;
         }
 
-        tx_buf.count = 0;
+        /* Packets come off the rings cold, fetch their mbufs and headers while the ones before are handled */
+        onvm_pkt_prefetch_burst((struct rte_mbuf **)pkts, nb_pkts);
 
-        /* Give each packet to the user proccessing function */
-        for (i = 0; i < nb_pkts; i++) {
-                meta = onvm_get_pkt_meta((struct rte_mbuf *)pkts[i]);
-                ret_act = (*handler)((struct rte_mbuf *)pkts[i], meta, nf_local_ctx);
-                /* NF returns 0 to return packets or 1 to buffer */
-                if (likely(ret_act == 0)) {
-                        tx_buf.buffer[tx_buf.count++] = pkts[i];
-                } else {
-                        nf->stats.tx_buffer++;
+        /* Give the packets to the user proccessing function, the ones it returns move to the front of pkts */
+        if (nf->function_table->pkt_bulk_handler != NULL) {
+                tx_count = (*nf->function_table->pkt_bulk_handler)((struct rte_mbuf **)pkts, nb_pkts, nf_local_ctx);
+        } else {
+                tx_count = 0;
+                for (i = 0; i < nb_pkts; i++) {
+                        onvm_pkt_prefetch_ahead((struct rte_mbuf **)pkts, i, nb_pkts);
+                        meta = onvm_get_pkt_meta((struct rte_mbuf *)pkts[i]);
+                        ret_act = (*handler)((struct rte_mbuf *)pkts[i], meta, nf_local_ctx);
+                        /* NF returns 0 to return packets or 1 to buffer */
+                        if (likely(ret_act == 0))
+                                pkts[tx_count++] = pkts[i];
                 }
         }
+        nf->stats.tx_buffer += nb_pkts - tx_count;
         if (ONVM_NF_HANDLE_TX) {
-                return nb_pkts;
+                return tx_count;
         }
 
+        tx_buf.count = tx_count;
+        memcpy(tx_buf.buffer, pkts, tx_count * sizeof(struct rte_mbuf *));
         onvm_pkt_enqueue_tx_thread(&tx_buf, nf);
+        /* tx_buf doesn't outlive this call, nothing can be held in it */
+        nf->stats.tx_drop += tx_buf.count;
+        onvm_drop_count(&nf->stats.drops, ONVM_DROP_TX_QUEUE_FULL, tx_buf.count);
+        for (i = 0; i < tx_buf.count; i++)
+                rte_pktmbuf_free(tx_buf.buffer[i]);
         return 0;
 }
 
+static inline uint16_t
+onvm_nflib_nic_rx(struct onvm_nf *nf, void **pkts, uint16_t max_pkts) {
+        struct onvm_pkt_meta *meta;
+        uint16_t i, p, port, rx_count, nb_pkts;
+
+        nb_pkts = 0;
+        for (p = 0; p < ports->num_ports && nb_pkts < max_pkts; p++) {
+                port = ports->id[p];
+                rx_count = rte_eth_rx_burst(port, nf->nic_rx.queue, (struct rte_mbuf **)pkts + nb_pkts,
+                                            max_pkts - nb_pkts);
+                if (rx_count == 0)
+                        continue;
+                /* The RX threads of the manager count the other queues of the port */
+                __atomic_fetch_add(&ports->rx_stats.rx[port], rx_count, __ATOMIC_RELAXED);
+                onvm_pkt_capture_batch((struct rte_mbuf **)pkts + nb_pkts, rx_count, nf->thread_info.core, port,
+                                       ONVM_CAPTURE_PORT_RX);
+                for (i = nb_pkts; i < nb_pkts + rx_count; i++) {
+                        meta = onvm_get_pkt_meta((struct rte_mbuf *)pkts[i]);
+                        meta->src = 0;
+                        meta->chain_id = ONVM_SC_NO_ID;
+                        meta->chain_index = onvm_sc_next_index(default_chain, 0);
+                        meta->action = ONVM_NF_ACTION_TONF;
+                        meta->destination = nf->service_id;
+                }
+                nb_pkts += rx_count;
+        }
+        nf->stats.rx += nb_pkts;
+        return nb_pkts;
+}
+
 static inline void
 onvm_nflib_dequeue_messages(struct onvm_nf_local_ctx *nf_local_ctx) {
         struct onvm_nf_msg *msg;
@@ -1095,7 +1228,8 @@ onvm_nflib_handle_signal(int sig) {
 static int
 onvm_nflib_is_scale_info_valid(struct onvm_nf_scale_info *scale_info) {
         return scale_info->nf_init_cfg->service_id != 0 && scale_info->function_table != NULL &&
-               scale_info->function_table->pkt_handler != NULL;
+               (scale_info->function_table->pkt_handler != NULL ||
+                scale_info->function_table->pkt_bulk_handler != NULL);
 }
 
 
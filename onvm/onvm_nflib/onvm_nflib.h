@@ -149,7 +149,8 @@ onvm_nflib_return_pkt(struct onvm_nf *nf, struct rte_mbuf *pkt);
  * @param count
  *    the number of packets contained within the buffer.
  * @return
- *    0 on success, or a negative value on error (-1 if bad arguments, -ENOBUFS if enqueue fails).
+ *    0 on success, or a negative value on error (-1 if bad arguments, -ENOBUFS if the tx ring
+ *    didn't take all packets, the ones left over are freed).
  */
 int
 onvm_nflib_return_pkt_bulk(struct onvm_nf *nf, struct rte_mbuf **pkts, uint16_t count);
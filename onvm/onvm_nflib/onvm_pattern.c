@@ -0,0 +1,504 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * onvm_pattern.c - multi-pattern payload matching
+ ********************************************************************/
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_malloc.h>
+#include <rte_prefetch.h>
+
+#ifdef RTE_MACHINE_CPUFLAG_SSSE3
+#include <rte_vect.h>
+#endif
+
+#include "onvm_pattern.h"
+
+#define ONVM_PATTERN_MATCH_FLAG 0x80000000
+#define ONVM_PATTERN_LINE_LEN 4096
+/* Above this chance of a random position passing the prefilter it costs more than it saves */
+#define ONVM_PATTERN_PREFILTER_MAX_RATE (1.0 / 16)
+
+/**********************Internal Functions Prototypes**************************/
+
+static void
+onvm_pattern_build_prefilter(struct onvm_pattern_set *set);
+
+static inline uint32_t
+onvm_pattern_next_candidate(const struct onvm_pattern_set *set, const uint8_t *data, uint32_t len, uint32_t i);
+
+static int
+onvm_pattern_parse_line(const char *line, uint8_t *out, uint16_t *out_len);
+
+static int
+onvm_pattern_first_match(uint32_t pattern_id, uint32_t end, void *arg);
+
+/**********************************Interfaces*********************************/
+
+struct onvm_pattern_set *
+onvm_pattern_set_create(uint32_t max_patterns, int socket_id) {
+        struct onvm_pattern_set *set;
+
+        if (max_patterns == 0)
+                return NULL;
+
+        set = rte_zmalloc_socket("onvm_pattern_set", sizeof(struct onvm_pattern_set), RTE_CACHE_LINE_SIZE,
+                                 socket_id);
+        if (set == NULL)
+                return NULL;
+
+        set->socket_id = socket_id;
+        set->max_patterns = max_patterns;
+        set->max_states = ONVM_PATTERN_DEFAULT_MAX_STATES;
+        set->patterns = calloc(max_patterns, sizeof(uint8_t *));
+        set->pattern_len = calloc(max_patterns, sizeof(uint16_t));
+        set->pattern_id = calloc(max_patterns, sizeof(uint32_t));
+        if (set->patterns == NULL || set->pattern_len == NULL || set->pattern_id == NULL) {
+                onvm_pattern_set_free(set);
+                return NULL;
+        }
+
+        return set;
+}
+
+int
+onvm_pattern_set_add(struct onvm_pattern_set *set, const uint8_t *pattern, uint16_t len, uint32_t id) {
+        uint8_t *copy;
+
+        if (set == NULL || set->compiled || pattern == NULL || len == 0 || len > ONVM_PATTERN_MAX_LEN)
+                return -EINVAL;
+        if (set->num_patterns >= set->max_patterns)
+                return -ENOSPC;
+
+        copy = malloc(len);
+        if (copy == NULL)
+                return -ENOMEM;
+        memcpy(copy, pattern, len);
+
+        set->patterns[set->num_patterns] = copy;
+        set->pattern_len[set->num_patterns] = len;
+        set->pattern_id[set->num_patterns] = id;
+        set->num_patterns++;
+        return 0;
+}
+
+int
+onvm_pattern_set_load(struct onvm_pattern_set *set, const char *path) {
+        char line[ONVM_PATTERN_LINE_LEN];
+        uint8_t pattern[ONVM_PATTERN_MAX_LEN];
+        uint16_t len;
+        int ret, loaded;
+        FILE *file;
+
+        if (set == NULL || path == NULL)
+                return -EINVAL;
+
+        file = fopen(path, "r");
+        if (file == NULL)
+                return -errno;
+
+        loaded = 0;
+        while (fgets(line, sizeof(line), file) != NULL) {
+                line[strcspn(line, "\r\n")] = '\0';
+                if (line[0] == '\0' || line[0] == '#')
+                        continue;
+
+                ret = onvm_pattern_parse_line(line, pattern, &len);
+                if (ret == 0)
+                        ret = onvm_pattern_set_add(set, pattern, len, set->num_patterns);
+                if (ret != 0) {
+                        fclose(file);
+                        return ret;
+                }
+                loaded++;
+        }
+
+        fclose(file);
+        return loaded;
+}
+
+int
+onvm_pattern_set_compile(struct onvm_pattern_set *set) {
+        uint8_t used[256];
+        uint32_t *goto_fn, *fail, *queue, *out_head, *pat_next, *out_count;
+        uint32_t max_states, nc, p, s, t, f, c, i, head, tail, num_out;
+        uint64_t total_len;
+        int ret;
+
+        if (set == NULL || set->compiled || set->num_patterns == 0)
+                return -EINVAL;
+
+        /* Alphabet compression: only bytes that appear in some pattern get their own class */
+        memset(used, 0, sizeof(used));
+        total_len = 0;
+        for (p = 0; p < set->num_patterns; p++) {
+                for (i = 0; i < set->pattern_len[p]; i++)
+                        used[set->patterns[p][i]] = 1;
+                total_len += set->pattern_len[p];
+        }
+        nc = 1;
+        for (i = 0; i < 256; i++)
+                set->byte_class[i] = used[i] ? nc++ : 0;
+        set->num_classes = nc;
+
+        /* The trie has at most a state per pattern byte, check that bound before any table is allocated */
+        if (total_len + 1 > set->max_states)
+                return -E2BIG;
+        max_states = total_len + 1;
+        if ((uint64_t)max_states * nc >= ONVM_PATTERN_MATCH_FLAG)
+                return -ENOMEM;
+
+        ret = -ENOMEM;
+        goto_fn = calloc((size_t)max_states * nc, sizeof(uint32_t));
+        fail = calloc(max_states, sizeof(uint32_t));
+        queue = calloc(max_states, sizeof(uint32_t));
+        out_head = calloc(max_states, sizeof(uint32_t));
+        out_count = calloc(max_states, sizeof(uint32_t));
+        pat_next = calloc(set->num_patterns, sizeof(uint32_t));
+        set->dict_link = rte_zmalloc_socket(NULL, max_states * sizeof(uint32_t), RTE_CACHE_LINE_SIZE, set->socket_id);
+        if (goto_fn == NULL || fail == NULL || queue == NULL || out_head == NULL || out_count == NULL ||
+            pat_next == NULL || set->dict_link == NULL)
+                goto out;
+
+        /* Trie of all patterns, 0 means no edge as nothing goes back to the root yet */
+        set->num_states = 1;
+        for (p = 0; p < set->num_patterns; p++) {
+                s = 0;
+                for (i = 0; i < set->pattern_len[p]; i++) {
+                        c = set->byte_class[set->patterns[p][i]];
+                        if (goto_fn[s * nc + c] == 0)
+                                goto_fn[s * nc + c] = set->num_states++;
+                        s = goto_fn[s * nc + c];
+                }
+                /* Patterns ending in a state are linked through pat_next, 1 based */
+                pat_next[p] = out_head[s];
+                out_head[s] = p + 1;
+                out_count[s]++;
+        }
+
+        /* Breadth first: failure links, then fill in missing edges from the failure state to get a DFA */
+        head = tail = 0;
+        queue[tail++] = 0;
+        while (head < tail) {
+                s = queue[head++];
+                for (c = 0; c < nc; c++) {
+                        t = goto_fn[s * nc + c];
+                        f = s == 0 ? 0 : goto_fn[fail[s] * nc + c];
+                        if (t != 0) {
+                                fail[t] = f;
+                                set->dict_link[t] = out_head[f] != 0 ? f : set->dict_link[f];
+                                queue[tail++] = t;
+                        } else {
+                                goto_fn[s * nc + c] = f;
+                        }
+                }
+        }
+
+        /* Flatten the pattern IDs reported by every state */
+        set->out_start = rte_zmalloc_socket(NULL, (set->num_states + 1) * sizeof(uint32_t), RTE_CACHE_LINE_SIZE,
+                                            set->socket_id);
+        set->out_ids = rte_zmalloc_socket(NULL, set->num_patterns * sizeof(uint32_t), RTE_CACHE_LINE_SIZE,
+                                          set->socket_id);
+        set->trans = rte_malloc_socket(NULL, (size_t)set->num_states * nc * sizeof(uint32_t), RTE_CACHE_LINE_SIZE,
+                                       set->socket_id);
+        if (set->out_start == NULL || set->out_ids == NULL || set->trans == NULL)
+                goto out;
+
+        num_out = 0;
+        for (s = 0; s < set->num_states; s++) {
+                set->out_start[s] = num_out;
+                for (p = out_head[s]; p != 0; p = pat_next[p - 1])
+                        set->out_ids[num_out++] = set->pattern_id[p - 1];
+        }
+        set->out_start[set->num_states] = num_out;
+
+        /* Store rows premultiplied so the scan loop needs no multiply, and flag states that report */
+        for (i = 0; i < set->num_states * nc; i++) {
+                t = goto_fn[i];
+                set->trans[i] = t * nc;
+                if (out_count[t] != 0 || set->dict_link[t] != 0)
+                        set->trans[i] |= ONVM_PATTERN_MATCH_FLAG;
+        }
+
+        onvm_pattern_build_prefilter(set);
+        set->compiled = 1;
+        ret = 0;
+
+out:
+        free(goto_fn);
+        free(fail);
+        free(queue);
+        free(out_head);
+        free(out_count);
+        free(pat_next);
+        return ret;
+}
+
+uint32_t
+onvm_pattern_scan(const struct onvm_pattern_set *set, const uint8_t *data, uint32_t len, onvm_pattern_match_cb cb,
+                  void *arg) {
+        const uint32_t *trans;
+        uint32_t i, k, u, entry, row, count;
+
+        if (unlikely(set == NULL || !set->compiled || data == NULL))
+                return 0;
+
+        trans = set->trans;
+        count = 0;
+        row = 0;
+        for (i = 0; i < len; i++) {
+                /* Nothing is partially matched at the root, skip ahead to where a pattern could start */
+                if (row == 0 && set->use_prefilter) {
+                        i = onvm_pattern_next_candidate(set, data, len, i);
+                        if (i == len)
+                                break;
+                }
+
+                entry = trans[row + set->byte_class[data[i]]];
+                row = entry & ~ONVM_PATTERN_MATCH_FLAG;
+                if (unlikely(entry & ONVM_PATTERN_MATCH_FLAG)) {
+                        for (u = row / set->num_classes; u != 0; u = set->dict_link[u]) {
+                                for (k = set->out_start[u]; k < set->out_start[u + 1]; k++) {
+                                        count++;
+                                        if (cb == NULL || cb(set->out_ids[k], i + 1, arg))
+                                                return count;
+                                }
+                        }
+                }
+        }
+
+        return count;
+}
+
+uint16_t
+onvm_pattern_scan_burst(const struct onvm_pattern_set *set, const uint8_t *const data[], const uint32_t len[],
+                        uint16_t count, uint32_t match[]) {
+        uint16_t i, nb_match;
+
+        nb_match = 0;
+        for (i = 0; i < count; i++) {
+                if (i + 1 < count)
+                        rte_prefetch0(data[i + 1]);
+                match[i] = ONVM_PATTERN_NO_MATCH;
+                onvm_pattern_scan(set, data[i], len[i], onvm_pattern_first_match, &match[i]);
+                nb_match += match[i] != ONVM_PATTERN_NO_MATCH;
+        }
+
+        return nb_match;
+}
+
+void
+onvm_pattern_set_free(struct onvm_pattern_set *set) {
+        uint32_t p;
+
+        if (set == NULL)
+                return;
+
+        if (set->patterns != NULL) {
+                for (p = 0; p < set->num_patterns; p++)
+                        free(set->patterns[p]);
+        }
+        free(set->patterns);
+        free(set->pattern_len);
+        free(set->pattern_id);
+        rte_free(set->trans);
+        rte_free(set->out_start);
+        rte_free(set->out_ids);
+        rte_free(set->dict_link);
+        rte_free(set);
+}
+
+/*****************************Internal functions******************************/
+
+static void
+onvm_pattern_build_prefilter(struct onvm_pattern_set *set) {
+        uint32_t first_count[257];
+        uint32_t *order;
+        uint32_t p, i, k, c, b, n;
+        uint8_t bit, m;
+        double pass, miss;
+
+        memset(set->lo_nibble, 0, sizeof(set->lo_nibble));
+        memset(set->hi_nibble, 0, sizeof(set->hi_nibble));
+        set->use_prefilter = 0;
+
+        /* Bucket patterns by first byte so each bucket's masks stay narrow */
+        order = malloc(set->num_patterns * sizeof(uint32_t));
+        if (order == NULL)
+                return;
+        memset(first_count, 0, sizeof(first_count));
+        for (p = 0; p < set->num_patterns; p++)
+                first_count[set->patterns[p][0] + 1]++;
+        for (c = 1; c < 257; c++)
+                first_count[c] += first_count[c - 1];
+        for (p = 0; p < set->num_patterns; p++)
+                order[first_count[set->patterns[p][0]]++] = p;
+
+        for (i = 0; i < set->num_patterns; i++) {
+                p = order[i];
+                bit = 1 << ((uint64_t)i * ONVM_PATTERN_PREFILTER_BUCKETS / set->num_patterns);
+                for (k = 0; k < ONVM_PATTERN_PREFILTER_LEN; k++) {
+                        if (k < set->pattern_len[p]) {
+                                c = set->patterns[p][k];
+                                set->lo_nibble[k][c & 0x0F] |= bit;
+                                set->hi_nibble[k][c >> 4] |= bit;
+                        } else {
+                                /* Short patterns match whatever follows them */
+                                for (c = 0; c < 16; c++) {
+                                        set->lo_nibble[k][c] |= bit;
+                                        set->hi_nibble[k][c] |= bit;
+                                }
+                        }
+                }
+        }
+        free(order);
+
+        /* Estimate how often a random position passes, assuming uniform bytes */
+        miss = 1.0;
+        for (b = 0; b < ONVM_PATTERN_PREFILTER_BUCKETS; b++) {
+                pass = 1.0;
+                for (k = 0; k < ONVM_PATTERN_PREFILTER_LEN; k++) {
+                        n = 0;
+                        for (c = 0; c < 256; c++) {
+                                m = set->lo_nibble[k][c & 0x0F] & set->hi_nibble[k][c >> 4];
+                                n += (m >> b) & 1;
+                        }
+                        pass *= n / 256.0;
+                }
+                miss *= 1.0 - pass;
+        }
+        set->use_prefilter = 1.0 - miss <= ONVM_PATTERN_PREFILTER_MAX_RATE;
+}
+
+#ifdef RTE_MACHINE_CPUFLAG_SSSE3
+static inline __m128i
+onvm_pattern_nibble_lookup(const struct onvm_pattern_set *set, uint32_t k, __m128i v) {
+        const __m128i low_mask = _mm_set1_epi8(0x0F);
+        __m128i lo, hi;
+
+        lo = _mm_shuffle_epi8(_mm_load_si128((const __m128i *)set->lo_nibble[k]), _mm_and_si128(v, low_mask));
+        hi = _mm_shuffle_epi8(_mm_load_si128((const __m128i *)set->hi_nibble[k]),
+                              _mm_and_si128(_mm_srli_epi16(v, 4), low_mask));
+        return _mm_and_si128(lo, hi);
+}
+#endif
+
+static inline uint32_t
+onvm_pattern_next_candidate(const struct onvm_pattern_set *set, const uint8_t *data, uint32_t len, uint32_t i) {
+        uint32_t k;
+        uint8_t m;
+
+#ifdef RTE_MACHINE_CPUFLAG_SSSE3
+        /* 16 positions at a time, a position passes if one bucket matches all of its leading bytes */
+        __m128i res;
+        uint32_t bits;
+
+        for (; i + 16 + ONVM_PATTERN_PREFILTER_LEN - 1 <= len; i += 16) {
+                res = _mm_set1_epi8((char)0xFF);
+                for (k = 0; k < ONVM_PATTERN_PREFILTER_LEN; k++)
+                        res = _mm_and_si128(res, onvm_pattern_nibble_lookup(
+                                                     set, k, _mm_loadu_si128((const __m128i *)(data + i + k))));
+                bits = _mm_movemask_epi8(_mm_cmpeq_epi8(res, _mm_setzero_si128())) ^ 0xFFFF;
+                if (bits != 0)
+                        return i + __builtin_ctz(bits);
+        }
+#endif
+
+        for (; i < len; i++) {
+                m = 0xFF;
+                for (k = 0; k < ONVM_PATTERN_PREFILTER_LEN && i + k < len; k++)
+                        m &= set->lo_nibble[k][data[i + k] & 0x0F] & set->hi_nibble[k][data[i + k] >> 4];
+                if (m != 0)
+                        return i;
+        }
+
+        return len;
+}
+
+static int
+onvm_pattern_parse_line(const char *line, uint8_t *out, uint16_t *out_len) {
+        char hex[3];
+        uint16_t len;
+        int in_hex;
+
+        len = 0;
+        in_hex = 0;
+        hex[2] = '\0';
+        while (*line != '\0') {
+                if (*line == '|') {
+                        in_hex = !in_hex;
+                        line++;
+                        continue;
+                }
+                if (len >= ONVM_PATTERN_MAX_LEN)
+                        return -EINVAL;
+
+                if (in_hex) {
+                        if (*line == ' ') {
+                                line++;
+                                continue;
+                        }
+                        if (!isxdigit(line[0]) || !isxdigit(line[1]))
+                                return -EINVAL;
+                        hex[0] = line[0];
+                        hex[1] = line[1];
+                        out[len++] = (uint8_t)strtoul(hex, NULL, 16);
+                        line += 2;
+                } else {
+                        /* A backslash keeps the next character literal, e.g. \| */
+                        if (*line == '\\' && line[1] != '\0')
+                                line++;
+                        out[len++] = (uint8_t)*line++;
+                }
+        }
+
+        if (in_hex || len == 0)
+                return -EINVAL;
+        *out_len = len;
+        return 0;
+}
+
+static int
+onvm_pattern_first_match(uint32_t pattern_id, __attribute__((unused)) uint32_t end, void *arg) {
+        *(uint32_t *)arg = pattern_id;
+        return 1;
+}
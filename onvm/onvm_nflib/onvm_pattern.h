@@ -0,0 +1,127 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * onvm_pattern.h - multi-pattern payload matching
+ ********************************************************************/
+
+#ifndef _ONVM_PATTERN_H_
+#define _ONVM_PATTERN_H_
+
+#include <stdint.h>
+
+#include <rte_common.h>
+#include <rte_mbuf.h>
+
+#define ONVM_PATTERN_MAX_LEN 255
+#define ONVM_PATTERN_NO_MATCH UINT32_MAX
+/* Most DFA states a set compiles to unless max_states is changed, the table is states * classes * 4 bytes */
+#define ONVM_PATTERN_DEFAULT_MAX_STATES (1 << 16)
+
+/* Number of leading pattern bytes and pattern buckets used by the prefilter */
+#define ONVM_PATTERN_PREFILTER_LEN 3
+#define ONVM_PATTERN_PREFILTER_BUCKETS 8
+
+/*
+ * A set of binary patterns compiled into an Aho-Corasick DFA.
+ * Add patterns, compile once, then scan from the packet path.
+ */
+struct onvm_pattern_set {
+        int socket_id;
+
+        /* Patterns added since creation, kept until the set is freed */
+        uint8_t **patterns;
+        uint16_t *pattern_len;
+        uint32_t *pattern_id;
+        uint32_t num_patterns;
+        uint32_t max_patterns;
+        uint32_t max_states; /* compile rejects sets whose total pattern length + 1 is above it */
+
+        /* Compiled DFA, bytes never used by a pattern share class 0 */
+        uint8_t compiled;
+        uint8_t byte_class[256];
+        uint16_t num_classes;
+        uint32_t num_states;
+        uint32_t *trans;     /* next state times num_classes, top bit set if the state reports matches */
+        uint32_t *out_start; /* pattern IDs of state s are out_ids[out_start[s]] to out_ids[out_start[s + 1] - 1] */
+        uint32_t *out_ids;
+        uint32_t *dict_link; /* next state along the failure chain that reports matches */
+
+        /* Teddy style prefilter on the first pattern bytes, off when it can't rule out enough positions */
+        uint8_t use_prefilter;
+        uint8_t lo_nibble[ONVM_PATTERN_PREFILTER_LEN][16] __rte_aligned(16);
+        uint8_t hi_nibble[ONVM_PATTERN_PREFILTER_LEN][16] __rte_aligned(16);
+};
+
+/*
+ * Called for every match with the ID of the pattern and the offset right after its last byte.
+ * Return non-zero to stop scanning.
+ */
+typedef int (*onvm_pattern_match_cb)(uint32_t pattern_id, uint32_t end, void *arg);
+
+struct onvm_pattern_set *
+onvm_pattern_set_create(uint32_t max_patterns, int socket_id);
+
+/* Returns 0 on success, -EINVAL for an empty or too long pattern, -ENOSPC when the set is full */
+int
+onvm_pattern_set_add(struct onvm_pattern_set *set, const uint8_t *pattern, uint16_t len, uint32_t id);
+
+/* Load one pattern per line, `|..|` encloses hex bytes as in "GET |20|/admin". Lines starting with # are skipped.
+ * Patterns get consecutive IDs starting at the number of patterns already in the set.
+ * Returns the number of patterns loaded or a negative error code. */
+int
+onvm_pattern_set_load(struct onvm_pattern_set *set, const char *path);
+
+/* Build the DFA and prefilter, patterns can't be added afterwards. Returns 0 on success, -E2BIG
+ * when the patterns could need more than max_states states. */
+int
+onvm_pattern_set_compile(struct onvm_pattern_set *set);
+
+/* Report every match in data to cb, or stop at the first one if cb is NULL. Returns the number of matches reported. */
+uint32_t
+onvm_pattern_scan(const struct onvm_pattern_set *set, const uint8_t *data, uint32_t len, onvm_pattern_match_cb cb,
+                  void *arg);
+
+/* Scan a burst of buffers, match[i] is the first pattern found in data[i] or ONVM_PATTERN_NO_MATCH.
+ * Returns the number of buffers with a match. */
+uint16_t
+onvm_pattern_scan_burst(const struct onvm_pattern_set *set, const uint8_t *const data[], const uint32_t len[],
+                        uint16_t count, uint32_t match[]);
+
+void
+onvm_pattern_set_free(struct onvm_pattern_set *set);
+
+#endif  // _ONVM_PATTERN_H_
@@ -0,0 +1,270 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * onvm_pkt_capture.c - capture tap shared by the manager and NFs
+ ********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_byteorder.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
+#include <rte_udp.h>
+
+#include "onvm_pkt_capture.h"
+#include "onvm_pkt_helper.h"
+
+/**********************Internal Functions Prototypes**************************/
+
+/*
+ * Helper function to check one filter term against the parsed headers.
+ *
+ * Inputs : a pointer to the term
+ *          a pointer to the IPv4 header
+ *          the source and destination L4 ports in host order, 0 if not TCP/UDP
+ *
+ */
+static inline int
+onvm_pkt_capture_match_term(struct onvm_capture_term *term, struct rte_ipv4_hdr *ipv4, uint16_t sport,
+                            uint16_t dport);
+
+/**********************************Interfaces*********************************/
+
+int
+onvm_pkt_capture_parse_filter(const char *filter, struct onvm_capture_info *info) {
+        char buf[ONVM_CAPTURE_FILTER_LEN];
+        char *tok, *save, *slash, *end;
+        struct onvm_capture_term *term;
+        unsigned long val;
+        uint8_t dir, expect_term;
+
+        if (filter == NULL || info == NULL || strlen(filter) >= ONVM_CAPTURE_FILTER_LEN)
+                return -1;
+
+        snprintf(info->filter, sizeof(info->filter), "%s", filter);
+        snprintf(buf, sizeof(buf), "%s", filter);
+        info->num_terms = 0;
+        expect_term = 1;
+        dir = ONVM_CAPTURE_DIR_ANY;
+
+        for (tok = strtok_r(buf, " ", &save); tok != NULL; tok = strtok_r(NULL, " ", &save)) {
+                if (!expect_term) {
+                        if (strcmp(tok, "and") != 0)
+                                return -1;
+                        expect_term = 1;
+                        continue;
+                }
+
+                if (!strcmp(tok, "src") || !strcmp(tok, "dst")) {
+                        if (dir != ONVM_CAPTURE_DIR_ANY)
+                                return -1;
+                        dir = !strcmp(tok, "src") ? ONVM_CAPTURE_DIR_SRC : ONVM_CAPTURE_DIR_DST;
+                        continue;
+                }
+
+                if (info->num_terms >= ONVM_CAPTURE_MAX_TERMS)
+                        return -1;
+                term = &info->terms[info->num_terms];
+                memset(term, 0, sizeof(*term));
+                term->dir = dir;
+
+                if (!strcmp(tok, "tcp") || !strcmp(tok, "udp") || !strcmp(tok, "icmp")) {
+                        if (dir != ONVM_CAPTURE_DIR_ANY)
+                                return -1;
+                        term->type = ONVM_CAPTURE_TERM_PROTO;
+                        term->mask = !strcmp(tok, "tcp") ? IPPROTO_TCP
+                                                         : (!strcmp(tok, "udp") ? IPPROTO_UDP : IPPROTO_ICMP);
+                } else if (!strcmp(tok, "host") || !strcmp(tok, "net")) {
+                        term->type = ONVM_CAPTURE_TERM_NET;
+                        term->mask = 0xFFFFFFFF;
+                        val = 32;
+                        tok = strtok_r(NULL, " ", &save);
+                        if (tok == NULL)
+                                return -1;
+                        slash = strchr(tok, '/');
+                        if (slash != NULL) {
+                                *slash = '\0';
+                                val = strtoul(slash + 1, &end, 10);
+                                if (end == slash + 1 || *end != '\0' || val > 32)
+                                        return -1;
+                        }
+                        if (onvm_pkt_parse_ip(tok, &term->ip) < 0)
+                                return -1;
+                        term->mask = val == 0 ? 0 : (uint32_t)(0xFFFFFFFF << (32 - val));
+                        term->ip &= term->mask;
+                } else if (!strcmp(tok, "port")) {
+                        term->type = ONVM_CAPTURE_TERM_PORT;
+                        tok = strtok_r(NULL, " ", &save);
+                        if (tok == NULL)
+                                return -1;
+                        val = strtoul(tok, &end, 10);
+                        if (end == tok || *end != '\0' || val > UINT16_MAX)
+                                return -1;
+                        term->port = (uint16_t)val;
+                } else {
+                        return -1;
+                }
+
+                info->num_terms++;
+                dir = ONVM_CAPTURE_DIR_ANY;
+                expect_term = 0;
+        }
+
+        /* A dangling "and" or "src"/"dst" */
+        if (info->num_terms > 0 && expect_term)
+                return -1;
+        if (dir != ONVM_CAPTURE_DIR_ANY)
+                return -1;
+
+        return 0;
+}
+
+int
+onvm_pkt_capture_match(struct onvm_capture_info *info, struct rte_mbuf *pkt) {
+        struct rte_ether_hdr *eth;
+        struct rte_ipv4_hdr *ipv4;
+        struct rte_tcp_hdr *tcp;
+        struct rte_udp_hdr *udp;
+        uint16_t sport, dport;
+        uint8_t i;
+
+        if (info->num_terms == 0)
+                return 1;
+
+        /* Every primitive looks at the IPv4 header */
+        eth = rte_pktmbuf_mtod(pkt, struct rte_ether_hdr *);
+        if (eth->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4) ||
+            rte_pktmbuf_data_len(pkt) < sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr))
+                return 0;
+        ipv4 = (struct rte_ipv4_hdr *)(eth + 1);
+
+        sport = dport = 0;
+        if (ipv4->next_proto_id == IPPROTO_TCP || ipv4->next_proto_id == IPPROTO_UDP) {
+                tcp = (struct rte_tcp_hdr *)((uint8_t *)ipv4 + (ipv4->version_ihl & RTE_IPV4_HDR_IHL_MASK) *
+                                                                   RTE_IPV4_IHL_MULTIPLIER);
+                udp = (struct rte_udp_hdr *)tcp;
+                sport = rte_be_to_cpu_16(ipv4->next_proto_id == IPPROTO_TCP ? tcp->src_port : udp->src_port);
+                dport = rte_be_to_cpu_16(ipv4->next_proto_id == IPPROTO_TCP ? tcp->dst_port : udp->dst_port);
+        }
+
+        for (i = 0; i < info->num_terms; i++) {
+                if (!onvm_pkt_capture_match_term(&info->terms[i], ipv4, sport, dport))
+                        return 0;
+        }
+        return 1;
+}
+
+void
+onvm_pkt_capture_tap(struct rte_mbuf **pkts, uint16_t count, uint16_t core, uint16_t iface, uint8_t point) {
+        struct onvm_capture_core *cap;
+        struct onvm_capture_hdr *hdr;
+        struct rte_mbuf *clones[PACKET_READ_SIZE];
+        uint16_t i, nb_clones;
+        uint64_t now;
+
+        if (core >= RTE_MAX_LCORE)
+                return;
+        cap = &capture_info->core[core];
+        if (cap->ring == NULL)
+                return;
+
+        now = rte_get_tsc_cycles();
+        nb_clones = 0;
+        for (i = 0; i < count && nb_clones < PACKET_READ_SIZE; i++) {
+                if (!onvm_pkt_capture_match(capture_info, pkts[i]))
+                        continue;
+                if (++cap->sample_count < capture_info->sample_rate)
+                        continue;
+                cap->sample_count = 0;
+
+                /* Only takes a reference on the packet data, the writer frees the clone */
+                clones[nb_clones] = rte_pktmbuf_clone(pkts[i], capture_info->clone_pool);
+                if (unlikely(clones[nb_clones] == NULL)) {
+                        cap->missed++;
+                        continue;
+                }
+                hdr = onvm_pkt_capture_hdr(clones[nb_clones]);
+                hdr->tsc = now;
+                hdr->iface = iface;
+                hdr->point = point;
+                nb_clones++;
+        }
+        /* The rest of a burst longer than the clone array is not looked at, count it as missed */
+        cap->missed += count - i;
+
+        if (nb_clones == 0)
+                return;
+
+        i = rte_ring_enqueue_burst(cap->ring, (void **)clones, nb_clones, NULL);
+        cap->captured += i;
+        cap->missed += nb_clones - i;
+        for (; i < nb_clones; i++)
+                rte_pktmbuf_free(clones[i]);
+}
+
+/*****************************Internal functions******************************/
+
+static inline int
+onvm_pkt_capture_match_term(struct onvm_capture_term *term, struct rte_ipv4_hdr *ipv4, uint16_t sport,
+                            uint16_t dport) {
+        uint32_t src, dst;
+
+        switch (term->type) {
+                case ONVM_CAPTURE_TERM_PROTO:
+                        return ipv4->next_proto_id == term->mask;
+                case ONVM_CAPTURE_TERM_NET:
+                        src = rte_be_to_cpu_32(ipv4->src_addr) & term->mask;
+                        dst = rte_be_to_cpu_32(ipv4->dst_addr) & term->mask;
+                        if (term->dir == ONVM_CAPTURE_DIR_SRC)
+                                return src == term->ip;
+                        if (term->dir == ONVM_CAPTURE_DIR_DST)
+                                return dst == term->ip;
+                        return src == term->ip || dst == term->ip;
+                case ONVM_CAPTURE_TERM_PORT:
+                        if (sport == 0 && dport == 0)
+                                return 0;
+                        if (term->dir == ONVM_CAPTURE_DIR_SRC)
+                                return sport == term->port;
+                        if (term->dir == ONVM_CAPTURE_DIR_DST)
+                                return dport == term->port;
+                        return sport == term->port || dport == term->port;
+        }
+        return 0;
+}
@@ -0,0 +1,163 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * onvm_pkt_capture.h - capture tap shared by the manager and NFs
+ ********************************************************************/
+
+#ifndef _ONVM_PKT_CAPTURE_H_
+#define _ONVM_PKT_CAPTURE_H_
+
+#include <rte_cycles.h>
+#include <rte_mbuf.h>
+#include <rte_ring.h>
+
+#include "onvm_common.h"
+
+#define MZ_CAPTURE_INFO "MProc_capture_info"
+#define CAPTURE_CLONE_POOL_NAME "MProc_capture_clone_pool"
+#define MP_CAPTURE_RING_NAME "MProc_Capture_%u"
+
+#define NUM_CAPTURE_MBUFS 16383
+#define ONVM_CAPTURE_RING_SIZE 1024
+#define ONVM_CAPTURE_MAX_TERMS 8
+#define ONVM_CAPTURE_FILTER_LEN 128
+
+/* Where in the data path a packet was captured */
+#define ONVM_CAPTURE_PORT_RX 0
+#define ONVM_CAPTURE_PORT_TX 1
+#define ONVM_CAPTURE_NF_TX 2
+
+/* Filter primitives, every term of a filter has to match */
+#define ONVM_CAPTURE_TERM_PROTO 0
+#define ONVM_CAPTURE_TERM_NET 1
+#define ONVM_CAPTURE_TERM_PORT 2
+
+#define ONVM_CAPTURE_DIR_ANY 0
+#define ONVM_CAPTURE_DIR_SRC 1
+#define ONVM_CAPTURE_DIR_DST 2
+
+struct onvm_capture_term {
+        uint8_t type;
+        uint8_t dir;
+        uint16_t port;
+        uint32_t ip;   /* host byte order */
+        uint32_t mask; /* host byte order, also holds the protocol number */
+};
+
+/*
+ * Per core state, the ring is multi producer as NFs can share a core
+ */
+struct onvm_capture_core {
+        struct rte_ring *ring;
+        uint32_t sample_count;
+        volatile uint64_t captured;
+        volatile uint64_t missed;
+} __rte_cache_aligned;
+
+/*
+ * Shared between the manager and all NFs through the MZ_CAPTURE_INFO memzone
+ */
+struct onvm_capture_info {
+        volatile uint8_t enabled;
+        uint8_t num_terms;
+        uint32_t sample_rate; /* capture one in every sample_rate matching packets */
+        struct onvm_capture_term terms[ONVM_CAPTURE_MAX_TERMS];
+        char filter[ONVM_CAPTURE_FILTER_LEN];
+        struct rte_mempool *clone_pool;
+        struct onvm_capture_core core[RTE_MAX_LCORE];
+};
+
+/*
+ * Kept in the private area of every capture clone until the writer is done with it
+ */
+struct onvm_capture_hdr {
+        uint64_t tsc;
+        uint16_t iface; /* port ID or NF instance ID depending on the point */
+        uint8_t point;
+};
+
+extern struct onvm_capture_info *capture_info;
+
+/*
+ * Given the name template above, get the capture ring name of a core
+ */
+static inline const char *
+get_capture_ring_name(unsigned core) {
+        /* buffer for return value. Size calculated by %u being replaced
+         * by maximum 3 digits (plus an extra byte for safety) */
+        static char buffer[sizeof(MP_CAPTURE_RING_NAME) + 2];
+
+        snprintf(buffer, sizeof(buffer) - 1, MP_CAPTURE_RING_NAME, core);
+        return buffer;
+}
+
+/*
+ * Parse a filter made of primitives joined by "and", e.g.
+ * "tcp and src net 10.0.0.0/8 and dst port 80". An empty filter matches everything.
+ * Supported primitives: tcp, udp, icmp, [src|dst] host IP, [src|dst] net IP/LEN, [src|dst] port N.
+ *
+ * Returns 0 on success, -1 on a malformed filter.
+ */
+int
+onvm_pkt_capture_parse_filter(const char *filter, struct onvm_capture_info *info);
+
+/*
+ * Returns 1 if the packet matches every term of the capture filter, 0 otherwise.
+ */
+int
+onvm_pkt_capture_match(struct onvm_capture_info *info, struct rte_mbuf *pkt);
+
+/*
+ * Clone matching packets of a batch by reference onto the capture ring of a core.
+ * Use onvm_pkt_capture_batch from the data path, it returns right away while capturing is off.
+ */
+void
+onvm_pkt_capture_tap(struct rte_mbuf **pkts, uint16_t count, uint16_t core, uint16_t iface, uint8_t point);
+
+static inline struct onvm_capture_hdr *
+onvm_pkt_capture_hdr(struct rte_mbuf *clone) {
+        return (struct onvm_capture_hdr *)rte_mbuf_to_priv(clone);
+}
+
+static inline void
+onvm_pkt_capture_batch(struct rte_mbuf **pkts, uint16_t count, uint16_t core, uint16_t iface, uint8_t point) {
+        if (likely(capture_info == NULL || !capture_info->enabled))
+                return;
+        onvm_pkt_capture_tap(pkts, count, core, iface, point);
+}
+
+#endif  // _ONVM_PKT_CAPTURE_H_
@@ -46,7 +46,15 @@
 
 ******************************************************************************/
 
+#include <rte_malloc.h>
+
 #include "onvm_pkt_common.h"
+#include "onvm_pkt_helper.h"
+
+/* Groups onvm_pkt_process_tx_batch sorts packets into, after the ONVM_NF_ACTION_* ones */
+#define ONVM_PKT_GROUP_INVALID (ONVM_NF_ACTION_OUT + 1)  // packet meta action is none of ONVM_NF_ACTION_*
+#define ONVM_PKT_GROUP_JOIN (ONVM_NF_ACTION_OUT + 2)     // parallel join branch voting on its held packet
+#define ONVM_PKT_GROUPS (ONVM_NF_ACTION_OUT + 3)
 
 /**********************Internal Functions Prototypes**************************/
 
@@ -61,6 +69,85 @@
 static inline void
 onvm_pkt_enqueue_port(struct queue_mgr *tx_mgr, uint16_t port, struct rte_mbuf *buf);
 
+/*
+ * Function to make sure a packet owns its data before it goes to a port with
+ * DEV_TX_OFFLOAD_MBUF_FAST_FREE, which puts mbufs back in their pool without
+ * looking at the refcnt. A packet still shared with the clones of a mirror
+ * stage is sent to such a port as a private copy, other ports get it as is.
+ *
+ * Inputs : a pointer to the packet
+ *          the port it goes to
+ * Output : the packet to send, or NULL if no copy could be made
+ *
+ */
+static struct rte_mbuf *
+onvm_pkt_unshare(struct rte_mbuf *pkt, uint16_t port);
+
+/*
+ * Function to enqueue packets on the ports' queues, runs of packets for the
+ * same port are copied to its buffer at once.
+ *
+ * Inputs : a pointer to the tx queue responsible
+ *          an array of packets, each meta's destination is its port
+ *          the size of the array
+ *
+ */
+static void
+onvm_pkt_enqueue_port_bulk(struct queue_mgr *tx_mgr, struct rte_mbuf *pkts[], uint16_t count);
+
+/*
+ * Function to put packets in the buffer an NF sends to its TX thread through.
+ *
+ * Inputs : a pointer to the NF's tx queue
+ *          an array of packets
+ *          the size of the array
+ *          a pointer to the NF
+ *
+ */
+static void
+onvm_pkt_enqueue_tx_buf_bulk(struct queue_mgr *tx_mgr, struct rte_mbuf *pkts[], uint16_t count, struct onvm_nf *nf);
+
+/*
+ * Function to enqueue packets on the NF queues of the services in their meta,
+ * runs of packets mapped to the same instance are copied to its buffer at once.
+ *
+ * Inputs : a pointer to the tx queue responsible
+ *          an array of packets
+ *          the size of the array
+ *          a pointer to the NF that sent the packets, or NULL
+ *
+ */
+static void
+onvm_pkt_enqueue_nf_bulk(struct queue_mgr *tx_mgr, struct rte_mbuf *pkts[], uint16_t count,
+                         struct onvm_nf *source_nf);
+
+/*
+ * Function to pick the instance of a service a packet goes to. A manager
+ * thread running NFs inline keeps packets on its own instance of the service.
+ *
+ * Inputs : a pointer to the tx queue responsible
+ *          the service ID
+ *          the packet
+ * Output : the instance ID, 0 if the service has no instance
+ *
+ */
+static inline uint16_t
+onvm_pkt_service_to_instance(struct queue_mgr *tx_mgr, uint16_t service_id, struct rte_mbuf *pkt);
+
+/*
+ * Function to enqueue packets on one NF instance's queue.
+ *
+ * Inputs : a pointer to the tx queue responsible
+ *          the instance ID, 0 if the service has no instance
+ *          an array of packets
+ *          the size of the array
+ *          a pointer to the NF that sent the packets, or NULL
+ *
+ */
+static void
+onvm_pkt_enqueue_instance(struct queue_mgr *tx_mgr, uint16_t dst_instance_id, struct rte_mbuf *pkts[],
+                          uint16_t count, struct onvm_nf *source_nf);
+
 /*
  * Function to process a single packet.
  *
@@ -83,130 +170,210 @@ onvm_pkt_process_next_action(struct queue_mgr *tx_mgr, struct rte_mbuf *pkt, str
 static int
 onvm_pkt_drop(struct rte_mbuf *pkt);
 
+/*
+ * Helper function to count packets dropped on their way to an NF.
+ * Drops of packets that didn't come from an NF are counted by the manager.
+ *
+ * Inputs : a pointer to the NF that sent the packets, or NULL
+ *          the reason the packets were dropped
+ *          the number of packets
+ *
+ */
+static inline void
+onvm_pkt_count_drop(struct onvm_nf *source_nf, enum onvm_drop_reason reason, uint16_t count);
+
+/*
+ * Helper function to deal with the packets at the end of a buffer a ring
+ * didn't take. Depending on the backpressure policy they are dropped or
+ * moved to the front of the buffer to be retried on the next flush.
+ *
+ * Inputs : a pointer to the packet buf
+ *          the number of packets the ring took
+ *          1 if an NF owns the buffer, only an NF can stop reading for ONVM_BP_SIGNAL
+ *
+ * Output : the number of packets dropped
+ *
+ */
+static uint16_t
+onvm_pkt_buf_retain(struct packet_buf *buf, uint16_t sent, uint8_t is_nf);
+
+/*
+ * Helper function to record that one branch of a parallel join is done.
+ * The last branch releases the held packet: it is dropped if any branch
+ * vetoed it, otherwise it continues along its service chain.
+ *
+ * Inputs : a pointer to the join
+ *          a pointer to the tx queue responsible, NULL to drop the held packet
+ *          a pointer to the NF possessing the TX queue
+ *
+ */
+static void
+onvm_pkt_join_put(struct onvm_pkt_join *join, struct queue_mgr *tx_mgr, struct onvm_nf *nf);
+
+/*
+ * Helper function to ask the manager for a direct ring between two NFs.
+ * Doesn't wait for the answer, packets keep using the rx ring until then.
+ *
+ * Inputs : a pointer to the sending NF
+ *          the instance ID of the receiving NF
+ *
+ */
+static void
+onvm_pkt_request_edge(struct onvm_nf *source_nf, uint16_t dst);
+
 /**********************************Interfaces*********************************/
 
 void
 onvm_pkt_process_tx_batch(struct queue_mgr *tx_mgr, struct rte_mbuf *pkts[], uint16_t tx_count, struct onvm_nf *nf) {
-        uint16_t i;
+        struct rte_mbuf *groups[ONVM_PKT_GROUPS][PACKET_READ_SIZE];
+        uint16_t group_count[ONVM_PKT_GROUPS];
         struct onvm_pkt_meta *meta;
-        struct packet_buf *out_buf;
+        struct onvm_pkt_join *join;
+        uint16_t i, done, n, group;
 
         if (tx_mgr == NULL || pkts == NULL || nf == NULL)
                 return;
 
-        for (i = 0; i < tx_count; i++) {
-                meta = (struct onvm_pkt_meta *)&(((struct rte_mbuf *)pkts[i])->udata64);
-                meta->src = nf->instance_id;
-                if (meta->action == ONVM_NF_ACTION_DROP) {
-                        // if the packet is drop, then <return value> is 0
-                        // and !<return value> is 1.
-                        nf->stats.act_drop++;
-                        nf->stats.tx += !onvm_pkt_drop(pkts[i]);
-                } else if (meta->action == ONVM_NF_ACTION_NEXT) {
-                        /* TODO: Here we drop the packet : there will be a flow table
-                        in the future to know what to do with the packet next */
-                        nf->stats.act_next++;
-                        onvm_pkt_process_next_action(tx_mgr, pkts[i], nf);
-                } else if (meta->action == ONVM_NF_ACTION_TONF) {
-                        nf->stats.act_tonf++;
-                        onvm_pkt_enqueue_nf(tx_mgr, meta->destination, pkts[i], nf);
-                } else if (meta->action == ONVM_NF_ACTION_OUT) {
-                        if (tx_mgr->mgr_type_t != MGR) {
-                                nf->stats.act_out++;
-                                out_buf = tx_mgr->to_tx_buf;
-                                out_buf->buffer[out_buf->count++] = pkts[i];
-                                if (out_buf->count == PACKET_READ_SIZE) {
-                                        onvm_pkt_enqueue_tx_thread(out_buf, nf);
-                                }
-                        } else {
-                                onvm_pkt_enqueue_port(tx_mgr, meta->destination, pkts[i]);
+        onvm_pkt_capture_batch(pkts, tx_count, tx_mgr->mgr_type_t == NF ? nf->thread_info.core : rte_lcore_id(),
+                               nf->instance_id, ONVM_CAPTURE_NF_TX);
+
+        onvm_pkt_prefetch_burst(pkts, tx_count);
+        for (done = 0; done < tx_count; done += n) {
+                n = RTE_MIN(tx_count - done, PACKET_READ_SIZE);
+
+                /* Sort the packets by action first, so each group below is dispatched without per packet branches */
+                memset(group_count, 0, sizeof(group_count));
+                for (i = done; i < done + n; i++) {
+                        onvm_pkt_prefetch_ahead(pkts, i, tx_count);
+                        meta = onvm_get_pkt_meta(pkts[i]);
+                        meta->src = nf->instance_id;
+                        group = meta->action <= ONVM_NF_ACTION_OUT ? meta->action : ONVM_PKT_GROUP_INVALID;
+                        /* Clones end at their branch whatever the NF asked for, they must not reach a port or NF */
+                        if (unlikely(onvm_pkt_is_fanout_clone(pkts[i])))
+                                group = *onvm_pkt_join_slot(pkts[i]) != NULL ? ONVM_PKT_GROUP_JOIN
+                                                                              : ONVM_NF_ACTION_DROP;
+                        groups[group][group_count[group]++] = pkts[i];
+                }
+
+                /* Join branches only vote on the held packet, their clone goes no further */
+                for (i = 0; i < group_count[ONVM_PKT_GROUP_JOIN]; i++) {
+                        join = *onvm_pkt_join_slot(groups[ONVM_PKT_GROUP_JOIN][i]);
+                        if (onvm_get_pkt_meta(groups[ONVM_PKT_GROUP_JOIN][i])->action == ONVM_NF_ACTION_DROP) {
+                                nf->stats.act_drop++;
+                                rte_atomic16_set(&join->vetoed, 1);
                         }
+                        rte_pktmbuf_free(groups[ONVM_PKT_GROUP_JOIN][i]);
+                        onvm_pkt_join_put(join, tx_mgr, nf);
+                }
+
+                nf->stats.act_drop += group_count[ONVM_NF_ACTION_DROP];
+                for (i = 0; i < group_count[ONVM_NF_ACTION_DROP]; i++)
+                        onvm_pkt_drop(groups[ONVM_NF_ACTION_DROP][i]);
+
+                nf->stats.act_tonf += group_count[ONVM_NF_ACTION_TONF];
+                onvm_pkt_enqueue_nf_bulk(tx_mgr, groups[ONVM_NF_ACTION_TONF], group_count[ONVM_NF_ACTION_TONF], nf);
+
+                if (tx_mgr->mgr_type_t != MGR) {
+                        nf->stats.act_out += group_count[ONVM_NF_ACTION_OUT];
+                        onvm_pkt_enqueue_tx_buf_bulk(tx_mgr, groups[ONVM_NF_ACTION_OUT],
+                                                     group_count[ONVM_NF_ACTION_OUT], nf);
                 } else {
-                        printf("ERROR invalid action : this shouldn't happen.\n");
-                        onvm_pkt_drop(pkts[i]);
-                        return;
+                        onvm_pkt_enqueue_port_bulk(tx_mgr, groups[ONVM_NF_ACTION_OUT], group_count[ONVM_NF_ACTION_OUT]);
                 }
+
+                /* The next hop depends on each packet's chain */
+                nf->stats.act_next += group_count[ONVM_NF_ACTION_NEXT];
+                for (i = 0; i < group_count[ONVM_NF_ACTION_NEXT]; i++)
+                        onvm_pkt_process_next_action(tx_mgr, groups[ONVM_NF_ACTION_NEXT][i], nf);
+
+                onvm_drop_count(&nf->stats.drops, ONVM_DROP_INVALID_ACTION, group_count[ONVM_PKT_GROUP_INVALID]);
+                for (i = 0; i < group_count[ONVM_PKT_GROUP_INVALID]; i++)
+                        onvm_pkt_drop(groups[ONVM_PKT_GROUP_INVALID][i]);
         }
 }
 
-void
+uint32_t
 onvm_pkt_flush_all_nfs(struct queue_mgr *tx_mgr, struct onvm_nf *source_nf) {
+        uint32_t held = 0;
         uint16_t i;
 
         if (tx_mgr == NULL)
-                return;
+                return 0;
 
         for (i = 0; i < MAX_NFS; i++)
-                onvm_pkt_flush_nf_queue(tx_mgr, i, source_nf);
+                held += onvm_pkt_flush_nf_queue(tx_mgr, i, source_nf);
+        return held;
 }
 
-void
+uint16_t
 onvm_pkt_flush_nf_queue(struct queue_mgr *tx_mgr, uint16_t nf_id, struct onvm_nf *source_nf) {
-        uint16_t i;
+        uint16_t i, sent, dropped;
+        unsigned int free_space;
         struct onvm_nf *nf;
         struct packet_buf *nf_buf;
+        struct rte_ring *rx_q;
+        uint8_t edge = 0;
 
         if (tx_mgr == NULL)
-                return;
+                return 0;
 
         nf_buf = &tx_mgr->nf_rx_bufs[nf_id];
         if (nf_buf->count == 0)
-                return;
+                return 0;
 
         nf = &nfs[nf_id];
 
-        // Ensure destination NF is running and ready to receive packets
-        if (!onvm_nf_is_valid(nf))
-                return;
-
-        if (rte_ring_enqueue_bulk(nf->rx_q, (void **)nf_buf->buffer, nf_buf->count, NULL) == 0) {
-                for (i = 0; i < nf_buf->count; i++) {
+        // Packets held for an NF that stopped would never leave the buffer
+        if (!onvm_nf_is_valid(nf)) {
+                for (i = 0; i < nf_buf->count; i++)
                         onvm_pkt_drop(nf_buf->buffer[i]);
-                }
-                nf->stats.rx_drop += nf_buf->count;
-                if (source_nf != NULL)
-                        source_nf->stats.tx_drop += nf_buf->count;
-        } else {
-                nf->stats.rx += nf_buf->count;
+                onvm_pkt_count_drop(source_nf, ONVM_DROP_NF_NOT_RUNNING, nf_buf->count);
+                nf_buf->count = 0;
+                nf_buf->held = 0;
+                return 0;
+        }
+
+        rx_q = nf->rx_q;
+        if (ONVM_NF_DIRECT_RINGS && tx_mgr->mgr_type_t == NF && source_nf != NULL) {
+                /* Full barrier, the manager must see the sequence odd before the ring pointer is read */
+                __atomic_fetch_add(&source_nf->edges.tx_seq, 1, __ATOMIC_SEQ_CST);
+                edge = 1;
+                if (likely(source_nf->edges.tx[nf_id] != NULL))
+                        rx_q = source_nf->edges.tx[nf_id];
+                else if (!source_nf->edges.requested[nf_id] && nf->edges.enabled)
+                        onvm_pkt_request_edge(source_nf, nf_id);
+        }
+
+        sent = rte_ring_enqueue_burst(rx_q, (void **)nf_buf->buffer, nf_buf->count, &free_space);
+        if (edge)
+                __atomic_fetch_add(&source_nf->edges.tx_seq, 1, __ATOMIC_RELEASE);
+        if (rx_q == nf->rx_q)
+                onvm_ring_hist_sample(nf->stats.rx_q_hist, rx_q, free_space);
+        if (onvm_config->congestion.action != ONVM_CONGESTION_OFF)
+                onvm_pkt_congestion_update(nf, rx_q, free_space);
+        nf->stats.rx += sent;
+        if (source_nf != NULL)
+                source_nf->stats.tx += sent;
+
+        dropped = onvm_pkt_buf_retain(nf_buf, sent, tx_mgr->mgr_type_t == NF);
+        if (unlikely(dropped > 0)) {
+                nf->stats.rx_drop += dropped;
+                onvm_drop_count(&nf->stats.drops, ONVM_DROP_RING_FULL, dropped);
                 if (source_nf != NULL)
-                        source_nf->stats.tx += nf_buf->count;
+                        source_nf->stats.tx_drop += dropped;
         }
-        nf_buf->count = 0;
+        return nf_buf->count;
 }
 
 void
 onvm_pkt_enqueue_nf(struct queue_mgr *tx_mgr, uint16_t dst_service_id, struct rte_mbuf *pkt,
                     struct onvm_nf *source_nf) {
-        struct onvm_nf *nf;
-        uint16_t dst_instance_id;
-        struct packet_buf *nf_buf;
-
         if (tx_mgr == NULL || pkt == NULL)
                 return;
 
-        // map service to instance and check one exists
-        dst_instance_id = onvm_sc_service_to_nf_map(dst_service_id, pkt);
-        if (dst_instance_id == 0) {
-                onvm_pkt_drop(pkt);
-                if (source_nf != NULL)
-                        source_nf->stats.tx_drop++;
-                return;
-        }
-
-        // Ensure destination NF is running and ready to receive packets
-        nf = &nfs[dst_instance_id];
-        if (!onvm_nf_is_valid(nf)) {
-                onvm_pkt_drop(pkt);
-                if (source_nf != NULL)
-                        source_nf->stats.tx_drop++;
-                return;
-        }
-
-        nf_buf = &tx_mgr->nf_rx_bufs[dst_instance_id];
-        nf_buf->buffer[nf_buf->count++] = pkt;
-        if (nf_buf->count == PACKET_READ_SIZE) {
-                onvm_pkt_flush_nf_queue(tx_mgr, dst_instance_id, source_nf);
-        }
+        // map service to instance
+        onvm_pkt_enqueue_instance(tx_mgr, onvm_pkt_service_to_instance(tx_mgr, dst_service_id, pkt), &pkt, 1,
+                                  source_nf);
 }
 
 void
@@ -223,44 +390,227 @@ onvm_pkt_flush_port_queue(struct queue_mgr *tx_mgr, uint16_t port) {
                 return;
 
         tx_stats = &(ports->tx_stats);
+        onvm_pkt_capture_batch(port_buf->buffer, port_buf->count, rte_lcore_id(), port, ONVM_CAPTURE_PORT_TX);
         sent = rte_eth_tx_burst(port, tx_mgr->id, port_buf->buffer, port_buf->count);
         if (unlikely(sent < port_buf->count)) {
                 for (i = sent; i < port_buf->count; i++) {
                         onvm_pkt_drop(port_buf->buffer[i]);
                 }
                 tx_stats->tx_drop[port] += (port_buf->count - sent);
+                onvm_drop_count(&ports->drop_stats, ONVM_DROP_TX_QUEUE_FULL, port_buf->count - sent);
         }
         tx_stats->tx[port] += sent;
 
         port_buf->count = 0;
 }
 
+void
+onvm_pkt_enqueue_parallel(struct queue_mgr *tx_mgr, struct onvm_service_chain *sc, uint16_t stage,
+                          struct rte_mbuf *pkt, struct onvm_nf *source_nf) {
+        struct onvm_pkt_meta *meta, *clone_meta;
+        struct onvm_pkt_join *join = NULL;
+        struct rte_mbuf *clone;
+        uint8_t i, branches;
+
+        if (tx_mgr == NULL || sc == NULL || pkt == NULL)
+                return;
+
+        meta = onvm_get_pkt_meta(pkt);
+        meta->chain_index = stage;
+        branches = sc->sc[stage].branches;
+
+        if (sc->sc[stage].join) {
+                if (pkt_join_pool == NULL || rte_mempool_get(pkt_join_pool, (void **)&join) != 0) {
+                        onvm_pkt_drop(pkt);
+                        onvm_pkt_count_drop(source_nf, ONVM_DROP_MBUF_ALLOC_FAIL, 1);
+                        return;
+                }
+                join->pkt = pkt;
+                rte_atomic16_set(&join->pending, branches);
+                rte_atomic16_set(&join->vetoed, 0);
+        }
+
+        /* Without a join the packet itself goes to the first branch, the others get clones */
+        for (i = (join != NULL) ? 0 : 1; i < branches; i++) {
+                clone = rte_pktmbuf_clone(pkt, pktmbuf_clone_pool);
+                if (unlikely(clone == NULL)) {
+                        onvm_pkt_count_drop(source_nf, ONVM_DROP_MBUF_ALLOC_FAIL, 1);
+                        /* A branch that never sees the packet can't approve it */
+                        if (join != NULL) {
+                                rte_atomic16_set(&join->vetoed, 1);
+                                onvm_pkt_join_put(join, NULL, NULL);
+                        }
+                        continue;
+                }
+                *onvm_pkt_join_slot(clone) = join;
+                clone_meta = onvm_get_pkt_meta(clone);
+                *clone_meta = *meta;
+                clone_meta->action = ONVM_NF_ACTION_TONF;
+                clone_meta->destination = sc->sc[stage + i].destination;
+                clone_meta->chain_index = stage + i;
+                onvm_pkt_enqueue_nf(tx_mgr, clone_meta->destination, clone, source_nf);
+        }
+
+        if (join == NULL) {
+                meta->action = ONVM_NF_ACTION_TONF;
+                meta->destination = sc->sc[stage].destination;
+                onvm_pkt_enqueue_nf(tx_mgr, meta->destination, pkt, source_nf);
+        }
+}
+
+void
+onvm_pkt_release(struct rte_mbuf *pkt) {
+        struct onvm_pkt_join *join;
+
+        if (pkt != NULL && unlikely(onvm_pkt_is_fanout_clone(pkt))) {
+                join = *onvm_pkt_join_slot(pkt);
+                if (join != NULL) {
+                        rte_atomic16_set(&join->vetoed, 1);
+                        rte_pktmbuf_free(pkt);
+                        onvm_pkt_join_put(join, NULL, NULL);
+                        return;
+                }
+        }
+        rte_pktmbuf_free(pkt);
+}
+
 void
 onvm_pkt_enqueue_tx_thread(struct packet_buf *pkt_buf, struct onvm_nf *nf) {
-        uint16_t i;
+        uint16_t sent, dropped;
+        unsigned int free_space;
 
         if (pkt_buf->count == 0)
                 return;
 
-        if (unlikely(pkt_buf->count > 0 &&
-                     rte_ring_enqueue_bulk(nf->tx_q, (void **)pkt_buf->buffer, pkt_buf->count, NULL) == 0)) {
-                nf->stats.tx_drop += pkt_buf->count;
-                for (i = 0; i < pkt_buf->count; i++) {
-                        rte_pktmbuf_free(pkt_buf->buffer[i]);
+        sent = rte_ring_enqueue_burst(nf->tx_q, (void **)pkt_buf->buffer, pkt_buf->count, &free_space);
+        onvm_ring_hist_sample(nf->stats.tx_q_hist, nf->tx_q, free_space);
+        nf->stats.tx += sent;
+
+        dropped = onvm_pkt_buf_retain(pkt_buf, sent, 1);
+        if (unlikely(dropped > 0)) {
+                nf->stats.tx_drop += dropped;
+                onvm_drop_count(&nf->stats.drops, ONVM_DROP_TX_QUEUE_FULL, dropped);
+        }
+}
+
+void
+onvm_pkt_congestion_recover(struct onvm_nf *nf) {
+        unsigned int low_pct;
+        uint16_t i;
+
+        if (!rte_atomic16_read(&nf->congested))
+                return;
+
+        low_pct = onvm_config->congestion.low_pct;
+        if (onvm_nf_is_valid(nf)) {
+                if (rte_ring_count(nf->rx_q) * 100 > rte_ring_get_capacity(nf->rx_q) * low_pct)
+                        return;
+                for (i = 0; i < nf->edges.rx_count; i++) {
+                        if (rte_ring_count(nf->edges.rx[i]) * 100 > rte_ring_get_capacity(nf->edges.rx[i]) * low_pct)
+                                return;
                 }
-        } else {
-                nf->stats.tx += pkt_buf->count;
         }
-        pkt_buf->count = 0;
+
+        /* The NF and the manager may both see it drained, only one of them updates the counts */
+        if (rte_atomic16_cmpset((volatile uint16_t *)&nf->congested.cnt, 1, 0)) {
+                rte_atomic16_dec(&congestion_info->congested_nfs[nf->service_id]);
+                rte_atomic16_dec(&congestion_info->congested_total);
+        }
+}
+
+int
+onvm_pkt_congestion_handle(struct onvm_service_chain *sc, uint16_t index, struct rte_mbuf *pkt,
+                           struct onvm_nf *source_nf) {
+        struct onvm_pkt_meta *meta;
+        uint16_t i, service, instances;
+        uint8_t congested = 0;
+
+        for (i = index; i <= sc->chain_length && !congested; i++) {
+                if (sc->sc[i].action != ONVM_NF_ACTION_TONF)
+                        break;
+                service = sc->sc[i].destination;
+                if (service >= MAX_SERVICES)
+                        continue;
+                /* Packets can still go to an instance with room in its ring */
+                instances = nf_per_service_count[service];
+                congested = instances > 0 && rte_atomic16_read(&congestion_info->congested_nfs[service]) >= instances;
+        }
+        if (!congested)
+                return 0;
+
+        meta = onvm_get_pkt_meta(pkt);
+        if (onvm_config->congestion.action == ONVM_CONGESTION_ECN) {
+                switch (onvm_pkt_set_ecn_ce(pkt)) {
+                        case 1:
+                                congestion_info->chains[meta->chain_id].ecn_marked++;
+                                return 0;
+                        case 0:
+                                return 0;
+                        default:
+                                /* Not ECN capable, the sender can only learn about the congestion from the drop */
+                                break;
+                }
+        }
+
+        congestion_info->chains[meta->chain_id].early_drop++;
+        onvm_pkt_drop(pkt);
+        onvm_pkt_count_drop(source_nf, ONVM_DROP_CONGESTION, 1);
+        return 1;
 }
 
 /****************************Internal functions*******************************/
 
+static struct rte_mbuf *
+onvm_pkt_unshare(struct rte_mbuf *pkt, uint16_t port) {
+        struct rte_mempool *pool;
+        struct rte_mbuf *copy;
+        const void *data;
+        void *dst;
+
+        if (likely(!ports->fast_free[port] || (RTE_MBUF_DIRECT(pkt) && rte_mbuf_refcnt_read(pkt) == 1)))
+                return pkt;
+
+        pool = RTE_MBUF_DIRECT(pkt) ? pkt->pool : rte_mbuf_from_indirect(pkt)->pool;
+        copy = rte_pktmbuf_alloc(pool);
+        if (unlikely(copy == NULL))
+                goto fail;
+        dst = rte_pktmbuf_append(copy, pkt->pkt_len);
+        if (unlikely(dst == NULL)) {
+                rte_pktmbuf_free(copy);
+                goto fail;
+        }
+        /* Contiguous data is read in place rather than copied to dst */
+        data = rte_pktmbuf_read(pkt, 0, pkt->pkt_len, dst);
+        if (data != dst)
+                memcpy(dst, data, pkt->pkt_len);
+        copy->ol_flags = pkt->ol_flags;
+        copy->tx_offload = pkt->tx_offload;
+        copy->packet_type = pkt->packet_type;
+        copy->hash = pkt->hash;
+        copy->udata64 = pkt->udata64;
+
+        /* Only this reference goes, the clones keep the data alive */
+        rte_pktmbuf_free(pkt);
+        return copy;
+
+fail:
+        rte_pktmbuf_free(pkt);
+        onvm_drop_count(&ports->drop_stats, ONVM_DROP_MBUF_ALLOC_FAIL, 1);
+        return NULL;
+}
+
 inline static void
 onvm_pkt_enqueue_port(struct queue_mgr *tx_mgr, uint16_t port, struct rte_mbuf *buf) {
         struct packet_buf *port_buf;
 
-        if (tx_mgr == NULL || buf == NULL || !ports->init[port])
+        if (tx_mgr == NULL || buf == NULL)
+                return;
+        if (unlikely(!ports->init[port])) {
+                onvm_pkt_drop(buf);
+                return;
+        }
+        buf = onvm_pkt_unshare(buf, port);
+        if (unlikely(buf == NULL))
                 return;
 
         port_buf = &tx_mgr->tx_thread_info->port_tx_bufs[port];
@@ -270,6 +620,133 @@ onvm_pkt_enqueue_port(struct queue_mgr *tx_mgr, uint16_t port, struct rte_mbuf *
         }
 }
 
+static void
+onvm_pkt_enqueue_port_bulk(struct queue_mgr *tx_mgr, struct rte_mbuf *pkts[], uint16_t count) {
+        struct packet_buf *port_buf;
+        uint16_t i, j, n, run, port;
+
+        for (i = 0, j = 0; i < count; i++) {
+                pkts[j] = onvm_pkt_unshare(pkts[i], onvm_get_pkt_meta(pkts[i])->destination);
+                j += pkts[j] != NULL;
+        }
+        count = j;
+
+        for (i = 0; i < count; i += run) {
+                port = onvm_get_pkt_meta(pkts[i])->destination;
+                for (run = 1; i + run < count && onvm_get_pkt_meta(pkts[i + run])->destination == port; run++)
+                        ;
+                if (unlikely(!ports->init[port])) {
+                        for (j = 0; j < run; j++)
+                                onvm_pkt_drop(pkts[i + j]);
+                        continue;
+                }
+
+                port_buf = &tx_mgr->tx_thread_info->port_tx_bufs[port];
+                for (j = 0; j < run; j += n) {
+                        n = RTE_MIN(run - j, PACKET_READ_SIZE - port_buf->count);
+                        memcpy(&port_buf->buffer[port_buf->count], &pkts[i + j], n * sizeof(struct rte_mbuf *));
+                        port_buf->count += n;
+                        if (port_buf->count == PACKET_READ_SIZE)
+                                onvm_pkt_flush_port_queue(tx_mgr, port);
+                }
+        }
+}
+
+static void
+onvm_pkt_enqueue_tx_buf_bulk(struct queue_mgr *tx_mgr, struct rte_mbuf *pkts[], uint16_t count, struct onvm_nf *nf) {
+        struct packet_buf *out_buf;
+        uint16_t i, n;
+
+        out_buf = tx_mgr->to_tx_buf;
+        for (i = 0; i < count; i += n) {
+                /* Still full of packets the tx ring didn't take, give it one more try */
+                if (unlikely(out_buf->count == PACKET_READ_SIZE))
+                        onvm_pkt_enqueue_tx_thread(out_buf, nf);
+                if (unlikely(out_buf->count == PACKET_READ_SIZE)) {
+                        nf->stats.tx_drop += count - i;
+                        onvm_drop_count(&nf->stats.drops, ONVM_DROP_TX_QUEUE_FULL, count - i);
+                        for (; i < count; i++)
+                                onvm_pkt_drop(pkts[i]);
+                        return;
+                }
+                n = RTE_MIN(count - i, PACKET_READ_SIZE - out_buf->count);
+                memcpy(&out_buf->buffer[out_buf->count], &pkts[i], n * sizeof(struct rte_mbuf *));
+                out_buf->count += n;
+                if (out_buf->count == PACKET_READ_SIZE)
+                        onvm_pkt_enqueue_tx_thread(out_buf, nf);
+        }
+}
+
+static void
+onvm_pkt_enqueue_nf_bulk(struct queue_mgr *tx_mgr, struct rte_mbuf *pkts[], uint16_t count,
+                         struct onvm_nf *source_nf) {
+        uint16_t dst_instance_ids[PACKET_READ_SIZE];
+        uint16_t i, run;
+
+        for (i = 0; i < count; i++)
+                dst_instance_ids[i] =
+                    onvm_pkt_service_to_instance(tx_mgr, onvm_get_pkt_meta(pkts[i])->destination, pkts[i]);
+
+        for (i = 0; i < count; i += run) {
+                for (run = 1; i + run < count && dst_instance_ids[i + run] == dst_instance_ids[i]; run++)
+                        ;
+                onvm_pkt_enqueue_instance(tx_mgr, dst_instance_ids[i], &pkts[i], run, source_nf);
+        }
+}
+
+static inline uint16_t
+onvm_pkt_service_to_instance(struct queue_mgr *tx_mgr, uint16_t service_id, struct rte_mbuf *pkt) {
+        if (tx_mgr->local_nfs != NULL && service_id < MAX_SERVICES && tx_mgr->local_nfs[service_id] != 0)
+                return tx_mgr->local_nfs[service_id];
+        return onvm_sc_service_to_nf_map(service_id, pkt);
+}
+
+static void
+onvm_pkt_enqueue_instance(struct queue_mgr *tx_mgr, uint16_t dst_instance_id, struct rte_mbuf *pkts[],
+                          uint16_t count, struct onvm_nf *source_nf) {
+        struct onvm_nf *nf;
+        struct packet_buf *nf_buf;
+        uint16_t i, n;
+
+        // check an instance exists
+        if (dst_instance_id == 0) {
+                for (i = 0; i < count; i++)
+                        onvm_pkt_drop(pkts[i]);
+                onvm_pkt_count_drop(source_nf, ONVM_DROP_NO_INSTANCE, count);
+                return;
+        }
+
+        // Ensure destination NF is running and ready to receive packets
+        nf = &nfs[dst_instance_id];
+        if (!onvm_nf_is_valid(nf)) {
+                for (i = 0; i < count; i++)
+                        onvm_pkt_drop(pkts[i]);
+                onvm_pkt_count_drop(source_nf, ONVM_DROP_NF_NOT_RUNNING, count);
+                return;
+        }
+
+        nf_buf = &tx_mgr->nf_rx_bufs[dst_instance_id];
+        for (i = 0; i < count; i += n) {
+                /* Still full of packets the ring didn't take, give it one more try before dropping */
+                if (unlikely(nf_buf->count == PACKET_READ_SIZE) &&
+                    onvm_pkt_flush_nf_queue(tx_mgr, dst_instance_id, source_nf) == PACKET_READ_SIZE) {
+                        nf->stats.rx_drop += count - i;
+                        onvm_drop_count(&nf->stats.drops, ONVM_DROP_RING_FULL, count - i);
+                        if (source_nf != NULL)
+                                source_nf->stats.tx_drop += count - i;
+                        for (; i < count; i++)
+                                onvm_pkt_drop(pkts[i]);
+                        return;
+                }
+                n = RTE_MIN(count - i, PACKET_READ_SIZE - nf_buf->count);
+                memcpy(&nf_buf->buffer[nf_buf->count], &pkts[i], n * sizeof(struct rte_mbuf *));
+                nf_buf->count += n;
+                /* A manager thread running the NF itself takes the full buffer without a ring in between */
+                if (nf_buf->count == PACKET_READ_SIZE && !(nf->flags.run_inline && tx_mgr->mgr_type_t == MGR))
+                        onvm_pkt_flush_nf_queue(tx_mgr, dst_instance_id, source_nf);
+        }
+}
+
 inline static void
 onvm_pkt_process_next_action(struct queue_mgr *tx_mgr, struct rte_mbuf *pkt, struct onvm_nf *nf) {
         if (tx_mgr == NULL || pkt == NULL || nf == NULL)
@@ -278,18 +755,33 @@ onvm_pkt_process_next_action(struct queue_mgr *tx_mgr, struct rte_mbuf *pkt, str
         struct onvm_flow_entry *flow_entry;
         struct onvm_service_chain *sc;
         struct onvm_pkt_meta *meta = onvm_get_pkt_meta(pkt);
+        uint16_t next_index;
         int ret;
 
-        ret = onvm_flow_dir_get_pkt(pkt, &flow_entry);
-        if (ret >= 0) {
-                sc = flow_entry->sc;
-                meta->action = onvm_sc_next_action(sc, pkt);
-                meta->destination = onvm_sc_next_destination(sc, pkt);
-        } else {
-                meta->action = onvm_sc_next_action(default_chain, pkt);
-                meta->destination = onvm_sc_next_destination(default_chain, pkt);
+        /* Mirrored copies from a parallel stage end at their branch */
+        if (unlikely(onvm_pkt_is_fanout_clone(pkt))) {
+                nf->stats.act_drop += onvm_pkt_drop(pkt);
+                return;
         }
 
+        sc = onvm_sc_lookup(meta->chain_id, NULL);
+        if (sc == NULL) {
+                /* Packet has no chain ID yet, resolve it through the flow director */
+                ret = onvm_flow_dir_get_pkt(pkt, &flow_entry);
+                if (ret >= 0) {
+                        meta->chain_id = flow_entry->sc->chain_id;
+                        sc = onvm_sc_lookup(meta->chain_id, flow_entry->sc);
+                } else {
+                        meta->chain_id = ONVM_SC_NO_ID;
+                        sc = default_chain;
+                }
+        }
+        meta->action = onvm_sc_next_action(sc, pkt);
+        meta->destination = onvm_sc_next_destination(sc, pkt);
+        /* Advance before handing the packet off, the next NF may already be reading it */
+        next_index = onvm_sc_next_index(sc, meta->chain_index);
+        meta->chain_index = next_index;
+
         switch (meta->action) {
                 case ONVM_NF_ACTION_DROP:
                         // if the packet is drop, then <return value> is 0
@@ -298,25 +790,127 @@ onvm_pkt_process_next_action(struct queue_mgr *tx_mgr, struct rte_mbuf *pkt, str
                         break;
                 case ONVM_NF_ACTION_TONF:
                         nf->stats.act_tonf++;
-                        onvm_pkt_enqueue_nf(tx_mgr, meta->destination, pkt, nf);
+                        if (unlikely(onvm_pkt_congestion_check(sc, next_index, pkt, nf)))
+                                break;
+                        if (unlikely(onvm_sc_is_parallel(sc, next_index)))
+                                onvm_pkt_enqueue_parallel(tx_mgr, sc, next_index, pkt, nf);
+                        else
+                                onvm_pkt_enqueue_nf(tx_mgr, meta->destination, pkt, nf);
                         break;
                 case ONVM_NF_ACTION_OUT:
                         nf->stats.act_out++;
                         onvm_pkt_enqueue_port(tx_mgr, meta->destination, pkt);
                         break;
                 default:
+                        onvm_drop_count(&nf->stats.drops, ONVM_DROP_INVALID_ACTION, 1);
+                        onvm_pkt_drop(pkt);
                         break;
         }
-        (meta->chain_index)++;
 }
 
 /*******************************Helper function*******************************/
 
 static int
 onvm_pkt_drop(struct rte_mbuf *pkt) {
-        rte_pktmbuf_free(pkt);
+        onvm_pkt_release(pkt);
         if (pkt != NULL) {
                 return 1;
         }
         return 0;
 }
+
+static inline void
+onvm_pkt_count_drop(struct onvm_nf *source_nf, enum onvm_drop_reason reason, uint16_t count) {
+        if (source_nf != NULL) {
+                source_nf->stats.tx_drop += count;
+                onvm_drop_count(&source_nf->stats.drops, reason, count);
+        } else {
+                onvm_drop_count(&ports->drop_stats, reason, count);
+        }
+}
+
+static uint16_t
+onvm_pkt_buf_retain(struct packet_buf *buf, uint16_t sent, uint8_t is_nf) {
+        uint16_t i, left;
+        uint8_t policy;
+
+        left = buf->count - sent;
+        if (likely(left == 0)) {
+                buf->count = 0;
+                buf->held = 0;
+                return 0;
+        }
+
+        policy = onvm_config->backpressure.policy;
+        /* Manager threads can't stop reading, they keep the hold budget */
+        if (policy == ONVM_BP_SIGNAL && !is_nf)
+                policy = ONVM_BP_HOLD;
+        if (policy == ONVM_BP_DROP_TAIL ||
+            (policy == ONVM_BP_HOLD && ++buf->held > onvm_config->backpressure.hold_budget)) {
+                for (i = sent; i < buf->count; i++)
+                        onvm_pkt_drop(buf->buffer[i]);
+                buf->count = 0;
+                buf->held = 0;
+                return left;
+        }
+
+        memmove(buf->buffer, &buf->buffer[sent], left * sizeof(struct rte_mbuf *));
+        buf->count = left;
+        return 0;
+}
+
+static void
+onvm_pkt_join_put(struct onvm_pkt_join *join, struct queue_mgr *tx_mgr, struct onvm_nf *nf) {
+        struct rte_mbuf *pkt;
+        int vetoed;
+
+        if (!rte_atomic16_dec_and_test(&join->pending))
+                return;
+
+        pkt = join->pkt;
+        vetoed = rte_atomic16_read(&join->vetoed);
+        rte_mempool_put(pkt_join_pool, join);
+
+        if (vetoed || tx_mgr == NULL || nf == NULL) {
+                if (nf != NULL)
+                        nf->stats.act_drop++;
+                rte_pktmbuf_free(pkt);
+                return;
+        }
+        onvm_pkt_process_next_action(tx_mgr, pkt, nf);
+}
+
+static void
+onvm_pkt_request_edge(struct onvm_nf *source_nf, uint16_t dst) {
+        static struct rte_ring *mgr_msg_queue;
+        static struct rte_mempool *nf_msg_pool;
+        struct onvm_nf_edge_request *req;
+        struct onvm_nf_msg *msg;
+
+        if (unlikely(mgr_msg_queue == NULL || nf_msg_pool == NULL)) {
+                mgr_msg_queue = rte_ring_lookup(_MGR_MSG_QUEUE_NAME);
+                nf_msg_pool = rte_mempool_lookup(_NF_MSG_POOL_NAME);
+                if (mgr_msg_queue == NULL || nf_msg_pool == NULL)
+                        return;
+        }
+
+        req = rte_malloc(NULL, sizeof(struct onvm_nf_edge_request), 0);
+        if (req == NULL)
+                return;
+        req->src = source_nf->instance_id;
+        req->dst = dst;
+
+        if (rte_mempool_get(nf_msg_pool, (void **)(&msg)) != 0) {
+                rte_free(req);
+                return;
+        }
+        msg->msg_type = MSG_REQUEST_EDGE;
+        msg->msg_data = req;
+
+        if (rte_ring_enqueue(mgr_msg_queue, msg) < 0) {
+                rte_mempool_put(nf_msg_pool, msg);
+                rte_free(req);
+                return;
+        }
+        source_nf->edges.requested[dst] = 1;
+}
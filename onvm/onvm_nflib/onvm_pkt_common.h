@@ -51,14 +51,67 @@
 #ifndef _ONVM_PKT_COMMON_H_
 #define _ONVM_PKT_COMMON_H_
 
+#include <rte_prefetch.h>
+
 #include "onvm_common.h"
 #include "onvm_flow_dir.h"
 #include "onvm_includes.h"
+#include "onvm_pkt_capture.h"
 #include "onvm_sc_common.h"
 #include "onvm_sc_mgr.h"
 
 extern struct port_info *ports;
+extern struct onvm_configuration *onvm_config;
+extern struct onvm_congestion_info *congestion_info;
 extern struct onvm_service_chain *default_chain;
+extern struct rte_mempool *pktmbuf_clone_pool;
+extern struct rte_mempool *pkt_join_pool;
+
+/* Parallel join a fan-out clone belongs to, stored in the clone's private area */
+static inline struct onvm_pkt_join **
+onvm_pkt_join_slot(struct rte_mbuf *clone) {
+        return (struct onvm_pkt_join **)rte_mbuf_to_priv(clone);
+}
+
+/* Returns 1 if the packet is a clone made for a parallel chain stage */
+static inline int
+onvm_pkt_is_fanout_clone(struct rte_mbuf *pkt) {
+        return pktmbuf_clone_pool != NULL && pkt->pool == pktmbuf_clone_pool;
+}
+
+/*
+ * Software pipelined prefetching for loops over a burst of packets. The mbuf
+ * of a packet has to be in cache before its data can be located, so mbufs are
+ * prefetched twice as far ahead as the first cache line of packet data.
+ */
+#define ONVM_PKT_PREFETCH_OFFSET 4
+
+/* Prefetch both cache lines of a packet's mbuf, the packet meta lives in the second one */
+static inline void
+onvm_pkt_prefetch_mbuf(struct rte_mbuf *pkt) {
+        rte_prefetch0(pkt);
+        rte_prefetch0(RTE_PTR_ADD(pkt, RTE_CACHE_LINE_SIZE));
+}
+
+/* Start the pipeline before the loop over pkts */
+static inline void
+onvm_pkt_prefetch_burst(struct rte_mbuf **pkts, uint16_t count) {
+        uint16_t i;
+
+        for (i = 0; i < count && i < 2 * ONVM_PKT_PREFETCH_OFFSET; i++)
+                onvm_pkt_prefetch_mbuf(pkts[i]);
+        for (i = 0; i < count && i < ONVM_PKT_PREFETCH_OFFSET; i++)
+                rte_prefetch0(rte_pktmbuf_mtod(pkts[i], void *));
+}
+
+/* Keep the pipeline going, called at the top of the loop for packet i of pkts */
+static inline void
+onvm_pkt_prefetch_ahead(struct rte_mbuf **pkts, uint16_t i, uint16_t count) {
+        if (i + 2 * ONVM_PKT_PREFETCH_OFFSET < count)
+                onvm_pkt_prefetch_mbuf(pkts[i + 2 * ONVM_PKT_PREFETCH_OFFSET]);
+        if (i + ONVM_PKT_PREFETCH_OFFSET < count)
+                rte_prefetch0(rte_pktmbuf_mtod(pkts[i + ONVM_PKT_PREFETCH_OFFSET], void *));
+}
 
 /*********************************Interfaces**********************************/
 
@@ -77,21 +130,25 @@ onvm_pkt_process_tx_batch(struct queue_mgr *tx_mgr, struct rte_mbuf *pkts[], uin
 /*
  * Interface to send packets to all NFs after processing them.
  *
- * Input : a pointer to the tx queue
- *         a pointer to the NF possessing the TX queue.
+ * Input  : a pointer to the tx queue
+ *          a pointer to the NF possessing the TX queue.
+ * Output : the number of packets the backpressure policy kept buffered
  *
  */
-void
+uint32_t
 onvm_pkt_flush_all_nfs(struct queue_mgr *tx_mgr, struct onvm_nf *source_nf);
 
 /*
  * Function to send packets to one NF after processing them.
+ * Packets the NF's ring doesn't take are dropped or kept for the
+ * next flush depending on the backpressure policy.
  *
- * Input : a pointer to the tx queue
- *         a pointer to the NF possessing the TX queue.
+ * Input  : a pointer to the tx queue
+ *          a pointer to the NF possessing the TX queue.
+ * Output : the number of packets kept buffered
  *
  */
-void
+uint16_t
 onvm_pkt_flush_nf_queue(struct queue_mgr *tx_mgr, uint16_t nf_id, struct onvm_nf *source_nf);
 
 /*
@@ -118,6 +175,8 @@ onvm_pkt_flush_port_queue(struct queue_mgr *tx_mgr, uint16_t port);
 
 /*
  * Give packets to TX thread so it can do useful work.
+ * Packets the tx ring doesn't take are dropped or left in pkt_buf
+ * depending on the backpressure policy.
  *
  * Inputs : a pointer to the packet buf
  *          a pointer to the NF
@@ -126,4 +185,85 @@ onvm_pkt_flush_port_queue(struct queue_mgr *tx_mgr, uint16_t port);
 void
 onvm_pkt_enqueue_tx_thread(struct packet_buf *pkt_buf, struct onvm_nf *nf);
 
+/*
+ * Send a packet to every branch of the parallel stage starting at chain index stage.
+ * Branches get indirect clones sharing the packet data; see onvm_sc_append_parallel_entry.
+ *
+ * Inputs : a pointer to the tx queue responsible
+ *          the service chain the packet follows
+ *          the index of the first entry of the stage
+ *          a pointer to the packet
+ *          a pointer to the NF possessing the TX queue, NULL for the manager
+ *
+ */
+void
+onvm_pkt_enqueue_parallel(struct queue_mgr *tx_mgr, struct onvm_service_chain *sc, uint16_t stage,
+                          struct rte_mbuf *pkt, struct onvm_nf *source_nf);
+
+/*
+ * Free a packet outside of the normal TX path. A parallel join clone freed this
+ * way counts as a branch dropping the packet, so the held packet is not leaked.
+ *
+ * Input : a pointer to the packet
+ *
+ */
+void
+onvm_pkt_release(struct rte_mbuf *pkt);
+
+/*
+ * Clear the congested flag of an NF once all of its rx rings drained below
+ * the low watermark, or right away if the NF is no longer running.
+ *
+ * Input : a pointer to the NF
+ *
+ */
+void
+onvm_pkt_congestion_recover(struct onvm_nf *nf);
+
+/*
+ * Slow path of onvm_pkt_congestion_check, walks the rest of the chain.
+ *
+ * Inputs : the service chain the packet follows
+ *          the chain index of the packet's next hop
+ *          a pointer to the packet
+ *          a pointer to the NF sending the packet, NULL for the manager
+ * Output : 1 if the packet was dropped, 0 if it should go on
+ *
+ */
+int
+onvm_pkt_congestion_handle(struct onvm_service_chain *sc, uint16_t index, struct rte_mbuf *pkt,
+                           struct onvm_nf *source_nf);
+
+/*
+ * Set the congested flag of an NF if the ring a burst was just enqueued on is
+ * filled past the high watermark, free_space is what the enqueue reported.
+ */
+static inline void
+onvm_pkt_congestion_update(struct onvm_nf *nf, const struct rte_ring *ring, unsigned int free_space) {
+        unsigned int capacity = rte_ring_get_capacity(ring);
+
+        if (likely((capacity - free_space) * 100 < capacity * onvm_config->congestion.high_pct))
+                return;
+        if (rte_atomic16_read(&nf->congested) || !rte_atomic16_test_and_set(&nf->congested))
+                return;
+        rte_atomic16_inc(&congestion_info->congested_nfs[nf->service_id]);
+        rte_atomic16_inc(&congestion_info->congested_total);
+}
+
+/*
+ * Drop or ECN mark a packet before it is sent further down its chain when one
+ * of the services it has yet to visit is congested. Nothing but a counter is
+ * read while no NF is congested.
+ *
+ * Output : 1 if the packet was dropped, 0 if it should go on
+ */
+static inline int
+onvm_pkt_congestion_check(struct onvm_service_chain *sc, uint16_t index, struct rte_mbuf *pkt,
+                          struct onvm_nf *source_nf) {
+        if (likely(onvm_config->congestion.action == ONVM_CONGESTION_OFF ||
+                   rte_atomic16_read(&congestion_info->congested_total) == 0))
+                return 0;
+        return onvm_pkt_congestion_handle(sc, index, pkt, source_nf);
+}
+
 #endif  // _ONVM_PKT_COMMON_H_
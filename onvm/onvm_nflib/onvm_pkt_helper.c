@@ -56,6 +56,9 @@
 #include <rte_memcpy.h>
 #include <rte_mempool.h>
 
+/* Marks the offload flags of a port as looked up, above the SUPPORTS_* bits */
+#define CHECKSUM_OFFLOAD_CACHED (1U << 31)
+
 int
 onvm_pkt_set_mac_addr(struct rte_mbuf* pkt, unsigned src_port_id, unsigned dst_port_id, struct port_info* ports) {
         struct rte_ether_hdr* eth;
@@ -195,6 +198,19 @@ onvm_pkt_ipv4_hdr(struct rte_mbuf* pkt) {
         return ipv4;
 }
 
+struct rte_ipv6_hdr*
+onvm_pkt_ipv6_hdr(struct rte_mbuf* pkt) {
+        struct rte_ether_hdr* eth = rte_pktmbuf_mtod(pkt, struct rte_ether_hdr*);
+        struct rte_ipv6_hdr* ipv6 = (struct rte_ipv6_hdr*)(eth + 1);
+
+        /* The version is the top 4 bits of vtc_flow, which also holds the traffic class and flow label */
+        if (eth->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV6) ||
+            unlikely((rte_be_to_cpu_32(ipv6->vtc_flow) >> 28) != 6)) {
+                return NULL;
+        }
+        return ipv6;
+}
+
 int
 onvm_pkt_is_tcp(struct rte_mbuf* pkt) {
         return onvm_pkt_tcp_hdr(pkt) != NULL;
@@ -210,6 +226,11 @@ onvm_pkt_is_ipv4(struct rte_mbuf* pkt) {
         return onvm_pkt_ipv4_hdr(pkt) != NULL;
 }
 
+int
+onvm_pkt_is_ipv6(struct rte_mbuf* pkt) {
+        return onvm_pkt_ipv6_hdr(pkt) != NULL;
+}
+
 void
 onvm_pkt_print(struct rte_mbuf* pkt) {
         struct rte_ipv4_hdr* ipv4 = onvm_pkt_ipv4_hdr(pkt);
@@ -422,6 +443,21 @@ onvm_pkt_get_checksum_offload_flags(uint8_t port_id) {
         return hw_offload_flags;
 }
 
+/*
+ * Port capabilities do not change at runtime, so the offload flags are only
+ * queried from the device once per port
+ */
+static uint32_t
+onvm_pkt_cached_checksum_offload_flags(uint16_t port_id) {
+        static uint32_t offload_flags[RTE_MAX_ETHPORTS];
+
+        if (unlikely(port_id >= RTE_MAX_ETHPORTS))
+                return 0;
+        if (unlikely(!(offload_flags[port_id] & CHECKSUM_OFFLOAD_CACHED)))
+                offload_flags[port_id] = onvm_pkt_get_checksum_offload_flags(port_id) | CHECKSUM_OFFLOAD_CACHED;
+        return offload_flags[port_id];
+}
+
 /**
  * Calculates TCP or UDP checksum.
  * This is the same implementation as rte_ipv4_udptcp_cksum(),
@@ -430,7 +466,7 @@ onvm_pkt_get_checksum_offload_flags(uint8_t port_id) {
 static uint16_t
 calculate_tcpudp_cksum(const struct rte_ipv4_hdr* ip, const void* l4_hdr, const uint32_t l3_len, uint8_t protocol) {
         uint32_t cksum = 0;
-        uint32_t l4_len = ip->total_length - l3_len;
+        uint32_t l4_len = rte_be_to_cpu_16(ip->total_length) - l3_len;
 
         /* pseudo header checksum */
         struct {
@@ -445,7 +481,7 @@ calculate_tcpudp_cksum(const struct rte_ipv4_hdr* ip, const void* l4_hdr, const
         ph.daddr = ip->dst_addr;
         ph.reserved = 0;
         ph.protocol = protocol;
-        ph.total_length = (uint16_t)l4_len;
+        ph.total_length = rte_cpu_to_be_16((uint16_t)l4_len);
 
         cksum += rte_raw_cksum(&ph, sizeof(ph));
 
@@ -455,7 +491,9 @@ calculate_tcpudp_cksum(const struct rte_ipv4_hdr* ip, const void* l4_hdr, const
         while (cksum & 0xffff0000) {
                 cksum = ((cksum & 0xffff0000) >> 16) + (cksum & 0xffff);
         }
-        return ~cksum;
+        cksum = (~cksum) & 0xffff;
+        /* A zero UDP checksum means none was computed, both forms are the same sum */
+        return cksum == 0 ? 0xffff : cksum;
 }
 
 /**
@@ -469,9 +507,8 @@ calculate_ip_cksum(const struct rte_ipv4_hdr* ip, const uint32_t l3_len) {
         return (cksum == 0xffff) ? cksum : ~cksum;
 }
 
-void
-onvm_pkt_set_checksums(struct rte_mbuf* pkt) {
-        uint32_t hw_cksum_support = onvm_pkt_get_checksum_offload_flags(pkt->port);
+static void
+onvm_pkt_set_checksums_flags(struct rte_mbuf* pkt, uint32_t hw_cksum_support) {
         struct rte_ipv4_hdr* ip = onvm_pkt_ipv4_hdr(pkt);
         struct rte_tcp_hdr* tcp = onvm_pkt_tcp_hdr(pkt);
         struct rte_udp_hdr* udp = onvm_pkt_udp_hdr(pkt);
@@ -484,7 +521,7 @@ onvm_pkt_set_checksums(struct rte_mbuf* pkt) {
 
                 if (tcp != NULL) {
                         tcp->cksum = 0;
-                        pkt->l4_len = (tcp->data_off >> 4) & 0b1111;
+                        pkt->l4_len = ((tcp->data_off >> 4) & 0b1111) * 4;
 
                         if (hw_cksum_support & SUPPORTS_TCP_CHECKSUM_OFFLOAD) {
                                 tcp->cksum = rte_ipv4_phdr_cksum(ip, pkt->ol_flags);
@@ -517,6 +554,171 @@ onvm_pkt_set_checksums(struct rte_mbuf* pkt) {
         }
 }
 
+void
+onvm_pkt_set_checksums(struct rte_mbuf* pkt) {
+        onvm_pkt_set_checksums_flags(pkt, onvm_pkt_cached_checksum_offload_flags(pkt->port));
+}
+
+void
+onvm_pkt_set_checksums_burst(struct rte_mbuf** pkts, uint16_t count) {
+        uint32_t hw_cksum_support = 0;
+        uint16_t port = RTE_MAX_ETHPORTS;
+        uint16_t i;
+
+        for (i = 0; i < count; i++) {
+                /* Bursts mostly come from one port, only look the flags up again when it changes */
+                if (pkts[i]->port != port) {
+                        port = pkts[i]->port;
+                        hw_cksum_support = onvm_pkt_cached_checksum_offload_flags(port);
+                }
+                onvm_pkt_set_checksums_flags(pkts[i], hw_cksum_support);
+        }
+}
+
+/*
+ * Returns the TCP or UDP checksum field that has to follow a rewrite, NULL if
+ * there is none. A UDP checksum of 0 means the sender did not compute one.
+ */
+static uint16_t*
+onvm_pkt_l4_cksum(struct rte_mbuf* pkt) {
+        struct rte_tcp_hdr* tcp;
+        struct rte_udp_hdr* udp;
+
+        if ((tcp = onvm_pkt_tcp_hdr(pkt)) != NULL)
+                return &tcp->cksum;
+        if ((udp = onvm_pkt_udp_hdr(pkt)) != NULL && udp->dgram_cksum != 0)
+                return &udp->dgram_cksum;
+        return NULL;
+}
+
+static void
+onvm_pkt_set_ipv4_addr(struct rte_mbuf* pkt, struct rte_ipv4_hdr* ip, uint32_t* field, uint32_t addr) {
+        uint16_t* l4_cksum = onvm_pkt_l4_cksum(pkt);
+
+        if (!(pkt->ol_flags & PKT_TX_IP_CKSUM))
+                ip->hdr_checksum = onvm_pkt_cksum_update32(ip->hdr_checksum, *field, addr);
+        if (l4_cksum != NULL) {
+                if (pkt->ol_flags & PKT_TX_L4_MASK) {
+                        /* With L4 offload the field holds the uncomplemented pseudo header sum */
+                        *l4_cksum = ~onvm_pkt_cksum_update32(~*l4_cksum, *field, addr);
+                } else {
+                        *l4_cksum = onvm_pkt_cksum_update32(*l4_cksum, *field, addr);
+                        if (*l4_cksum == 0)
+                                *l4_cksum = 0xffff;
+                }
+        }
+        *field = addr;
+}
+
+void
+onvm_pkt_set_ipv4_src(struct rte_mbuf* pkt, uint32_t addr) {
+        struct rte_ipv4_hdr* ip = onvm_pkt_ipv4_hdr(pkt);
+
+        if (ip != NULL)
+                onvm_pkt_set_ipv4_addr(pkt, ip, &ip->src_addr, addr);
+}
+
+void
+onvm_pkt_set_ipv4_dst(struct rte_mbuf* pkt, uint32_t addr) {
+        struct rte_ipv4_hdr* ip = onvm_pkt_ipv4_hdr(pkt);
+
+        if (ip != NULL)
+                onvm_pkt_set_ipv4_addr(pkt, ip, &ip->dst_addr, addr);
+}
+
+static int
+onvm_pkt_set_port(struct rte_mbuf* pkt, int dst, uint16_t port) {
+        struct rte_tcp_hdr* tcp;
+        struct rte_udp_hdr* udp;
+        uint16_t* l4_cksum;
+        uint16_t* field;
+
+        if ((tcp = onvm_pkt_tcp_hdr(pkt)) != NULL) {
+                field = dst ? &tcp->dst_port : &tcp->src_port;
+        } else if ((udp = onvm_pkt_udp_hdr(pkt)) != NULL) {
+                field = dst ? &udp->dst_port : &udp->src_port;
+        } else {
+                return -1;
+        }
+
+        /* Ports are not part of the pseudo header, an offloaded checksum needs no update */
+        l4_cksum = onvm_pkt_l4_cksum(pkt);
+        if (l4_cksum != NULL && !(pkt->ol_flags & PKT_TX_L4_MASK)) {
+                *l4_cksum = onvm_pkt_cksum_update16(*l4_cksum, *field, port);
+                if (*l4_cksum == 0)
+                        *l4_cksum = 0xffff;
+        }
+        *field = port;
+        return 0;
+}
+
+int
+onvm_pkt_set_src_port(struct rte_mbuf* pkt, uint16_t port) {
+        return onvm_pkt_set_port(pkt, 0, port);
+}
+
+int
+onvm_pkt_set_dst_port(struct rte_mbuf* pkt, uint16_t port) {
+        return onvm_pkt_set_port(pkt, 1, port);
+}
+
+int
+onvm_pkt_set_ttl(struct rte_mbuf* pkt, uint8_t ttl) {
+        struct rte_ipv4_hdr* ip = onvm_pkt_ipv4_hdr(pkt);
+        uint16_t old_word, new_word;
+
+        if (ip == NULL)
+                return -1;
+
+        /* The TTL shares its 16 bit word with the protocol */
+        if (!(pkt->ol_flags & PKT_TX_IP_CKSUM)) {
+                old_word = rte_cpu_to_be_16((ip->time_to_live << 8) | ip->next_proto_id);
+                new_word = rte_cpu_to_be_16((ttl << 8) | ip->next_proto_id);
+                ip->hdr_checksum = onvm_pkt_cksum_update16(ip->hdr_checksum, old_word, new_word);
+        }
+        ip->time_to_live = ttl;
+        return 0;
+}
+
+int
+onvm_pkt_set_ecn_ce(struct rte_mbuf* pkt) {
+        struct rte_ipv4_hdr* ipv4;
+        struct rte_ipv6_hdr* ipv6;
+        uint16_t old_word, new_word;
+        uint32_t vtc_flow;
+        uint8_t ecn;
+
+        ipv4 = onvm_pkt_ipv4_hdr(pkt);
+        if (ipv4 != NULL) {
+                ecn = ipv4->type_of_service & ONVM_ECN_MASK;
+                if (ecn == ONVM_ECN_NOT_ECT)
+                        return -1;
+                if (ecn == ONVM_ECN_CE)
+                        return 0;
+                /* The TOS shares its 16 bit word with version_ihl */
+                if (!(pkt->ol_flags & PKT_TX_IP_CKSUM)) {
+                        old_word = rte_cpu_to_be_16((ipv4->version_ihl << 8) | ipv4->type_of_service);
+                        new_word = rte_cpu_to_be_16((ipv4->version_ihl << 8) | ipv4->type_of_service | ONVM_ECN_CE);
+                        ipv4->hdr_checksum = onvm_pkt_cksum_update16(ipv4->hdr_checksum, old_word, new_word);
+                }
+                ipv4->type_of_service |= ONVM_ECN_CE;
+                return 1;
+        }
+
+        ipv6 = onvm_pkt_ipv6_hdr(pkt);
+        if (ipv6 == NULL)
+                return -1;
+        /* The traffic class sits between the version and the 20 bit flow label, IPv6 has no header checksum */
+        vtc_flow = rte_be_to_cpu_32(ipv6->vtc_flow);
+        ecn = (vtc_flow >> 20) & ONVM_ECN_MASK;
+        if (ecn == ONVM_ECN_NOT_ECT)
+                return -1;
+        if (ecn == ONVM_ECN_CE)
+                return 0;
+        ipv6->vtc_flow = rte_cpu_to_be_32(vtc_flow | (ONVM_ECN_CE << 20));
+        return 1;
+}
+
 int
 onvm_pkt_swap_ether_hdr(struct rte_ether_hdr* ether_hdr) {
         int i;
@@ -50,10 +50,16 @@ struct rte_mbuf;
 struct rte_tcp_hdr;
 struct rte_udp_hdr;
 struct rte_ipv4_hdr;
+struct rte_ipv6_hdr;
 
 #define IP_PROTOCOL_TCP 6
 #define IP_PROTOCOL_UDP 17
 
+/* ECN codepoints, the bottom 2 bits of the IPv4 TOS or IPv6 traffic class (RFC 3168) */
+#define ONVM_ECN_MASK 0x3
+#define ONVM_ECN_NOT_ECT 0x0
+#define ONVM_ECN_CE 0x3
+
 #define SUPPORTS_IPV4_CHECKSUM_OFFLOAD (1 << 0)
 #define SUPPORTS_TCP_CHECKSUM_OFFLOAD (1 << 1)
 #define SUPPORTS_UDP_CHECKSUM_OFFLOAD (1 << 2)
@@ -114,6 +120,9 @@ onvm_pkt_udp_hdr(struct rte_mbuf* pkt);
 struct rte_ipv4_hdr*
 onvm_pkt_ipv4_hdr(struct rte_mbuf* pkt);
 
+struct rte_ipv6_hdr*
+onvm_pkt_ipv6_hdr(struct rte_mbuf* pkt);
+
 /**
  * Check the type of a packet. Return 1 if packet is of the specified type, else 0
  */
@@ -126,6 +135,9 @@ onvm_pkt_is_udp(struct rte_mbuf* pkt);
 int
 onvm_pkt_is_ipv4(struct rte_mbuf* pkt);
 
+int
+onvm_pkt_is_ipv6(struct rte_mbuf* pkt);
+
 /**
  * Print out a packet or header.  Check to be sure DPDK doesn't already do any of these
  */
@@ -174,6 +186,71 @@ onvm_pkt_get_checksum_offload_flags(uint8_t port_id);
 void
 onvm_pkt_set_checksums(struct rte_mbuf* pkt);
 
+/**
+ * Set the checksums of a burst of packets. The offload flags of each port are
+ * looked up once, checksums the port can offload get PKT_TX_*_CKSUM and the
+ * rest are computed in software.
+ */
+void
+onvm_pkt_set_checksums_burst(struct rte_mbuf** pkts, uint16_t count);
+
+/**
+ * Incremental checksum update (RFC 1624 eqn. 3) for a 16 bit word of the
+ * checksummed data changing from old_val to new_val. The one's complement sum
+ * does not depend on byte order, so all values are taken as they are in the header.
+ */
+static inline uint16_t
+onvm_pkt_cksum_update16(uint16_t cksum, uint16_t old_val, uint16_t new_val) {
+        uint32_t sum;
+
+        sum = (uint16_t)~cksum + (uint16_t)~old_val + new_val;
+        sum = (sum & 0xffff) + (sum >> 16);
+        sum = (sum & 0xffff) + (sum >> 16);
+        return (uint16_t)~sum;
+}
+
+/**
+ * Incremental checksum update for a 32 bit field, e.g. an IPv4 address
+ */
+static inline uint16_t
+onvm_pkt_cksum_update32(uint16_t cksum, uint32_t old_val, uint32_t new_val) {
+        cksum = onvm_pkt_cksum_update16(cksum, old_val >> 16, new_val >> 16);
+        return onvm_pkt_cksum_update16(cksum, old_val & 0xffff, new_val & 0xffff);
+}
+
+/**
+ * Rewrite the IPv4 source or destination address (network byte order) of a
+ * packet with valid checksums, patching the IP and TCP/UDP checksums
+ */
+void
+onvm_pkt_set_ipv4_src(struct rte_mbuf* pkt, uint32_t addr);
+
+void
+onvm_pkt_set_ipv4_dst(struct rte_mbuf* pkt, uint32_t addr);
+
+/**
+ * Rewrite the TCP/UDP source or destination port (network byte order),
+ * patching the L4 checksum. Returns -1 if the packet is not TCP or UDP.
+ */
+int
+onvm_pkt_set_src_port(struct rte_mbuf* pkt, uint16_t port);
+
+int
+onvm_pkt_set_dst_port(struct rte_mbuf* pkt, uint16_t port);
+
+/**
+ * Set the IPv4 TTL, patching the IP checksum. Returns -1 if the packet is not IPv4.
+ */
+int
+onvm_pkt_set_ttl(struct rte_mbuf* pkt, uint8_t ttl);
+
+/**
+ * Mark an ECN capable IPv4 or IPv6 packet Congestion Experienced, patching the IPv4 checksum.
+ * Returns 1 if the packet was marked, 0 if it already was and -1 if it is not ECN capable.
+ */
+int
+onvm_pkt_set_ecn_ce(struct rte_mbuf* pkt);
+
 /**
  * Fill the packet UDP header
  */
@@ -69,7 +69,7 @@ int
 onvm_sc_append_entry(struct onvm_service_chain *chain, uint8_t action, uint16_t destination) {
         int chain_length = chain->chain_length;
 
-        if (unlikely(chain_length > ONVM_MAX_CHAIN_LENGTH)) {
+        if (unlikely(chain_length >= chain->max_length)) {
                 return ENOSPC;
         }
         /*the first entry is reserved*/
@@ -81,6 +81,32 @@ onvm_sc_append_entry(struct onvm_service_chain *chain, uint8_t action, uint16_t
         return 0;
 }
 
+int
+onvm_sc_append_parallel_entry(struct onvm_service_chain *chain, uint16_t *destinations, uint8_t count, uint8_t join) {
+        int first, i;
+
+        if (unlikely(count == 0 || destinations == NULL)) {
+                return EINVAL;
+        }
+        if (unlikely(chain->chain_length + count > chain->max_length)) {
+                return ENOSPC;
+        }
+
+        /*the first entry is reserved*/
+        first = chain->chain_length + 1;
+        for (i = 0; i < count; i++) {
+                chain->sc[first + i].action = ONVM_NF_ACTION_TONF;
+                chain->sc[first + i].destination = destinations[i];
+                chain->sc[first + i].branches = 0;
+                chain->sc[first + i].join = 0;
+        }
+        chain->sc[first].branches = count;
+        chain->sc[first].join = join;
+        chain->chain_length += count;
+
+        return 0;
+}
+
 int
 onvm_sc_set_entry(struct onvm_service_chain *chain, int entry, uint8_t action, uint16_t destination) {
         if (unlikely(entry > chain->chain_length)) {
@@ -95,9 +121,14 @@ onvm_sc_set_entry(struct onvm_service_chain *chain, int entry, uint8_t action, u
 void
 onvm_sc_print(struct onvm_service_chain *chain) {
         int i;
+        printf("chain_id:%" PRIu8 ", chain_length:%" PRIu8 "\n", chain->chain_id, chain->chain_length);
         for (i = 1; i <= chain->chain_length; i++) {
-                printf("cur_index:%d, action:%" PRIu8 ", destination:%" PRIu16 "\n", i, chain->sc[i].action,
+                printf("cur_index:%d, action:%" PRIu8 ", destination:%" PRIu16, i, chain->sc[i].action,
                        chain->sc[i].destination);
+                if (chain->sc[i].branches > 1)
+                        printf(", parallel branches:%" PRIu8 "%s", chain->sc[i].branches,
+                               chain->sc[i].join ? " (join)" : "");
+                printf("\n");
         }
         printf("\n");
 }
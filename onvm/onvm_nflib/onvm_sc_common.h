@@ -49,6 +49,10 @@
 extern struct onvm_nf *nfs;
 extern uint16_t **services;
 extern uint16_t *nf_per_service_count;
+extern struct onvm_service_chain **sc_table;
+
+/* Chain ID carried by packets whose chain must be resolved through the flow director */
+#define ONVM_SC_NO_ID 0
 
 /********************************Interfaces***********************************/
 /* Returns the instance ID associated with the given service ID and packet.
@@ -58,10 +62,19 @@ uint16_t
 onvm_sc_service_to_nf_map(uint16_t service_id,
                           struct rte_mbuf *pkt);
 
-/* append a entry to serivce chain, 0 means appending successful, 1 means failed*/
+/* append a entry to serivce chain, 0 means appending successful, ENOSPC means the chain is full */
 int
 onvm_sc_append_entry(struct onvm_service_chain *chain, uint8_t action, uint16_t destination);
 
+/*
+ * append a parallel stage sending the packet to count services at once, 0 means appending successful, ENOSPC means
+ * the chain is full and EINVAL means count is 0. Without join the packet continues with destinations[0] and the
+ * others get read-only clones; with join all services get clones and the packet continues along the chain only
+ * once none of them dropped it.
+ */
+int
+onvm_sc_append_parallel_entry(struct onvm_service_chain *chain, uint16_t *destinations, uint8_t count, uint8_t join);
+
 /*set entry to a new action and destination, 0 means setting successful, 1 means failed */
 int
 onvm_sc_set_entry(struct onvm_service_chain *chain, int entry, uint8_t action, uint16_t destination);
@@ -39,12 +39,30 @@
  ********************************************************************/
 
 #include "onvm_sc_mgr.h"
+#include <rte_atomic.h>
 #include <rte_common.h>
+#include <rte_cycles.h>
 #include <rte_debug.h>
 #include <rte_malloc.h>
 #include <rte_memory.h>
+#include <rte_spinlock.h>
 #include "onvm_sc_common.h"
 
+/* Chains taken out of use in this process, waiting out the grace period before they are freed */
+static struct {
+        struct onvm_service_chain* chain;
+        uint64_t tsc;
+} sc_retired[ONVM_SC_RETIRED_MAX];
+static unsigned sc_num_retired;
+static rte_spinlock_t sc_retired_lock = RTE_SPINLOCK_INITIALIZER;
+
+/*
+ * Free a chain once the packets that may be reading it are gone. A packet only holds on to a chain
+ * while a thread works on its burst, so ONVM_SC_RETIRE_GRACE_MS after it left the table nobody does.
+ */
+static void
+onvm_sc_retire(struct onvm_service_chain* chain);
+
 struct onvm_service_chain*
 onvm_sc_get(void) {
         return NULL;
@@ -52,12 +70,117 @@ onvm_sc_get(void) {
 
 struct onvm_service_chain*
 onvm_sc_create(void) {
+        return onvm_sc_create_with_length(ONVM_MAX_CHAIN_LENGTH);
+}
+
+struct onvm_service_chain*
+onvm_sc_create_with_length(uint8_t max_length) {
         struct onvm_service_chain* chain;
+        uint16_t i;
 
-        chain = rte_calloc("ONVM_sercice_chain", 1, sizeof(struct onvm_service_chain), 0);
+        if (max_length > ONVM_MAX_CHAIN_LENGTH)
+                max_length = ONVM_MAX_CHAIN_LENGTH;
+
+        /* Entry 0 is reserved, so allocate one more than the chain can hold */
+        chain = rte_calloc("ONVM_sercice_chain", 1, sizeof(struct onvm_service_chain) +
+                           (max_length + 1) * sizeof(struct onvm_service_chain_entry), 0);
         if (chain == NULL) {
                 rte_exit(EXIT_FAILURE, "Cannot allocate memory for service chain\n");
         }
+        chain->max_length = max_length;
+        chain->chain_id = ONVM_SC_NO_ID;
 
+        /* Claim a free slot in the shared table, other processes may be racing for the same one */
+        if (sc_table == NULL)
+                return chain;
+        for (i = ONVM_SC_NO_ID + 1; i < ONVM_MAX_CHAINS; i++) {
+                if (sc_table[i] != NULL)
+                        continue;
+                chain->chain_id = i;
+                rte_wmb();
+                if (rte_atomic64_cmpset((volatile uint64_t *)&sc_table[i], (uint64_t)(uintptr_t)NULL,
+                                        (uint64_t)(uintptr_t)chain))
+                        return chain;
+        }
+
+        /* Table is full, packets will resolve this chain through the flow director instead */
+        chain->chain_id = ONVM_SC_NO_ID;
         return chain;
 }
+
+void
+onvm_sc_free(struct onvm_service_chain* chain) {
+        struct onvm_service_chain* cur_chain;
+
+        if (chain == NULL)
+                return;
+
+        /* The chain owns its ID, a version onvm_sc_update installed under it goes with the slot */
+        if (chain->chain_id != ONVM_SC_NO_ID && sc_table != NULL) {
+                do {
+                        cur_chain = sc_table[chain->chain_id];
+                } while (!rte_atomic64_cmpset((volatile uint64_t *)&sc_table[chain->chain_id],
+                                              (uint64_t)(uintptr_t)cur_chain, (uint64_t)(uintptr_t)NULL));
+                if (cur_chain != NULL && cur_chain != chain)
+                        onvm_sc_retire(cur_chain);
+        }
+        onvm_sc_retire(chain);
+}
+
+int
+onvm_sc_update(struct onvm_service_chain* chain, struct onvm_service_chain* new_chain) {
+        struct onvm_service_chain* cur_chain;
+        uint8_t chain_id;
+
+        if (chain == NULL || new_chain == NULL || new_chain == chain || sc_table == NULL ||
+            chain->chain_id == ONVM_SC_NO_ID)
+                return -1;
+
+        chain_id = chain->chain_id;
+
+        /* new_chain may have been registered under its own ID, give that slot back */
+        if (new_chain->chain_id != ONVM_SC_NO_ID && new_chain->chain_id != chain_id) {
+                rte_atomic64_cmpset((volatile uint64_t *)&sc_table[new_chain->chain_id],
+                                    (uint64_t)(uintptr_t)new_chain, (uint64_t)(uintptr_t)NULL);
+        }
+        new_chain->chain_id = chain_id;
+        rte_wmb();
+
+        do {
+                cur_chain = sc_table[chain_id];
+        } while (!rte_atomic64_cmpset((volatile uint64_t *)&sc_table[chain_id], (uint64_t)(uintptr_t)cur_chain,
+                                      (uint64_t)(uintptr_t)new_chain));
+
+        /* Flow entries still point at chain itself, only a version installed by an earlier update is retired */
+        if (cur_chain != NULL && cur_chain != chain)
+                onvm_sc_retire(cur_chain);
+        return 0;
+}
+
+static void
+onvm_sc_retire(struct onvm_service_chain* chain) {
+        uint64_t grace, now;
+        unsigned i, kept;
+
+        grace = rte_get_tsc_hz() * ONVM_SC_RETIRE_GRACE_MS / 1000;
+
+        rte_spinlock_lock(&sc_retired_lock);
+        /* Out of room, wait for the oldest one to be safe rather than free it under a reader */
+        if (sc_num_retired == ONVM_SC_RETIRED_MAX) {
+                now = rte_get_tsc_cycles();
+                if (now - sc_retired[0].tsc < grace)
+                        rte_delay_us_block((grace - (now - sc_retired[0].tsc)) * 1000000 / rte_get_tsc_hz() + 1);
+        }
+
+        now = rte_get_tsc_cycles();
+        for (i = 0, kept = 0; i < sc_num_retired; i++) {
+                if (now - sc_retired[i].tsc >= grace)
+                        rte_free(sc_retired[i].chain);
+                else
+                        sc_retired[kept++] = sc_retired[i];
+        }
+        sc_retired[kept].chain = chain;
+        sc_retired[kept].tsc = now;
+        sc_num_retired = kept + 1;
+        rte_spinlock_unlock(&sc_retired_lock);
+}
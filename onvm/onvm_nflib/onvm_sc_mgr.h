@@ -43,13 +43,39 @@
 
 #include <rte_mbuf.h>
 #include "onvm_common.h"
+#include "onvm_sc_common.h"
+
+/* Freed chains stay allocated this long, packets already past the chain table may still read them */
+#define ONVM_SC_RETIRE_GRACE_MS 100
+/* Freed chains a process keeps waiting out the grace period at once */
+#define ONVM_SC_RETIRED_MAX 64
+
+/* Returns the index of the step after cur_nf, skipping the other branches of a parallel stage */
+static inline uint16_t
+onvm_sc_next_index(struct onvm_service_chain* chain, uint16_t cur_nf) {
+        uint8_t branches;
+
+        if (unlikely(cur_nf >= chain->chain_length)) {
+                return cur_nf + 1;
+        }
+        branches = chain->sc[cur_nf].branches;
+        return cur_nf + (branches > 1 ? branches : 1);
+}
+
+/* Returns 1 if the step at index is the start of a parallel stage */
+static inline int
+onvm_sc_is_parallel(struct onvm_service_chain* chain, uint16_t index) {
+        return index <= chain->chain_length && chain->sc[index].branches > 1;
+}
 
 static inline uint8_t
 onvm_next_action(struct onvm_service_chain* chain, uint16_t cur_nf) {
-        if (unlikely(cur_nf >= chain->chain_length)) {
+        uint16_t next = onvm_sc_next_index(chain, cur_nf);
+
+        if (unlikely(next > chain->chain_length)) {
                 return ONVM_NF_ACTION_DROP;
         }
-        return chain->sc[cur_nf + 1].action;
+        return chain->sc[next].action;
 }
 
 static inline uint8_t
@@ -59,10 +85,12 @@ onvm_sc_next_action(struct onvm_service_chain* chain, struct rte_mbuf* pkt) {
 
 static inline uint16_t
 onvm_next_destination(struct onvm_service_chain* chain, uint16_t cur_nf) {
-        if (unlikely(cur_nf >= chain->chain_length)) {
+        uint16_t next = onvm_sc_next_index(chain, cur_nf);
+
+        if (unlikely(next > chain->chain_length)) {
                 return 0;
         }
-        return chain->sc[cur_nf + 1].destination;
+        return chain->sc[next].destination;
 }
 
 static inline uint16_t
@@ -70,10 +98,39 @@ onvm_sc_next_destination(struct onvm_service_chain* chain, struct rte_mbuf* pkt)
         return onvm_next_destination(chain, onvm_get_pkt_chain_index(pkt));
 }
 
+/* Returns the chain currently installed under chain_id, or fallback if no chain is installed under it */
+static inline struct onvm_service_chain*
+onvm_sc_lookup(uint8_t chain_id, struct onvm_service_chain* fallback) {
+        struct onvm_service_chain* chain;
+
+        if (chain_id == ONVM_SC_NO_ID || sc_table == NULL)
+                return fallback;
+
+        chain = sc_table[chain_id];
+        return likely(chain != NULL) ? chain : fallback;
+}
+
 /*get service chain*/
 struct onvm_service_chain*
 onvm_sc_get(void);
-/*create service chain*/
+/*create service chain with room for ONVM_MAX_CHAIN_LENGTH entries*/
 struct onvm_service_chain*
 onvm_sc_create(void);
+/*create service chain with room for max_length entries, registered in the shared chain table if space allows*/
+struct onvm_service_chain*
+onvm_sc_create_with_length(uint8_t max_length);
+/*
+ * Unregister a service chain, along with the version onvm_sc_update installed under its ID. Both are freed
+ * ONVM_SC_RETIRE_GRACE_MS later, when no packet can still be reading them.
+ */
+void
+onvm_sc_free(struct onvm_service_chain* chain);
+/*
+ * Atomically install new_chain under the ID of chain, so packets already carrying that ID follow new_chain at
+ * their next hop. chain stays valid for the flow entries pointing at it and keeps owning the ID, new_chain is
+ * freed along with it by onvm_sc_free. A version an earlier update installed is freed after the grace period.
+ * Returns 0, or -1 if chain has no ID.
+ */
+int
+onvm_sc_update(struct onvm_service_chain* chain, struct onvm_service_chain* new_chain);
 #endif  // _ONVM_SC_MGR_H_
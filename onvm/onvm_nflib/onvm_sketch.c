@@ -0,0 +1,533 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * onvm_sketch.c - bounded memory measurement: Count-Min, Count-Sketch,
+ *                 per key HyperLogLog and SpaceSaving top-k
+ ********************************************************************/
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include <rte_hash_crc.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_prefetch.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+#include "onvm_sketch.h"
+
+#define ONVM_SKETCH_MAX_WIDTH_BITS 28
+/* Item hashes of ONVM_SKETCH_HLL must not correlate with the key hashes */
+#define ONVM_SKETCH_ITEM_SEED 0x5bd1e995
+
+/*********************************Internal Functions**********************************/
+
+static inline uint32_t
+onvm_sketch_fmix32(uint32_t z) {
+        z = (z ^ (z >> 16)) * 0x85ebca6b;
+        z = (z ^ (z >> 13)) * 0xc2b2ae35;
+        return z ^ (z >> 16);
+}
+
+static inline uint32_t
+onvm_sketch_mix32(uint32_t *state) {
+        return onvm_sketch_fmix32(*state += 0x9e3779b9);
+}
+
+/*
+ * Multiply-add hash of every row at once, h[r] = mul[r] * hash + add[r].
+ * The row index is the top width_bits bits of h[r].
+ */
+static inline void
+onvm_sketch_hash_rows(const struct onvm_sketch *sketch, uint32_t hash, uint32_t h[ONVM_SKETCH_MAX_ROWS]) {
+#ifdef __AVX2__
+        __m256i x = _mm256_set1_epi32((int)hash);
+        __m256i v = _mm256_mullo_epi32(x, _mm256_load_si256((const __m256i *)sketch->mul));
+
+        v = _mm256_add_epi32(v, _mm256_load_si256((const __m256i *)sketch->add));
+        _mm256_storeu_si256((__m256i *)h, v);
+#elif defined(__SSE4_1__)
+        __m128i x = _mm_set1_epi32((int)hash);
+        __m128i lo = _mm_mullo_epi32(x, _mm_load_si128((const __m128i *)sketch->mul));
+        __m128i hi = _mm_mullo_epi32(x, _mm_load_si128((const __m128i *)(sketch->mul + 4)));
+
+        lo = _mm_add_epi32(lo, _mm_load_si128((const __m128i *)sketch->add));
+        hi = _mm_add_epi32(hi, _mm_load_si128((const __m128i *)(sketch->add + 4)));
+        _mm_storeu_si128((__m128i *)h, lo);
+        _mm_storeu_si128((__m128i *)(h + 4), hi);
+#else
+        uint32_t r;
+
+        for (r = 0; r < ONVM_SKETCH_MAX_ROWS; r++)
+                h[r] = sketch->mul[r] * hash + sketch->add[r];
+#endif
+}
+
+static inline uint32_t
+onvm_sketch_row_index(const struct onvm_sketch *sketch, uint32_t h) {
+        return sketch->width_bits == 0 ? 0 : h >> (32 - sketch->width_bits);
+}
+
+/* Count-Sketch sign, the bit right below the index bits */
+static inline int32_t
+onvm_sketch_row_sign(const struct onvm_sketch *sketch, uint32_t h) {
+        return ((h >> (31 - sketch->width_bits)) & 1) ? 1 : -1;
+}
+
+static inline uint8_t *
+onvm_sketch_bank(const struct onvm_sketch *sketch, enum onvm_sketch_epoch epoch) {
+        return (uint8_t *)(uintptr_t)sketch->banks + (size_t)(sketch->cur ^ epoch) * sketch->bank_size;
+}
+
+/* Cell of each row for a key, prefetched */
+static inline void
+onvm_sketch_cells(const struct onvm_sketch *sketch, const void *key, uint32_t key_len,
+                  enum onvm_sketch_epoch epoch, uint8_t *cells[ONVM_SKETCH_MAX_ROWS],
+                  uint32_t h[ONVM_SKETCH_MAX_ROWS]) {
+        uint8_t *bank = onvm_sketch_bank(sketch, epoch);
+        uint32_t r;
+
+        onvm_sketch_hash_rows(sketch, rte_hash_crc(key, key_len, sketch->seed), h);
+        for (r = 0; r < sketch->rows; r++) {
+                cells[r] = bank + ((size_t)r * sketch->width + onvm_sketch_row_index(sketch, h[r])) *
+                                  sketch->cell_size;
+                rte_prefetch0(cells[r]);
+        }
+}
+
+static int64_t
+onvm_sketch_median(int64_t *v, uint32_t n) {
+        uint32_t i, j;
+        int64_t tmp;
+
+        for (i = 1; i < n; i++) {
+                tmp = v[i];
+                for (j = i; j > 0 && v[j - 1] > tmp; j--)
+                        v[j] = v[j - 1];
+                v[j] = tmp;
+        }
+        return (n & 1) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static int64_t
+onvm_sketch_hll_estimate(const uint8_t *regs, uint32_t m) {
+        double sum = 0, alpha, est;
+        uint32_t zeros = 0, i;
+
+        for (i = 0; i < m; i++) {
+                sum += 1.0 / (double)(1ULL << regs[i]);
+                zeros += (regs[i] == 0);
+        }
+
+        if (m == 16)
+                alpha = 0.673;
+        else if (m == 32)
+                alpha = 0.697;
+        else if (m == 64)
+                alpha = 0.709;
+        else
+                alpha = 0.7213 / (1.0 + 1.079 / m);
+
+        est = alpha * m * m / sum;
+        /* Linear counting is more accurate for small sets */
+        if (est <= 2.5 * m && zeros != 0)
+                est = m * log((double)m / zeros);
+        return (int64_t)(est + 0.5);
+}
+
+static int64_t
+onvm_sketch_estimate(const struct onvm_sketch *sketch, uint8_t *cells[ONVM_SKETCH_MAX_ROWS],
+                     const uint32_t h[ONVM_SKETCH_MAX_ROWS]) {
+        int64_t v[ONVM_SKETCH_MAX_ROWS], est = INT64_MAX;
+        uint32_t r;
+
+        switch (sketch->type) {
+                case ONVM_SKETCH_CM:
+                        for (r = 0; r < sketch->rows; r++)
+                                est = RTE_MIN(est, (int64_t)*(int32_t *)cells[r]);
+                        return est;
+                case ONVM_SKETCH_CS:
+                        for (r = 0; r < sketch->rows; r++)
+                                v[r] = (int64_t)onvm_sketch_row_sign(sketch, h[r]) * *(int32_t *)cells[r];
+                        return onvm_sketch_median(v, sketch->rows);
+                case ONVM_SKETCH_HLL:
+                        for (r = 0; r < sketch->rows; r++)
+                                est = RTE_MIN(est, onvm_sketch_hll_estimate(cells[r], 1U << sketch->hll_bits));
+                        return est;
+        }
+        return 0;
+}
+
+static inline uint64_t
+onvm_topk_hash(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return key;
+}
+
+static inline void
+onvm_topk_place(struct onvm_topk *topk, uint32_t pos, const struct onvm_topk_entry *entry) {
+        topk->heap[pos] = *entry;
+        topk->index[entry->slot] = pos + 1;
+}
+
+/* Restore the heap after the count at pos grew */
+static void
+onvm_topk_sift_down(struct onvm_topk *topk, uint32_t pos) {
+        struct onvm_topk_entry entry = topk->heap[pos];
+        uint32_t child;
+
+        while ((child = 2 * pos + 1) < topk->size) {
+                if (child + 1 < topk->size && topk->heap[child + 1].count < topk->heap[child].count)
+                        child++;
+                if (topk->heap[child].count >= entry.count)
+                        break;
+                onvm_topk_place(topk, pos, &topk->heap[child]);
+                pos = child;
+        }
+        onvm_topk_place(topk, pos, &entry);
+}
+
+static void
+onvm_topk_sift_up(struct onvm_topk *topk, uint32_t pos) {
+        struct onvm_topk_entry entry = topk->heap[pos];
+        uint32_t parent;
+
+        while (pos > 0) {
+                parent = (pos - 1) / 2;
+                if (topk->heap[parent].count <= entry.count)
+                        break;
+                onvm_topk_place(topk, pos, &topk->heap[parent]);
+                pos = parent;
+        }
+        onvm_topk_place(topk, pos, &entry);
+}
+
+/* Returns the index slot of key, or the empty slot where it would go */
+static uint32_t
+onvm_topk_find_slot(const struct onvm_topk *topk, uint64_t key) {
+        uint32_t slot = onvm_topk_hash(key) & topk->index_mask;
+
+        while (topk->index[slot] != 0 && topk->heap[topk->index[slot] - 1].key != key)
+                slot = (slot + 1) & topk->index_mask;
+        return slot;
+}
+
+/* Linear probing deletion, shift back the entries that probed past the hole */
+static void
+onvm_topk_remove_slot(struct onvm_topk *topk, uint32_t hole) {
+        uint32_t next = hole, home;
+
+        while (1) {
+                next = (next + 1) & topk->index_mask;
+                if (topk->index[next] == 0)
+                        break;
+                home = onvm_topk_hash(topk->heap[topk->index[next] - 1].key) & topk->index_mask;
+                if (((next - home) & topk->index_mask) < ((next - hole) & topk->index_mask))
+                        continue;
+                topk->index[hole] = topk->index[next];
+                topk->heap[topk->index[hole] - 1].slot = hole;
+                hole = next;
+        }
+        topk->index[hole] = 0;
+}
+
+/*********************************Interfaces**********************************/
+
+struct onvm_sketch *
+onvm_sketch_create(const char *name, enum onvm_sketch_type type, uint32_t rows, uint32_t width, uint8_t hll_bits,
+                   uint32_t seed) {
+        const struct rte_memzone *mz = NULL;
+        struct onvm_sketch *sketch;
+        uint32_t cell_size, width_bits, state, r;
+        size_t bank_size, size;
+
+        if (rows == 0 || rows > ONVM_SKETCH_MAX_ROWS || width == 0)
+                return NULL;
+        if (type == ONVM_SKETCH_HLL && (hll_bits < ONVM_SKETCH_HLL_MIN_BITS || hll_bits > ONVM_SKETCH_HLL_MAX_BITS))
+                return NULL;
+
+        width = rte_align32pow2(width);
+        width_bits = rte_bsf32(width);
+        if (width_bits > ONVM_SKETCH_MAX_WIDTH_BITS)
+                return NULL;
+
+        cell_size = type == ONVM_SKETCH_HLL ? 1U << hll_bits : sizeof(int32_t);
+        bank_size = RTE_ALIGN_CEIL((size_t)rows * width * cell_size, RTE_CACHE_LINE_SIZE);
+        size = sizeof(struct onvm_sketch) + 2 * bank_size;
+
+        if (name != NULL) {
+                mz = rte_memzone_reserve_aligned(name, size, rte_socket_id(), 0, RTE_CACHE_LINE_SIZE);
+                if (mz == NULL)
+                        return NULL;
+                sketch = mz->addr;
+                memset(sketch, 0, size);
+        } else {
+                sketch = rte_zmalloc("onvm_sketch", size, RTE_CACHE_LINE_SIZE);
+                if (sketch == NULL)
+                        return NULL;
+        }
+
+        sketch->type = type;
+        sketch->rows = rows;
+        sketch->width = width;
+        sketch->width_bits = width_bits;
+        sketch->hll_bits = hll_bits;
+        sketch->cell_size = cell_size;
+        sketch->seed = seed;
+        sketch->bank_size = bank_size;
+        sketch->mz = mz;
+
+        state = seed;
+        for (r = 0; r < ONVM_SKETCH_MAX_ROWS; r++) {
+                sketch->mul[r] = onvm_sketch_mix32(&state) | 1;
+                sketch->add[r] = onvm_sketch_mix32(&state);
+        }
+
+        return sketch;
+}
+
+struct onvm_sketch *
+onvm_sketch_lookup(const char *name) {
+        const struct rte_memzone *mz = rte_memzone_lookup(name);
+
+        return mz == NULL ? NULL : mz->addr;
+}
+
+void
+onvm_sketch_free(struct onvm_sketch *sketch) {
+        if (sketch == NULL)
+                return;
+        if (sketch->mz != NULL)
+                rte_memzone_free(sketch->mz);
+        else
+                rte_free(sketch);
+}
+
+int64_t
+onvm_sketch_update(struct onvm_sketch *sketch, const void *key, uint32_t key_len, int32_t inc) {
+        uint8_t *cells[ONVM_SKETCH_MAX_ROWS];
+        uint32_t h[ONVM_SKETCH_MAX_ROWS];
+        uint32_t r;
+
+        if (unlikely(sketch->type == ONVM_SKETCH_HLL))
+                return -EINVAL;
+
+        onvm_sketch_cells(sketch, key, key_len, ONVM_SKETCH_CUR, cells, h);
+        if (sketch->type == ONVM_SKETCH_CM) {
+                for (r = 0; r < sketch->rows; r++)
+                        *(int32_t *)cells[r] += inc;
+        } else {
+                for (r = 0; r < sketch->rows; r++)
+                        *(int32_t *)cells[r] += onvm_sketch_row_sign(sketch, h[r]) * inc;
+        }
+        return onvm_sketch_estimate(sketch, cells, h);
+}
+
+int64_t
+onvm_sketch_hll_add(struct onvm_sketch *sketch, const void *key, uint32_t key_len, const void *item,
+                    uint32_t item_len) {
+        uint8_t *cells[ONVM_SKETCH_MAX_ROWS];
+        uint32_t h[ONVM_SKETCH_MAX_ROWS];
+        uint32_t item_hash, reg, rest, r;
+        uint8_t rank;
+
+        if (unlikely(sketch->type != ONVM_SKETCH_HLL))
+                return -EINVAL;
+
+        onvm_sketch_cells(sketch, key, key_len, ONVM_SKETCH_CUR, cells, h);
+        /* CRC alone spreads consecutive items poorly over the registers */
+        item_hash = onvm_sketch_fmix32(rte_hash_crc(item, item_len, sketch->seed ^ ONVM_SKETCH_ITEM_SEED));
+        reg = item_hash >> (32 - sketch->hll_bits);
+        rest = item_hash << sketch->hll_bits;
+        rank = rest == 0 ? 32 - sketch->hll_bits + 1 : __builtin_clz(rest) + 1;
+
+        for (r = 0; r < sketch->rows; r++) {
+                if (cells[r][reg] < rank)
+                        cells[r][reg] = rank;
+        }
+        return onvm_sketch_estimate(sketch, cells, h);
+}
+
+int64_t
+onvm_sketch_query(const struct onvm_sketch *sketch, const void *key, uint32_t key_len,
+                  enum onvm_sketch_epoch epoch) {
+        uint8_t *cells[ONVM_SKETCH_MAX_ROWS];
+        uint32_t h[ONVM_SKETCH_MAX_ROWS];
+
+        onvm_sketch_cells(sketch, key, key_len, epoch, cells, h);
+        return onvm_sketch_estimate(sketch, cells, h);
+}
+
+void
+onvm_sketch_rotate(struct onvm_sketch *sketch) {
+        sketch->cur ^= 1;
+        sketch->epoch++;
+        memset(onvm_sketch_bank(sketch, ONVM_SKETCH_CUR), 0, sketch->bank_size);
+}
+
+int
+onvm_sketch_merge(struct onvm_sketch *dst, const struct onvm_sketch *src, enum onvm_sketch_epoch epoch) {
+        size_t i, n;
+
+        if (dst->type != src->type || dst->rows != src->rows || dst->width != src->width ||
+            dst->hll_bits != src->hll_bits || dst->seed != src->seed)
+                return -EINVAL;
+
+        if (dst->type == ONVM_SKETCH_HLL) {
+                uint8_t *d = onvm_sketch_bank(dst, epoch);
+                const uint8_t *s = onvm_sketch_bank(src, epoch);
+
+                for (i = 0; i < dst->bank_size; i++)
+                        d[i] = RTE_MAX(d[i], s[i]);
+        } else {
+                int32_t *d = (int32_t *)onvm_sketch_bank(dst, epoch);
+                const int32_t *s = (const int32_t *)onvm_sketch_bank(src, epoch);
+
+                n = dst->bank_size / sizeof(int32_t);
+                for (i = 0; i < n; i++)
+                        d[i] += s[i];
+        }
+        return 0;
+}
+
+struct onvm_topk *
+onvm_topk_create(uint32_t k) {
+        struct onvm_topk *topk;
+        uint32_t index_size;
+        size_t heap_size;
+
+        if (k == 0 || k > ONVM_TOPK_MAX)
+                return NULL;
+
+        index_size = rte_align32pow2(2 * k);
+        heap_size = RTE_ALIGN_CEIL(k * sizeof(struct onvm_topk_entry), RTE_CACHE_LINE_SIZE);
+        topk = rte_zmalloc("onvm_topk", RTE_CACHE_LINE_ROUNDUP(sizeof(struct onvm_topk)) + heap_size +
+                                                index_size * sizeof(uint32_t),
+                           RTE_CACHE_LINE_SIZE);
+        if (topk == NULL)
+                return NULL;
+
+        topk->k = k;
+        topk->index_mask = index_size - 1;
+        topk->heap = (struct onvm_topk_entry *)((uint8_t *)topk + RTE_CACHE_LINE_ROUNDUP(sizeof(struct onvm_topk)));
+        topk->index = (uint32_t *)((uint8_t *)topk->heap + heap_size);
+        return topk;
+}
+
+void
+onvm_topk_free(struct onvm_topk *topk) {
+        rte_free(topk);
+}
+
+uint64_t
+onvm_topk_update(struct onvm_topk *topk, uint64_t key, uint64_t inc) {
+        struct onvm_topk_entry *entry;
+        uint32_t slot, pos;
+
+        slot = onvm_topk_find_slot(topk, key);
+        if (topk->index[slot] != 0) {
+                pos = topk->index[slot] - 1;
+                topk->heap[pos].count += inc;
+                onvm_topk_sift_down(topk, pos);
+                return topk->heap[topk->index[slot] - 1].count;
+        }
+
+        if (topk->size < topk->k) {
+                pos = topk->size++;
+                entry = &topk->heap[pos];
+                entry->key = key;
+                entry->count = inc;
+                entry->error = 0;
+                entry->slot = slot;
+                topk->index[slot] = pos + 1;
+                onvm_topk_sift_up(topk, pos);
+                return inc;
+        }
+
+        /* Evict the smallest key, the newcomer inherits its count as error */
+        entry = &topk->heap[0];
+        onvm_topk_remove_slot(topk, entry->slot);
+        slot = onvm_topk_find_slot(topk, key);
+        entry->key = key;
+        entry->error = entry->count;
+        entry->count += inc;
+        entry->slot = slot;
+        topk->index[slot] = 1;
+        onvm_topk_sift_down(topk, 0);
+        return topk->heap[topk->index[slot] - 1].count;
+}
+
+uint32_t
+onvm_topk_list(const struct onvm_topk *topk, struct onvm_topk_entry *out, uint32_t n) {
+        struct onvm_topk_entry tmp;
+        uint32_t i, j;
+
+        n = RTE_MIN(n, topk->size);
+        /* Partial selection sort, n is expected to be small */
+        for (i = 0; i < topk->size; i++) {
+                tmp = topk->heap[i];
+                for (j = RTE_MIN(i, n); j > 0 && out[j - 1].count < tmp.count; j--) {
+                        if (j < n)
+                                out[j] = out[j - 1];
+                }
+                if (j < n)
+                        out[j] = tmp;
+        }
+        return n;
+}
+
+void
+onvm_topk_merge(struct onvm_topk *dst, const struct onvm_topk *src) {
+        uint32_t i;
+
+        for (i = 0; i < src->size; i++)
+                onvm_topk_update(dst, src->heap[i].key, src->heap[i].count);
+}
+
+void
+onvm_topk_reset(struct onvm_topk *topk) {
+        topk->size = 0;
+        memset(topk->index, 0, (topk->index_mask + 1) * sizeof(uint32_t));
+}
@@ -0,0 +1,169 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * onvm_sketch.h - bounded memory measurement: Count-Min, Count-Sketch,
+ *                 per key HyperLogLog and SpaceSaving top-k
+ ********************************************************************/
+
+#ifndef _ONVM_SKETCH_H_
+#define _ONVM_SKETCH_H_
+
+#include <stdint.h>
+
+#include <rte_common.h>
+#include <rte_memzone.h>
+
+/* Rows are hashed together in one vector, so this is also the lane count */
+#define ONVM_SKETCH_MAX_ROWS 8
+#define ONVM_SKETCH_HLL_MIN_BITS 4
+#define ONVM_SKETCH_HLL_MAX_BITS 16
+#define ONVM_TOPK_MAX 4096
+
+enum onvm_sketch_type {
+        ONVM_SKETCH_CM = 0,  // Count-Min, never underestimates, minimum of the rows
+        ONVM_SKETCH_CS,      // Count-Sketch, unbiased, median of the signed rows
+        ONVM_SKETCH_HLL,     // a HyperLogLog per cell, distinct items per key, minimum of the rows
+};
+
+/* Every sketch keeps two banks, updates go to the current one */
+enum onvm_sketch_epoch {
+        ONVM_SKETCH_CUR = 0,  // epoch being updated
+        ONVM_SKETCH_PREV,     // last closed epoch, stable until the next rotation
+};
+
+/*
+ * A sketch is a single allocation so it can live in a memzone and be looked up
+ * and merged by other instances. Sketches built with the same type, geometry
+ * and seed hash keys identically and can be merged.
+ */
+struct onvm_sketch {
+        enum onvm_sketch_type type;
+        uint32_t rows;
+        uint32_t width;
+        uint8_t width_bits;
+        uint8_t hll_bits;  // log2 of the registers of a cell for ONVM_SKETCH_HLL
+        uint32_t cell_size;
+        uint32_t seed;
+        uint32_t cur;     // index of the current bank
+        uint64_t epoch;   // number of rotations
+        size_t bank_size;
+        const struct rte_memzone *mz;
+        uint32_t mul[ONVM_SKETCH_MAX_ROWS] __rte_aligned(32);  // odd multipliers of the row hashes
+        uint32_t add[ONVM_SKETCH_MAX_ROWS] __rte_aligned(32);
+        uint8_t banks[] __rte_cache_aligned;
+};
+
+struct onvm_topk_entry {
+        uint64_t key;
+        uint64_t count;  // overestimates the true count by at most error
+        uint64_t error;
+        uint32_t slot;   // position in the key index
+};
+
+/* SpaceSaving top-k: a min-heap on count plus an open addressing index of the keys */
+struct onvm_topk {
+        uint32_t k;
+        uint32_t size;
+        uint32_t index_mask;
+        struct onvm_topk_entry *heap;
+        uint32_t *index;  // heap position + 1, 0 for an empty slot
+};
+
+/*
+ * Create a sketch with rows (<= ONVM_SKETCH_MAX_ROWS) rows of width cells, width is
+ * rounded up to a power of two. hll_bits is only used by ONVM_SKETCH_HLL.
+ * If name is not NULL the sketch is put in a memzone of that name.
+ */
+struct onvm_sketch *
+onvm_sketch_create(const char *name, enum onvm_sketch_type type, uint32_t rows, uint32_t width, uint8_t hll_bits,
+                   uint32_t seed);
+
+/* Find a sketch another instance created with a name */
+struct onvm_sketch *
+onvm_sketch_lookup(const char *name);
+
+void
+onvm_sketch_free(struct onvm_sketch *sketch);
+
+/* Count-Min and Count-Sketch: add inc to key, returns the estimate of key after the update */
+int64_t
+onvm_sketch_update(struct onvm_sketch *sketch, const void *key, uint32_t key_len, int32_t inc);
+
+/* HyperLogLog: add item to the set of key, returns the distinct item estimate of key after the update */
+int64_t
+onvm_sketch_hll_add(struct onvm_sketch *sketch, const void *key, uint32_t key_len, const void *item,
+                    uint32_t item_len);
+
+/* Estimate of key in the given epoch, a count or a number of distinct items depending on the type */
+int64_t
+onvm_sketch_query(const struct onvm_sketch *sketch, const void *key, uint32_t key_len,
+                  enum onvm_sketch_epoch epoch);
+
+/* Close the current epoch, it becomes ONVM_SKETCH_PREV and a cleared bank becomes current */
+void
+onvm_sketch_rotate(struct onvm_sketch *sketch);
+
+/*
+ * Fold an epoch of src into the same epoch of dst. Merging ONVM_SKETCH_PREV is safe while
+ * the owner of src keeps updating it. Returns -EINVAL if the sketches are not compatible.
+ */
+int
+onvm_sketch_merge(struct onvm_sketch *dst, const struct onvm_sketch *src, enum onvm_sketch_epoch epoch);
+
+/* Create a top-k tracker for k (<= ONVM_TOPK_MAX) keys */
+struct onvm_topk *
+onvm_topk_create(uint32_t k);
+
+void
+onvm_topk_free(struct onvm_topk *topk);
+
+/* Count inc more for key, returns its estimated count. O(log k). */
+uint64_t
+onvm_topk_update(struct onvm_topk *topk, uint64_t key, uint64_t inc);
+
+/* Copy up to n entries into out, largest count first. Returns the number copied. */
+uint32_t
+onvm_topk_list(const struct onvm_topk *topk, struct onvm_topk_entry *out, uint32_t n);
+
+/* Add the entries of src to dst */
+void
+onvm_topk_merge(struct onvm_topk *dst, const struct onvm_topk *src);
+
+void
+onvm_topk_reset(struct onvm_topk *topk);
+
+#endif  // _ONVM_SKETCH_H_
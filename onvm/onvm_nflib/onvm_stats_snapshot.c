@@ -0,0 +1,93 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * onvm_stats_snapshot.c - seqlock protected stats snapshots published by the manager
+ ********************************************************************/
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <rte_common.h>
+#include <rte_memzone.h>
+#include <rte_pause.h>
+
+#include "onvm_stats_snapshot.h"
+
+struct onvm_stats_snapshot *
+onvm_stats_snapshot_lookup(void) {
+        const struct rte_memzone *mz;
+
+        mz = rte_memzone_lookup(MZ_STATS_SNAPSHOT);
+        if (mz == NULL)
+                return NULL;
+        return mz->addr;
+}
+
+int
+onvm_stats_snapshot_read(const struct onvm_stats_snapshot *snapshot, struct onvm_stats_snapshot *copy) {
+        uint32_t seq;
+        unsigned tries;
+
+        for (tries = 0; tries < ONVM_STATS_SNAPSHOT_MAX_TRIES; tries++) {
+                seq = snapshot->seq;
+                if (seq == 0)
+                        return -EAGAIN;
+                if (seq & 1) {
+                        rte_pause();
+                        continue;
+                }
+                rte_smp_rmb();
+
+                /* Counts can be torn while the manager writes, the retry below throws the copy away */
+                memcpy(copy, snapshot, offsetof(struct onvm_stats_snapshot, ports));
+                copy->num_ports = RTE_MIN(copy->num_ports, RTE_MAX_ETHPORTS);
+                copy->num_nfs = RTE_MIN(copy->num_nfs, MAX_NFS);
+                copy->num_services = RTE_MIN(copy->num_services, MAX_SERVICES);
+                copy->num_mempools = RTE_MIN(copy->num_mempools, ONVM_STATS_SNAPSHOT_MAX_MEMPOOLS);
+                memcpy(copy->ports, snapshot->ports, sizeof(copy->ports[0]) * copy->num_ports);
+                memcpy(copy->nfs, snapshot->nfs, sizeof(copy->nfs[0]) * copy->num_nfs);
+
+                rte_smp_rmb();
+                if (snapshot->seq == seq) {
+                        copy->seq = seq;
+                        return 0;
+                }
+        }
+
+        return -EAGAIN;
+}
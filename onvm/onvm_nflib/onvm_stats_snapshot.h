@@ -0,0 +1,166 @@
+/*********************************************************************
+ *                     openNetVM
+ *              https://sdnfv.github.io
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c)
+ *            2015-2019 George Washington University
+ *            2015-2019 University of California Riverside
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * onvm_stats_snapshot.h - seqlock protected stats snapshots published by the manager
+ ********************************************************************/
+
+#ifndef _ONVM_STATS_SNAPSHOT_H_
+#define _ONVM_STATS_SNAPSHOT_H_
+
+#include <stdint.h>
+
+#include <rte_atomic.h>
+#include <rte_ethdev.h>
+#include <rte_mempool.h>
+
+#include "onvm_common.h"
+
+#define MZ_STATS_SNAPSHOT "MProc_stats_snapshot"
+
+/* How often a reader retries while the manager keeps rewriting the snapshot */
+#define ONVM_STATS_SNAPSHOT_MAX_TRIES 1024
+#define ONVM_STATS_SNAPSHOT_MAX_MEMPOOLS 8
+
+struct onvm_stats_port_snapshot {
+        uint16_t id;
+        uint64_t rx;
+        uint64_t tx;
+        uint64_t tx_drop;
+};
+
+struct onvm_stats_nf_snapshot {
+        char tag[TAG_SIZE];
+        uint16_t instance_id;
+        uint16_t service_id;
+        uint16_t core;
+        uint16_t parent;
+        uint16_t children_cnt;
+        uint8_t status;
+        uint8_t sleeping; /* shared core mode only, set while the NF waits on its semaphore */
+        uint8_t congested; /* set while the rx rings are over the congestion high watermark */
+        uint64_t rx;
+        uint64_t rx_drop;
+        uint64_t tx;
+        uint64_t tx_drop;
+        uint64_t tx_buffer;
+        uint64_t tx_returned;
+        uint64_t act_out;
+        uint64_t act_tonf;
+        uint64_t act_drop;
+        uint64_t act_next;
+        uint64_t num_wakeups;
+        uint64_t drop[ONVM_DROP_REASON_MAX];
+        /* Ring depth histograms, see onvm_ring_hist_sample */
+        uint64_t rx_q_hist[ONVM_RING_HIST_BUCKETS];
+        uint64_t tx_q_hist[ONVM_RING_HIST_BUCKETS];
+        /* Ring occupancy when the snapshot was taken */
+        uint32_t rx_q_count;
+        uint32_t rx_q_capacity;
+        uint32_t tx_q_count;
+        uint32_t tx_q_capacity;
+};
+
+/* Packets stopped or marked ahead of a congested hop of one chain */
+struct onvm_stats_chain_snapshot {
+        uint8_t chain_id;
+        uint64_t early_drop;
+        uint64_t ecn_marked;
+};
+
+struct onvm_stats_mempool_snapshot {
+        char name[RTE_MEMPOOL_NAMESIZE];
+        uint32_t size;
+        uint32_t avail;
+};
+
+/*
+ * Counters of all ports and running NFs, rewritten by the manager every stats interval.
+ * The manager is the only writer: seq is odd while it copies the counters in, readers
+ * take a consistent copy with onvm_stats_snapshot_read and never block the manager.
+ */
+struct onvm_stats_snapshot {
+        volatile uint32_t seq;
+        uint64_t tsc;      /* rte_rdtsc() of the manager when the snapshot was taken */
+        uint64_t tsc_hz;
+        uint64_t time;     /* wall clock seconds when the snapshot was taken */
+        uint16_t num_ports;
+        uint16_t num_nfs;  /* only the first num_nfs entries of nfs are valid */
+        uint16_t num_services;
+        uint16_t nf_per_service[MAX_SERVICES];
+        uint64_t drop[ONVM_DROP_REASON_MAX];  /* drops of packets from and to ports, by reason */
+        uint16_t congested_nfs[MAX_SERVICES];
+        uint16_t num_chains;  /* only chains that had packets dropped or marked are listed */
+        struct onvm_stats_chain_snapshot chains[ONVM_MAX_CHAINS];
+        uint16_t num_mempools;
+        struct onvm_stats_mempool_snapshot mempools[ONVM_STATS_SNAPSHOT_MAX_MEMPOOLS];
+        struct onvm_stats_port_snapshot ports[RTE_MAX_ETHPORTS];
+        struct onvm_stats_nf_snapshot nfs[MAX_NFS];
+};
+
+/*
+ * Start and finish rewriting the snapshot, only the manager calls these.
+ */
+static inline void
+onvm_stats_snapshot_write_begin(struct onvm_stats_snapshot *snapshot) {
+        snapshot->seq++;
+        rte_smp_wmb();
+}
+
+static inline void
+onvm_stats_snapshot_write_end(struct onvm_stats_snapshot *snapshot) {
+        rte_smp_wmb();
+        snapshot->seq++;
+}
+
+/*
+ * Look up the snapshot the manager publishes, for NFs and other secondary processes.
+ *
+ * Returns NULL if the manager hasn't set it up.
+ */
+struct onvm_stats_snapshot *
+onvm_stats_snapshot_lookup(void);
+
+/*
+ * Take a consistent copy of the shared snapshot.
+ *
+ * Returns 0 on success, -EAGAIN if nothing was published yet or the manager
+ * kept rewriting the snapshot for ONVM_STATS_SNAPSHOT_MAX_TRIES attempts.
+ */
+int
+onvm_stats_snapshot_read(const struct onvm_stats_snapshot *snapshot, struct onvm_stats_snapshot *copy);
+
+#endif  // _ONVM_STATS_SNAPSHOT_H_